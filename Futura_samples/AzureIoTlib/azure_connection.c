@@ -0,0 +1,712 @@
+/* Futura MT3620 Azure IoT Hub connection manager.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Only Networking_IsNetworkingReady is used, which does not depend on the struct version.
+#define NETWORKING_STRUCTS_VERSION 1
+#include <applibs/log.h>
+#include <applibs/networking.h>
+
+#include <iothub_client_core_common.h>
+#include <iothub_device_client_ll.h>
+#include <iothub_client_options.h>
+#include <iothubtransportmqtt.h>
+#include <iothub.h>
+#include <azure_sphere_provisioning.h>
+
+#include "azure_connection.h"
+#include "eventloop_timer_utilities.h"
+
+// Azure IoT poll periods. DoWork runs every AzureIoTBusyPollPeriodMs while messages or
+// reported properties wait for their acknowledgement, then the period doubles up to
+// AzureIoTIdlePollPeriodMs, which also paces the checks for network availability.
+static const long AzureIoTBusyPollPeriodMs = 100;
+static const long AzureIoTIdlePollPeriodMs = 5000;
+static const int AzureIoTMinReconnectPeriodSeconds = 60;
+static const int AzureIoTMaxReconnectPeriodSeconds = 10 * 60;
+
+static const int keepalivePeriodSeconds = 20;
+static const unsigned int provisioningTimeoutMs = 10000;
+
+// Queued messages handed over to the client and not yet confirmed, at most.
+#define TELEMETRY_REPLAY_WINDOW 16
+
+#define SCOPEID_LENGTH 64
+static char scopeId[SCOPEID_LENGTH];
+
+static AzureConnection_Config config;
+static AzureConnection_State state = AzureConnection_Disconnected;
+static IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle = NULL;
+
+static EventLoopTimer *connectionTimer = NULL;
+
+// Lower bound of the current backoff window; 0 until the first failure, and again once
+// IoT Hub authenticates a client.
+static int backoffSeconds = 0;
+
+// State of the backoff jitter: a generator of its own, so that the library leaves the
+// rand() sequence of the application alone.
+static uint32_t jitterState = 1;
+
+// Set when IoT Hub reports the client unauthenticated; the next tick destroys it, since the
+// status callback runs inside DoWork.
+static bool clientLost = false;
+
+// Current DoWork period while connected.
+static long pollPeriodMs = 0;
+
+// Messages and reported properties handed to the client and not yet acknowledged.
+static unsigned int outstandingSends = 0;
+static unsigned int outstandingReports = 0;
+
+// Enqueue times of the messages in flight, passed as the SendEventAsync context.
+// Messages sent while every slot is taken are delivered but not timed.
+#define PENDING_SEND_SLOTS 32
+typedef struct {
+    bool inUse;
+    bool replayed;    // sent from the offline queue
+    uint32_t queueId; // id of the queued message, if replayed
+    struct timespec enqueued;
+} PendingSend;
+static PendingSend pendingSends[PENDING_SEND_SLOTS];
+
+// Replay of the offline queue: queued messages stay in it until IoT Hub confirms them. The
+// cursor is the next message to send; confirmations that arrive before the one for the
+// oldest message are kept in replayConfirmed until it is confirmed too. After a failed
+// delivery, the replay waits for the messages in flight and starts again from the oldest.
+static TelemetryQueue_Cursor replayCursor;
+static unsigned int replaysInFlight = 0;
+static bool replayFailed = false;
+static uint32_t replayConfirmed[TELEMETRY_REPLAY_WINDOW];
+static unsigned int replayConfirmedCount = 0;
+
+static AzureConnection_LatencyHistogram latency;
+
+// Buffer the Device Twin documents are copied to. It is kept between updates and only grows,
+// so after the first complete document the twin path no longer touches the heap.
+static char *twinBuffer = NULL;
+static size_t twinBufferSize = 0;
+
+static void SetState(AzureConnection_State newState)
+{
+    if (newState == state) {
+        return;
+    }
+    bool wasConnected = state == AzureConnection_Connected;
+    state = newState;
+    bool isConnected = state == AzureConnection_Connected;
+    if (wasConnected != isConnected && config.connectionStatus != NULL) {
+        config.connectionStatus(isConnected);
+    }
+}
+
+// Arms the single-shot timer; a zero delay runs the next tick on the next loop iteration.
+static void ScheduleTick(long milliseconds)
+{
+    struct timespec delay = {.tv_sec = milliseconds / 1000,
+                             .tv_nsec = (milliseconds % 1000) * 1000000};
+    if (milliseconds == 0) {
+        delay.tv_nsec = 1;
+    }
+    if (SetEventLoopTimerOneShot(connectionTimer, &delay) != 0) {
+        Log_Debug("ERROR: Could not arm IoT Hub timer: %s (%d).\n", strerror(errno), errno);
+    }
+}
+
+// Called after handing work to the client: DoWork runs on the next loop iteration, so the
+// work reaches the wire without waiting for the poll period, and polling turns fast until
+// the acknowledgements arrive. Several sends from one event handler share a single DoWork.
+static void KickDoWork(void)
+{
+    pollPeriodMs = AzureIoTBusyPollPeriodMs;
+    ScheduleTick(0);
+}
+
+static PendingSend *AllocPendingSend(void)
+{
+    for (int i = 0; i < PENDING_SEND_SLOTS; ++i) {
+        if (!pendingSends[i].inUse) {
+            pendingSends[i].inUse = true;
+            pendingSends[i].replayed = false;
+            clock_gettime(CLOCK_MONOTONIC, &pendingSends[i].enqueued);
+            return &pendingSends[i];
+        }
+    }
+    return NULL;
+}
+
+// Adds the enqueue-to-confirm time of a delivered message to the histogram.
+static void RecordLatency(const struct timespec *enqueued)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsedMs = (now.tv_sec - enqueued->tv_sec) * 1000 +
+                     (now.tv_nsec - enqueued->tv_nsec) / 1000000;
+    if (elapsedMs < 0) {
+        elapsedMs = 0;
+    }
+
+    int bucket = 0;
+    while (bucket < AZURE_CONNECTION_LATENCY_BUCKETS - 1 &&
+           elapsedMs >= (AZURE_CONNECTION_LATENCY_BASE_MS << bucket)) {
+        ++bucket;
+    }
+    ++latency.buckets[bucket];
+    ++latency.delivered;
+    latency.totalMs += (uint64_t)elapsedMs;
+    if ((uint32_t)elapsedMs > latency.maxMs) {
+        latency.maxMs = (uint32_t)elapsedMs;
+    }
+}
+
+// Restarts the replay of the offline queue from its oldest message.
+static void RestartReplay(void)
+{
+    replaysInFlight = 0;
+    replayFailed = false;
+    replayConfirmedCount = 0;
+    if (config.offlineQueue != NULL) {
+        TelemetryQueue_Rewind(config.offlineQueue, &replayCursor);
+    }
+}
+
+// Records the delivery of a replayed message, and removes from the queue the oldest
+// messages as long as they are confirmed.
+static void ConfirmReplayed(uint32_t id, bool delivered)
+{
+    TelemetryQueue *queue = config.offlineQueue;
+    if (replaysInFlight > 0) {
+        --replaysInFlight;
+    }
+    if (!delivered) {
+        replayFailed = true;
+    } else if (replayConfirmedCount < TELEMETRY_REPLAY_WINDOW) {
+        replayConfirmed[replayConfirmedCount++] = id;
+    }
+
+    // Messages evicted while in flight are behind the oldest one, and there is nothing to
+    // remove for them.
+    for (unsigned int i = 0; i < replayConfirmedCount;) {
+        int32_t ahead = (int32_t)(replayConfirmed[i] - queue->headId);
+        if (ahead > 0) {
+            ++i;
+            continue;
+        }
+        replayConfirmed[i] = replayConfirmed[--replayConfirmedCount];
+        if (ahead == 0) {
+            if (TelemetryQueue_Pop(queue) != 0) {
+                break;
+            }
+            i = 0;
+        }
+    }
+
+    if (replayFailed && replaysInFlight == 0) {
+        RestartReplay();
+    }
+}
+
+// Destroys the client. The SDK fails the pending callbacks while destroying it; the
+// counters are cleared as well in case a callback was not invoked.
+static void DestroyClient(void)
+{
+    if (iothubClientHandle != NULL) {
+        IoTHubDeviceClient_LL_Destroy(iothubClientHandle);
+        iothubClientHandle = NULL;
+    }
+    outstandingSends = 0;
+    outstandingReports = 0;
+    memset(pendingSends, 0, sizeof(pendingSends));
+    RestartReplay();
+    clientLost = false;
+}
+
+// xorshift32; jitterState is never 0.
+static uint32_t NextJitter(void)
+{
+    jitterState ^= jitterState << 13;
+    jitterState ^= jitterState >> 17;
+    jitterState ^= jitterState << 5;
+    return jitterState;
+}
+
+// Doubles the backoff window from AzureIoTMinReconnectPeriodSeconds and returns a delay
+// drawn from [window, 2 * window], so that devices that lost the connection together do not
+// retry in lockstep. The window stops at half of AzureIoTMaxReconnectPeriodSeconds, so the
+// delay stays between the minimum and the maximum.
+static int NextBackoffSeconds(void)
+{
+    if (backoffSeconds == 0) {
+        backoffSeconds = AzureIoTMinReconnectPeriodSeconds;
+    } else {
+        backoffSeconds *= 2;
+        if (backoffSeconds > AzureIoTMaxReconnectPeriodSeconds / 2) {
+            backoffSeconds = AzureIoTMaxReconnectPeriodSeconds / 2;
+        }
+    }
+    return backoffSeconds + (int)(NextJitter() % (uint32_t)(backoffSeconds + 1));
+}
+
+// Converts the IoT Hub connection status reason to a string.
+static const char *GetReasonString(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    switch (reason) {
+    case IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN:
+        return "IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN";
+    case IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED:
+        return "IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED";
+    case IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL:
+        return "IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL";
+    case IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED:
+        return "IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED";
+    case IOTHUB_CLIENT_CONNECTION_NO_NETWORK:
+        return "IOTHUB_CLIENT_CONNECTION_NO_NETWORK";
+    case IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR:
+        return "IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR";
+    case IOTHUB_CLIENT_CONNECTION_OK:
+        return "IOTHUB_CLIENT_CONNECTION_OK";
+    default:
+        return "unknown reason";
+    }
+}
+
+// Converts AZURE_SPHERE_PROV_RETURN_VALUE to a string.
+static const char *GetProvisioningResultString(AZURE_SPHERE_PROV_RETURN_VALUE provisioningResult)
+{
+    switch (provisioningResult.result) {
+    case AZURE_SPHERE_PROV_RESULT_OK:
+        return "AZURE_SPHERE_PROV_RESULT_OK";
+    case AZURE_SPHERE_PROV_RESULT_INVALID_PARAM:
+        return "AZURE_SPHERE_PROV_RESULT_INVALID_PARAM";
+    case AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY:
+        return "AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY";
+    case AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY:
+        return "AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY";
+    case AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR:
+        return "AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR";
+    case AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR:
+        return "AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR";
+    default:
+        return "UNKNOWN_RETURN_VALUE";
+    }
+}
+
+// The connection is up once IoT Hub authenticates the client, which ends the backoff. The
+// SAS token expiring, a rejected device or any other loss of authentication drops the
+// client: see DropClient.
+static void HubConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result,
+                                        IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
+                                        void *userContextCallback)
+{
+    Log_Debug("IoT Hub Authenticated: %s\n", GetReasonString(reason));
+    if (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED) {
+        backoffSeconds = 0;
+        clientLost = false;
+        SetState(AzureConnection_Connected);
+        KickDoWork();
+    } else {
+        clientLost = true;
+    }
+}
+
+// Copies the Device Twin document to a NUL-terminated buffer for the twin hook.
+static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload,
+                         size_t payloadSize, void *userContextCallback)
+{
+    if (config.twinUpdate == NULL) {
+        return;
+    }
+
+    if (payloadSize + 1 > twinBufferSize) {
+        char *buffer = (char *)realloc(twinBuffer, payloadSize + 1);
+        if (buffer == NULL) {
+            Log_Debug("ERROR: Could not allocate buffer for twin update payload.\n");
+            abort();
+        }
+        twinBuffer = buffer;
+        twinBufferSize = payloadSize + 1;
+    }
+    memcpy(twinBuffer, payload, payloadSize);
+    twinBuffer[payloadSize] = '\0';
+
+    config.twinUpdate(twinBuffer);
+}
+
+// Dispatches a Direct Method to the method hook, or answers 404.
+static int DirectMethodCallback(const char *methodName, const unsigned char *payload, size_t size,
+                                unsigned char **response, size_t *responseSize,
+                                void *userContextCallback)
+{
+    Log_Debug("INFO: Trying to invoke method %s\n", methodName);
+
+    if (config.directMethod != NULL) {
+        char *methodResponse = NULL;
+        size_t methodResponseSize = 0;
+        int result = config.directMethod(methodName, (const char *)payload, size, &methodResponse,
+                                         &methodResponseSize);
+        *response = (unsigned char *)methodResponse;
+        *responseSize = methodResponseSize;
+        return result;
+    }
+
+    static const char methodNotFound[] = "\"No method found\"";
+    *responseSize = strlen(methodNotFound);
+    *response = (unsigned char *)malloc(*responseSize);
+    if (*response == NULL) {
+        Log_Debug("ERROR: Cannot create response message for method call.\n");
+        abort();
+    }
+    memcpy(*response, methodNotFound, *responseSize);
+    return 404;
+}
+
+// Callback confirming message delivered to IoT Hub.
+static void SendMessageCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context)
+{
+    Log_Debug("INFO: Message received by IoT Hub. Result is: %d\n", result);
+    if (outstandingSends > 0) {
+        --outstandingSends;
+    }
+    PendingSend *pending = (PendingSend *)context;
+    if (result != IOTHUB_CLIENT_CONFIRMATION_OK) {
+        ++latency.failed;
+    } else if (pending != NULL) {
+        RecordLatency(&pending->enqueued);
+    }
+    if (pending != NULL) {
+        pending->inUse = false;
+        if (pending->replayed) {
+            ConfirmReplayed(pending->queueId, result == IOTHUB_CLIENT_CONFIRMATION_OK);
+        }
+    }
+    if (config.sendConfirmation != NULL) {
+        config.sendConfirmation(result == IOTHUB_CLIENT_CONFIRMATION_OK);
+    }
+}
+
+// Callback invoked when the Device Twin reported properties are accepted by IoT Hub.
+static void ReportStatusCallback(int result, void *context)
+{
+    Log_Debug("INFO: Device Twin reported properties update result: HTTP status code %d\n", result);
+    if (outstandingReports > 0) {
+        --outstandingReports;
+    }
+}
+
+// Creates the client through the Device Provisioning Service and installs the callbacks.
+// When the SAS Token for a device expires the client needs to be recreated, which is why
+// this runs again every time the connection is lost.
+static bool SetupAzureClient(void)
+{
+    DestroyClient();
+
+    AZURE_SPHERE_PROV_RETURN_VALUE provResult =
+        IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning(
+            scopeId, provisioningTimeoutMs, &iothubClientHandle);
+    Log_Debug("IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning returned '%s'.\n",
+              GetProvisioningResultString(provResult));
+
+    if (provResult.result != AZURE_SPHERE_PROV_RESULT_OK || iothubClientHandle == NULL) {
+        return false;
+    }
+
+    if (IoTHubDeviceClient_LL_SetOption(iothubClientHandle, OPTION_KEEP_ALIVE,
+                                        &keepalivePeriodSeconds) != IOTHUB_CLIENT_OK) {
+        Log_Debug("ERROR: failure setting option \"%s\"\n", OPTION_KEEP_ALIVE);
+    }
+
+    IoTHubDeviceClient_LL_SetDeviceTwinCallback(iothubClientHandle, TwinCallback, NULL);
+    IoTHubDeviceClient_LL_SetDeviceMethodCallback(iothubClientHandle, DirectMethodCallback, NULL);
+    IoTHubDeviceClient_LL_SetConnectionStatusCallback(iothubClientHandle,
+                                                      HubConnectionStatusCallback, NULL);
+    return true;
+}
+
+// Hands a telemetry message over to the IoT Hub client, with pending as the confirmation
+// context, which is released if the message is not accepted.
+// <returns>true if the client accepted the message, false if it must be retried later</returns>
+static bool SendTelemetryNow(const char *jsonMessage, PendingSend *pending)
+{
+    IOTHUB_MESSAGE_HANDLE messageHandle = 0;
+    if (state == AzureConnection_Connected) {
+        messageHandle = IoTHubMessage_CreateFromString(jsonMessage);
+        if (messageHandle == 0) {
+            Log_Debug("WARNING: unable to create a new IoTHubMessage\n");
+        }
+    }
+    if (messageHandle == 0) {
+        if (pending != NULL) {
+            pending->inUse = false;
+        }
+        return false;
+    }
+
+    bool accepted = IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle,
+                                                         SendMessageCallback, pending) ==
+                    IOTHUB_CLIENT_OK;
+    if (accepted) {
+        ++outstandingSends;
+        KickDoWork();
+    } else {
+        Log_Debug("WARNING: failed to hand over the message to IoTHubClient\n");
+        if (pending != NULL) {
+            pending->inUse = false;
+        }
+    }
+
+    IoTHubMessage_Destroy(messageHandle);
+    return accepted;
+}
+
+// Sends queued messages, oldest first, keeping up to TELEMETRY_REPLAY_WINDOW in flight.
+// Each stays in the queue until IoT Hub confirms it: see ConfirmReplayed.
+static void ReplayQueuedTelemetry(void)
+{
+    static char message[TELEMETRY_QUEUE_MAX_MESSAGE + 1];
+
+    if (config.offlineQueue == NULL) {
+        return;
+    }
+    while (!replayFailed && replaysInFlight < TELEMETRY_REPLAY_WINDOW) {
+        // Every replayed message needs its slot, which carries its queue id.
+        PendingSend *pending = AllocPendingSend();
+        if (pending == NULL) {
+            break;
+        }
+        TelemetryQueue_Cursor next = replayCursor;
+        uint32_t id;
+        int len = TelemetryQueue_Read(config.offlineQueue, &next, &id, message, sizeof(message));
+        if (len <= 0) {
+            pending->inUse = false;
+            break;
+        }
+        pending->replayed = true;
+        pending->queueId = id;
+        if (!SendTelemetryNow(message, pending)) {
+            break;
+        }
+        replayCursor = next;
+        ++replaysInFlight;
+    }
+}
+
+// Drops a client that IoT Hub did not authenticate, or no longer does. A client that was
+// connected, e.g. whose SAS token expired, is provisioned again at once; otherwise the
+// backoff, which only an authenticated client resets, paces the retries, so that a hub
+// that rejects the device is not provisioned against in a loop.
+static void DropClient(void)
+{
+    bool wasConnected = state == AzureConnection_Connected;
+    DestroyClient();
+    if (wasConnected) {
+        SetState(AzureConnection_Disconnected);
+        ScheduleTick(0);
+        return;
+    }
+    int delay = NextBackoffSeconds();
+    SetState(AzureConnection_Backoff);
+    Log_Debug("ERROR: IoT Hub did not authenticate the device - will retry in %i seconds.\n",
+              delay);
+    ScheduleTick(delay * 1000L);
+}
+
+// Advances the state machine and re-arms the timer for the next tick.
+static void ConnectionTick(void)
+{
+    if (iothubClientHandle != NULL) {
+        // Connected, or Provisioning while IoT Hub authenticates the new client.
+        if (state == AzureConnection_Connected) {
+            ReplayQueuedTelemetry();
+        }
+        IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
+        if (clientLost) {
+            DropClient();
+            return;
+        }
+        bool busy = state != AzureConnection_Connected || outstandingSends > 0 ||
+                    outstandingReports > 0 ||
+                    (config.offlineQueue != NULL && !TelemetryQueue_IsEmpty(config.offlineQueue));
+        if (busy || pollPeriodMs < AzureIoTBusyPollPeriodMs) {
+            pollPeriodMs = AzureIoTBusyPollPeriodMs;
+        } else if (pollPeriodMs < AzureIoTIdlePollPeriodMs) {
+            // Stay responsive for a short while after the last ack: a twin update or a
+            // method call often follows, and only DoWork receives it.
+            pollPeriodMs *= 2;
+            if (pollPeriodMs > AzureIoTIdlePollPeriodMs) {
+                pollPeriodMs = AzureIoTIdlePollPeriodMs;
+            }
+        }
+        ScheduleTick(pollPeriodMs);
+        return;
+    }
+
+    bool isNetworkReady = false;
+    if (Networking_IsNetworkingReady(&isNetworkReady) == -1) {
+        Log_Debug("Failed to get Network state\n");
+    }
+    if (!isNetworkReady) {
+        // Keep the backoff state; only a provisioning failure advances it.
+        if (state != AzureConnection_Backoff) {
+            SetState(AzureConnection_Disconnected);
+        }
+        ScheduleTick(AzureIoTIdlePollPeriodMs);
+        return;
+    }
+
+    SetState(AzureConnection_Provisioning);
+    if (!SetupAzureClient()) {
+        int delay = NextBackoffSeconds();
+        SetState(AzureConnection_Backoff);
+        Log_Debug("ERROR: failure to create IoTHub Handle - will retry in %i seconds.\n", delay);
+        ScheduleTick(delay * 1000L);
+        return;
+    }
+
+    // Stay in Provisioning until HubConnectionStatusCallback reports the client
+    // authenticated; DoWork drives the connection meanwhile.
+    KickDoWork();
+}
+
+static void TimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        return;
+    }
+    ConnectionTick();
+}
+
+int AzureConnection_Init(EventLoop *loop, const AzureConnection_Config *newConfig)
+{
+    if (newConfig->scopeId == NULL || strlen(newConfig->scopeId) >= SCOPEID_LENGTH) {
+        errno = EINVAL;
+        return -1;
+    }
+    config = *newConfig;
+    strncpy(scopeId, newConfig->scopeId, SCOPEID_LENGTH);
+    config.scopeId = scopeId;
+
+    // Seed the backoff jitter so devices do not share a retry sequence.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    jitterState = (uint32_t)now.tv_nsec ^ (uint32_t)now.tv_sec ^ (uint32_t)getpid();
+    if (jitterState == 0) {
+        jitterState = 1;
+    }
+
+    connectionTimer = CreateEventLoopDisarmedTimer(loop, &TimerEventHandler);
+    if (connectionTimer == NULL) {
+        Log_Debug("ERROR: Could not create IoT Hub timer: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    state = AzureConnection_Disconnected;
+    backoffSeconds = 0;
+    ScheduleTick(0);
+    return 0;
+}
+
+void AzureConnection_Cleanup(void)
+{
+    DestroyClient();
+    DisposeEventLoopTimer(connectionTimer);
+    connectionTimer = NULL;
+    free(twinBuffer);
+    twinBuffer = NULL;
+    twinBufferSize = 0;
+    state = AzureConnection_Disconnected;
+    clientLost = false;
+}
+
+AzureConnection_State AzureConnection_GetState(void)
+{
+    return state;
+}
+
+bool AzureConnection_IsConnected(void)
+{
+    return state == AzureConnection_Connected;
+}
+
+int AzureConnection_SendTelemetry(const char *jsonMessage)
+{
+    Log_Debug("Sending IoT Hub Message: %s\n", jsonMessage);
+
+    TelemetryQueue *queue = config.offlineQueue;
+
+    // Keep ordering: while older messages are waiting, new ones go behind them.
+    if ((queue == NULL || TelemetryQueue_IsEmpty(queue)) &&
+        SendTelemetryNow(jsonMessage, AllocPendingSend())) {
+        Log_Debug("INFO: IoTHubClient accepted the message for delivery\n");
+        return 0;
+    }
+
+    if (queue == NULL) {
+        Log_Debug("WARNING: Cannot send IoTHubMessage because IoT Hub is not connected.\n");
+        return -1;
+    }
+    if (TelemetryQueue_Push(queue, jsonMessage, strlen(jsonMessage)) != 0) {
+        Log_Debug("WARNING: Telemetry dropped: %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    Log_Debug("INFO: Telemetry queued, %u message(s) waiting (%u evicted)\n", queue->count,
+              queue->evicted);
+    return 0;
+}
+
+int AzureConnection_SendTelemetryValue(const char *key, const char *value)
+{
+    static char eventBuffer[128];
+    int len = snprintf(eventBuffer, sizeof(eventBuffer), "{ \"%s\": \"%s\" }", key, value);
+    if (len < 0 || (size_t)len >= sizeof(eventBuffer)) {
+        Log_Debug("WARNING: telemetry '%s' does not fit in %zu bytes\n", key, sizeof(eventBuffer));
+        return -1;
+    }
+    return AzureConnection_SendTelemetry(eventBuffer);
+}
+
+int AzureConnection_ReportState(const char *json)
+{
+    if (state != AzureConnection_Connected) {
+        Log_Debug("ERROR: client not initialized\n");
+        return -1;
+    }
+
+    if (IoTHubDeviceClient_LL_SendReportedState(iothubClientHandle, (const unsigned char *)json,
+                                                strlen(json), ReportStatusCallback,
+                                                NULL) != IOTHUB_CLIENT_OK) {
+        Log_Debug("ERROR: failed to set reported state as '%s'.\n", json);
+        return -1;
+    }
+    ++outstandingReports;
+    KickDoWork();
+    Log_Debug("INFO: Reported state as '%s'.\n", json);
+    return 0;
+}
+
+int AzureConnection_ReportBoolState(const char *propertyName, bool propertyValue)
+{
+    static char reportedPropertiesString[64];
+    int len = snprintf(reportedPropertiesString, sizeof(reportedPropertiesString), "{\"%s\":%s}",
+                       propertyName, propertyValue ? "true" : "false");
+    if (len < 0 || (size_t)len >= sizeof(reportedPropertiesString)) {
+        return -1;
+    }
+    return AzureConnection_ReportState(reportedPropertiesString);
+}
+
+void AzureConnection_GetLatencyHistogram(AzureConnection_LatencyHistogram *histogram)
+{
+    *histogram = latency;
+}
+
+void AzureConnection_ResetLatencyHistogram(void)
+{
+    memset(&latency, 0, sizeof(latency));
+}
@@ -0,0 +1,154 @@
+/* Futura MT3620 Azure IoT Hub connection manager.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+#include "telemetry_queue.h"
+
+/// <summary>
+/// Connection state, advanced by the connection manager timer.
+/// </summary>
+typedef enum {
+    /// <summary>No client; waiting for the network to come up.</summary>
+    AzureConnection_Disconnected = 0,
+    /// <summary>Device Provisioning Service registration and client creation in progress, then
+    /// IoT Hub authentication of the new client.</summary>
+    AzureConnection_Provisioning = 1,
+    /// <summary>Client created and authenticated; IoTHubDeviceClient_LL_DoWork is driven.</summary>
+    AzureConnection_Connected = 2,
+    /// <summary>Provisioning or authentication failed; waiting a jittered, growing delay before
+    /// retrying.</summary>
+    AzureConnection_Backoff = 3,
+} AzureConnection_State;
+
+/// <summary>
+/// Called when the connection enters or leaves the Connected state.
+/// </summary>
+typedef void (*AzureConnection_StatusFn)(bool connected);
+
+/// <summary>
+/// Called when a Device Twin document (complete or partial) is received.
+/// </summary>
+/// <param name="json">NUL-terminated JSON text, valid only for the duration of the call. The
+/// buffer belongs to the connection manager and may be modified, e.g. to parse it in situ.</param>
+typedef void (*AzureConnection_TwinFn)(char *json);
+
+/// <summary>
+/// Called when a Direct Method is invoked. *response must be set to a malloc'd buffer,
+/// which the Azure IoT SDK frees after sending it.
+/// </summary>
+/// <returns>HTTP status code returned to the caller.</returns>
+typedef int (*AzureConnection_MethodFn)(const char *methodName, const char *payload,
+                                        size_t payloadSize, char **response,
+                                        size_t *responseSize);
+
+/// <summary>
+/// Called when IoT Hub confirms, or fails, the delivery of a telemetry message.
+/// </summary>
+typedef void (*AzureConnection_ConfirmFn)(bool delivered);
+
+/// <summary>
+/// Connection manager configuration. Every hook is optional and may be NULL.
+/// </summary>
+typedef struct {
+    /// <summary>Azure IoT Central / DPS scope ID, copied at init.</summary>
+    const char *scopeId;
+    AzureConnection_StatusFn connectionStatus;
+    AzureConnection_TwinFn twinUpdate;
+    AzureConnection_MethodFn directMethod;
+    AzureConnection_ConfirmFn sendConfirmation;
+    /// <summary>Open store-and-forward queue for telemetry that cannot be sent, or NULL to
+    /// drop telemetry while offline.</summary>
+    TelemetryQueue *offlineQueue;
+} AzureConnection_Config;
+
+/// <summary>Lower edge of the second latency bucket, in milliseconds.</summary>
+#define AZURE_CONNECTION_LATENCY_BASE_MS 16
+/// <summary>Number of latency buckets.</summary>
+#define AZURE_CONNECTION_LATENCY_BUCKETS 12
+
+/// <summary>
+/// Enqueue-to-confirm latency of the telemetry messages delivered since the last reset.
+/// buckets[0] counts latencies below AZURE_CONNECTION_LATENCY_BASE_MS, buckets[i] those
+/// below AZURE_CONNECTION_LATENCY_BASE_MS &lt;&lt; i, and the last bucket everything slower.
+/// </summary>
+typedef struct {
+    uint32_t buckets[AZURE_CONNECTION_LATENCY_BUCKETS];
+    /// <summary>Messages confirmed as delivered.</summary>
+    uint32_t delivered;
+    /// <summary>Messages whose confirmation reported an error, a timeout or a destroyed
+    /// client; they are not counted in the buckets.</summary>
+    uint32_t failed;
+    uint32_t maxMs;
+    uint64_t totalMs;
+} AzureConnection_LatencyHistogram;
+
+/// <summary>
+/// Creates the connection manager timer on the event loop and schedules the first
+/// connection attempt. Provisioning, reconnection with jittered exponential backoff and
+/// calls to IoTHubDeviceClient_LL_DoWork are then driven from that timer. DoWork runs right
+/// after a message or reported property is handed to the client, every 100 ms while
+/// acknowledgements are outstanding, and slows down to every 5 s once idle.
+/// </summary>
+/// <param name="eventLoop">Application event loop.</param>
+/// <param name="config">Scope ID, hooks and optional offline queue.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int AzureConnection_Init(EventLoop *eventLoop, const AzureConnection_Config *config);
+
+/// <summary>
+/// Destroys the IoT Hub client and disposes of the timer. Call before EventLoop_Close.
+/// </summary>
+void AzureConnection_Cleanup(void);
+
+/// <summary>
+/// Returns the current connection state.
+/// </summary>
+AzureConnection_State AzureConnection_GetState(void);
+
+/// <summary>
+/// Returns true when messages can be handed over to IoT Hub.
+/// </summary>
+bool AzureConnection_IsConnected(void);
+
+/// <summary>
+/// Sends a JSON telemetry message. While offline, or while older messages are still queued,
+/// the message goes to the offline queue if one is configured.
+/// </summary>
+/// <returns>0 if the message was accepted for delivery or queued, -1 if it was dropped.</returns>
+int AzureConnection_SendTelemetry(const char *jsonMessage);
+
+/// <summary>
+/// Sends a single { "key": "value" } telemetry message.
+/// </summary>
+/// <returns>0 if the message was accepted for delivery or queued, -1 if it was dropped.</returns>
+int AzureConnection_SendTelemetryValue(const char *key, const char *value);
+
+/// <summary>
+/// Queues a Device Twin reported properties document.
+/// </summary>
+/// <param name="json">JSON object holding the reported properties.</param>
+/// <returns>0 on success, -1 if not connected or the client rejected it.</returns>
+int AzureConnection_ReportState(const char *json);
+
+/// <summary>
+/// Queues a Device Twin reported property with a boolean value.
+/// </summary>
+/// <returns>0 on success, -1 if not connected or the client rejected it.</returns>
+int AzureConnection_ReportBoolState(const char *propertyName, bool propertyValue);
+
+/// <summary>
+/// Copies the telemetry latency histogram.
+/// </summary>
+void AzureConnection_GetLatencyHistogram(AzureConnection_LatencyHistogram *histogram);
+
+/// <summary>
+/// Clears the telemetry latency histogram.
+/// </summary>
+void AzureConnection_ResetLatencyHistogram(void);
@@ -0,0 +1,361 @@
+/* Futura MT3620 offline telemetry queue.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/log.h>
+
+#include "telemetry_queue.h"
+
+// File layout: two header slots, then the circular data region.
+// Each record is a RecordHeader followed by length bytes of message.
+#define HEADER_SLOT_SIZE 32
+#define DATA_OFFSET (2 * HEADER_SLOT_SIZE)
+
+static const uint32_t QueueMagic = 0x51544654; // "TFTQ"
+static const uint32_t QueueVersion = 1;
+
+// Record length that marks the rest of the region as unused; the next record is at 0.
+static const uint16_t WrapMarker = 0xffff;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sequence;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t count;
+    uint32_t checksum;
+} QueueHeader;
+
+typedef struct {
+    uint16_t length;
+    uint16_t checksum;
+} RecordHeader;
+
+_Static_assert(sizeof(QueueHeader) <= HEADER_SLOT_SIZE, "QueueHeader does not fit its slot");
+
+// Fletcher-16 over a byte buffer.
+static uint16_t Checksum16(const uint8_t *data, size_t length)
+{
+    uint32_t sum1 = 0, sum2 = 0;
+    for (size_t i = 0; i < length; ++i) {
+        sum1 = (sum1 + data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return (uint16_t)(sum2 << 8 | sum1);
+}
+
+static uint32_t HeaderChecksum(const QueueHeader *header)
+{
+    return Checksum16((const uint8_t *)header, offsetof(QueueHeader, checksum)) ^ QueueMagic;
+}
+
+static int ReadAt(int fd, void *data, size_t length, off_t offset)
+{
+    ssize_t result = pread(fd, data, length, offset);
+    if (result < 0) {
+        return -1;
+    }
+    if ((size_t)result != length) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int WriteAt(int fd, const void *data, size_t length, off_t offset)
+{
+    ssize_t result = pwrite(fd, data, length, offset);
+    if (result < 0) {
+        return -1;
+    }
+    if ((size_t)result != length) {
+        errno = ENOSPC;
+        return -1;
+    }
+    return 0;
+}
+
+// Publishes head and count of the in-memory state, with tail, by writing the next header
+// slot and syncing the file. Every header is synced before the next one is written, so
+// the other slot always holds the previous state if a reset tears this write.
+static int CommitHeader(TelemetryQueue *queue, uint32_t tail)
+{
+    QueueHeader header = {.magic = QueueMagic,
+                          .version = QueueVersion,
+                          .sequence = queue->sequence + 1,
+                          .capacity = queue->capacity,
+                          .head = queue->head,
+                          .tail = tail,
+                          .count = queue->count};
+    header.checksum = HeaderChecksum(&header);
+
+    off_t slotOffset = (off_t)(header.sequence % 2) * HEADER_SLOT_SIZE;
+    if (WriteAt(queue->fd, &header, sizeof(header), slotOffset) != 0 || fsync(queue->fd) != 0) {
+        Log_Debug("ERROR: telemetry queue header write failed: %s (%d).\n", strerror(errno),
+                  errno);
+        return -1;
+    }
+    queue->sequence = header.sequence;
+    queue->headDirty = false;
+    return 0;
+}
+
+// Returns true if the slot holds a consistent header for this budget.
+static bool IsValidHeader(const QueueHeader *header, uint32_t capacity)
+{
+    return header->magic == QueueMagic && header->version == QueueVersion &&
+           header->checksum == HeaderChecksum(header) && header->capacity == capacity &&
+           header->head < capacity && header->tail <= capacity;
+}
+
+static void ResetState(TelemetryQueue *queue)
+{
+    queue->head = 0;
+    queue->tail = 0;
+    queue->count = 0;
+}
+
+int TelemetryQueue_Open(TelemetryQueue *queue, int fd, uint32_t budgetBytes)
+{
+    if (budgetBytes < sizeof(RecordHeader) + 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    queue->fd = fd;
+    queue->capacity = budgetBytes;
+    queue->sequence = 0;
+    queue->evicted = 0;
+    queue->headId = 0;
+    queue->headDirty = false;
+    ResetState(queue);
+
+    QueueHeader slots[2];
+    bool valid[2];
+    for (int i = 0; i < 2; ++i) {
+        valid[i] = ReadAt(fd, &slots[i], sizeof(slots[i]), (off_t)i * HEADER_SLOT_SIZE) == 0 &&
+                   IsValidHeader(&slots[i], budgetBytes);
+    }
+
+    const QueueHeader *current = NULL;
+    if (valid[0] && valid[1]) {
+        current = (slots[0].sequence > slots[1].sequence) ? &slots[0] : &slots[1];
+    } else if (valid[0] || valid[1]) {
+        current = valid[0] ? &slots[0] : &slots[1];
+    }
+
+    if (current == NULL) {
+        // New or incompatible file: format it to the requested budget.
+        Log_Debug("INFO: formatting telemetry queue (%u bytes).\n", budgetBytes);
+        if (ftruncate(fd, DATA_OFFSET + (off_t)budgetBytes) != 0) {
+            Log_Debug("ERROR: telemetry queue resize failed: %s (%d).\n", strerror(errno), errno);
+            return -1;
+        }
+        return CommitHeader(queue, queue->tail);
+    }
+
+    queue->sequence = current->sequence;
+    queue->head = current->head;
+    queue->tail = current->tail;
+    queue->count = current->count;
+    Log_Debug("INFO: telemetry queue recovered %u queued message(s).\n", queue->count);
+    return 0;
+}
+
+// Moves offset past a wrap marker, or past a tail too short to hold a record header, and
+// reads the record header there. Returns -1 on read failure.
+static int SkipWrap(TelemetryQueue *queue, uint32_t *offset, RecordHeader *record)
+{
+    if (queue->capacity - *offset < sizeof(RecordHeader)) {
+        *offset = 0;
+    }
+    if (ReadAt(queue->fd, record, sizeof(*record), DATA_OFFSET + (off_t)*offset) != 0) {
+        return -1;
+    }
+    if (record->length == WrapMarker) {
+        *offset = 0;
+        return ReadAt(queue->fd, record, sizeof(*record), DATA_OFFSET);
+    }
+    return 0;
+}
+
+// Moves offset past the record whose header is given.
+static void SkipRecord(TelemetryQueue *queue, uint32_t *offset, const RecordHeader *record)
+{
+    *offset += (uint32_t)sizeof(*record) + record->length;
+    if (queue->capacity - *offset < sizeof(RecordHeader)) {
+        *offset = 0;
+    }
+}
+
+// Copies the record at offset into buffer, NUL-terminated, and moves offset past it.
+// Returns the message length, or -1 on failure. A corrupt record clears the queue, which
+// then reads as empty.
+static int ReadRecord(TelemetryQueue *queue, uint32_t *offset, char *buffer, size_t size)
+{
+    RecordHeader record;
+    if (SkipWrap(queue, offset, &record) != 0) {
+        return -1;
+    }
+    if (record.length >= size) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    if (record.length > TELEMETRY_QUEUE_MAX_MESSAGE ||
+        *offset + sizeof(record) + record.length > queue->capacity ||
+        ReadAt(queue->fd, buffer, record.length,
+               DATA_OFFSET + (off_t)(*offset + sizeof(record))) != 0 ||
+        Checksum16((const uint8_t *)buffer, record.length) != record.checksum) {
+        Log_Debug("WARNING: telemetry queue is corrupt, discarding %u message(s).\n",
+                  queue->count);
+        return TelemetryQueue_Clear(queue) == 0 ? 0 : -1;
+    }
+
+    buffer[record.length] = '\0';
+    SkipRecord(queue, offset, &record);
+    return record.length;
+}
+
+// Drops the oldest record from the in-memory state. The committed header still lists it
+// until the next commit.
+static int EvictOldest(TelemetryQueue *queue)
+{
+    RecordHeader record;
+    if (SkipWrap(queue, &queue->head, &record) != 0) {
+        return -1;
+    }
+    SkipRecord(queue, &queue->head, &record);
+    queue->headDirty = true;
+    ++queue->headId;
+    --queue->count;
+    if (queue->count == 0) {
+        ResetState(queue);
+    }
+    return 0;
+}
+
+int TelemetryQueue_Push(TelemetryQueue *queue, const char *message, size_t length)
+{
+    uint32_t needed = (uint32_t)(sizeof(RecordHeader) + length);
+    if (length > TELEMETRY_QUEUE_MAX_MESSAGE || needed > queue->capacity) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    // Find contiguous room at tail, wrapping to the start of the region and evicting the
+    // oldest records as needed. The loop ends at the latest when the queue is empty.
+    uint32_t committedTail = queue->tail;
+    for (;;) {
+        if (queue->count == 0) {
+            ResetState(queue);
+            break;
+        }
+        bool full = queue->tail == queue->head;
+        if (!full && queue->tail > queue->head) {
+            if (queue->capacity - queue->tail >= needed) {
+                break;
+            }
+            if (queue->capacity - queue->tail >= sizeof(RecordHeader)) {
+                RecordHeader marker = {.length = WrapMarker, .checksum = 0};
+                if (WriteAt(queue->fd, &marker, sizeof(marker),
+                            DATA_OFFSET + (off_t)queue->tail) != 0) {
+                    return -1;
+                }
+            }
+            queue->tail = 0;
+            continue;
+        }
+        if (!full && queue->head - queue->tail >= needed) {
+            break;
+        }
+        if (EvictOldest(queue) != 0) {
+            return -1;
+        }
+        ++queue->evicted;
+    }
+
+    // The room found may hold records evicted or popped since the last commit, which the
+    // committed header still lists: commit the new head first, with the tail it had, so that
+    // a reset while the record is written does not leave the header on a half-overwritten
+    // record. The wrap marker, if written, is past that tail and not listed yet.
+    if (queue->headDirty &&
+        CommitHeader(queue, queue->count == 0 ? queue->tail : committedTail) != 0) {
+        return -1;
+    }
+
+    // Sync the record before the header that lists it, so that the header cannot reach the
+    // flash first. This costs no extra flash write, only the ordering.
+    RecordHeader record = {.length = (uint16_t)length,
+                           .checksum = Checksum16((const uint8_t *)message, length)};
+    off_t offset = DATA_OFFSET + (off_t)queue->tail;
+    if (WriteAt(queue->fd, &record, sizeof(record), offset) != 0 ||
+        WriteAt(queue->fd, message, length, offset + (off_t)sizeof(record)) != 0 ||
+        fsync(queue->fd) != 0) {
+        Log_Debug("ERROR: telemetry queue write failed: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    queue->tail += needed;
+    ++queue->count;
+    return CommitHeader(queue, queue->tail);
+}
+
+int TelemetryQueue_Peek(TelemetryQueue *queue, char *buffer, size_t size)
+{
+    if (queue->count == 0) {
+        return 0;
+    }
+    uint32_t offset = queue->head;
+    return ReadRecord(queue, &offset, buffer, size);
+}
+
+void TelemetryQueue_Rewind(const TelemetryQueue *queue, TelemetryQueue_Cursor *cursor)
+{
+    cursor->id = queue->headId;
+    cursor->offset = queue->head;
+}
+
+int TelemetryQueue_Read(TelemetryQueue *queue, TelemetryQueue_Cursor *cursor, uint32_t *id,
+                        char *buffer, size_t size)
+{
+    // Messages behind the cursor may have been popped or evicted, and their space reused.
+    if ((int32_t)(cursor->id - queue->headId) < 0) {
+        TelemetryQueue_Rewind(queue, cursor);
+    }
+    if (cursor->id - queue->headId >= queue->count) {
+        return 0;
+    }
+    *id = cursor->id;
+    int length = ReadRecord(queue, &cursor->offset, buffer, size);
+    if (length > 0) {
+        ++cursor->id;
+    }
+    return length;
+}
+
+int TelemetryQueue_Pop(TelemetryQueue *queue)
+{
+    if (queue->count == 0) {
+        return 0;
+    }
+    if (EvictOldest(queue) != 0) {
+        return -1;
+    }
+    // The header is committed by the next push, or once the queue drains, rather than for
+    // every message, which would write the header page once more per message. A reset in
+    // between sends the messages popped since again.
+    return queue->count == 0 ? CommitHeader(queue, queue->tail) : 0;
+}
+
+int TelemetryQueue_Clear(TelemetryQueue *queue)
+{
+    queue->headId += queue->count;
+    ResetState(queue);
+    return CommitHeader(queue, queue->tail);
+}
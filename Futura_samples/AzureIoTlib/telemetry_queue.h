@@ -0,0 +1,110 @@
+/* Futura MT3620 offline telemetry queue.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest telemetry message that can be queued
+#define TELEMETRY_QUEUE_MAX_MESSAGE 1024
+
+/// <summary>
+/// Bounded store-and-forward log of telemetry messages kept in a file, normally the
+/// application's mutable storage (Storage_OpenMutableFile). Messages are appended to a
+/// circular region of budgetBytes; when it is full the oldest messages are evicted.
+/// Record data is synced before the header that publishes it, evicted space is released by
+/// a synced header before it is reused, and the header is kept in two alternating slots,
+/// so a reset during a push loses at most that message. Pops are committed lazily, by the
+/// next push or when the queue drains, so a reset may send popped messages again.
+/// </summary>
+typedef struct {
+    int fd;
+    uint32_t capacity; // data region size in bytes
+    uint32_t head;     // offset of the oldest record
+    uint32_t tail;     // offset where the next record is written
+    uint32_t count;    // number of queued messages
+    uint32_t sequence; // header generation, selects the header slot
+    uint32_t evicted;  // messages dropped to make room since open
+    uint32_t headId;   // id of the oldest message; ids count up from 0 at open
+    bool headDirty;    // head moved since the last committed header
+} TelemetryQueue;
+
+/// <summary>
+/// Position of a reader that goes through the queued messages without removing them,
+/// e.g. to hand several over to IoT Hub before the first is confirmed.
+/// </summary>
+typedef struct {
+    uint32_t id;     // id of the next message to read
+    uint32_t offset; // its offset in the data region
+} TelemetryQueue_Cursor;
+
+/// <summary>
+/// Opens the queue on an open read/write file, recovering queued messages from a previous
+/// run. If the file holds no valid queue, or one with a different budget, it is reformatted.
+/// </summary>
+/// <param name="queue">Queue to initialize.</param>
+/// <param name="fd">File descriptor, e.g. from Storage_OpenMutableFile. Not closed by the
+/// queue.</param>
+/// <param name="budgetBytes">Bytes reserved for queued messages, excluding the header.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int TelemetryQueue_Open(TelemetryQueue *queue, int fd, uint32_t budgetBytes);
+
+/// <summary>
+/// Appends a message, evicting the oldest messages if the budget is exhausted.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int TelemetryQueue_Push(TelemetryQueue *queue, const char *message, size_t length);
+
+/// <summary>
+/// Copies the oldest message into buffer and NUL-terminates it, without removing it.
+/// </summary>
+/// <param name="queue">Open queue.</param>
+/// <param name="buffer">Receives the message.</param>
+/// <param name="size">Size of buffer; TELEMETRY_QUEUE_MAX_MESSAGE + 1 always suffices.</param>
+/// <returns>Message length, 0 if the queue is empty, or -1 on failure, in which case errno
+/// contains more information. A corrupt queue is reset and reported as empty.</returns>
+int TelemetryQueue_Peek(TelemetryQueue *queue, char *buffer, size_t size);
+
+/// <summary>
+/// Moves a cursor to the oldest message.
+/// </summary>
+void TelemetryQueue_Rewind(const TelemetryQueue *queue, TelemetryQueue_Cursor *cursor);
+
+/// <summary>
+/// Copies the message at the cursor into buffer, NUL-terminates it and moves the cursor to
+/// the next message. A cursor on a message that has been removed since is rewound first.
+/// </summary>
+/// <param name="queue">Open queue.</param>
+/// <param name="cursor">Cursor, set by TelemetryQueue_Rewind before the first read.</param>
+/// <param name="id">Receives the id of the message, which is the oldest one when it equals
+/// queue-&gt;headId.</param>
+/// <param name="buffer">Receives the message.</param>
+/// <param name="size">Size of buffer; TELEMETRY_QUEUE_MAX_MESSAGE + 1 always suffices.</param>
+/// <returns>Message length, 0 past the newest message, or -1 on failure, as for
+/// TelemetryQueue_Peek.</returns>
+int TelemetryQueue_Read(TelemetryQueue *queue, TelemetryQueue_Cursor *cursor, uint32_t *id,
+                        char *buffer, size_t size);
+
+/// <summary>
+/// Removes the oldest message, normally after IoT Hub has confirmed it. The removal is
+/// committed to the file by the next push, or when the queue becomes empty.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int TelemetryQueue_Pop(TelemetryQueue *queue);
+
+/// <summary>
+/// Discards every queued message.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int TelemetryQueue_Clear(TelemetryQueue *queue);
+
+/// <summary>
+/// Returns true when no message is queued.
+/// </summary>
+static inline bool TelemetryQueue_IsEmpty(const TelemetryQueue *queue)
+{
+    return queue->count == 0;
+}
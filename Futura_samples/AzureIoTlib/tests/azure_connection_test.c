@@ -0,0 +1,604 @@
+/* Futura MT3620 Azure IoT Hub connection manager: state machine and replay test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Drives the connection manager against a fake IoT Hub client, a fake timer and a fake
+// clock: the test runs the ticks, which advance the clock by their delay, decides when the
+// hub authenticates or rejects the device, and confirms or fails the messages in flight, in
+// any order. azure_connection.c is built with clock_gettime renamed to FakeClockGettime.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <azure_sphere_provisioning.h>
+#include <applibs/networking.h>
+
+#include "azure_connection.h"
+#include "eventloop_timer_utilities.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                   \
+    do {                                                                                   \
+        if (!(condition)) {                                                                \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++failures;                                                                    \
+        }                                                                                  \
+    } while (0)
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+int Networking_IsNetworkingReady(bool *outIsNetworkingReady)
+{
+    *outIsNetworkingReady = true;
+    return 0;
+}
+
+// Fake clock, in milliseconds
+static long long nowMs = 1000000;
+
+int FakeClockGettime(clockid_t clockId, struct timespec *now)
+{
+    now->tv_sec = (time_t)(nowMs / 1000);
+    now->tv_nsec = (long)(nowMs % 1000) * 1000000;
+    return 0;
+}
+
+// Fake timer: the one-shot delay last armed, or -1 when disarmed.
+struct EventLoopTimer {
+    EventLoopTimerHandler handler;
+};
+static EventLoopTimer timer;
+static long armedMs = -1;
+
+EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
+{
+    timer.handler = handler;
+    armedMs = -1;
+    return &timer;
+}
+
+void DisposeEventLoopTimer(EventLoopTimer *t)
+{
+    armedMs = -1;
+}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *t)
+{
+    return 0;
+}
+
+int SetEventLoopTimerOneShot(EventLoopTimer *t, const struct timespec *delay)
+{
+    armedMs = delay->tv_sec * 1000 + delay->tv_nsec / 1000000;
+    return 0;
+}
+
+// Runs the tick the timer is armed for, once its delay has passed; returns its delay.
+static long RunTick(void)
+{
+    long delay = armedMs;
+    armedMs = -1;
+    nowMs += delay;
+    timer.handler(&timer);
+    return delay;
+}
+
+// Fake client. The hub authenticates or rejects it at its first DoWork.
+typedef enum { Hub_Authenticates, Hub_Rejects } HubBehavior;
+static HubBehavior hub = Hub_Authenticates;
+// When set, destroying the client drops the pending callbacks instead of failing them.
+static bool destroySilently = false;
+static int provisionings = 0;
+static bool clientAlive = false;
+static bool statusReported = false;
+static IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK statusCallback;
+
+struct IOTHUB_MESSAGE_HANDLE_DATA_TAG {
+    char text[TELEMETRY_QUEUE_MAX_MESSAGE + 1];
+};
+
+typedef struct {
+    char text[TELEMETRY_QUEUE_MAX_MESSAGE + 1];
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void *context;
+} InFlight;
+#define MAX_IN_FLIGHT 64
+static InFlight inFlight[MAX_IN_FLIGHT];
+static int inFlightCount = 0;
+
+// Every message the hub confirmed, in order of confirmation.
+static int delivered[256];
+static int deliveredCount = 0;
+
+AZURE_SPHERE_PROV_RETURN_VALUE IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning(
+    const char *scopeId, unsigned int timeout, IOTHUB_DEVICE_CLIENT_LL_HANDLE *handle)
+{
+    ++provisionings;
+    clientAlive = true;
+    statusReported = false;
+    *handle = (IOTHUB_DEVICE_CLIENT_LL_HANDLE)&clientAlive;
+    AZURE_SPHERE_PROV_RETURN_VALUE result = {.result = AZURE_SPHERE_PROV_RESULT_OK};
+    return result;
+}
+
+static int MessageNumber(const InFlight *message)
+{
+    int n = 0;
+    sscanf(message->text, "{\"n\":%d}", &n);
+    return n;
+}
+
+static void Confirm(int index, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    InFlight message = inFlight[index];
+    inFlight[index] = inFlight[--inFlightCount];
+    if (result == IOTHUB_CLIENT_CONFIRMATION_OK && deliveredCount < 256) {
+        delivered[deliveredCount++] = MessageNumber(&message);
+    }
+    message.callback(result, message.context);
+}
+
+void IoTHubDeviceClient_LL_Destroy(IOTHUB_DEVICE_CLIENT_LL_HANDLE h)
+{
+    while (inFlightCount > 0) {
+        if (destroySilently) {
+            --inFlightCount;
+        } else {
+            Confirm(inFlightCount - 1, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
+        }
+    }
+    clientAlive = false;
+}
+
+void IoTHubDeviceClient_LL_DoWork(IOTHUB_DEVICE_CLIENT_LL_HANDLE h)
+{
+    if (!statusReported) {
+        statusReported = true;
+        statusCallback(hub == Hub_Authenticates ? IOTHUB_CLIENT_CONNECTION_AUTHENTICATED
+                                                : IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                       hub == Hub_Authenticates ? IOTHUB_CLIENT_CONNECTION_OK
+                                                : IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL,
+                       NULL);
+    }
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetOption(IOTHUB_DEVICE_CLIENT_LL_HANDLE h,
+                                                     const char *optionName, const void *value)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceTwinCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE h, IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK cb, void *ctx)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE h, IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK cb, void *ctx)
+{
+    statusCallback = cb;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceMethodCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE h, IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC cb, void *ctx)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendEventAsync(IOTHUB_DEVICE_CLIENT_LL_HANDLE h,
+                                                          IOTHUB_MESSAGE_HANDLE m,
+                                                          IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK cb,
+                                                          void *ctx)
+{
+    if (inFlightCount == MAX_IN_FLIGHT) {
+        return IOTHUB_CLIENT_ERROR;
+    }
+    InFlight *message = &inFlight[inFlightCount++];
+    strcpy(message->text, m->text);
+    message->callback = cb;
+    message->context = ctx;
+    return IOTHUB_CLIENT_OK;
+}
+
+// The reported state acknowledgement the hub has not sent yet, if any
+static IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reportCallback = NULL;
+static void *reportContext = NULL;
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendReportedState(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE h, const unsigned char *reportedState, size_t size,
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK cb, void *ctx)
+{
+    reportCallback = cb;
+    reportContext = ctx;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char *source)
+{
+    IOTHUB_MESSAGE_HANDLE message = malloc(sizeof(*message));
+    snprintf(message->text, sizeof(message->text), "%s", source);
+    return message;
+}
+
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE h)
+{
+    free(h);
+}
+
+static int statusChanges = 0;
+static bool lastStatus = false;
+
+static void ConnectionStatus(bool connected)
+{
+    ++statusChanges;
+    lastStatus = connected;
+}
+
+static TelemetryQueue queue;
+
+static void Start(HubBehavior behavior)
+{
+    hub = behavior;
+    destroySilently = false;
+    provisionings = 0;
+    statusChanges = 0;
+    inFlightCount = 0;
+    deliveredCount = 0;
+
+    FILE *file = tmpfile();
+    CHECK(file != NULL && TelemetryQueue_Open(&queue, fileno(file), 8192) == 0);
+    AzureConnection_Config config = {
+        .scopeId = "0ne00000000", .connectionStatus = ConnectionStatus, .offlineQueue = &queue};
+    CHECK(AzureConnection_Init(NULL, &config) == 0);
+}
+
+static void SendNumbered(int n)
+{
+    char message[32];
+    snprintf(message, sizeof(message), "{\"n\":%d}", n);
+    CHECK(AzureConnection_SendTelemetry(message) == 0);
+}
+
+// A hub that rejects the device is provisioned against at the backoff pace, not at once.
+static void TestRejectingHubBacksOff(void)
+{
+    // The library draws its jitter without touching the rand() sequence of the app
+    srand(1234);
+    int expectedRand = rand();
+    srand(1234);
+    Start(Hub_Rejects);
+    long previousMinMs = 0;
+    for (int attempt = 1; attempt <= 8; ++attempt) {
+        RunTick(); // provisions the client
+        CHECK(provisionings == attempt);
+        CHECK(AzureConnection_GetState() == AzureConnection_Provisioning);
+        CHECK(armedMs == 0);
+        RunTick(); // DoWork: the hub rejects the device
+        CHECK(AzureConnection_GetState() == AzureConnection_Backoff);
+        CHECK(!clientAlive);
+        // Drawn from [window, 2 window], the window doubling from 60 s up to 300 s, so
+        // never sooner than 60 s nor later than 600 s.
+        long minMs = 60000L << (attempt - 1);
+        if (minMs > 300000) {
+            minMs = 300000;
+        }
+        CHECK(armedMs >= minMs && armedMs <= 2 * minMs && minMs >= previousMinMs);
+        CHECK(armedMs >= 60000 && armedMs <= 600000);
+        previousMinMs = minMs;
+    }
+    CHECK(statusChanges == 0);
+    CHECK(rand() == expectedRand);
+    AzureConnection_Cleanup();
+}
+
+// Connected only once the hub authenticates the client; a later loss reconnects at once.
+static void TestConnectedOnAuthentication(void)
+{
+    Start(Hub_Rejects);
+    RunTick();
+    RunTick();
+    CHECK(AzureConnection_GetState() == AzureConnection_Backoff);
+
+    hub = Hub_Authenticates;
+    RunTick();
+    CHECK(AzureConnection_GetState() == AzureConnection_Provisioning);
+    CHECK(!AzureConnection_IsConnected());
+    RunTick();
+    CHECK(AzureConnection_IsConnected());
+    CHECK(statusChanges == 1 && lastStatus);
+
+    // The SAS token expires: no backoff after an authenticated session.
+    statusCallback(IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                   IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN, NULL);
+    RunTick();
+    CHECK(AzureConnection_GetState() == AzureConnection_Disconnected);
+    CHECK(statusChanges == 2 && !lastStatus);
+    CHECK(armedMs == 0);
+    RunTick();
+    RunTick();
+    CHECK(AzureConnection_IsConnected());
+    AzureConnection_Cleanup();
+}
+
+// Queued messages leave the queue only when the hub confirms them, in any order; after a
+// failed delivery the replay starts again from the oldest message.
+static void TestReplayPopsOnConfirmation(void)
+{
+    Start(Hub_Authenticates);
+    for (int n = 1; n <= 40; ++n) {
+        SendNumbered(n);
+    }
+    CHECK(queue.count == 40);
+
+    RunTick();
+    RunTick(); // authenticated
+    RunTick(); // replays the first window
+    CHECK(inFlightCount == 16);
+    CHECK(queue.count == 40);
+
+    // Confirmed newest first: nothing leaves the queue until message 1 is confirmed.
+    for (int i = 0; i < 15; ++i) {
+        int newest = 0;
+        for (int j = 1; j < inFlightCount; ++j) {
+            if (MessageNumber(&inFlight[j]) > MessageNumber(&inFlight[newest])) {
+                newest = j;
+            }
+        }
+        Confirm(newest, IOTHUB_CLIENT_CONFIRMATION_OK);
+    }
+    CHECK(queue.count == 40);
+    CHECK(inFlightCount == 1 && MessageNumber(&inFlight[0]) == 1);
+    Confirm(0, IOTHUB_CLIENT_CONFIRMATION_OK);
+    CHECK(queue.count == 24);
+
+    // Sent while older messages wait, a new message goes behind them.
+    SendNumbered(41);
+    CHECK(queue.count == 25);
+
+    RunTick();
+    CHECK(inFlightCount == 16);
+    for (int i = 0; i < inFlightCount; ++i) {
+        if (MessageNumber(&inFlight[i]) == 17) {
+            Confirm(i, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
+        }
+    }
+    while (inFlightCount > 0) {
+        Confirm(inFlightCount - 1, IOTHUB_CLIENT_CONFIRMATION_OK);
+    }
+    CHECK(queue.count == 25);
+
+    // The replay starts again from message 17 and drains the queue.
+    for (int tick = 0; tick < 10 && queue.count > 0; ++tick) {
+        RunTick();
+        while (inFlightCount > 0) {
+            Confirm(0, IOTHUB_CLIENT_CONFIRMATION_OK);
+        }
+    }
+    CHECK(queue.count == 0);
+
+    bool seen[42] = {false};
+    for (int i = 0; i < deliveredCount; ++i) {
+        if (delivered[i] >= 1 && delivered[i] <= 41) {
+            seen[delivered[i]] = true;
+        }
+    }
+    for (int n = 1; n <= 41; ++n) {
+        CHECK(seen[n]);
+    }
+
+    // With the queue empty, telemetry goes straight to the client again.
+    SendNumbered(42);
+    CHECK(queue.count == 0 && inFlightCount == 1);
+    AzureConnection_Cleanup();
+}
+
+// Dropping the client while replayed messages are in flight keeps them queued.
+static void TestLostClientKeepsMessages(void)
+{
+    Start(Hub_Authenticates);
+    for (int n = 1; n <= 5; ++n) {
+        SendNumbered(n);
+    }
+    RunTick();
+    RunTick();
+    RunTick();
+    CHECK(inFlightCount == 5);
+    statusCallback(IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                   IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR, NULL);
+    RunTick();
+    CHECK(inFlightCount == 0);
+    CHECK(queue.count == 5);
+    AzureConnection_Cleanup();
+}
+
+// Connects to a hub that authenticates the device, with an empty offline queue.
+static void Connect(void)
+{
+    Start(Hub_Authenticates);
+    RunTick(); // provisions the client
+    RunTick(); // authenticated
+    CHECK(AzureConnection_IsConnected());
+    // Polls fast a while after the authentication, then settles at the idle period
+    while (armedMs < 5000) {
+        RunTick();
+    }
+}
+
+// DoWork runs at once after a send, every 100 ms while the message is in flight, then at
+// a period which doubles up to 5 s, and at once again when more work arrives.
+static void TestDoWorkSchedule(void)
+{
+    Connect();
+    CHECK(RunTick() == 5000 && armedMs == 5000);
+
+    for (int round = 0; round < 3; ++round) {
+        SendNumbered(round);
+        CHECK(armedMs == 0);
+        SendNumbered(100 + round); // a second send shares the DoWork
+        CHECK(armedMs == 0);
+        RunTick();
+        for (int tick = 0; tick < 5; ++tick) {
+            CHECK(armedMs == 100);
+            RunTick();
+        }
+        while (inFlightCount > 0) {
+            Confirm(0, IOTHUB_CLIENT_CONFIRMATION_OK);
+        }
+        CHECK(armedMs == 100);
+        static const long steps[] = {100, 200, 400, 800, 1600, 3200, 5000, 5000};
+        for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i) {
+            CHECK(RunTick() == steps[i]);
+        }
+        CHECK(armedMs == 5000);
+    }
+
+    // Work arriving in the middle of the back-off resets it
+    SendNumbered(1);
+    RunTick();
+    Confirm(0, IOTHUB_CLIENT_CONFIRMATION_OK);
+    RunTick();
+    RunTick();
+    CHECK(armedMs == 400);
+    SendNumbered(2);
+    CHECK(armedMs == 0);
+    RunTick();
+    CHECK(armedMs == 100);
+    Confirm(0, IOTHUB_CLIENT_CONFIRMATION_OK);
+
+    // A reported property keeps the fast poll until the hub acknowledges it
+    while (armedMs < 5000) {
+        RunTick();
+    }
+    CHECK(AzureConnection_ReportBoolState("led", true) == 0);
+    CHECK(armedMs == 0);
+    for (int tick = 0; tick < 4; ++tick) {
+        RunTick();
+        CHECK(armedMs == 100);
+    }
+    reportCallback(200, reportContext);
+    RunTick();
+    CHECK(armedMs == 200);
+    AzureConnection_Cleanup();
+}
+
+// Sends a message at the current time, and confirms it latencyMs later with result.
+static void SendAndConfirm(long latencyMs, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    SendNumbered(1);
+    CHECK(inFlightCount == 1);
+    nowMs += latencyMs;
+    Confirm(0, result);
+}
+
+// Latencies land in the bucket of their power of two, failures in none.
+static void TestLatencyHistogram(void)
+{
+    Connect();
+    AzureConnection_ResetLatencyHistogram();
+
+    static const struct {
+        long latencyMs;
+        int bucket;
+    } cases[] = {{0, 0},     {15, 0},    {16, 1},     {31, 1},     {32, 2},     {100, 3},
+                 {255, 4},   {256, 5},   {1000, 6},   {8191, 9},   {8192, 10},  {16383, 10},
+                 {16384, 11}, {100000, 11}};
+    uint64_t totalMs = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        AzureConnection_LatencyHistogram before, after;
+        AzureConnection_GetLatencyHistogram(&before);
+        SendAndConfirm(cases[i].latencyMs, IOTHUB_CLIENT_CONFIRMATION_OK);
+        AzureConnection_GetLatencyHistogram(&after);
+        for (int b = 0; b < AZURE_CONNECTION_LATENCY_BUCKETS; ++b) {
+            CHECK(after.buckets[b] == before.buckets[b] + (b == cases[i].bucket));
+        }
+        totalMs += (uint64_t)cases[i].latencyMs;
+    }
+
+    SendAndConfirm(500, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
+    SendAndConfirm(500, IOTHUB_CLIENT_CONFIRMATION_ERROR);
+
+    AzureConnection_LatencyHistogram histogram;
+    AzureConnection_GetLatencyHistogram(&histogram);
+    CHECK(histogram.delivered == sizeof(cases) / sizeof(cases[0]));
+    CHECK(histogram.failed == 2);
+    CHECK(histogram.maxMs == 100000);
+    CHECK(histogram.totalMs == totalMs);
+
+    AzureConnection_ResetLatencyHistogram();
+    AzureConnection_GetLatencyHistogram(&histogram);
+    CHECK(histogram.delivered == 0 && histogram.failed == 0 && histogram.maxMs == 0);
+    AzureConnection_Cleanup();
+}
+
+// Sends count messages and confirms them all OK; returns how many were timed.
+static uint32_t TimedDeliveries(int count)
+{
+    AzureConnection_LatencyHistogram before, after;
+    AzureConnection_GetLatencyHistogram(&before);
+    for (int n = 0; n < count; ++n) {
+        SendNumbered(n);
+    }
+    nowMs += 20;
+    while (inFlightCount > 0) {
+        Confirm(0, IOTHUB_CLIENT_CONFIRMATION_OK);
+    }
+    AzureConnection_GetLatencyHistogram(&after);
+    return after.delivered - before.delivered;
+}
+
+// The 32 timing slots come back after a timeout, a failure and the loss of the client,
+// whether or not the SDK fails the pending callbacks; messages beyond them are not timed.
+static void TestPendingSlotsFreed(void)
+{
+    Connect();
+    CHECK(TimedDeliveries(40) == 32);
+
+    for (int n = 0; n < 32; ++n) {
+        SendNumbered(n);
+    }
+    while (inFlightCount > 0) {
+        Confirm(0, inFlightCount % 2 ? IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT
+                                     : IOTHUB_CLIENT_CONFIRMATION_ERROR);
+    }
+    CHECK(TimedDeliveries(32) == 32);
+
+    for (int silently = 0; silently < 2; ++silently) {
+        destroySilently = silently;
+        for (int n = 0; n < 32; ++n) {
+            SendNumbered(n);
+        }
+        statusCallback(IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                       IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR, NULL);
+        RunTick(); // drops the client
+        CHECK(inFlightCount == 0);
+        RunTick(); // provisions it again
+        RunTick(); // authenticated
+        CHECK(AzureConnection_IsConnected());
+        CHECK(TimedDeliveries(32) == 32);
+    }
+    AzureConnection_Cleanup();
+}
+
+int main(void)
+{
+    TestRejectingHubBacksOff();
+    TestConnectedOnAuthentication();
+    TestReplayPopsOnConfirmation();
+    TestLostClientKeepsMessages();
+    TestDoWorkSchedule();
+    TestLatencyHistogram();
+    TestPendingSlotsFreed();
+    printf("%d check(s) failed\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,19 @@
+/* Host stand-in for the Azure Sphere SDK header of the same name, for the tests. */
+
+#pragma once
+#include <stdint.h>
+typedef struct EventLoop EventLoop;
+typedef struct EventRegistration EventRegistration;
+typedef uint32_t EventLoop_IoEvents;
+#define EventLoop_Input 1u
+#define EventLoop_Output 4u
+typedef void EventLoopIoCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context);
+typedef enum { EventLoop_Run_Failed = -1, EventLoop_Run_FinishedEmpty = 0, EventLoop_Run_Finished = 1 } EventLoop_Run_Result;
+EventLoop *EventLoop_Create(void);
+void EventLoop_Close(EventLoop *el);
+EventLoop_Run_Result EventLoop_Run(EventLoop *el, int duration_in_milliseconds, _Bool process_one_event);
+int EventLoop_Stop(EventLoop *el);
+EventRegistration *EventLoop_RegisterIo(EventLoop *el, int fd, EventLoop_IoEvents eventBitmask, EventLoopIoCallback *callback, void *context);
+int EventLoop_ModifyIoEvents(EventLoop *el, EventRegistration *reg, EventLoop_IoEvents eventBitmask);
+int EventLoop_UnregisterIo(EventLoop *el, EventRegistration *reg);
+int EventLoop_GetWaitDescriptor(EventLoop *el);
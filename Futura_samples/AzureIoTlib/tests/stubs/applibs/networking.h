@@ -0,0 +1,5 @@
+/* Host stand-in for the Azure Sphere SDK header of the same name, for the tests. */
+
+#pragma once
+#include <stdbool.h>
+int Networking_IsNetworkingReady(bool *outIsNetworkingReady);
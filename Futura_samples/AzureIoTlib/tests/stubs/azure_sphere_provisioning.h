@@ -0,0 +1,7 @@
+/* Host stand-in for the Azure Sphere SDK header of the same name, for the tests. */
+
+#pragma once
+#include "iothub_device_client_ll.h"
+typedef enum { AZURE_SPHERE_PROV_RESULT_OK, AZURE_SPHERE_PROV_RESULT_INVALID_PARAM, AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY, AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY, AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR, AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR } AZURE_SPHERE_PROV_RESULT;
+typedef struct { AZURE_SPHERE_PROV_RESULT result; int prov_device_error; int iothub_client_error; } AZURE_SPHERE_PROV_RETURN_VALUE;
+AZURE_SPHERE_PROV_RETURN_VALUE IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning(const char *scopeId, unsigned int timeout, IOTHUB_DEVICE_CLIENT_LL_HANDLE *handle);
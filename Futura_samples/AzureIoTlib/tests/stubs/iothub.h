@@ -0,0 +1,4 @@
+/* Host stand-in for the Azure Sphere SDK header of the same name, for the tests. */
+
+#pragma once
+#include "iothub_client_core_common.h"
@@ -0,0 +1,248 @@
+/* Futura MT3620 offline telemetry queue: reset test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Runs pushes and pops on a simulated flash, where writes stay pending until fsync, and
+// resets the device before each write or sync in turn. At each reset any subset of the
+// pending writes may have reached the flash. The queue is then reopened and drained, and
+// must hold, in order and uncorrupted, every message pushed before the reset that was not
+// evicted, possibly preceded by messages popped since the last commit.
+
+#include <errno.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "telemetry_queue.h"
+
+#define FLASH_SIZE 512
+#define MAX_PENDING 64
+#define BUDGET 160
+#define MESSAGES 40
+
+typedef struct {
+    off_t offset;
+    size_t length;
+    unsigned char data[TELEMETRY_QUEUE_MAX_MESSAGE];
+} PendingWrite;
+
+static unsigned char flash[FLASH_SIZE];
+static PendingWrite pending[MAX_PENDING];
+static int pendingCount;
+
+// Writes and syncs allowed before the reset, or -1 for none.
+static long callsLeft = -1;
+static jmp_buf resetPoint;
+
+static int corruptWarnings;
+
+int Log_Debug(const char *fmt, ...)
+{
+    if (strstr(fmt, "corrupt") != NULL) {
+        ++corruptWarnings;
+    }
+    return 0;
+}
+
+static void CountCall(void)
+{
+    if (callsLeft == 0) {
+        longjmp(resetPoint, 1);
+    }
+    if (callsLeft > 0) {
+        --callsLeft;
+    }
+}
+
+ssize_t SimPread(int fd, void *data, size_t length, off_t offset)
+{
+    (void)fd;
+    if (offset < 0 || (size_t)offset + length > FLASH_SIZE) {
+        errno = EIO;
+        return -1;
+    }
+    // What the application reads back includes the writes not synced yet.
+    memcpy(data, flash + offset, length);
+    for (int i = 0; i < pendingCount; ++i) {
+        const PendingWrite *w = &pending[i];
+        for (size_t j = 0; j < w->length; ++j) {
+            off_t at = w->offset + (off_t)j;
+            if (at >= offset && at < offset + (off_t)length) {
+                ((unsigned char *)data)[at - offset] = w->data[j];
+            }
+        }
+    }
+    return (ssize_t)length;
+}
+
+ssize_t SimPwrite(int fd, const void *data, size_t length, off_t offset)
+{
+    (void)fd;
+    CountCall();
+    if (pendingCount == MAX_PENDING || length > TELEMETRY_QUEUE_MAX_MESSAGE ||
+        offset < 0 || (size_t)offset + length > FLASH_SIZE) {
+        fprintf(stderr, "simulated flash: write out of range\n");
+        exit(1);
+    }
+    PendingWrite *w = &pending[pendingCount++];
+    w->offset = offset;
+    w->length = length;
+    memcpy(w->data, data, length);
+    return (ssize_t)length;
+}
+
+static void Persist(const PendingWrite *w)
+{
+    memcpy(flash + w->offset, w->data, w->length);
+}
+
+int SimFsync(int fd)
+{
+    (void)fd;
+    CountCall();
+    for (int i = 0; i < pendingCount; ++i) {
+        Persist(&pending[i]);
+    }
+    pendingCount = 0;
+    return 0;
+}
+
+int SimFtruncate(int fd, off_t length)
+{
+    (void)fd;
+    if (length > FLASH_SIZE) {
+        errno = EFBIG;
+        return -1;
+    }
+    memset(flash, 0, FLASH_SIZE);
+    return 0;
+}
+
+// Message number n; lengths vary so that records wrap at different offsets.
+static int FormatMessage(char *buffer, size_t size, int n)
+{
+    return snprintf(buffer, size, "{\"n\":%d,\"pad\":\"%.*s\"}", n, 3 + (n * 7) % 17,
+                    "xxxxxxxxxxxxxxxxxxxxxxxx");
+}
+
+static int ParseMessage(const char *message)
+{
+    int n;
+    char check[TELEMETRY_QUEUE_MAX_MESSAGE + 1];
+    if (sscanf(message, "{\"n\":%d", &n) != 1) {
+        return -1;
+    }
+    FormatMessage(check, sizeof(check), n);
+    return strcmp(check, message) == 0 ? n : -1;
+}
+
+// The workload: pushes, with a pop after every third push while "connected", so that both
+// eviction and lazily committed pops overwrite space the committed header listed.
+static int lastPushed;
+
+static void RunWorkload(void)
+{
+    TelemetryQueue queue;
+    if (TelemetryQueue_Open(&queue, 3, BUDGET) != 0) {
+        fprintf(stderr, "open failed\n");
+        exit(1);
+    }
+    char message[TELEMETRY_QUEUE_MAX_MESSAGE + 1];
+    for (int n = 1; n <= MESSAGES; ++n) {
+        int length = FormatMessage(message, sizeof(message), n);
+        if (TelemetryQueue_Push(&queue, message, (size_t)length) != 0) {
+            fprintf(stderr, "push %d failed\n", n);
+            exit(1);
+        }
+        lastPushed = n;
+        if (n % 3 == 0 && (n / 12) % 2 == 1) {
+            TelemetryQueue_Pop(&queue);
+        }
+    }
+}
+
+// Reopens the queue after a reset and checks what it holds; returns false on failure.
+static bool CheckRecovered(long resetAt, unsigned mask)
+{
+    TelemetryQueue queue;
+    corruptWarnings = 0;
+    if (TelemetryQueue_Open(&queue, 3, BUDGET) != 0) {
+        fprintf(stderr, "reset at call %ld, mask %#x: open failed\n", resetAt, mask);
+        return false;
+    }
+    char message[TELEMETRY_QUEUE_MAX_MESSAGE + 1];
+    int previous = 0;
+    int length;
+    while ((length = TelemetryQueue_Peek(&queue, message, sizeof(message))) > 0) {
+        int n = ParseMessage(message);
+        if (n <= previous) {
+            fprintf(stderr, "reset at call %ld, mask %#x: message \"%s\" after %d\n", resetAt,
+                    mask, message, previous);
+            return false;
+        }
+        previous = n;
+        TelemetryQueue_Pop(&queue);
+    }
+    if (length < 0 || corruptWarnings != 0) {
+        fprintf(stderr, "reset at call %ld, mask %#x: queue found corrupt\n", resetAt, mask);
+        return false;
+    }
+    // Only the push in progress may be lost; earlier ones may have been evicted, but then a
+    // later message is there.
+    if (previous < lastPushed) {
+        fprintf(stderr, "reset at call %ld, mask %#x: newest message %d, %d was pushed\n",
+                resetAt, mask, previous, lastPushed);
+        return false;
+    }
+    return true;
+}
+
+int main(void)
+{
+    unsigned long resets = 0;
+    int failures = 0;
+    for (long resetAt = 0;; ++resetAt) {
+        memset(flash, 0xA5, sizeof(flash));
+        pendingCount = 0;
+        lastPushed = 0;
+        callsLeft = resetAt;
+        if (setjmp(resetPoint) == 0) {
+            RunWorkload();
+            callsLeft = -1;
+            break;
+        }
+        callsLeft = -1;
+
+        // Any subset of the pending writes may have reached the flash, in any order; writes
+        // do not overlap within a sync, so the order does not matter.
+        unsigned char before[FLASH_SIZE];
+        PendingWrite lost[MAX_PENDING];
+        int lostCount = pendingCount;
+        memcpy(before, flash, sizeof(flash));
+        memcpy(lost, pending, sizeof(PendingWrite) * (size_t)lostCount);
+        if (lostCount > 16) {
+            fprintf(stderr, "%d writes pending at a reset\n", lostCount);
+            return 1;
+        }
+        for (unsigned mask = 0; mask < (1u << lostCount); ++mask) {
+            memcpy(flash, before, sizeof(flash));
+            pendingCount = 0;
+            for (int i = 0; i < lostCount; ++i) {
+                if (mask & (1u << i)) {
+                    Persist(&lost[i]);
+                }
+            }
+            ++resets;
+            if (!CheckRecovered(resetAt, mask) && ++failures == 10) {
+                return 1;
+            }
+        }
+    }
+
+    printf("%lu resets checked, %d failed\n", resets, failures);
+    return failures != 0;
+}
@@ -0,0 +1,190 @@
+/* Futura MT3620 debounced push buttons.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <applibs/log.h>
+
+#include "button.h"
+#include "eventloop_timer_utilities.h"
+
+// GPIO_GetValue does not report edges, so the buttons are sampled. A 1 ms period was needed
+// to catch presses with plain polling; with debouncing, a press is detected reliably at
+// 50 ms, and the period drops to 5 ms only around edges.
+static const uint32_t idlePollPeriodMs = 50;
+static const uint32_t activePollPeriodMs = 5;
+// Time the period stays short after the last edge on any button.
+static const uint32_t activeHoldMs = 500;
+
+// A level must be stable this long before it is accepted.
+static const uint32_t debounceMs = 20;
+static const uint32_t longPressMs = 1000;
+// Time after a release during which another press extends the click sequence.
+static const uint32_t multiClickWindowMs = 400;
+
+// Times are milliseconds of the monotonic clock modulo 2^32, and only their differences are
+// used, computed in uint32_t: they stay right across the wrap, after 49.7 days, for
+// intervals up to that long. A long would overflow after 24.8 days on the 32-bit A7.
+
+typedef struct {
+    int fd;
+    Button_EventFn handler;
+    void *context;
+    GPIO_Value_Type raw;    // last sampled level
+    GPIO_Value_Type stable; // debounced level
+    uint32_t rawChangedMs;
+    uint32_t pressedMs;
+    uint32_t releasedMs;
+    unsigned int clicks;
+    bool longPressSent;
+} Button;
+
+static Button buttons[BUTTON_MAX_COUNT];
+static int buttonCount = 0;
+
+static EventLoopTimer *pollTimer = NULL;
+
+static uint32_t lastEdgeMs = 0;
+static uint32_t wakeups = 0;
+
+static uint32_t NowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec * 1000u + (uint32_t)(now.tv_nsec / 1000000);
+}
+
+static void ScheduleTick(uint32_t milliseconds)
+{
+    struct timespec delay = {.tv_sec = milliseconds / 1000,
+                             .tv_nsec = (milliseconds % 1000) * 1000000};
+    if (SetEventLoopTimerOneShot(pollTimer, &delay) != 0) {
+        Log_Debug("ERROR: Could not arm button timer: %s (%d).\n", strerror(errno), errno);
+    }
+}
+
+// Samples one button and reports the events it produced.
+static void PollButton(Button *button, uint32_t now)
+{
+    GPIO_Value_Type value;
+    if (GPIO_GetValue(button->fd, &value) != 0) {
+        Log_Debug("ERROR: Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
+        return;
+    }
+
+    if (value != button->raw) {
+        button->raw = value;
+        button->rawChangedMs = now;
+        lastEdgeMs = now;
+    }
+
+    if (button->raw != button->stable && now - button->rawChangedMs >= debounceMs) {
+        button->stable = button->raw;
+        if (button->stable == GPIO_Value_Low) {
+            button->pressedMs = now;
+            button->longPressSent = false;
+            button->handler(Button_Pressed, 0, button->context);
+        } else {
+            button->handler(Button_Released, 0, button->context);
+            if (!button->longPressSent) {
+                ++button->clicks;
+                button->releasedMs = now;
+            }
+        }
+    }
+
+    if (button->stable == GPIO_Value_Low && !button->longPressSent &&
+        now - button->pressedMs >= longPressMs) {
+        button->longPressSent = true;
+        button->clicks = 0;
+        button->handler(Button_LongPress, 0, button->context);
+    }
+
+    if (button->stable == GPIO_Value_High && button->clicks > 0 &&
+        now - button->releasedMs >= multiClickWindowMs) {
+        unsigned int clicks = button->clicks;
+        button->clicks = 0;
+        button->handler(Button_Click, clicks, button->context);
+    }
+}
+
+static void TimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        return;
+    }
+
+    ++wakeups;
+    uint32_t now = NowMs();
+    for (int i = 0; i < buttonCount; ++i) {
+        PollButton(&buttons[i], now);
+    }
+    ScheduleTick(now - lastEdgeMs < activeHoldMs ? activePollPeriodMs : idlePollPeriodMs);
+}
+
+int Button_Init(EventLoop *eventLoop)
+{
+    buttonCount = 0;
+    wakeups = 0;
+    lastEdgeMs = NowMs() - activeHoldMs;
+
+    pollTimer = CreateEventLoopDisarmedTimer(eventLoop, &TimerEventHandler);
+    if (pollTimer == NULL) {
+        Log_Debug("ERROR: Could not create button timer: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    ScheduleTick(idlePollPeriodMs);
+    return 0;
+}
+
+int Button_Add(GPIO_Id gpioId, Button_EventFn handler, void *context)
+{
+    if (buttonCount == BUTTON_MAX_COUNT || handler == NULL) {
+        errno = buttonCount == BUTTON_MAX_COUNT ? ENOSPC : EINVAL;
+        return -1;
+    }
+
+    Button *button = &buttons[buttonCount];
+    memset(button, 0, sizeof(*button));
+    button->fd = GPIO_OpenAsInput(gpioId);
+    if (button->fd < 0) {
+        return -1;
+    }
+
+    // Start from the current level, so a button held at startup is not reported as pressed.
+    if (GPIO_GetValue(button->fd, &button->raw) != 0) {
+        int error = errno;
+        close(button->fd);
+        errno = error;
+        return -1;
+    }
+    button->stable = button->raw;
+    button->longPressSent = button->stable == GPIO_Value_Low;
+    button->handler = handler;
+    button->context = context;
+    ++buttonCount;
+    return 0;
+}
+
+void Button_Cleanup(void)
+{
+    DisposeEventLoopTimer(pollTimer);
+    pollTimer = NULL;
+    for (int i = 0; i < buttonCount; ++i) {
+        if (close(buttons[i].fd) != 0) {
+            Log_Debug("ERROR: Could not close button GPIO: %s (%d).\n", strerror(errno), errno);
+        }
+    }
+    buttonCount = 0;
+}
+
+uint32_t Button_GetWakeups(void)
+{
+    return wakeups;
+}
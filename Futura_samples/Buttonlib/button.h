@@ -0,0 +1,64 @@
+/* Futura MT3620 debounced push buttons.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+#include <applibs/gpio.h>
+
+// Largest number of buttons that can be added
+#define BUTTON_MAX_COUNT 4
+
+/// <summary>
+/// Button events. Buttons are active low, as on the Futura board.
+/// </summary>
+typedef enum {
+    /// <summary>The button went down, after debouncing.</summary>
+    Button_Pressed = 0,
+    /// <summary>The button went up, after debouncing.</summary>
+    Button_Released = 1,
+    /// <summary>One or more short presses ended and no further press followed within the
+    /// multi-click window; clicks holds the number of presses.</summary>
+    Button_Click = 2,
+    /// <summary>The button has been held down for the long-press time. The press that
+    /// produced it is not counted as a click.</summary>
+    Button_LongPress = 3,
+} Button_Event;
+
+/// <summary>
+/// Called from the event loop for every button event.
+/// </summary>
+/// <param name="event">Event that occurred.</param>
+/// <param name="clicks">Number of presses for Button_Click, 0 otherwise.</param>
+/// <param name="context">Context passed to Button_Add.</param>
+typedef void (*Button_EventFn)(Button_Event event, unsigned int clicks, void *context);
+
+/// <summary>
+/// Registers the button poll timer with the event loop. All buttons share it: it runs
+/// every 50 ms while the buttons are idle and every 5 ms for a while after any edge,
+/// which is long enough to debounce, time long presses and count multiple clicks.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Button_Init(EventLoop *eventLoop);
+
+/// <summary>
+/// Opens a GPIO as a button input and starts polling it.
+/// </summary>
+/// <param name="gpioId">Button GPIO.</param>
+/// <param name="handler">Event handler.</param>
+/// <param name="context">Passed to the handler.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Button_Add(GPIO_Id gpioId, Button_EventFn handler, void *context);
+
+/// <summary>
+/// Closes the button GPIOs and disposes of the timer. Call before EventLoop_Close.
+/// </summary>
+void Button_Cleanup(void);
+
+/// <summary>
+/// Returns the number of times the poll timer has run since Button_Init.
+/// </summary>
+uint32_t Button_GetWakeups(void);
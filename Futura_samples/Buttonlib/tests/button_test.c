@@ -0,0 +1,176 @@
+/* Futura MT3620 debounced push buttons: virtual clock test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Runs the same presses on a virtual clock started at 0, just before 2^31 ms, where a 32-bit
+// long overflows, and just before 2^32 ms, where the millisecond count wraps, and checks
+// that every run reports the same events at the same times.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "button.h"
+#include "eventloop_timer_utilities.h"
+
+static uint64_t virtualMs;
+
+int VirtualClockGettime(clockid_t clock, struct timespec *now)
+{
+    now->tv_sec = (time_t)(virtualMs / 1000);
+    now->tv_nsec = (long)(virtualMs % 1000) * 1000000;
+    return 0;
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    return 0;
+}
+
+// Fake timer: the one-shot delay last armed.
+struct EventLoopTimer {
+    EventLoopTimerHandler handler;
+};
+static EventLoopTimer timer;
+static uint64_t armedMs;
+
+EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
+{
+    timer.handler = handler;
+    return &timer;
+}
+
+void DisposeEventLoopTimer(EventLoopTimer *t) {}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *t)
+{
+    return 0;
+}
+
+int SetEventLoopTimerOneShot(EventLoopTimer *t, const struct timespec *delay)
+{
+    armedMs = (uint64_t)delay->tv_sec * 1000 + (uint64_t)delay->tv_nsec / 1000000;
+    return 0;
+}
+
+// Fake GPIO: the button is down during the intervals of the script, in ms from the start,
+// with a bounce at each press.
+typedef struct {
+    uint32_t downMs;
+    uint32_t upMs;
+} Press;
+
+static const Press script[] = {
+    {1000, 1100}, // click
+    {3000, 3080}, {3300, 3390}, // double click
+    {5000, 6500}, // long press
+    {8000, 8010}, // shorter than the debounce time: ignored
+};
+static uint64_t startMs;
+
+int GPIO_OpenAsInput(GPIO_Id gpioId)
+{
+    return 3;
+}
+
+int GPIO_GetValue(int gpioFd, GPIO_Value_Type *outValue)
+{
+    uint64_t t = virtualMs - startMs;
+    bool down = false;
+    for (size_t i = 0; i < sizeof(script) / sizeof(script[0]); ++i) {
+        // Bounces for 6 ms after the press.
+        if (t >= script[i].downMs && t < script[i].upMs) {
+            uint64_t since = t - script[i].downMs;
+            down = since >= 6 || since % 2 == 0;
+        }
+    }
+    *outValue = down ? GPIO_Value_Low : GPIO_Value_High;
+    return 0;
+}
+
+int GpioClose(int fd)
+{
+    return 0;
+}
+
+typedef struct {
+    Button_Event event;
+    unsigned int clicks;
+    uint64_t atMs; // from the start
+} Recorded;
+#define MAX_RECORDED 32
+static Recorded recorded[MAX_RECORDED];
+static int recordedCount;
+
+static void Handler(Button_Event event, unsigned int clicks, void *context)
+{
+    if (recordedCount < MAX_RECORDED) {
+        recorded[recordedCount++] = (Recorded){event, clicks, virtualMs - startMs};
+    }
+}
+
+static int Run(uint64_t start, Recorded *events)
+{
+    startMs = start;
+    virtualMs = start;
+    recordedCount = 0;
+    Button_Init(NULL);
+    Button_Add(0, Handler, NULL);
+    while (virtualMs - startMs < 10000) {
+        virtualMs += armedMs;
+        timer.handler(&timer);
+    }
+    Button_Cleanup();
+    memcpy(events, recorded, sizeof(recorded));
+    return recordedCount;
+}
+
+int main(void)
+{
+    static const Button_Event expected[] = {
+        Button_Pressed,  Button_Released, Button_Click,    Button_Pressed,
+        Button_Released, Button_Pressed,  Button_Released, Button_Click,
+        Button_Pressed,  Button_LongPress, Button_Released,
+    };
+    const int expectedCount = sizeof(expected) / sizeof(expected[0]);
+    const uint64_t starts[] = {0, (1ull << 31) - 2500, (1ull << 32) - 2500, (1ull << 32) - 5200};
+
+    Recorded reference[MAX_RECORDED];
+    int failures = 0;
+    int referenceCount = Run(starts[0], reference);
+    if (referenceCount != expectedCount) {
+        fprintf(stderr, "start 0: %d events, expected %d\n", referenceCount, expectedCount);
+        ++failures;
+    }
+    for (int i = 0; i < referenceCount && i < expectedCount; ++i) {
+        if (reference[i].event != expected[i]) {
+            fprintf(stderr, "start 0: event %d is %d, expected %d\n", i, reference[i].event,
+                    expected[i]);
+            ++failures;
+        }
+    }
+    if (referenceCount >= 8 && (reference[2].clicks != 1 || reference[7].clicks != 2)) {
+        fprintf(stderr, "start 0: wrong click counts\n");
+        ++failures;
+    }
+
+    for (size_t s = 1; s < sizeof(starts) / sizeof(starts[0]); ++s) {
+        Recorded events[MAX_RECORDED];
+        int count = Run(starts[s], events);
+        bool same = count == referenceCount;
+        for (int i = 0; same && i < count; ++i) {
+            same = events[i].event == reference[i].event &&
+                   events[i].clicks == reference[i].clicks && events[i].atMs == reference[i].atMs;
+        }
+        if (!same) {
+            fprintf(stderr, "start %llu ms: events differ from the run started at 0\n",
+                    (unsigned long long)starts[s]);
+            ++failures;
+        }
+    }
+
+    printf("%d failure(s)\n", failures);
+    return failures != 0;
+}
@@ -22,13 +22,7 @@
 
 //IOTHUB libs
 #include "eventloop_timer_utilities.h"
-#include <iothub_client_core_common.h>
-#include <iothub_device_client_ll.h>
-#include <iothub_client_options.h>
-#include <iothubtransportmqtt.h>
-#include <iothub.h>
-#include <azure_sphere_provisioning.h>
-#include "parson.h" // used to parse Device Twin messages.
+#include "azure_connection.h"
 
 // File descriptors - initialized to invalid value
 static int adcControllerFd = -1;
@@ -58,10 +52,9 @@ typedef enum {
     ExitCode_Init_AdcPollTimer = 9,
     ExitCode_Main_EventLoopFail = 10,
     ExitCode_ButtonTimer_Consume = 3,
-    ExitCode_AzureTimer_Consume = 4,    
     ExitCode_Init_TwinStatusLed = 8,
     ExitCode_Init_ButtonPollTimer = 9,
-    ExitCode_Init_AzureTimer = 10,
+    ExitCode_Init_AzureConnection = 10,
     ExitCode_IsButtonPressed_GetValue = 11,
     ExitCode_Init_SetBusSpeed = 27,
     ExitCode_Init_SetTimeout = 28,
@@ -80,19 +73,6 @@ static void TerminationHandler(int signalNumber);
 // Azure IoT Hub/Central defines.
 #define SCOPEID_LENGTH 20
 static char scopeId[SCOPEID_LENGTH]; // ScopeId for the Azure IoT Central application, set in app_manifest.json, CmdArgs
-static IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle = NULL;
-static const int keepalivePeriodSeconds = 20;
-static bool iothubAuthenticated = false;
-static void SendMessageCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context);
-static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload,
-                         size_t payloadSize, void *userContextCallback);
-static void TwinReportBoolState(const char *propertyName, bool propertyValue);
-static void ReportStatusCallback(int result, void *context);
-static const char *GetReasonString(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason);
-static const char *getAzureSphereProvisioningResultString(
-    AZURE_SPHERE_PROV_RETURN_VALUE provisioningResult);
-static void SendTelemetry(const unsigned char *key, const unsigned char *value);
-static void SetupAzureClient(void);
 
 
 // Initialization/Cleanup
@@ -106,21 +86,13 @@ static bool statusLedOn = false;
 
 // Timer / polling
 static EventLoopTimer *buttonPollTimer = NULL;
-static EventLoopTimer *azureTimer = NULL;
 
-// Azure IoT poll periods
-static const int AzureIoTDefaultPollPeriodSeconds = 5;
-static const int AzureIoTMinReconnectPeriodSeconds = 60;
-static const int AzureIoTMaxReconnectPeriodSeconds = 10 * 60;
-
-static int azureIoTPollPeriodSeconds = -1;
 
 // Button state variables
 static GPIO_Value_Type sendMessageButtonState = GPIO_Value_High;
 static GPIO_Value_Type sendMessageButtonStateAccel = GPIO_Value_High;
 static GPIO_Value_Type sendOrientationButtonState = GPIO_Value_High;
 
-static void AzureTimerEventHandler(EventLoopTimer *timer);
 
 
 
@@ -168,32 +140,6 @@ int main(int argc, char *argv[])
 
 
 
-// // // // // // // // // // // // // // // // // // 
-// Azure timer event:  Check connection status and send telemetry
-// // // // // // // // // // // // // // // // // // 
-static void AzureTimerEventHandler(EventLoopTimer *timer)
-{
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_AzureTimer_Consume;
-        return;
-    }
-
-    bool isNetworkReady = false;
-    if (Networking_IsNetworkingReady(&isNetworkReady) != -1) {
-        if (isNetworkReady && !iothubAuthenticated) {
-            SetupAzureClient();
-        }
-    } else {
-        Log_Debug("Failed to get Network state\n");
-    }
-
-    if (iothubAuthenticated) {
-        //SendSimulatedTemperature(); // uncomment optionally
-        IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
-    }
-}
-
-
 // Set up SIGTERM termination handler, initialize peripherals, and set up event handlers.
 static ExitCode InitPeripheralsAndHandlers(void)
 {
@@ -239,12 +185,9 @@ static ExitCode InitPeripheralsAndHandlers(void)
         return ExitCode_Init_AdcPollTimer;
     }
 
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = {.tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0};
-    azureTimer =
-        CreateEventLoopPeriodicTimer(eventLoop, &AzureTimerEventHandler, &azureTelemetryPeriod);
-    if (azureTimer == NULL) {
-        return ExitCode_Init_AzureTimer;
+    AzureConnection_Config azureConfig = {.scopeId = scopeId};
+    if (AzureConnection_Init(eventLoop, &azureConfig) != 0) {
+        return ExitCode_Init_AzureConnection;
     }
 
     return ExitCode_Success;
@@ -256,262 +199,18 @@ static void ClosePeripheralsAndHandlers(void)
 
     DisposeEventLoopTimer(adcPollTimer);
     
+    AzureConnection_Cleanup();
     EventLoop_Close(eventLoop);
 
     Log_Debug("Closing file descriptors.\n");
     CloseFdAndPrintError(adcControllerFd, "ADC");
     
-    DisposeEventLoopTimer(azureTimer);
     
     Log_Debug("Closing file descriptors\n");
     
     }
 
 
-// Sets the IoT Hub authentication state for the app
-// The SAS Token expires which will set the authentication state
-
-static void HubConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result,
-                                        IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
-                                        void *userContextCallback)
-{
-    iothubAuthenticated = (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED);
-    Log_Debug("IoT Hub Authenticated: %s\n", GetReasonString(reason));
-}
-
-
-// Sets up the Azure IoT Hub connection (creates the iothubClientHandle)
-// When the SAS Token for a device expires the connection needs to be recreated
-// which is why this is not simply a one time call.
-
-static void SetupAzureClient(void)
-{
-    if (iothubClientHandle != NULL) {
-        IoTHubDeviceClient_LL_Destroy(iothubClientHandle);
-    }
-
-    AZURE_SPHERE_PROV_RETURN_VALUE provResult =
-        IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning(scopeId, 10000,
-                                                                          &iothubClientHandle);
-    Log_Debug("IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning returned '%s'.\n",
-              getAzureSphereProvisioningResultString(provResult));
-
-    if (provResult.result != AZURE_SPHERE_PROV_RESULT_OK) {
-
-        // If fail to connect, reduce the polling frequency, starting at
-        // AzureIoTMinReconnectPeriodSeconds and with a backoff up to
-        // AzureIoTMaxReconnectPeriodSeconds
-        if (azureIoTPollPeriodSeconds == AzureIoTDefaultPollPeriodSeconds) {
-            azureIoTPollPeriodSeconds = AzureIoTMinReconnectPeriodSeconds;
-        } else {
-            azureIoTPollPeriodSeconds *= 2;
-            if (azureIoTPollPeriodSeconds > AzureIoTMaxReconnectPeriodSeconds) {
-                azureIoTPollPeriodSeconds = AzureIoTMaxReconnectPeriodSeconds;
-            }
-        }
-
-        struct timespec azureTelemetryPeriod = {azureIoTPollPeriodSeconds, 0};
-        SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
-
-        Log_Debug("ERROR: failure to create IoTHub Handle - will retry in %i seconds.\n",
-                  azureIoTPollPeriodSeconds);
-        return;
-    }
-
-    // Successfully connected, so make sure the polling frequency is back to the default
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = {.tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0};
-    SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
-
-    iothubAuthenticated = true;
-
-    if (IoTHubDeviceClient_LL_SetOption(iothubClientHandle, OPTION_KEEP_ALIVE,
-                                        &keepalivePeriodSeconds) != IOTHUB_CLIENT_OK) {
-        Log_Debug("ERROR: failure setting option \"%s\"\n", OPTION_KEEP_ALIVE);
-        return;
-    }
-
-    IoTHubDeviceClient_LL_SetDeviceTwinCallback(iothubClientHandle, TwinCallback, NULL);
-    IoTHubDeviceClient_LL_SetConnectionStatusCallback(iothubClientHandle,
-                                                      HubConnectionStatusCallback, NULL);
-}
-
-
-// Callback invoked when a Device Twin update is received from IoT Hub.
-// Updates local state for 'showEvents' (bool).
-// <param name="payload">contains the Device Twin JSON document (desired and reported)</param>
-// <param name="payloadSize">size of the Device Twin JSON document</param>
-static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload,
-                         size_t payloadSize, void *userContextCallback)
-{
-    size_t nullTerminatedJsonSize = payloadSize + 1;
-    char *nullTerminatedJsonString = (char *)malloc(nullTerminatedJsonSize);
-    if (nullTerminatedJsonString == NULL) {
-        Log_Debug("ERROR: Could not allocate buffer for twin update payload.\n");
-        abort();
-    }
-
-    // Copy the provided buffer to a null terminated buffer.
-    memcpy(nullTerminatedJsonString, payload, payloadSize);
-    // Add the null terminator at the end.
-    nullTerminatedJsonString[nullTerminatedJsonSize - 1] = 0;
-
-    JSON_Value *rootProperties = NULL;
-    rootProperties = json_parse_string(nullTerminatedJsonString);
-    if (rootProperties == NULL) {
-        Log_Debug("WARNING: Cannot parse the string as JSON content.\n");
-        goto cleanup;
-    }
-
-    JSON_Object *rootObject = json_value_get_object(rootProperties);
-    JSON_Object *desiredProperties = json_object_dotget_object(rootObject, "desired");
-    if (desiredProperties == NULL) {
-        desiredProperties = rootObject;
-    }
-
-
-cleanup:
-    // Release the allocated memory.
-    json_value_free(rootProperties);
-    free(nullTerminatedJsonString);
-}
-
-// Converts the IoT Hub connection status reason to a string.
-static const char *GetReasonString(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
-{
-    static char *reasonString = "unknown reason";
-    switch (reason) {
-    case IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_NO_NETWORK:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_NO_NETWORK";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_OK:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_OK"; // must be always this
-        break;
-    }
-    return reasonString;
-}
-
-
-// Converts AZURE_SPHERE_PROV_RETURN_VALUE to a string.
-
-static const char *getAzureSphereProvisioningResultString(
-    AZURE_SPHERE_PROV_RETURN_VALUE provisioningResult)
-{
-    switch (provisioningResult.result) {
-    case AZURE_SPHERE_PROV_RESULT_OK:
-        return "AZURE_SPHERE_PROV_RESULT_OK"; // must be this
-    case AZURE_SPHERE_PROV_RESULT_INVALID_PARAM:
-        return "AZURE_SPHERE_PROV_RESULT_INVALID_PARAM";
-    case AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY:
-        return "AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY";
-    case AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY:
-        return "AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY";
-    case AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR:
-        return "AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR";
-    case AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR:
-        return "AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR";
-    default:
-        return "UNKNOWN_RETURN_VALUE";
-    }
-}
-
-
-// Sends telemetry to IoT Hub
-// <param name="key">The telemetry item to update</param>
-// <param name="value">new telemetry value</param>
-static void SendTelemetry(const unsigned char *key, const unsigned char *value)
-{
-    static char eventBuffer[100] = {0};
-    static const char *EventMsgTemplate = "{ \"%s\": \"%s\" }";
-    int len = snprintf(eventBuffer, sizeof(eventBuffer), EventMsgTemplate, key, value);
-    if (len < 0)
-        return;
-
-    Log_Debug("Sending IoT Central Message: %s\n", eventBuffer);
-
-    bool isNetworkingReady = false;
-
-    if ((Networking_IsNetworkingReady(&isNetworkingReady) == -1) || !isNetworkingReady) {
-        Log_Debug("WARNING: Cannot send IoT Central Message because network is not up.\n");
-        return;
-    }
-
-    IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromString(eventBuffer);
-
-    if (messageHandle == 0) {
-        Log_Debug("WARNING: unable to create a new IoT Central Message\n");
-        return;
-    }
-
-    if (IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle, SendMessageCallback,
-                                             /*&callback_param*/ 0) != IOTHUB_CLIENT_OK) {
-        Log_Debug("WARNING: failed to hand over the message to IoT Central Client\n");
-    } else {
-        Log_Debug("INFO: IoT Central accepted the message for delivery\n");
-    }
-    
-    IoTHubMessage_Destroy(messageHandle);
-}
-
-
-// Callback confirming message delivered to IoT Hub.
-// <param name="result">Message delivery status</param>
-// <param name="context">User specified context</param>
-static void SendMessageCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context)
-{
-    Log_Debug("INFO: Message received by IoT Central. Result is: %d\n", result);
-}
-
-
-// Creates and enqueues a report containing the name and value pair of a Device Twin reported
-// property. The report is not sent immediately, but it is sent on the next invocation of
-// IoTHubDeviceClient_LL_DoWork().
-// <param name="propertyName">the IoT Hub Device Twin property name</param>
-// <param name="propertyValue">the IoT Hub Device Twin property value</param>
-static void TwinReportBoolState(const char *propertyName, bool propertyValue)
-{
-    if (iothubClientHandle == NULL) {
-        Log_Debug("ERROR: client not initialized\n");
-    } else {
-        static char reportedPropertiesString[30] = {0};
-        int len = snprintf(reportedPropertiesString, 30, "{\"%s\":%s}", propertyName,
-                           (propertyValue == true ? "true" : "false"));
-        if (len < 0)
-            return;
-
-        if (IoTHubDeviceClient_LL_SendReportedState(
-                iothubClientHandle, (unsigned char *)reportedPropertiesString,
-                strlen(reportedPropertiesString), ReportStatusCallback, 0) != IOTHUB_CLIENT_OK) {
-            Log_Debug("ERROR: failed to set reported state for '%s'.\n", propertyName);
-        } else {
-            Log_Debug("INFO: Reported state for '%s' to value '%s'.\n", propertyName,
-                      (propertyValue == true ? "true" : "false"));
-        }
-    }
-}
-
-
-// Callback invoked when the Device Twin reported properties are accepted by IoT Hub.
-static void ReportStatusCallback(int result, void *context)
-{
-    Log_Debug("INFO: Device Twin reported properties update result: HTTP status code %d\n", result);
-}
-
 static void CloseFdAndPrintError(int fd, const char* fdName)
 {
     if (fd >= 0) {
@@ -553,7 +252,7 @@ static void AdcPollingEventHandler(EventLoopTimer* timer)
 
     char cLux[10]; //size of the number
     sprintf(cLux, "%g", Lux); // buffer
-    SendTelemetry("LUX", cLux); // for graphic visualization
+    AzureConnection_SendTelemetryValue("LUX", cLux); // for graphic visualization
     
 }
 
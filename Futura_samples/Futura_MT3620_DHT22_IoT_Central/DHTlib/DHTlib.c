@@ -161,10 +161,9 @@ DHT_SensorData * DHT_ReadData(GPIO_Id gpioPin)
 		return &dhtLastReading; // OK
 	}
 	else {
-		Log_Debug("[DHT] Humidity = %.1f %% Temperature = %.1f *C (%.1f *F)\n", 
-			dhtLastReading.Humidity,
-			dhtLastReading.TemperatureCelsius,
-			dhtLastReading.TemperatureFahrenheit);
-		return &dhtLastReading; // OK		
+		// do not hand out the previous reading as if it were new
+		Log_Debug("[DHT] ERROR: %u bits read, checksum %s\n", uBitCount,
+			(data[4] == ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) ? "ok" : "mismatch");
+		return NULL;
 	}
 }
@@ -18,7 +18,7 @@
 
 #include "hw/avnet_mt3620_sk.h"
 #include "deviceTwin.h"
-#include "azure_iot_utilities.h"
+#include "azure_connection.h"
 #include "parson.h"
 
 
@@ -133,7 +133,7 @@ void checkAndUpdateDeviceTwin(char* property, void* value, data_type_t type, boo
 
 		if (nJsonLength > 0) {
 			Log_Debug("[MCU] Updating device twin: %s\n", pjsonBuffer);
-			AzureIoT_TwinReportStateJson(pjsonBuffer, (size_t)nJsonLength);
+			AzureConnection_ReportState(pjsonBuffer);
 		}
 		free(pjsonBuffer);
 	}
@@ -15,17 +15,16 @@
 
 #include "hw/sample_hardware.h"
 #include "deviceTwin.h"
-#include "azure_iot_utilities.h"
+#include "azure_connection.h"
 #include <applibs/log.h>
 #include <applibs/gpio.h>
 #include <applibs/wificonfig.h>
-#include <azureiot/iothub_device_client_ll.h>
+#include <applibs/eventloop.h>
 
 
 // Provide local access to variables in other files
 extern twin_t twinArray[];
 extern int twinArraySize;
-extern IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle;
 
 // Support functions.
 static void TerminationHandler(int signalNumber);
@@ -35,6 +34,9 @@ static void ClosePeripheralsAndHandlers(void);
 // File descriptors - initialized to invalid value
 int epollFd = -1;
 
+// The IoT Hub connection manager runs on an EventLoop, nested in epoll via its wait descriptor
+static EventLoop *eventLoop = NULL;
+
 static int buttonPollTimerFd = -1;
 static int button1GpioFd = -1;
 static int button2GpioFd = -1;
@@ -68,6 +70,11 @@ bool versionStringSent = false;
 // Define the Json string format for the accelerator button press data
 static const char cstrButtonTelemetryJson[] = "{\"%s\":\"%d\"}";
 
+// Device Twin documents are parsed in situ into this arena, without using the heap as long
+// as they fit: see TWIN_ARENA_SIZE.
+static char twinArenaBuffer[TWIN_ARENA_SIZE];
+static JSON_Arena twinArena;
+
 // Termination state
 volatile sig_atomic_t terminationRequired = false;
 
@@ -314,21 +321,21 @@ static void ButtonTimerEventHandler(EventData* eventData)
 			// construct the telemetry message  for Button 1
 			snprintf(pjsonBuffer, JSON_BUFFER_SIZE, cstrButtonTelemetryJson, "button1", !newbutton1State);
 			Log_Debug("\n[Info] Sending telemetry %s\n", pjsonBuffer);
-			AzureIoT_SendMessage(pjsonBuffer);
+			AzureConnection_SendTelemetry(pjsonBuffer);
 		}
 
 		if (sendTelemetrybutton2) {
 			// construct the telemetry message for Button 2
 			snprintf(pjsonBuffer, JSON_BUFFER_SIZE, cstrButtonTelemetryJson, "button2", newbutton2State);
 			Log_Debug("\n[Info] Sending telemetry %s\n", pjsonBuffer);
-			AzureIoT_SendMessage(pjsonBuffer);
+			AzureConnection_SendTelemetry(pjsonBuffer);
 		}
 
 		if (sendTelemetrybutton3) {
 			// construct the telemetry message for Button 3
 			snprintf(pjsonBuffer, JSON_BUFFER_SIZE, cstrButtonTelemetryJson, "button3", newbutton3State);
 			Log_Debug("\n[Info] Sending telemetry %s\n", pjsonBuffer);
-			AzureIoT_SendMessage(pjsonBuffer);
+			AzureConnection_SendTelemetry(pjsonBuffer);
 		}
 
 		free(pjsonBuffer);
@@ -336,8 +343,46 @@ static void ButtonTimerEventHandler(EventData* eventData)
 
 }
 
+/// <summary>
+///     Parses a Device Twin document and passes its desired properties to the twin table.
+/// </summary>
+static void TwinUpdateHandler(char* json)
+{
+	json_arena_init(&twinArena, twinArenaBuffer, sizeof(twinArenaBuffer));
+	JSON_Value* rootProperties = json_parse_string_in_situ(json, &twinArena);
+	if (rootProperties == NULL) {
+		Log_Debug("WARNING: Cannot parse the string as JSON content.\n");
+		json_arena_reset(&twinArena);
+		return;
+	}
+	if (json_arena_overflow_size(&twinArena) > 0) {
+		Log_Debug("WARNING: Device Twin took %zu bytes from the heap beyond the %d-byte arena.\n",
+				  json_arena_overflow_size(&twinArena), TWIN_ARENA_SIZE);
+	}
+
+	JSON_Object* rootObject = json_value_get_object(rootProperties);
+	JSON_Object* desiredProperties = json_object_dotget_object(rootObject, "desired");
+	if (desiredProperties == NULL) {
+		desiredProperties = rootObject;
+	}
+	deviceTwinChangedHandler(desiredProperties);
+
+	json_arena_reset(&twinArena);
+}
+
+/// <summary>
+///     Dispatches the events of the nested EventLoop.
+/// </summary>
+static void EventLoopEventHandler(EventData* eventData)
+{
+	if (EventLoop_Run(eventLoop, 0, true) == EventLoop_Run_Failed && errno != EINTR) {
+		terminationRequired = true;
+	}
+}
+
 // event handler data structures. Only the event handler field needs to be populated.
 static EventData buttonEventData = { .eventHandler = &ButtonTimerEventHandler };
+static EventData eventLoopEventData = { .eventHandler = &EventLoopEventHandler };
 
 
 
@@ -453,11 +498,25 @@ static int InitPeripheralsAndHandlers(void)
 		return -1;
 	}
 
-	// Tell the system about the callback function that gets called when we receive a device twin update message from Azure
-	AzureIoT_SetDeviceTwinUpdateCallback(&deviceTwinChangedHandler);
+	eventLoop = EventLoop_Create();
+	if (eventLoop == NULL) {
+		Log_Debug("ERROR: Could not create event loop.\n");
+		return -1;
+	}
+	if (RegisterEventHandlerToEpoll(epollFd, EventLoop_GetWaitDescriptor(eventLoop),
+		&eventLoopEventData, EPOLLIN) != 0) {
+		return -1;
+	}
 
-	// Tell the system about the callback function to call when we receive a Direct Method message from Azure
-	AzureIoT_SetDirectMethodCallback(&DirectMethodCall);
+#if (defined(IOT_CENTRAL_APPLICATION) )
+	// Device twin updates go to the twin table and Direct Method calls to DirectMethodCall
+	AzureConnection_Config azureConfig = { .scopeId = scopeId,
+										   .twinUpdate = &TwinUpdateHandler,
+										   .directMethod = &DirectMethodCall };
+	if (AzureConnection_Init(eventLoop, &azureConfig) != 0) {
+		return -1;
+	}
+#endif
 
 	return 0;
 }
@@ -469,7 +528,12 @@ static void ClosePeripheralsAndHandlers(void)
 {
 	Log_Debug("Closing file descriptors.\n");
 
-	
+#if (defined(IOT_CENTRAL_APPLICATION) )
+	AzureConnection_Cleanup();
+#endif
+	if (eventLoop != NULL) {
+		EventLoop_Close(eventLoop);
+	}
 	CloseFdAndPrintError(epollFd, "Epoll");
 	CloseFdAndPrintError(buttonPollTimerFd, "buttonPoll");
 	CloseFdAndPrintError(button1GpioFd, "button1");
@@ -523,30 +587,16 @@ int main(int argc, char* argv[])
 			terminationRequired = true;
 		}
 
-#if (defined(IOT_CENTRAL_APPLICATION) )
-		// Setup the IoT Hub client.
-		// Notes:
-		// - it is safe to call this function even if the client has already been set up, as in
-		//   this case it would have no effect;
-		// - a failure to setup the client is a fatal error.
-		if (!AzureIoT_SetupClient()) {
-			Log_Debug("ERROR: Failed to set up IoT Hub client\n");
-			Log_Debug("ERROR: Verify network connection and Azure Resource configurations\n");
-		}
-#endif 
-
 		WifiConfig_ConnectedNetwork network;
 		int result = WifiConfig_GetCurrentNetwork(&network);
 
 #if (defined(IOT_CENTRAL_APPLICATION) )
-		if (iothubClientHandle != NULL && !versionStringSent) {
+		if (AzureConnection_IsConnected() && !versionStringSent) {
 
 			#warning "If you need to update the version string do so in main.c ~line 740!"
 				checkAndUpdateDeviceTwin("versionString", "FUTURA MT3620", TYPE_STRING, false);
 			versionStringSent = true;
 		}
-
-		AzureIoT_DoPeriodicTasks();
 #endif
 	}
 
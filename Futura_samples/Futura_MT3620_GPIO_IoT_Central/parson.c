@@ -3,6 +3,8 @@
     https://github.com/kgabis/parson at commit id 4f3eaa6
     Patched to avoid any usage of fopen(), and removed implicit
     cast warnings by making them explicit.
+    Added json_parse_string_in_situ, which parses into a caller-supplied arena.
+    Added a hash index to objects with many keys.
 */
 
 /*
@@ -35,6 +37,7 @@
 
 #include "parson.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -47,6 +50,15 @@
 #define sscanf THINK_TWICE_ABOUT_USING_SSCANF
 
 #define STARTING_CAPACITY 16
+/* Arena parses start small: the old arrays are not reclaimed when an object or array grows */
+#define ARENA_STARTING_CAPACITY 4
+#define ARENA_ALIGNMENT sizeof(double)
+/* Objects with more keys than this get a hash index; smaller ones are scanned, comparing the
+   stored hashes and lengths before the names, which is as fast up to a few dozen keys.
+   tests/parson_lookup_bench measures both. */
+#ifndef HASH_INDEX_THRESHOLD
+#define HASH_INDEX_THRESHOLD 16
+#endif
 #define MAX_NESTING 2048
 
 #define FLOAT_FORMAT "%1.17g" /* do not increase precision without incresing NUM_BUF_SIZE */
@@ -67,6 +79,10 @@
 static JSON_Malloc_Function parson_malloc = malloc;
 static JSON_Free_Function parson_free = free;
 
+/* Set while json_parse_string_in_situ runs: parson_malloc then allocates from this arena,
+   parson_free does nothing and strings are decoded in place. */
+static JSON_Arena *parse_arena = NULL;
+
 #define IS_CONT(b) (((unsigned char)(b)&0xC0) == 0x80) /* is utf-8 continuation byte */
 
 /* Type definitions */
@@ -85,10 +101,18 @@ struct json_value_t {
     JSON_Value_Value value;
 };
 
+typedef struct json_key_t {
+    unsigned long hash;
+    size_t length;
+} JSON_Key;
+
 struct json_object_t {
     JSON_Value *wrapping_value;
     char **names;
     JSON_Value **values;
+    JSON_Key *keys; /* hash and length of each name */
+    size_t *index;  /* open addressing table of positions + 1, 0 if empty; NULL for small objects */
+    size_t index_capacity;
     size_t count;
     size_t capacity;
 };
@@ -102,6 +126,8 @@ struct json_array_t {
 
 /* Various */
 static void remove_comments(char *string, const char *start_token, const char *end_token);
+static void *arena_malloc(size_t size);
+static void arena_free(void *ptr);
 static char *parson_strndup(const char *string, size_t n);
 static char *parson_strdup(const char *string);
 static int hex_char_to_int(char c);
@@ -117,6 +143,9 @@ static JSON_Status json_object_add(JSON_Object *object, const char *name, JSON_V
 static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_t name_len,
                                     JSON_Value *value);
 static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity);
+static unsigned long hash_string(const char *string, size_t n);
+static void json_object_index_insert(JSON_Object *object, size_t position);
+static void json_object_rebuild_index(JSON_Object *object);
 static JSON_Value *json_object_getn_value(const JSON_Object *object, const char *name,
                                           size_t name_len);
 static JSON_Status json_object_remove_internal(JSON_Object *object, const char *name,
@@ -171,6 +200,33 @@ static char *parson_strdup(const char *string)
     return parson_strndup(string, strlen(string));
 }
 
+static void *arena_malloc(size_t size)
+{
+    uintptr_t base = (uintptr_t)parse_arena->buffer;
+    uintptr_t aligned =
+        (base + parse_arena->used + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1);
+    size_t offset = (size_t)(aligned - base);
+    if (offset > parse_arena->size || size > parse_arena->size - offset) {
+        /* Full: take a heap block, with the link to the previous one in front */
+        char *block = NULL;
+        if (size > (size_t)-1 - ARENA_ALIGNMENT ||
+            (block = (char *)malloc(ARENA_ALIGNMENT + size)) == NULL) {
+            return NULL;
+        }
+        *(void **)block = parse_arena->overflow;
+        parse_arena->overflow = block;
+        parse_arena->overflow_size += size;
+        return block + ARENA_ALIGNMENT;
+    }
+    parse_arena->used = offset + size;
+    return parse_arena->buffer + offset;
+}
+
+static void arena_free(void *ptr)
+{
+    (void)ptr; /* released all at once by json_arena_reset */
+}
+
 static int hex_char_to_int(char c)
 {
     if (c >= '0' && c <= '9') {
@@ -332,6 +388,9 @@ static JSON_Object *json_object_init(JSON_Value *wrapping_value)
     new_obj->wrapping_value = wrapping_value;
     new_obj->names = (char **)NULL;
     new_obj->values = (JSON_Value **)NULL;
+    new_obj->keys = (JSON_Key *)NULL;
+    new_obj->index = (size_t *)NULL;
+    new_obj->index_capacity = 0;
     new_obj->capacity = 0;
     new_obj->count = 0;
     return new_obj;
@@ -356,19 +415,28 @@ static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_
         return JSONFailure;
     }
     if (object->count >= object->capacity) {
-        size_t new_capacity = MAX(object->capacity * 2, STARTING_CAPACITY);
+        size_t new_capacity = MAX(object->capacity * 2, parse_arena != NULL ? ARENA_STARTING_CAPACITY
+                                                                             : STARTING_CAPACITY);
         if (json_object_resize(object, new_capacity) == JSONFailure) {
             return JSONFailure;
         }
     }
     index = object->count;
-    object->names[index] = parson_strndup(name, name_len);
+    /* In situ, keys are already NUL-terminated in the parsed string */
+    object->names[index] = parse_arena != NULL ? (char *)name : parson_strndup(name, name_len);
     if (object->names[index] == NULL) {
         return JSONFailure;
     }
+    object->keys[index].hash = hash_string(name, name_len);
+    object->keys[index].length = name_len;
     value->parent = json_object_get_wrapping_value(object);
     object->values[index] = value;
     object->count++;
+    if (object->index != NULL && object->count * 2 <= object->index_capacity) {
+        json_object_index_insert(object, index);
+    } else if (object->count > HASH_INDEX_THRESHOLD) {
+        json_object_rebuild_index(object);
+    }
     return JSONSuccess;
 }
 
@@ -376,6 +444,7 @@ static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity)
 {
     char **temp_names = NULL;
     JSON_Value **temp_values = NULL;
+    JSON_Key *temp_keys = NULL;
 
     if ((object->names == NULL && object->values != NULL) ||
         (object->names != NULL && object->values == NULL) || new_capacity == 0) {
@@ -390,28 +459,97 @@ static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity)
         parson_free(temp_names);
         return JSONFailure;
     }
+    temp_keys = (JSON_Key *)parson_malloc(new_capacity * sizeof(JSON_Key));
+    if (temp_keys == NULL) {
+        parson_free(temp_names);
+        parson_free(temp_values);
+        return JSONFailure;
+    }
     if (object->names != NULL && object->values != NULL && object->count > 0) {
         memcpy(temp_names, object->names, object->count * sizeof(char *));
         memcpy(temp_values, object->values, object->count * sizeof(JSON_Value *));
+        memcpy(temp_keys, object->keys, object->count * sizeof(JSON_Key));
     }
     parson_free(object->names);
     parson_free(object->values);
+    parson_free(object->keys);
     object->names = temp_names;
     object->values = temp_values;
+    object->keys = temp_keys;
     object->capacity = new_capacity;
     return JSONSuccess;
 }
 
+/* FNV-1a */
+static unsigned long hash_string(const char *string, size_t n)
+{
+    unsigned long hash = 2166136261UL;
+    size_t i;
+    for (i = 0; i < n; i++) {
+        hash ^= (unsigned char)string[i];
+        hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return hash;
+}
+
+static void json_object_index_insert(JSON_Object *object, size_t position)
+{
+    size_t mask = object->index_capacity - 1;
+    size_t slot = (size_t)object->keys[position].hash & mask;
+    while (object->index[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    object->index[slot] = position + 1;
+}
+
+/* Sizes the index for twice the current count, or drops it below the threshold. Without
+   memory for it the object is scanned, which is slower but correct. */
+static void json_object_rebuild_index(JSON_Object *object)
+{
+    size_t i, capacity = 1;
+    parson_free(object->index);
+    object->index = NULL;
+    object->index_capacity = 0;
+    if (object->count <= HASH_INDEX_THRESHOLD) {
+        return;
+    }
+    while (capacity < object->count * 2) {
+        capacity *= 2;
+    }
+    object->index = (size_t *)parson_malloc(capacity * sizeof(size_t));
+    if (object->index == NULL) {
+        return;
+    }
+    memset(object->index, 0, capacity * sizeof(size_t));
+    object->index_capacity = capacity;
+    for (i = 0; i < object->count; i++) {
+        json_object_index_insert(object, i);
+    }
+}
+
 static JSON_Value *json_object_getn_value(const JSON_Object *object, const char *name,
                                           size_t name_len)
 {
-    size_t i, name_length;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        name_length = strlen(object->names[i]);
-        if (name_length != name_len) {
-            continue;
+    size_t i, slot, mask;
+    unsigned long hash;
+    if (object == NULL || object->count == 0) {
+        return NULL;
+    }
+    hash = hash_string(name, name_len);
+    if (object->index != NULL) {
+        mask = object->index_capacity - 1;
+        for (slot = (size_t)hash & mask; object->index[slot] != 0; slot = (slot + 1) & mask) {
+            i = object->index[slot] - 1;
+            if (object->keys[i].hash == hash && object->keys[i].length == name_len &&
+                memcmp(object->names[i], name, name_len) == 0) {
+                return object->values[i];
+            }
         }
-        if (strncmp(object->names[i], name, name_len) == 0) {
+        return NULL;
+    }
+    for (i = 0; i < object->count; i++) {
+        if (object->keys[i].hash == hash && object->keys[i].length == name_len &&
+            memcmp(object->names[i], name, name_len) == 0) {
             return object->values[i];
         }
     }
@@ -435,8 +573,12 @@ static JSON_Status json_object_remove_internal(JSON_Object *object, const char *
             if (i != last_item_index) { /* Replace key value pair with one from the end */
                 object->names[i] = object->names[last_item_index];
                 object->values[i] = object->values[last_item_index];
+                object->keys[i] = object->keys[last_item_index];
             }
             object->count -= 1;
+            if (object->index != NULL) {
+                json_object_rebuild_index(object);
+            }
             return JSONSuccess;
         }
     }
@@ -469,6 +611,8 @@ static void json_object_free(JSON_Object *object)
     }
     parson_free(object->names);
     parson_free(object->values);
+    parson_free(object->keys);
+    parson_free(object->index);
     parson_free(object);
 }
 
@@ -489,7 +633,8 @@ static JSON_Array *json_array_init(JSON_Value *wrapping_value)
 static JSON_Status json_array_add(JSON_Array *array, JSON_Value *value)
 {
     if (array->count >= array->capacity) {
-        size_t new_capacity = MAX(array->capacity * 2, STARTING_CAPACITY);
+        size_t new_capacity = MAX(array->capacity * 2, parse_arena != NULL ? ARENA_STARTING_CAPACITY
+                                                                           : STARTING_CAPACITY);
         if (json_array_resize(array, new_capacity) == JSONFailure) {
             return JSONFailure;
         }
@@ -613,7 +758,8 @@ static int parse_utf16(const char **unprocessed, char **processed)
     return JSONSuccess;
 }
 
-/* Copies and processes passed string up to supplied length.
+/* Copies and processes passed string up to supplied length, or processes it in place while
+parsing in situ: escapes never decode to more bytes than they take.
 Example: "\u006Corem ipsum" -> lorem ipsum */
 static char *process_string(const char *input, size_t len)
 {
@@ -621,7 +767,11 @@ static char *process_string(const char *input, size_t len)
     size_t initial_size = (len + 1) * sizeof(char);
     size_t final_size = 0;
     char *output = NULL, *output_ptr = NULL, *resized_output = NULL;
-    output = (char *)parson_malloc(initial_size);
+    if (parse_arena != NULL) {
+        output = (char *)input;
+    } else {
+        output = (char *)parson_malloc(initial_size);
+    }
     if (output == NULL) {
         goto error;
     }
@@ -672,6 +822,9 @@ static char *process_string(const char *input, size_t len)
         input_ptr++;
     }
     *output_ptr = '\0';
+    if (parse_arena != NULL) {
+        return output;
+    }
     /* resize to new length */
     final_size = (size_t)(output_ptr - output) + 1;
     /* todo: don't resize if final_size == initial_size */
@@ -683,7 +836,9 @@ static char *process_string(const char *input, size_t len)
     parson_free(output);
     return resized_output;
 error:
-    parson_free(output);
+    if (parse_arena == NULL) {
+        parson_free(output);
+    }
     return NULL;
 }
 
@@ -790,8 +945,9 @@ static JSON_Value *parse_object_value(const char **string, size_t nesting)
         SKIP_WHITESPACES(string);
     }
     SKIP_WHITESPACES(string);
-    if (**string != '}' || /* Trim object after parsing is over */
-        json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure) {
+    if (**string != '}' || /* Trim object after parsing is over, unless it lives in an arena */
+        (parse_arena == NULL &&
+         json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure)) {
         json_value_free(output_value);
         return NULL;
     }
@@ -837,8 +993,9 @@ static JSON_Value *parse_array_value(const char **string, size_t nesting)
         SKIP_WHITESPACES(string);
     }
     SKIP_WHITESPACES(string);
-    if (**string != ']' || /* Trim array after parsing is over */
-        json_array_resize(output_array, json_array_get_count(output_array)) == JSONFailure) {
+    if (**string != ']' || /* Trim array after parsing is over, unless it lives in an arena */
+        (parse_arena == NULL &&
+         json_array_resize(output_array, json_array_get_count(output_array)) == JSONFailure)) {
         json_value_free(output_value);
         return NULL;
     }
@@ -1241,6 +1398,57 @@ JSON_Value *json_parse_string_with_comments(const char *string)
     return result;
 }
 
+void json_arena_init(JSON_Arena *arena, void *buffer, size_t size)
+{
+    arena->buffer = (char *)buffer;
+    arena->size = size;
+    arena->used = 0;
+    arena->overflow = NULL;
+    arena->overflow_size = 0;
+}
+
+void json_arena_reset(JSON_Arena *arena)
+{
+    while (arena->overflow != NULL) {
+        void *block = arena->overflow;
+        arena->overflow = *(void **)block;
+        free(block);
+    }
+    arena->overflow_size = 0;
+    arena->used = 0;
+}
+
+size_t json_arena_overflow_size(const JSON_Arena *arena)
+{
+    return arena->overflow_size;
+}
+
+JSON_Value *json_parse_string_in_situ(char *string, JSON_Arena *arena)
+{
+    JSON_Malloc_Function saved_malloc = parson_malloc;
+    JSON_Free_Function saved_free = parson_free;
+    JSON_Value *result = NULL;
+    size_t used = 0;
+    if (string == NULL || arena == NULL) {
+        return NULL;
+    }
+    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
+    }
+    used = arena->used;
+    parse_arena = arena;
+    parson_malloc = arena_malloc;
+    parson_free = arena_free;
+    result = parse_value((const char **)&string, 0);
+    parson_malloc = saved_malloc;
+    parson_free = saved_free;
+    parse_arena = NULL;
+    if (result == NULL) {
+        arena->used = used; /* drop the nodes of the failed parse; heap blocks wait for reset */
+    }
+    return result;
+}
+
 /* JSON Object API */
 
 JSON_Value *json_object_get_value(const JSON_Object *object, const char *name)
@@ -2032,6 +2240,7 @@ JSON_Status json_object_clear(JSON_Object *object)
         json_value_free(object->values[i]);
     }
     object->count = 0;
+    json_object_rebuild_index(object);
     return JSONSuccess;
 }
 
@@ -3,6 +3,7 @@
     https://github.com/kgabis/parson at commit id 4f3eaa6
     Patched to avoid any usage of fopen(), and removed implicit
     cast warnings by making them explicit.
+    Added json_parse_string_in_situ, which parses into a caller-supplied arena.
 */
 
 /*
@@ -59,6 +60,16 @@ typedef int JSON_Status;
 typedef void *(*JSON_Malloc_Function)(size_t);
 typedef void (*JSON_Free_Function)(void *);
 
+/* Bump allocator for json_parse_string_in_situ. Once the buffer is full, allocations fall
+   back to heap blocks, released with the rest by json_arena_reset. Fields are private. */
+typedef struct json_arena_t {
+    char *buffer;
+    size_t size;
+    size_t used;
+    void *overflow;       /* heap blocks, linked through their first bytes */
+    size_t overflow_size; /* bytes allocated in them */
+} JSON_Arena;
+
 /* Call only once, before calling any other function from parson API. If not called, malloc and free
    from stdlib will be used for all allocations */
 void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Function free_fun);
@@ -70,6 +81,23 @@ JSON_Value *json_parse_string(const char *string);
     returns NULL in case of error */
 JSON_Value *json_parse_string_with_comments(const char *string);
 
+/* Uses size bytes at buffer for json_parse_string_in_situ */
+void json_arena_init(JSON_Arena *arena, void *buffer, size_t size);
+
+/* Releases every value parsed into the arena at once */
+void json_arena_reset(JSON_Arena *arena);
+
+/* Bytes allocated from the heap because the buffer was full, since the last reset */
+size_t json_arena_overflow_size(const JSON_Arena *arena);
+
+/*  Parses first JSON value in a mutable string without using the heap, as long as the arena
+    buffer suffices: values, objects and arrays are allocated from the arena and strings are decoded in place, so the string must
+    outlive the result. The result is read-only: release it with json_arena_reset, never with
+    json_value_free, and do not pass it to functions that modify values. Returns NULL in case
+    of error, including when the heap is exhausted too; the string is then left partly
+    decoded. */
+JSON_Value *json_parse_string_in_situ(char *string, JSON_Arena *arena);
+
 /* Serialization */
 size_t json_serialization_size(const JSON_Value *value); /* returns 0 on fail */
 JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes);
@@ -0,0 +1,151 @@
+/* Futura MT3620 GPIO IoT Central: benchmark of the parson object key lookup.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Parses objects of 4 to 512 keys named as twin properties, then looks their keys up, with
+// as many misses as hits, two ways: with json_object_get_value, and with the scan of
+// json_object_getn_value before the hash index, a strlen and a strncmp per entry, run here
+// over json_object_get_name. Reports the time per lookup of each, and the time to parse the
+// object, whose duplicate check makes one lookup per key. Both lookups must agree on every
+// key.
+//
+// parson_lookup_bench uses the index above HASH_INDEX_THRESHOLD keys, as the image does;
+// parson_lookup_bench_scan never builds it, to measure the hashed scan alone. Together they
+// give the crossover which sets the threshold.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parson.h"
+
+#define LOOKUPS 1000000
+#define RUNS 5
+#define MAX_KEYS 512
+
+static unsigned long failures = 0;
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %lu\n", what, n);
+    }
+}
+
+static double NowSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+// The lookup before the hash index
+static JSON_Value *ScanLookup(const JSON_Object *object, const char *name, size_t nameLength)
+{
+    size_t count = json_object_get_count(object);
+    for (size_t i = 0; i < count; i++) {
+        const char *key = json_object_get_name(object, i);
+        if (strlen(key) != nameLength) {
+            continue;
+        }
+        if (strncmp(key, name, nameLength) == 0) {
+            return json_object_get_value_at(object, i);
+        }
+    }
+    return NULL;
+}
+
+// Key k: the present ones are even, the absent ones odd, in a mixed order
+static void KeyName(unsigned k, char *name, size_t size)
+{
+    static const char *const stems[] = {"StatusLED", "Relay", "Temperature", "desiredVersion"};
+    snprintf(name, size, "%s%u", stems[k % 4], k);
+}
+
+int main(void)
+{
+    static char document[MAX_KEYS * 40 + 16];
+    static char names[2 * MAX_KEYS][32];
+    static size_t lengths[2 * MAX_KEYS];
+    static unsigned order[4096];
+
+    printf("%5s  %10s  %10s  %10s\n", "keys", "before ns", "parson ns", "parse us");
+    for (unsigned keys = 4; keys <= MAX_KEYS; keys *= 2) {
+        size_t length = 0;
+        document[length++] = '{';
+        for (unsigned k = 0; k < 2 * keys; ++k) {
+            KeyName(k, names[k], sizeof(names[k]));
+            lengths[k] = strlen(names[k]);
+            if (k % 2 == 0) {
+                length += (size_t)snprintf(document + length, sizeof(document) - length,
+                                           "%s\"%s\":%u", length > 1 ? "," : "", names[k], k);
+            }
+        }
+        document[length++] = '}';
+        document[length] = '\0';
+
+        uint32_t rng = 0x9E3779B9u ^ keys;
+        for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); ++i) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            order[i] = rng % (2 * keys);
+        }
+
+        double parseSeconds = 1e9;
+        JSON_Value *root = NULL;
+        for (int run = 0; run < RUNS; ++run) {
+            json_value_free(root);
+            double start = NowSeconds();
+            root = json_parse_string(document);
+            double seconds = NowSeconds() - start;
+            parseSeconds = seconds < parseSeconds ? seconds : parseSeconds;
+        }
+        JSON_Object *object = json_value_get_object(root);
+        if (json_object_get_count(object) != keys) {
+            Fail("keys parsed", keys);
+        }
+
+        double scanSeconds = 1e9;
+        double parsonSeconds = 1e9;
+        for (int run = 0; run < RUNS; ++run) {
+            unsigned long found = 0;
+            double start = NowSeconds();
+            for (unsigned long n = 0; n < LOOKUPS; ++n) {
+                unsigned k = order[n % (sizeof(order) / sizeof(order[0]))];
+                found += ScanLookup(object, names[k], lengths[k]) != NULL;
+            }
+            double seconds = NowSeconds() - start;
+            scanSeconds = seconds < scanSeconds ? seconds : scanSeconds;
+
+            unsigned long parsonFound = 0;
+            start = NowSeconds();
+            for (unsigned long n = 0; n < LOOKUPS; ++n) {
+                unsigned k = order[n % (sizeof(order) / sizeof(order[0]))];
+                parsonFound += json_object_get_value(object, names[k]) != NULL;
+            }
+            seconds = NowSeconds() - start;
+            parsonSeconds = seconds < parsonSeconds ? seconds : parsonSeconds;
+
+            if (found != parsonFound) {
+                Fail("lookups differ, keys", keys);
+            }
+        }
+
+        for (unsigned k = 0; k < 2 * keys; ++k) {
+            JSON_Value *value = json_object_get_value(object, names[k]);
+            if (value != ScanLookup(object, names[k], lengths[k]) || (value != NULL) != (k % 2 == 0) ||
+                (value != NULL && json_value_get_number(value) != k)) {
+                Fail("key differs", k);
+            }
+        }
+        json_value_free(root);
+
+        printf("%5u  %10.1f  %10.1f  %10.1f\n", keys, scanSeconds / LOOKUPS * 1e9,
+               parsonSeconds / LOOKUPS * 1e9, parseSeconds * 1e6);
+    }
+    printf("%lu failure(s)\n", failures);
+    return failures != 0;
+}
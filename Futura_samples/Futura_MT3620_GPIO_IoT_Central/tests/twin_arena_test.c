@@ -0,0 +1,155 @@
+/* Futura MT3620 GPIO IoT Central: Device Twin arena test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Parses a complete Device Twin document as IoT Central sends it, desired and reported
+// properties with the $metadata of every property, the way TwinUpdateHandler does:
+// - it must fit in TWIN_ARENA_SIZE, measured here on the host, whose 64-bit nodes are larger
+//   than the 32-bit ones of the device;
+// - in an arena too small for it, the parse falls back to the heap and gives the same
+//   values as json_parse_string, and json_arena_reset releases the heap blocks.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "deviceTwin.h"
+#include "parson.h"
+
+static int failures = 0;
+
+static void Check(bool condition, const char *what)
+{
+    if (!condition) {
+        fprintf(stderr, "check failed: %s\n", what);
+        ++failures;
+    }
+}
+
+#define TIMESTAMP "2020-11-23T17:42:08.5163457Z"
+
+// Appends a property with IoT Central's metadata to a twin document being built.
+static size_t AppendMetadata(char *twin, size_t length, size_t size, const char *key, int version)
+{
+    return length + (size_t)snprintf(twin + length, size - length,
+                                     "\"%s\":{\"$lastUpdated\":\"" TIMESTAMP
+                                     "\",\"$lastUpdatedVersion\":%d,\"value\":{\"$lastUpdated\":"
+                                     "\"" TIMESTAMP "\",\"$lastUpdatedVersion\":%d},"
+                                     "\"status\":{\"$lastUpdated\":\"" TIMESTAMP "\"},"
+                                     "\"desiredVersion\":{\"$lastUpdated\":\"" TIMESTAMP "\"}},",
+                                     key, version, version);
+}
+
+// Drops the comma after the last member of an object being built.
+static size_t DropComma(char *twin, size_t length)
+{
+    if (length > 0 && twin[length - 1] == ',') {
+        twin[--length] = '\0';
+    }
+    return length;
+}
+
+// A complete twin: the four OLED messages desired and reported, the version string
+// reported, and the $metadata of each.
+static size_t BuildFullTwin(char *twin, size_t size)
+{
+    static const char *keys[] = {"OledDisplayMsg1", "OledDisplayMsg2", "OledDisplayMsg3",
+                                 "OledDisplayMsg4"};
+    size_t length = (size_t)snprintf(twin, size, "{\"desired\":{");
+    for (int i = 0; i < 4; ++i) {
+        length += (size_t)snprintf(twin + length, size - length,
+                                   "\"%s\":{\"value\":\"Futura MT3620 line %d text\"},", keys[i],
+                                   i + 1);
+    }
+    length += (size_t)snprintf(twin + length, size - length, "\"$metadata\":{");
+    for (int i = 0; i < 4; ++i) {
+        length = AppendMetadata(twin, length, size, keys[i], 12);
+    }
+    length = DropComma(twin, length);
+    length += (size_t)snprintf(twin + length, size - length,
+                               "},\"$version\":12},\"reported\":{");
+    for (int i = 0; i < 4; ++i) {
+        length += (size_t)snprintf(twin + length, size - length,
+                                   "\"%s\":{\"value\":\"Futura MT3620 line %d text\","
+                                   "\"status\":\"completed\",\"desiredVersion\":12},",
+                                   keys[i], i + 1);
+    }
+    length += (size_t)snprintf(twin + length, size - length,
+                               "\"versionString\":\"FUTURA MT3620\",\"$metadata\":{"
+                               "\"$lastUpdated\":\"" TIMESTAMP "\",");
+    for (int i = 0; i < 4; ++i) {
+        length = AppendMetadata(twin, length, size, keys[i], 34);
+    }
+    length += (size_t)snprintf(twin + length, size - length,
+                               "\"versionString\":{\"$lastUpdated\":\"" TIMESTAMP "\"}},"
+                               "\"$version\":34}}");
+    return length;
+}
+
+// Checks the values the twin table reads.
+static void CheckValues(const JSON_Value *root, const char *label)
+{
+    const JSON_Object *rootObject = json_value_get_object(root);
+    const JSON_Object *desired = json_object_dotget_object(rootObject, "desired");
+    char what[128];
+    snprintf(what, sizeof(what), "%s: desired $version", label);
+    Check(desired != NULL && json_object_get_number(desired, "$version") == 12, what);
+    const char *message = json_object_dotget_string(desired, "OledDisplayMsg3.value");
+    snprintf(what, sizeof(what), "%s: OledDisplayMsg3", label);
+    Check(message != NULL && strcmp(message, "Futura MT3620 line 3 text") == 0, what);
+    snprintf(what, sizeof(what), "%s: reported metadata", label);
+    Check(json_object_dotget_number(rootObject,
+                                    "reported.$metadata.OledDisplayMsg4.$lastUpdatedVersion") == 34,
+          what);
+}
+
+int main(void)
+{
+    static char twin[4096];
+    static char copy[sizeof(twin)];
+    static char arenaBuffer[TWIN_ARENA_SIZE];
+    size_t length = BuildFullTwin(twin, sizeof(twin));
+    Check(length < sizeof(twin), "twin fits its buffer");
+
+    JSON_Value *heapRoot = json_parse_string(twin);
+    Check(heapRoot != NULL, "heap parse");
+    if (heapRoot != NULL) {
+        CheckValues(heapRoot, "heap parse");
+        json_value_free(heapRoot);
+    }
+
+    // The arena of the sample holds the full twin without the heap.
+    JSON_Arena arena;
+    memcpy(copy, twin, length + 1);
+    json_arena_init(&arena, arenaBuffer, sizeof(arenaBuffer));
+    JSON_Value *root = json_parse_string_in_situ(copy, &arena);
+    Check(root != NULL, "arena parse");
+    if (root != NULL) {
+        CheckValues(root, "arena parse");
+    }
+    printf("full twin: %zu bytes of JSON, %zu bytes of arena of %d, %zu from the heap\n", length,
+           arena.used, TWIN_ARENA_SIZE, json_arena_overflow_size(&arena));
+    Check(json_arena_overflow_size(&arena) == 0, "full twin fits TWIN_ARENA_SIZE");
+    json_arena_reset(&arena);
+
+    // A smaller arena falls back to the heap for the rest.
+    static const size_t smallSizes[] = {0, 64, 1024, TWIN_ARENA_SIZE / 4};
+    for (size_t i = 0; i < sizeof(smallSizes) / sizeof(smallSizes[0]); ++i) {
+        memcpy(copy, twin, length + 1);
+        json_arena_init(&arena, arenaBuffer, smallSizes[i]);
+        root = json_parse_string_in_situ(copy, &arena);
+        char label[64];
+        snprintf(label, sizeof(label), "%zu-byte arena", smallSizes[i]);
+        Check(root != NULL, label);
+        Check(json_arena_overflow_size(&arena) > 0, label);
+        if (root != NULL) {
+            CheckValues(root, label);
+        }
+        json_arena_reset(&arena);
+        Check(json_arena_overflow_size(&arena) == 0 && arena.overflow == NULL, label);
+    }
+
+    printf("%d check(s) failed\n", failures);
+    return failures != 0;
+}
@@ -27,46 +27,39 @@
 
 //IOTHUB libs
 #include "eventloop_timer_utilities.h"
-#include <iothub_client_core_common.h>
-#include <iothub_device_client_ll.h>
-#include <iothub_client_options.h>
-#include <iothubtransportmqtt.h>
-#include <iothub.h>
-#include <azure_sphere_provisioning.h>
-#include "parson.h" // used to parse Device Twin messages.
+#include "azure_connection.h"
+#include "button.h"
+#include "mpu6050.h"
+#include "telemetry.h"
+#include "telemetry_queue.h"
 
 
-static char eventBuffer[100] = { 0 };
-
-// MPU6050 Accel XYZ Gyro XYZ
-int16_t AcX, AcY, AcZ, Tmp, GyX, GyY, GyZ;
+// MPU6050 Accel XYZ Gyro XYZ, last sample read
+static MPU6050_Sample mpuSample;
 
 double temp_MPU6050;
 
 // MPU6050 address
-static const uint8_t MPU6050Address = 0x68;
+static const uint8_t MPU6050Address = MPU6050_ADDR;
 
 //ExitCode enum
 typedef enum {
     ExitCode_Success = 0,
     ExitCode_TermHandler_SigTerm = 1,
     ExitCode_Main_EventLoopFail = 2,
-    ExitCode_ButtonTimer_Consume = 3,
-    ExitCode_AzureTimer_Consume = 4,
     ExitCode_Init_EventLoop = 5,
     ExitCode_Init_MessageButton = 6,
     ExitCode_Init_TwinStatusLed = 8,
-    ExitCode_Init_ButtonPollTimer = 9,
-    ExitCode_Init_AzureTimer = 10,
-    ExitCode_IsButtonPressed_GetValue = 11,
-    ExitCode_AccelTimer_ReadStatus = 12,
-    ExitCode_AccelTimer_ReadZAccel = 13,
+    ExitCode_Init_Buttons = 9,
+    ExitCode_Init_AzureConnection = 10,
     ExitCode_AccelTimer_Consume = 24,
     ExitCode_Init_AccelTimer = 25,
     ExitCode_Init_OpenMaster = 26,
     ExitCode_Init_SetBusSpeed = 27,
     ExitCode_Init_SetTimeout = 28,
     ExitCode_Init_SetDefaultTarget = 29,
+    ExitCode_Init_MPU6050 = 31,
+    ExitCode_Init_TelemetryQueue = 32,
     ExitCode_Main_Led = 30,    
     ExitCode_Init_RegisterIo = 33,
 } ExitCode;
@@ -79,19 +72,13 @@ static void AccelTimerEventHandler(EventLoopTimer* timer);
 // Azure IoT Hub/Central defines.
 #define SCOPEID_LENGTH 20
 static char scopeId[SCOPEID_LENGTH]; // ScopeId for the Azure IoT Central application, set in app_manifest.json, CmdArgs
-static IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle = NULL;
-static const int keepalivePeriodSeconds = 20;
-static bool iothubAuthenticated = false;
-static void SendMessageCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context);
-static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload,
-                         size_t payloadSize, void *userContextCallback);
-static void TwinReportBoolState(const char *propertyName, bool propertyValue);
-static void ReportStatusCallback(int result, void *context);
-static const char *GetReasonString(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason);
-static const char *getAzureSphereProvisioningResultString(
-    AZURE_SPHERE_PROV_RETURN_VALUE provisioningResult);
-static void SendTelemetry(const unsigned char *key, const unsigned char *value);
-static void SetupAzureClient(void);
+
+// Offline telemetry queue in mutable storage (see MutableStorage in app_manifest.json).
+// Messages that cannot be sent are kept here, oldest evicted first, and replayed by the
+// connection manager once IoT Hub is connected.
+static int telemetryQueueFd = -1;
+static TelemetryQueue telemetryQueue;
+static const uint32_t telemetryQueueBudgetBytes = 32 * 1024;
 
 // Function to generate simulated Temperature data/telemetry, uncomment optionally
 // static void SendSimulatedTemperature(void); 
@@ -99,12 +86,68 @@ static void SetupAzureClient(void);
 static int i2cFd = -1; //File Descriptor for i2c
 static EventLoopTimer* accelTimer = NULL;
 
+// Sample the accelerometer at 100 Hz, printing one sample in 100. Change optionally
+static const struct timespec accelReadPeriod = { .tv_sec = 0, .tv_nsec = 10 * 1000 * 1000 };
+static const int accelLogEverySamples = 100;
+
+// FIFO streaming mode: the MPU6050 samples at 1 kHz / (1 + accelFifoSampleRateDiv) into its
+// 1 KB FIFO (73 frames) and the timer drains it in block reads. At 1 kHz the FIFO fills in
+// about 73 ms, so drain every 50 ms. Set accelFifoMode to false to poll single samples.
+// Bus budget: a frame is 14 bytes, 126 bits on the wire with the ACK bits, so 1 kHz needs
+// 126 kbit/s plus about 4 bytes of addressing per 16-frame burst: more than the 100 kHz
+// standard mode, so the bus runs in 400 kHz fast mode, about 32% busy. At 100 kHz use a
+// divider of 1 or more (500 Hz, about 65% busy).
+static const bool accelFifoMode = true;
+static const uint8_t accelFifoSampleRateDiv = 0;
+static const struct timespec accelFifoDrainPeriod = { .tv_sec = 0, .tv_nsec = 50 * 1000 * 1000 };
+static const int accelLogEveryDrains = 20;
+
+#define ACCEL_RING_SAMPLES 256
+static MPU6050_Sample accelRingStorage[ACCEL_RING_SAMPLES];
+static MPU6050_SampleRing accelRing;
+static MPU6050_FifoStats accelFifoStats;
+
+// Every sample read since the last telemetry message, which sends their mean
+static MPU6050_SampleSum accelSum;
+
 double vertical_accel = 0.0;
 
-// Print latest data from accelerometer.
-static void AccelTimerEventHandler(EventLoopTimer* timer)
+// Print the last sample read.
+static void LogAccelSample(void)
+{
+    Log_Debug("Temp: %.2lf\n", temp_MPU6050);
+    Log_Debug("AcX: %d AcY: %d AcZ: %d\n", mpuSample.accelX, mpuSample.accelY, mpuSample.accelZ);
+    Log_Debug("GyX: %d GyY: %d GyZ: %d\n", mpuSample.gyroX, mpuSample.gyroY, mpuSample.gyroZ);
+}
+
+// Drain the MPU6050 FIFO into the telemetry sums, keeping the latest sample.
+static void AccelFifoDrain(int iter)
 {
+    if (MPU6050_FifoDrain(i2cFd, MPU6050Address, &accelRing, &accelFifoStats) < 0) {
+        Log_Debug("INFO: %d: MPU6050 FIFO read failed: errno=%d (%s)\n", iter, errno,
+                  strerror(errno));
+    }
+
+    size_t consumed = 0;
+    while (MPU6050_RingPop(&accelRing, &mpuSample)) {
+        MPU6050_SumAdd(&accelSum, &mpuSample);
+        ++consumed;
+    }
+    if (consumed > 0) {
+        temp_MPU6050 = MPU6050_TempCelsius(mpuSample.temp);
+    }
 
+    if (iter % accelLogEveryDrains == 0) {
+        Log_Debug("FIFO: %u frames in %u drains, %u overflows, %u dropped\n",
+                  accelFifoStats.frames, accelFifoStats.drains, accelFifoStats.overflows,
+                  accelRing.dropped);
+        LogAccelSample();
+    }
+}
+
+// Read the latest sample(s) from the accelerometer, printing them about once a second.
+static void AccelTimerEventHandler(EventLoopTimer* timer)
+{
     static int iter = 1;
 
     if (ConsumeEventLoopTimerEvent(timer) != 0) {
@@ -112,97 +155,17 @@ static void AccelTimerEventHandler(EventLoopTimer* timer)
         return;
     }
 
+    if (accelFifoMode) {
+        AccelFifoDrain(iter);
+    } else if (MPU6050_ReadSample(i2cFd, MPU6050Address, &mpuSample) != 0) {
+        Log_Debug("INFO: %d: No accelerometer data: errno=%d (%s)\n", iter, errno, strerror(errno));
+    } else {
+        MPU6050_SumAdd(&accelSum, &mpuSample);
+        temp_MPU6050 = MPU6050_TempCelsius(mpuSample.temp);
 
-    static const uint8_t statusRegId = 0x00; // 
-    uint8_t status;
-    ssize_t transferredBytes = I2CMaster_WriteThenRead(
-        i2cFd, MPU6050Address, &statusRegId, sizeof(statusRegId), &status, sizeof(status));
-    if ((status & 0x1) == 0) {
-        Log_Debug("INFO: %d: No accelerometer data.\n", iter);
-    }
-    else {
-
-        //constants for mpu6050 registers
-#define MPU6050_ADDR         0x68
-#define MPU6050_SMPLRT_DIV   0x19
-#define MPU6050_CONFIG       0x1a
-#define MPU6050_GYRO_CONFIG  0x1b
-#define MPU6050_ACCEL_CONFIG 0x1c
-#define MPU6050_WHO_AM_I     0x75
-#define MPU6050_PWR_MGMT_1   0x6b
-#define MPU6050_TEMP_H       0x41
-#define MPU6050_TEMP_L       0x42
-
-        const uint8_t Command1[] = { MPU6050_SMPLRT_DIV, 0x00 };
-        ssize_t transferredBytes1 = I2CMaster_Write(i2cFd, MPU6050Address, Command1, sizeof(Command1));
-
-        const uint8_t Command2[] = { MPU6050_CONFIG, 0x00 };
-        ssize_t transferredBytes2 = I2CMaster_Write(i2cFd, MPU6050Address, Command2, sizeof(Command2));
-
-        const uint8_t Command3[] = { MPU6050_GYRO_CONFIG, 0x08 };
-        ssize_t transferredBytes3 = I2CMaster_Write(i2cFd, MPU6050Address, Command3, sizeof(Command3));
-
-        const uint8_t Command4[] = { MPU6050_ACCEL_CONFIG, 0x00 };
-        ssize_t transferredBytes4 = I2CMaster_Write(i2cFd, MPU6050Address, Command4, sizeof(Command4));
-
-        const uint8_t Command5[] = { MPU6050_PWR_MGMT_1, 0x01 };
-        ssize_t transferredBytes5 = I2CMaster_Write(i2cFd, MPU6050Address, Command5, sizeof(Command5));
-
-        static const uint8_t outTmp = 0x41; //Temperature 
-        static const uint8_t outAcX = 0x3b; //Accelerometer X 
-        static const uint8_t outAcY = 0x3d; //Accelerometer Y 
-        static const uint8_t outAcZ = 0x3f; //Accelerometer Z 
-        static const uint8_t outGyX = 0x43; //Gyroscope X 
-        static const uint8_t outGyY = 0x45; //Gyroscope Y 
-        static const uint8_t outGyZ = 0x47; //Gyroscope Z 
-
-        uint8_t zRaw, zRaw1;
-
-        transferredBytes = I2CMaster_Write(i2cFd, MPU6050Address, &outTmp, sizeof(outTmp));
-        ssize_t hi = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw, sizeof(zRaw));
-        ssize_t lo = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw1, sizeof(zRaw1));
-
-        Tmp = zRaw << 8 | zRaw1; //0x41 (TEMP_OUT_H) & 0x42 (TEMP_OUT_L)
-        // Formula from datasheet 
-        // Temperature in degrees C = (TEMP_OUT Register Value as a signed quantity) / 340 + 36.53
-        temp_MPU6050 = Tmp / 340.00 + 36.53;
-        Log_Debug("Temp: %.2lf\n", temp_MPU6050);
-
-        transferredBytes = I2CMaster_Write(i2cFd, MPU6050Address, &outAcX, sizeof(outAcX));
-        hi = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw, sizeof(zRaw));
-        lo = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw1, sizeof(zRaw1));
-        AcX = zRaw << 8 | zRaw1; //0x3B (ACCEL_XOUT_H) & 0x3C (ACCEL_XOUT_L)
-        Log_Debug("AcX: %d\n", AcX);
-
-        transferredBytes = I2CMaster_Write(i2cFd, MPU6050Address, &outAcY, sizeof(outAcY));
-        hi = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw, sizeof(zRaw));
-        lo = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw1, sizeof(zRaw1));
-        AcY = zRaw << 8 | zRaw1; //0x3D (ACCEL_YOUT_H) & 0x3E (ACCEL_YOUT_L)
-        Log_Debug("AcY: %d\n", AcY);
-
-        transferredBytes = I2CMaster_Write(i2cFd, MPU6050Address, &outAcZ, sizeof(outAcZ));
-        hi = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw, sizeof(zRaw));
-        lo = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw1, sizeof(zRaw1));
-        AcZ = zRaw << 8 | zRaw1; //0x3F (ACCEL_ZOUT_H) & 0x40 (ACCEL_ZOUT_L)
-        Log_Debug("AcZ: %d\n", AcZ);
-
-        transferredBytes = I2CMaster_Write(i2cFd, MPU6050Address, &outGyX, sizeof(outGyX));
-        hi = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw, sizeof(zRaw));
-        lo = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw1, sizeof(zRaw1));
-        GyX = zRaw << 8 | zRaw1; //0x43 (GYRO_XOUT_H) & 0x44 (GYRO_XOUT_L)
-        Log_Debug("GyX: %d\n", GyX);
-
-        transferredBytes = I2CMaster_Write(i2cFd, MPU6050Address, &outGyY, sizeof(outGyY));
-        hi = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw, sizeof(zRaw));
-        lo = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw1, sizeof(zRaw1));
-        GyY = zRaw << 8 | zRaw1; //0x45 (GYRO_YOUT_H) & 0x46 (GYRO_YOUT_L)
-        Log_Debug("GyY: %d\n", GyY);
-
-        transferredBytes = I2CMaster_Write(i2cFd, MPU6050Address, &outGyZ, sizeof(outGyZ));
-        hi = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw, sizeof(zRaw));
-        lo = I2CMaster_Read(i2cFd, MPU6050Address, (uint8_t*)&zRaw1, sizeof(zRaw1));
-        GyZ = zRaw << 8 | zRaw1; //0x47 (GYRO_ZOUT_H) & 0x48 (GYRO_ZOUT_L)
-        Log_Debug("GyZ: %d\n", GyZ);
+        if (iter % accelLogEverySamples == 0) {
+            LogAccelSample();
+        }
     }
     ++iter;
 }
@@ -215,35 +178,19 @@ static void ClosePeripheralsAndHandlers(void);
 
 // File descriptors - initialized to invalid value Buttons
 static int sendMessageButtonGpioFd = -1;
-static int sendMessageButtonGpioFdAccel = -1;
 static int sendOrientationButtonGpioFd = -1;
 
 // LED
 static int deviceTwinStatusLedGpioFd = -1;
 static bool statusLedOn = false;
 
-// Timer / polling
+// Event loop
 static EventLoop *eventLoop = NULL;
-static EventLoopTimer *buttonPollTimer = NULL;
-static EventLoopTimer *azureTimer = NULL;
-
-// Azure IoT poll periods
-static const int AzureIoTDefaultPollPeriodSeconds = 5;
-static const int AzureIoTMinReconnectPeriodSeconds = 60;
-static const int AzureIoTMaxReconnectPeriodSeconds = 10 * 60;
 
-static int azureIoTPollPeriodSeconds = -1;
 
-// Button state variables
-static GPIO_Value_Type sendMessageButtonState = GPIO_Value_High;
-static GPIO_Value_Type sendMessageButtonStateAccel = GPIO_Value_High;
-static GPIO_Value_Type sendOrientationButtonState = GPIO_Value_High;
-
-static void ButtonPollTimerEventHandler(EventLoopTimer *timer);
-static bool IsButtonPressed(int fd, GPIO_Value_Type *oldState);
-static void SendAccelButtonHandler(void);
+// Button handlers
+static void SendAccelButtonHandler(Button_Event event, unsigned int clicks, void *context);
 static bool deviceIsUp = false; // Orientation
-static void AzureTimerEventHandler(EventLoopTimer *timer);
 
 // Signal handler for termination requests. This handler must be async-signal-safe.
 static void TerminationHandler(int signalNumber)
@@ -287,41 +234,6 @@ int main(int argc, char *argv[])
 }
 
 
-// Button timer event:  Check the status of buttons 1 2 3
-static void ButtonPollTimerEventHandler(EventLoopTimer *timer)
-{
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_ButtonTimer_Consume;
-        return;
-    }
-    SendAccelButtonHandler();    
-}
-
-// // // // // // // // // // // // // // // // // // 
-// Azure timer event:  Check connection status and send telemetry
-// // // // // // // // // // // // // // // // // // 
-static void AzureTimerEventHandler(EventLoopTimer *timer)
-{
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_AzureTimer_Consume;
-        return;
-    }
-
-    bool isNetworkReady = false;
-    if (Networking_IsNetworkingReady(&isNetworkReady) != -1) {
-        if (isNetworkReady && !iothubAuthenticated) {
-            SetupAzureClient();
-        }
-    } else {
-        Log_Debug("Failed to get Network state\n");
-    }
-
-    if (iothubAuthenticated) {
-        IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
-    }
-}
-
-
 // Set up SIGTERM termination handler, initialize peripherals, and set up event handlers.
 static ExitCode InitPeripheralsAndHandlers(void)
 {
@@ -336,38 +248,17 @@ static ExitCode InitPeripheralsAndHandlers(void)
         return ExitCode_Init_EventLoop;
     }
 
+    // Buttons share one poll timer, slow while idle and fast around presses
+    if (Button_Init(eventLoop) != 0) {
+        return ExitCode_Init_Buttons;
+    }
+
     // Open button 2 GPIO as input
     Log_Debug("Opening SAMPLE_BUTTON_2 as input\n");
-    sendMessageButtonGpioFdAccel = GPIO_OpenAsInput(SAMPLE_BUTTON_2);
-    if (sendMessageButtonGpioFdAccel < 0) {
+    if (Button_Add(SAMPLE_BUTTON_2, &SendAccelButtonHandler, NULL) != 0) {
         Log_Debug("ERROR: Could not open button 2: %s (%d).\n", strerror(errno), errno);
         return ExitCode_Init_MessageButton;
     }
-    
-
-
-    // Set up a timer to poll for button events
-    static const struct timespec buttonPressCheckPeriod = {.tv_sec = 0, .tv_nsec = 1000 * 1000};
-    buttonPollTimer = CreateEventLoopPeriodicTimer(eventLoop, &ButtonPollTimerEventHandler,
-                                                   &buttonPressCheckPeriod);
-    if (buttonPollTimer == NULL) {
-        return ExitCode_Init_ButtonPollTimer;
-    }
-
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = {.tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0};
-    azureTimer =
-        CreateEventLoopPeriodicTimer(eventLoop, &AzureTimerEventHandler, &azureTelemetryPeriod);
-    if (azureTimer == NULL) {
-        return ExitCode_Init_AzureTimer;
-    }
-
-    // Print accelerometer data every 0.9 second. Change optionally
-    static const struct timespec accelReadPeriod = { .tv_sec = 0, .tv_nsec = 900000000 };
-    accelTimer = CreateEventLoopPeriodicTimer(eventLoop, &AccelTimerEventHandler, &accelReadPeriod);
-    if (accelTimer == NULL) {
-        return ExitCode_Init_AccelTimer;
-    }
 
     i2cFd = I2CMaster_Open(SAMPLE_ISU0_I2C); //MPU6050
     if (i2cFd < 0) {
@@ -376,7 +267,8 @@ static ExitCode InitPeripheralsAndHandlers(void)
     }
     else Log_Debug("Open ok\n");//OPEN OK
 
-    int result = I2CMaster_SetBusSpeed(i2cFd, I2C_BUS_SPEED_STANDARD);
+    // Fast mode: the FIFO at 1 kHz does not fit in 100 kHz, see accelFifoSampleRateDiv
+    int result = I2CMaster_SetBusSpeed(i2cFd, I2C_BUS_SPEED_FAST);
     if (result != 0) {
         Log_Debug("ERROR: I2CMaster_SetBusSpeed: errno=%d (%s)\n", errno, strerror(errno));
         return ExitCode_Init_SetBusSpeed;
@@ -399,6 +291,40 @@ static ExitCode InitPeripheralsAndHandlers(void)
     }
     else Log_Debug("Set Default Target Address ok\n");//OPEN OK
 
+    // Configure the sensor once; the timer handler then only reads samples
+    if (MPU6050_Init(i2cFd, MPU6050Address) != 0) {
+        return ExitCode_Init_MPU6050;
+    }
+    else Log_Debug("MPU6050 init ok\n");
+
+    if (accelFifoMode) {
+        MPU6050_RingInit(&accelRing, accelRingStorage, ACCEL_RING_SAMPLES);
+        if (MPU6050_FifoEnable(i2cFd, MPU6050Address, accelFifoSampleRateDiv) != 0) {
+            return ExitCode_Init_MPU6050;
+        }
+        else Log_Debug("MPU6050 FIFO enabled\n");
+    }
+
+    telemetryQueueFd = Storage_OpenMutableFile();
+    if (telemetryQueueFd < 0) {
+        Log_Debug("ERROR: Could not open mutable file: %s (%d).\n", strerror(errno), errno);
+        return ExitCode_Init_TelemetryQueue;
+    }
+    if (TelemetryQueue_Open(&telemetryQueue, telemetryQueueFd, telemetryQueueBudgetBytes) != 0) {
+        return ExitCode_Init_TelemetryQueue;
+    }
+
+    AzureConnection_Config azureConfig = {.scopeId = scopeId, .offlineQueue = &telemetryQueue};
+    if (AzureConnection_Init(eventLoop, &azureConfig) != 0) {
+        return ExitCode_Init_AzureConnection;
+    }
+
+    accelTimer = CreateEventLoopPeriodicTimer(eventLoop, &AccelTimerEventHandler,
+                                              accelFifoMode ? &accelFifoDrainPeriod : &accelReadPeriod);
+    if (accelTimer == NULL) {
+        return ExitCode_Init_AccelTimer;
+    }
+
     return ExitCode_Success;
 }
 
@@ -418,318 +344,47 @@ static void CloseFdAndPrintError(int fd, const char *fdName)
 // Close peripherals and handlers.
 static void ClosePeripheralsAndHandlers(void)
 {
-    DisposeEventLoopTimer(buttonPollTimer);
-    DisposeEventLoopTimer(azureTimer);
+    Button_Cleanup();
+    AzureConnection_Cleanup();
     EventLoop_Close(eventLoop);
     Log_Debug("Closing file descriptors\n");
     DisposeEventLoopTimer(accelTimer);
     CloseFdAndPrintError(i2cFd, "i2c");
-    CloseFdAndPrintError(sendMessageButtonGpioFdAccel, "SendMessageButtonAccel");
+    CloseFdAndPrintError(telemetryQueueFd, "TelemetryQueue");
 }
 
 
-// Sets the IoT Hub authentication state for the app
-// The SAS Token expires which will set the authentication state
-static void HubConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result,
-                                        IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
-                                        void *userContextCallback)
-{
-    iothubAuthenticated = (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED);
-    Log_Debug("IoT Hub Authenticated: %s\n", GetReasonString(reason));
-}
-
-
-// Sets up the Azure IoT Hub connection (creates the iothubClientHandle)
-// When the SAS Token for a device expires the connection needs to be recreated
-// which is why this is not simply a one time call.
-
-static void SetupAzureClient(void)
-{
-    if (iothubClientHandle != NULL) {
-        IoTHubDeviceClient_LL_Destroy(iothubClientHandle);
-    }
-
-    AZURE_SPHERE_PROV_RETURN_VALUE provResult =
-        IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning(scopeId, 10000,
-                                                                          &iothubClientHandle);
-    Log_Debug("IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning returned '%s'.\n",
-              getAzureSphereProvisioningResultString(provResult));
-
-    if (provResult.result != AZURE_SPHERE_PROV_RESULT_OK) {
-
-        // If fail to connect, reduce the polling frequency, starting at
-        // AzureIoTMinReconnectPeriodSeconds and with a backoff up to
-        // AzureIoTMaxReconnectPeriodSeconds
-        if (azureIoTPollPeriodSeconds == AzureIoTDefaultPollPeriodSeconds) {
-            azureIoTPollPeriodSeconds = AzureIoTMinReconnectPeriodSeconds;
-        } else {
-            azureIoTPollPeriodSeconds *= 2;
-            if (azureIoTPollPeriodSeconds > AzureIoTMaxReconnectPeriodSeconds) {
-                azureIoTPollPeriodSeconds = AzureIoTMaxReconnectPeriodSeconds;
-            }
-        }
-
-        struct timespec azureTelemetryPeriod = {azureIoTPollPeriodSeconds, 0};
-        SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
-
-        Log_Debug("ERROR: failure to create IoTHub Handle - will retry in %i seconds.\n",
-                  azureIoTPollPeriodSeconds);
-        return;
-    }
-
-    // Successfully connected, so make sure the polling frequency is back to the default
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = {.tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0};
-    SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
-
-    iothubAuthenticated = true;
-
-    if (IoTHubDeviceClient_LL_SetOption(iothubClientHandle, OPTION_KEEP_ALIVE,
-                                        &keepalivePeriodSeconds) != IOTHUB_CLIENT_OK) {
-        Log_Debug("ERROR: failure setting option \"%s\"\n", OPTION_KEEP_ALIVE);
-        return;
-    }
-
-    IoTHubDeviceClient_LL_SetDeviceTwinCallback(iothubClientHandle, TwinCallback, NULL);
-    IoTHubDeviceClient_LL_SetConnectionStatusCallback(iothubClientHandle,
-                                                      HubConnectionStatusCallback, NULL);
-}
-
-
-// Callback invoked when a Device Twin update is received from IoT Hub.
-// Updates local state for 'showEvents' (bool).
-// <param name="payload">contains the Device Twin JSON document (desired and reported)</param>
-// <param name="payloadSize">size of the Device Twin JSON document</param>
-static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload,
-                         size_t payloadSize, void *userContextCallback)
-{
-    size_t nullTerminatedJsonSize = payloadSize + 1;
-    char *nullTerminatedJsonString = (char *)malloc(nullTerminatedJsonSize);
-    if (nullTerminatedJsonString == NULL) {
-        Log_Debug("ERROR: Could not allocate buffer for twin update payload.\n");
-        abort();
-    }
-
-    // Copy the provided buffer to a null terminated buffer.
-    memcpy(nullTerminatedJsonString, payload, payloadSize);
-    // Add the null terminator at the end.
-    nullTerminatedJsonString[nullTerminatedJsonSize - 1] = 0;
-
-    JSON_Value *rootProperties = NULL;
-    rootProperties = json_parse_string(nullTerminatedJsonString);
-    if (rootProperties == NULL) {
-        Log_Debug("WARNING: Cannot parse the string as JSON content.\n");
-        goto cleanup;
-    }
-
-    JSON_Object *rootObject = json_value_get_object(rootProperties);
-    JSON_Object *desiredProperties = json_object_dotget_object(rootObject, "desired");
-    if (desiredProperties == NULL) {
-        desiredProperties = rootObject;
-    }
-
-
-cleanup:
-    // Release the allocated memory.
-    json_value_free(rootProperties);
-    free(nullTerminatedJsonString);
-}
-
-// Converts the IoT Hub connection status reason to a string.
-static const char *GetReasonString(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
-{
-    static char *reasonString = "unknown reason";
-    switch (reason) {
-    case IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_NO_NETWORK:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_NO_NETWORK";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_OK:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_OK"; // must be always this
-        break;
-    }
-    return reasonString;
-}
-
-
-// Converts AZURE_SPHERE_PROV_RETURN_VALUE to a string.
-
-static const char *getAzureSphereProvisioningResultString(
-    AZURE_SPHERE_PROV_RETURN_VALUE provisioningResult)
-{
-    switch (provisioningResult.result) {
-    case AZURE_SPHERE_PROV_RESULT_OK:
-        return "AZURE_SPHERE_PROV_RESULT_OK"; // must be this
-    case AZURE_SPHERE_PROV_RESULT_INVALID_PARAM:
-        return "AZURE_SPHERE_PROV_RESULT_INVALID_PARAM";
-    case AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY:
-        return "AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY";
-    case AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY:
-        return "AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY";
-    case AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR:
-        return "AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR";
-    case AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR:
-        return "AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR";
-    default:
-        return "UNKNOWN_RETURN_VALUE";
-    }
-}
-
-
-// Sends telemetry to IoT Hub
-// <param name="key">The telemetry item to update</param>
-// <param name="value">new telemetry value</param>
-static void SendTelemetry(const unsigned char *key, const unsigned char *value)
-{
-    static char eventBuffer[100] = {0};
-    static const char *EventMsgTemplate = "{ \"%s\": \"%s\" }";
-    int len = snprintf(eventBuffer, sizeof(eventBuffer), EventMsgTemplate, key, value);
-    if (len < 0)
-        return;
-
-    Log_Debug("Sending IoT Hub Message: %s\n", eventBuffer);
-
-    bool isNetworkingReady = false;
-
-    if ((Networking_IsNetworkingReady(&isNetworkingReady) == -1) || !isNetworkingReady) {
-        Log_Debug("WARNING: Cannot send IoTHubMessage because network is not up.\n");
-        return;
-    }
-
-    IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromString(eventBuffer);
-
-    if (messageHandle == 0) {
-        Log_Debug("WARNING: unable to create a new IoTHubMessage\n");
-        return;
-    }
-
-    if (IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle, SendMessageCallback,
-                                             /*&callback_param*/ 0) != IOTHUB_CLIENT_OK) {
-        Log_Debug("WARNING: failed to hand over the message to IoTHubClient\n");
-    } else {
-        Log_Debug("INFO: IoTHubClient accepted the message for delivery\n");
-    }
-    
-    IoTHubMessage_Destroy(messageHandle);
-}
-
-
-// Callback confirming message delivered to IoT Hub.
-// <param name="result">Message delivery status</param>
-// <param name="context">User specified context</param>
-static void SendMessageCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context)
-{
-    Log_Debug("INFO: Message received by IoT Hub. Result is: %d\n", result);
-}
-
-
-// Creates and enqueues a report containing the name and value pair of a Device Twin reported
-// property. The report is not sent immediately, but it is sent on the next invocation of
-// IoTHubDeviceClient_LL_DoWork().
-
-// <param name="propertyName">the IoT Hub Device Twin property name</param>
-// <param name="propertyValue">the IoT Hub Device Twin property value</param>
-static void TwinReportBoolState(const char *propertyName, bool propertyValue)
-{
-    if (iothubClientHandle == NULL) {
-        Log_Debug("ERROR: client not initialized\n");
-    } else {
-        static char reportedPropertiesString[30] = {0};
-        int len = snprintf(reportedPropertiesString, 30, "{\"%s\":%s}", propertyName,
-                           (propertyValue == true ? "true" : "false"));
-        if (len < 0)
-            return;
-
-        if (IoTHubDeviceClient_LL_SendReportedState(
-                iothubClientHandle, (unsigned char *)reportedPropertiesString,
-                strlen(reportedPropertiesString), ReportStatusCallback, 0) != IOTHUB_CLIENT_OK) {
-            Log_Debug("ERROR: failed to set reported state for '%s'.\n", propertyName);
-        } else {
-            Log_Debug("INFO: Reported state for '%s' to value '%s'.\n", propertyName,
-                      (propertyValue == true ? "true" : "false"));
-        }
-    }
-}
-
-
-// Callback invoked when the Device Twin reported properties are accepted by IoT Hub.
-static void ReportStatusCallback(int result, void *context)
-{
-    Log_Debug("INFO: Device Twin reported properties update result: HTTP status code %d\n", result);
-}
-
-
-
-// Check button been pressed.
-// <param name="fd">The button file descriptor</param>
-// <param name="oldState">Old state of the button (pressed or released)</param>
-// <returns>true if pressed, false otherwise</returns>
-static bool IsButtonPressed(int fd, GPIO_Value_Type *oldState)
-{
-    bool isButtonPressed = false;
-    GPIO_Value_Type newState;
-    int result = GPIO_GetValue(fd, &newState);
-    if (result != 0) {
-        Log_Debug("ERROR: Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
-        exitCode = ExitCode_IsButtonPressed_GetValue;
-    } else {
-        // Button is pressed if it is low and different than last known state.
-        isButtonPressed = (newState != *oldState) && (newState == GPIO_Value_Low);
-        *oldState = newState;
-    }
-
-    return isButtonPressed;
-}
 
 
 // Pressing button 2 will send Accel event to Azure IoT Central
-static void SendAccelButtonHandler(void)
+// All MPU6050 channels go in one message matching the Futura Azure Sphere MPU6050 interface,
+// each the mean of the samples read since the last message, or the last sample if none was.
+static void SendAccelButtonHandler(Button_Event event, unsigned int clicks, void *context)
 {
-    if (IsButtonPressed(sendMessageButtonGpioFdAccel, &sendMessageButtonStateAccel)) {
-        char tempBuffer[20];
-        int len = snprintf(tempBuffer, 20, "%d", AcX);
-        if (len > 0) {
-            SendTelemetry("AccelX", tempBuffer);      //AcX
-            Log_Debug("AcX: %s\n", tempBuffer);
+    if (event == Button_Pressed) {
+        MPU6050_Sample mean = mpuSample;
+        MPU6050_SumMean(&accelSum, &mean);
+        Log_Debug("Mean of %u samples\n", accelSum.count);
+        memset(&accelSum, 0, sizeof(accelSum));
+
+        static char telemetryBuffer[160];
+        TelemetryBuilder telemetry;
+        Telemetry_Init(&telemetry, telemetryBuffer, sizeof(telemetryBuffer));
+
+        Telemetry_AddInt(&telemetry, "AccelX", mean.accelX);
+        Telemetry_AddInt(&telemetry, "AccelY", mean.accelY);
+        Telemetry_AddInt(&telemetry, "AccelZ", mean.accelZ);
+        Telemetry_AddInt(&telemetry, "GyroX", mean.gyroX);
+        Telemetry_AddInt(&telemetry, "GyroY", mean.gyroY);
+        Telemetry_AddInt(&telemetry, "GyroZ", mean.gyroZ);
+        Telemetry_AddDouble(&telemetry, "TempMPU6050", MPU6050_TempCelsius(mean.temp));
+
+        const char *message = Telemetry_Finish(&telemetry);
+        if (message != NULL) {
+            AzureConnection_SendTelemetry(message);
+        } else {
+            Log_Debug("WARNING: telemetry message does not fit in %zu bytes\n",
+                      sizeof(telemetryBuffer));
         }
-                
-        len = snprintf(tempBuffer, 20, "%d", AcY);
-        if (len > 0) SendTelemetry("AccelY", tempBuffer);      //AcY
-        Log_Debug("AcY: %d\n", AcY);
-
-        len = snprintf(tempBuffer, 20, "%d", AcZ);
-        if (len > 0) SendTelemetry("AccelZ", tempBuffer);      //AcZ
-        Log_Debug("AcZ: %d\n", AcZ);
-
-        len = snprintf(tempBuffer, 20, "%d", GyX);
-        if (len > 0) SendTelemetry("GyroX", tempBuffer);      //GyX
-        Log_Debug("GyX: %d\n", GyX);
-
-        len = snprintf(tempBuffer, 20, "%d", GyY);
-        if (len > 0) SendTelemetry("GyroY", tempBuffer);      //GyY
-        Log_Debug("GyY: %d\n", GyY);
-
-        len = snprintf(tempBuffer, 20, "%d", GyZ);
-        if (len > 0) SendTelemetry("GyroZ", tempBuffer);      //GyZ
-        Log_Debug("GyZ: %d\n", GyZ);
-        
-        len = snprintf(tempBuffer, 20, "%.2lf", temp_MPU6050);
-        if (len > 0) SendTelemetry("TempMPU6050", tempBuffer);      // tempMPU6050
-        Log_Debug("Temp MPU6050: %i\n", tempBuffer);
     }
 }
-
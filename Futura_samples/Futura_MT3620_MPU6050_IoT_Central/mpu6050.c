@@ -0,0 +1,254 @@
+/* Futura MT3620 MPU6050 driver.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <string.h>
+
+#include "applibs_versions.h"
+#include <applibs/i2c.h>
+#include <applibs/log.h>
+
+#include "mpu6050.h"
+
+// WHO_AM_I reports the upper six bits of the I2C address
+static const uint8_t MPU6050WhoAmI = 0x68;
+
+// FIFO_EN: TEMP, XG, YG, ZG and ACCEL, in register order
+static const uint8_t fifoEnableMask = 0xf8;
+// USER_CTRL bits
+static const uint8_t userCtrlFifoEn = 0x40;
+static const uint8_t userCtrlFifoReset = 0x04;
+// INT_ENABLE / INT_STATUS FIFO_OFLOW bit
+static const uint8_t intFifoOverflow = 0x10;
+// CONFIG DLPF_CFG = 1: 184 Hz bandwidth, gyro output rate 1 kHz
+static const uint8_t configDlpf184Hz = 0x01;
+
+// Register/value pairs written once at init.
+// Sample rate = 8 kHz / (1 + SMPLRT_DIV) with the DLPF off, gyro +-500 dps, accel +-2 g,
+// clock from the X gyro PLL (wakes the chip from sleep).
+static const uint8_t initSequence[][2] = {
+    {MPU6050_PWR_MGMT_1, 0x01},   {MPU6050_SMPLRT_DIV, 0x00}, {MPU6050_CONFIG, 0x00},
+    {MPU6050_GYRO_CONFIG, 0x08}, {MPU6050_ACCEL_CONFIG, 0x00},
+};
+
+// Writes a single register.
+static int WriteRegister(int i2cFd, uint8_t address, uint8_t reg, uint8_t value)
+{
+    const uint8_t command[] = {reg, value};
+    ssize_t transferredBytes = I2CMaster_Write(i2cFd, address, command, sizeof(command));
+    if (transferredBytes != sizeof(command)) {
+        if (transferredBytes >= 0) {
+            errno = EIO;
+        }
+        Log_Debug("ERROR: MPU6050 write to register 0x%02x failed: errno=%d (%s)\n", reg, errno,
+                  strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Reads length consecutive bytes starting at reg (or length bytes from FIFO_R_W).
+static int ReadRegisters(int i2cFd, uint8_t address, uint8_t reg, uint8_t *data, size_t length)
+{
+    ssize_t transferredBytes =
+        I2CMaster_WriteThenRead(i2cFd, address, &reg, sizeof(reg), data, length);
+    if (transferredBytes != (ssize_t)(sizeof(reg) + length)) {
+        if (transferredBytes >= 0) {
+            errno = EIO;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+int MPU6050_Init(int i2cFd, uint8_t address)
+{
+    uint8_t whoAmI;
+    if (ReadRegisters(i2cFd, address, MPU6050_WHO_AM_I, &whoAmI, sizeof(whoAmI)) != 0) {
+        Log_Debug("ERROR: MPU6050 WHO_AM_I read failed: errno=%d (%s)\n", errno, strerror(errno));
+        return -1;
+    }
+    if ((whoAmI & 0x7e) != MPU6050WhoAmI) {
+        Log_Debug("ERROR: unexpected MPU6050 WHO_AM_I 0x%02x\n", whoAmI);
+        errno = ENODEV;
+        return -1;
+    }
+
+    for (size_t i = 0; i < sizeof(initSequence) / sizeof(initSequence[0]); ++i) {
+        if (WriteRegister(i2cFd, address, initSequence[i][0], initSequence[i][1]) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void MPU6050_DecodeSample(const uint8_t *raw, MPU6050_Sample *sample)
+{
+    sample->accelX = (int16_t)(raw[0] << 8 | raw[1]);
+    sample->accelY = (int16_t)(raw[2] << 8 | raw[3]);
+    sample->accelZ = (int16_t)(raw[4] << 8 | raw[5]);
+    sample->temp = (int16_t)(raw[6] << 8 | raw[7]);
+    sample->gyroX = (int16_t)(raw[8] << 8 | raw[9]);
+    sample->gyroY = (int16_t)(raw[10] << 8 | raw[11]);
+    sample->gyroZ = (int16_t)(raw[12] << 8 | raw[13]);
+}
+
+int MPU6050_ReadSample(int i2cFd, uint8_t address, MPU6050_Sample *sample)
+{
+    uint8_t raw[MPU6050_SAMPLE_LEN];
+
+    // The register pointer auto-increments, so one repeated-start read fetches every channel.
+    if (ReadRegisters(i2cFd, address, MPU6050_ACCEL_XOUT_H, raw, sizeof(raw)) != 0) {
+        return -1;
+    }
+
+    MPU6050_DecodeSample(raw, sample);
+    return 0;
+}
+
+// Flushes the FIFO and keeps it enabled.
+static int ResetFifo(int i2cFd, uint8_t address)
+{
+    if (WriteRegister(i2cFd, address, MPU6050_USER_CTRL, userCtrlFifoReset) != 0) {
+        return -1;
+    }
+    return WriteRegister(i2cFd, address, MPU6050_USER_CTRL, userCtrlFifoEn);
+}
+
+int MPU6050_FifoEnable(int i2cFd, uint8_t address, uint8_t sampleRateDiv)
+{
+    // Stop collecting while the rate changes, then start from an empty FIFO.
+    if (WriteRegister(i2cFd, address, MPU6050_FIFO_EN, 0x00) != 0 ||
+        WriteRegister(i2cFd, address, MPU6050_CONFIG, configDlpf184Hz) != 0 ||
+        WriteRegister(i2cFd, address, MPU6050_SMPLRT_DIV, sampleRateDiv) != 0 ||
+        WriteRegister(i2cFd, address, MPU6050_INT_ENABLE, intFifoOverflow) != 0 ||
+        ResetFifo(i2cFd, address) != 0 ||
+        WriteRegister(i2cFd, address, MPU6050_FIFO_EN, fifoEnableMask) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void MPU6050_RingInit(MPU6050_SampleRing *ring, MPU6050_Sample *storage, size_t capacity)
+{
+    ring->samples = storage;
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->count = 0;
+    ring->dropped = 0;
+}
+
+bool MPU6050_RingPop(MPU6050_SampleRing *ring, MPU6050_Sample *sample)
+{
+    if (ring->count == 0) {
+        return false;
+    }
+    *sample = ring->samples[ring->head];
+    ring->head = (ring->head + 1) % ring->capacity;
+    --ring->count;
+    return true;
+}
+
+// Appends a sample, overwriting the oldest one when the ring is full.
+static MPU6050_Sample *RingPushSlot(MPU6050_SampleRing *ring)
+{
+    if (ring->count == ring->capacity) {
+        ring->head = (ring->head + 1) % ring->capacity;
+        --ring->count;
+        ++ring->dropped;
+    }
+    MPU6050_Sample *slot = &ring->samples[(ring->head + ring->count) % ring->capacity];
+    ++ring->count;
+    return slot;
+}
+
+int MPU6050_FifoDrain(int i2cFd, uint8_t address, MPU6050_SampleRing *ring,
+                      MPU6050_FifoStats *stats)
+{
+    // Reading INT_STATUS clears it, so an overflow is reported exactly once.
+    uint8_t intStatus;
+    if (ReadRegisters(i2cFd, address, MPU6050_INT_STATUS, &intStatus, sizeof(intStatus)) != 0) {
+        return -1;
+    }
+
+    uint8_t countRaw[2];
+    if (ReadRegisters(i2cFd, address, MPU6050_FIFO_COUNTH, countRaw, sizeof(countRaw)) != 0) {
+        return -1;
+    }
+    size_t fifoCount = (size_t)(countRaw[0] << 8 | countRaw[1]);
+
+    // After an overflow the oldest bytes were overwritten and the FIFO no longer starts
+    // on a frame boundary, so its content is discarded.
+    if ((intStatus & intFifoOverflow) != 0 || fifoCount % MPU6050_SAMPLE_LEN != 0) {
+        ++stats->overflows;
+        Log_Debug("WARNING: MPU6050 FIFO overflow (%u bytes), resetting FIFO.\n",
+                  (unsigned)fifoCount);
+        return ResetFifo(i2cFd, address) == 0 ? 0 : -1;
+    }
+
+    size_t frames = fifoCount / MPU6050_SAMPLE_LEN;
+    size_t framesRead = 0;
+    uint8_t block[MPU6050_FIFO_BURST_FRAMES * MPU6050_SAMPLE_LEN];
+    while (framesRead < frames) {
+        size_t burstFrames = frames - framesRead;
+        if (burstFrames > MPU6050_FIFO_BURST_FRAMES) {
+            burstFrames = MPU6050_FIFO_BURST_FRAMES;
+        }
+
+        // FIFO_R_W does not auto-increment; consecutive reads pop consecutive FIFO bytes.
+        if (ReadRegisters(i2cFd, address, MPU6050_FIFO_R_W, block,
+                          burstFrames * MPU6050_SAMPLE_LEN) != 0) {
+            break;
+        }
+        for (size_t i = 0; i < burstFrames; ++i) {
+            MPU6050_DecodeSample(&block[i * MPU6050_SAMPLE_LEN], RingPushSlot(ring));
+        }
+        framesRead += burstFrames;
+    }
+
+    stats->frames += (uint32_t)framesRead;
+    if (framesRead > 0) {
+        ++stats->drains;
+    }
+
+    if (framesRead < frames) {
+        return -1;
+    }
+    return (int)framesRead;
+}
+
+void MPU6050_SumAdd(MPU6050_SampleSum *sum, const MPU6050_Sample *sample)
+{
+    ++sum->count;
+    sum->accelX += sample->accelX;
+    sum->accelY += sample->accelY;
+    sum->accelZ += sample->accelZ;
+    sum->temp += sample->temp;
+    sum->gyroX += sample->gyroX;
+    sum->gyroY += sample->gyroY;
+    sum->gyroZ += sample->gyroZ;
+}
+
+// Rounds sum / count to the nearest, halves away from zero.
+static int16_t Mean(int64_t sum, uint32_t count)
+{
+    int64_t half = count / 2;
+    return (int16_t)(sum >= 0 ? (sum + half) / count : -((-sum + half) / count));
+}
+
+bool MPU6050_SumMean(const MPU6050_SampleSum *sum, MPU6050_Sample *mean)
+{
+    if (sum->count == 0) {
+        return false;
+    }
+    mean->accelX = Mean(sum->accelX, sum->count);
+    mean->accelY = Mean(sum->accelY, sum->count);
+    mean->accelZ = Mean(sum->accelZ, sum->count);
+    mean->temp = Mean(sum->temp, sum->count);
+    mean->gyroX = Mean(sum->gyroX, sum->count);
+    mean->gyroY = Mean(sum->gyroY, sum->count);
+    mean->gyroZ = Mean(sum->gyroZ, sum->count);
+    return true;
+}
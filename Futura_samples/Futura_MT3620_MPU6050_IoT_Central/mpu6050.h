@@ -0,0 +1,160 @@
+/* Futura MT3620 MPU6050 driver.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// MPU6050 default I2C address (AD0 low)
+#define MPU6050_ADDR         0x68
+
+// MPU6050 registers
+#define MPU6050_SMPLRT_DIV   0x19
+#define MPU6050_CONFIG       0x1a
+#define MPU6050_GYRO_CONFIG  0x1b
+#define MPU6050_ACCEL_CONFIG 0x1c
+#define MPU6050_FIFO_EN      0x23
+#define MPU6050_INT_ENABLE   0x38
+#define MPU6050_INT_STATUS   0x3a
+#define MPU6050_ACCEL_XOUT_H 0x3b
+#define MPU6050_TEMP_OUT_H   0x41
+#define MPU6050_GYRO_XOUT_H  0x43
+#define MPU6050_USER_CTRL    0x6a
+#define MPU6050_PWR_MGMT_1   0x6b
+#define MPU6050_FIFO_COUNTH  0x72
+#define MPU6050_FIFO_R_W     0x74
+#define MPU6050_WHO_AM_I     0x75
+
+// ACCEL_XOUT_H..GYRO_ZOUT_L: accel XYZ, temperature, gyro XYZ, big endian
+#define MPU6050_SAMPLE_LEN   14
+
+// On-chip FIFO size. With accel, temperature and gyro enabled each FIFO frame has
+// the same layout as a MPU6050_SAMPLE_LEN register read.
+#define MPU6050_FIFO_SIZE    1024
+
+// Frames fetched per FIFO_R_W block read
+#define MPU6050_FIFO_BURST_FRAMES 16
+
+/// <summary>
+/// One decoded MPU6050 sample: raw accelerometer, temperature and gyroscope channels.
+/// </summary>
+typedef struct {
+    int16_t accelX, accelY, accelZ;
+    int16_t temp;
+    int16_t gyroX, gyroY, gyroZ;
+} MPU6050_Sample;
+
+/// <summary>
+/// Fixed-size ring of decoded samples filled by <see cref="MPU6050_FifoDrain" />.
+/// When the ring is full the oldest sample is overwritten and counted in dropped.
+/// </summary>
+typedef struct {
+    MPU6050_Sample *samples;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    uint32_t dropped;
+} MPU6050_SampleRing;
+
+/// <summary>
+/// Channel sums of the samples added by <see cref="MPU6050_SumAdd" />, for their mean.
+/// </summary>
+typedef struct {
+    uint32_t count;
+    int64_t accelX, accelY, accelZ;
+    int64_t temp;
+    int64_t gyroX, gyroY, gyroZ;
+} MPU6050_SampleSum;
+
+/// <summary>
+/// FIFO streaming counters, updated by <see cref="MPU6050_FifoDrain" />.
+/// </summary>
+typedef struct {
+    uint32_t frames;    // frames read from the FIFO
+    uint32_t drains;    // calls that read at least one frame
+    uint32_t overflows; // FIFO overflows detected (the FIFO is reset, its content lost)
+} MPU6050_FifoStats;
+
+/// <summary>
+/// Checks WHO_AM_I and writes the sample rate, filter, full scale and clock source
+/// registers. Call once after the I2C master has been opened and configured.
+/// </summary>
+/// <param name="i2cFd">I2C master file descriptor.</param>
+/// <param name="address">MPU6050 I2C address.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int MPU6050_Init(int i2cFd, uint8_t address);
+
+/// <summary>
+/// Reads all seven channels with a single I2C write-then-read burst starting at
+/// ACCEL_XOUT_H, so that every channel comes from the same sampling instant.
+/// </summary>
+/// <param name="i2cFd">I2C master file descriptor.</param>
+/// <param name="address">MPU6050 I2C address.</param>
+/// <param name="sample">Receives the decoded sample.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int MPU6050_ReadSample(int i2cFd, uint8_t address, MPU6050_Sample *sample);
+
+/// <summary>
+/// Enables the on-chip FIFO for accelerometer, temperature and gyroscope and starts
+/// streaming at 1 kHz / (1 + sampleRateDiv), with the 184 Hz digital low pass filter.
+/// Call after <see cref="MPU6050_Init" />.
+/// </summary>
+/// <param name="i2cFd">I2C master file descriptor.</param>
+/// <param name="address">MPU6050 I2C address.</param>
+/// <param name="sampleRateDiv">SMPLRT_DIV value; 0 gives 1 kHz, 9 gives 100 Hz.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int MPU6050_FifoEnable(int i2cFd, uint8_t address, uint8_t sampleRateDiv);
+
+/// <summary>
+/// Reads FIFO_COUNT and moves every whole frame in the FIFO into the ring using
+/// block reads of up to MPU6050_FIFO_BURST_FRAMES frames. On FIFO overflow the FIFO
+/// is reset and the overflow is counted in stats.
+/// </summary>
+/// <param name="i2cFd">I2C master file descriptor.</param>
+/// <param name="address">MPU6050 I2C address.</param>
+/// <param name="ring">Receives the decoded samples.</param>
+/// <param name="stats">Streaming counters to update.</param>
+/// <returns>Number of frames read, or -1 on failure, in which case errno contains more
+/// information.</returns>
+int MPU6050_FifoDrain(int i2cFd, uint8_t address, MPU6050_SampleRing *ring,
+                      MPU6050_FifoStats *stats);
+
+/// <summary>
+/// Initializes an empty sample ring on caller-provided storage.
+/// </summary>
+void MPU6050_RingInit(MPU6050_SampleRing *ring, MPU6050_Sample *storage, size_t capacity);
+
+/// <summary>
+/// Removes the oldest sample from the ring.
+/// </summary>
+/// <returns>true if a sample was returned, false if the ring is empty.</returns>
+bool MPU6050_RingPop(MPU6050_SampleRing *ring, MPU6050_Sample *sample);
+
+/// <summary>
+/// Adds a sample to the channel sums. Zero the sums to start again.
+/// </summary>
+void MPU6050_SumAdd(MPU6050_SampleSum *sum, const MPU6050_Sample *sample);
+
+/// <summary>
+/// Computes the mean of each channel over the samples added, rounded to the nearest.
+/// </summary>
+/// <returns>true if the mean was returned, false if no sample was added.</returns>
+bool MPU6050_SumMean(const MPU6050_SampleSum *sum, MPU6050_Sample *mean);
+
+/// <summary>
+/// Decodes a 14-byte ACCEL_XOUT_H..GYRO_ZOUT_L block into a sample.
+/// </summary>
+/// <param name="raw">MPU6050_SAMPLE_LEN bytes in register order.</param>
+/// <param name="sample">Receives the decoded sample.</param>
+void MPU6050_DecodeSample(const uint8_t *raw, MPU6050_Sample *sample);
+
+/// <summary>
+/// Converts the raw TEMP_OUT value to degrees Celsius (datasheet formula).
+/// </summary>
+static inline double MPU6050_TempCelsius(int16_t rawTemp)
+{
+    return rawTemp / 340.00 + 36.53;
+}
@@ -0,0 +1,110 @@
+/* Futura MT3620 telemetry message builder.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "telemetry.h"
+
+// Appends formatted text; on overflow the builder is marked and left unterminated.
+static bool Append(TelemetryBuilder *builder, const char *format, ...)
+{
+    if (builder->overflow || builder->finished) {
+        return false;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(builder->buffer + builder->length, builder->size - builder->length,
+                        format, args);
+    va_end(args);
+
+    if (len < 0 || (size_t)len >= builder->size - builder->length) {
+        builder->overflow = true;
+        return false;
+    }
+    builder->length += (size_t)len;
+    return true;
+}
+
+// Writes the separator and quoted key of the next pair.
+static bool AppendKey(TelemetryBuilder *builder, const char *key)
+{
+    return Append(builder, "%c\"%s\":", builder->count == 0 ? '{' : ',', key);
+}
+
+void Telemetry_Init(TelemetryBuilder *builder, char *buffer, size_t size)
+{
+    builder->buffer = buffer;
+    builder->size = size;
+    Telemetry_Reset(builder);
+}
+
+void Telemetry_Reset(TelemetryBuilder *builder)
+{
+    builder->length = 0;
+    builder->count = 0;
+    builder->overflow = builder->size == 0;
+    builder->finished = false;
+    if (builder->size > 0) {
+        builder->buffer[0] = '\0';
+    }
+}
+
+bool Telemetry_AddInt(TelemetryBuilder *builder, const char *key, int value)
+{
+    if (!AppendKey(builder, key) || !Append(builder, "%d", value)) {
+        return false;
+    }
+    ++builder->count;
+    return true;
+}
+
+bool Telemetry_AddDouble(TelemetryBuilder *builder, const char *key, double value)
+{
+    if (!AppendKey(builder, key) ||
+        !(isfinite(value) ? Append(builder, "%.2f", value) : Append(builder, "null"))) {
+        return false;
+    }
+    ++builder->count;
+    return true;
+}
+
+bool Telemetry_AddString(TelemetryBuilder *builder, const char *key, const char *value)
+{
+    if (!AppendKey(builder, key) || !Append(builder, "\"")) {
+        return false;
+    }
+    for (const char *c = value; *c != '\0'; ++c) {
+        bool ok;
+        if (*c == '"' || *c == '\\') {
+            ok = Append(builder, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            ok = Append(builder, "\\u%04x", (unsigned char)*c);
+        } else {
+            ok = Append(builder, "%c", *c);
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    if (!Append(builder, "\"")) {
+        return false;
+    }
+    ++builder->count;
+    return true;
+}
+
+const char *Telemetry_Finish(TelemetryBuilder *builder)
+{
+    if (builder->finished) {
+        return builder->buffer;
+    }
+    if (builder->count == 0 || !Append(builder, "}")) {
+        return NULL;
+    }
+    builder->finished = true;
+    return builder->buffer;
+}
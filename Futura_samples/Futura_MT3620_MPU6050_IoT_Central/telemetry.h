@@ -0,0 +1,62 @@
+/* Futura MT3620 telemetry message builder.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// <summary>
+/// Accumulates telemetry key/value pairs into a single flat JSON object held in a
+/// caller-provided buffer, so that several readings go out in one IoT Hub message.
+/// Initialize with <see cref="Telemetry_Init" />.
+/// </summary>
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t length;
+    size_t count;
+    bool overflow;
+    bool finished;
+} TelemetryBuilder;
+
+/// <summary>
+/// Initializes an empty builder on the given buffer.
+/// </summary>
+/// <param name="builder">Builder to initialize.</param>
+/// <param name="buffer">Output buffer, sized for the largest message.</param>
+/// <param name="size">Size of buffer in bytes.</param>
+void Telemetry_Init(TelemetryBuilder *builder, char *buffer, size_t size);
+
+/// <summary>
+/// Discards all pairs so the builder can be reused for the next message.
+/// </summary>
+void Telemetry_Reset(TelemetryBuilder *builder);
+
+/// <summary>
+/// Adds an integer value, written as a JSON number.
+/// </summary>
+/// <returns>true on success, false if the buffer is full.</returns>
+bool Telemetry_AddInt(TelemetryBuilder *builder, const char *key, int value);
+
+/// <summary>
+/// Adds a floating point value, written as a JSON number with two decimals. JSON has no
+/// NaN or infinity, so non-finite values are written as null.
+/// </summary>
+/// <returns>true on success, false if the buffer is full.</returns>
+bool Telemetry_AddDouble(TelemetryBuilder *builder, const char *key, double value);
+
+/// <summary>
+/// Adds a string value, escaping quotes, backslashes and control characters.
+/// </summary>
+/// <returns>true on success, false if the buffer is full.</returns>
+bool Telemetry_AddString(TelemetryBuilder *builder, const char *key, const char *value);
+
+/// <summary>
+/// Closes the JSON object. Calling it again returns the same message; pairs added after it
+/// are rejected until <see cref="Telemetry_Reset" />.
+/// </summary>
+/// <returns>The NUL-terminated message, or NULL if no pair was added or any pair did not
+/// fit in the buffer.</returns>
+const char *Telemetry_Finish(TelemetryBuilder *builder);
@@ -0,0 +1,284 @@
+/* Futura MT3620 MPU6050: FIFO streaming test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Streams samples through the FIFO model of mpu6050_host.c, which fills the FIFO at the
+// sample rate, also while the bus is busy, and checks that:
+// - MPU6050_FifoEnable sets the 184 Hz filter, the divider, the overflow interrupt and the
+//   FIFO groups, so that each frame is a 14-byte ACCEL_XOUT_H..GYRO_ZOUT_L block, and
+//   starts from an empty FIFO;
+// - MPU6050_FifoDrain, at random divisors, rates of the bus and intervals, returns every
+//   sample in order, without a gap, in 2 transactions plus one per 16 frames, never reads
+//   the FIFO empty, and counts the frames and the drains;
+// - an overflow, or a FIFO which does not hold whole frames, is counted and warned about,
+//   the FIFO is reset and still enabled, and the next drain starts on a frame boundary;
+// - a full ring keeps the newest samples and counts the dropped ones;
+// - a failed block read returns -1, with the frames read before it in the ring;
+// - MPU6050_SumMean returns the mean of the samples added, rounded to the nearest.
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <applibs/i2c.h>
+
+#include "mpu6050.h"
+#include "mpu6050_host.h"
+
+#define ROUNDS 3000
+#define RING_SAMPLES 128
+
+static const int i2cFd = 3;
+static unsigned long failures = 0;
+
+static MPU6050_Sample ringStorage[RING_SAMPLES];
+static MPU6050_SampleRing ring;
+static MPU6050_FifoStats stats;
+
+static uint32_t rngState = 0x68E31DA4;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %lu\n", what, n);
+    }
+}
+
+static bool SampleIs(const MPU6050_Sample *sample, uint32_t n)
+{
+    uint8_t raw[MPU6050_SAMPLE_LEN];
+    HostMpu6050_SampleBytes(n, raw);
+    const int16_t channels[7] = {sample->accelX, sample->accelY, sample->accelZ, sample->temp,
+                                 sample->gyroX,  sample->gyroY,  sample->gyroZ};
+    for (int c = 0; c < 7; ++c) {
+        if (channels[c] != (int16_t)((uint16_t)raw[2 * c] << 8 | raw[2 * c + 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Pops the ring, which must hold samples next.. in order; returns how many it held.
+static size_t PopInOrder(uint32_t *next, const char *what, unsigned long n)
+{
+    size_t popped = 0;
+    MPU6050_Sample sample;
+    while (MPU6050_RingPop(&ring, &sample)) {
+        if (!SampleIs(&sample, (*next)++)) {
+            Fail(what, n);
+        }
+        ++popped;
+    }
+    return popped;
+}
+
+static void Start(uint8_t sampleRateDiv)
+{
+    HostMpu6050_Reset();
+    MPU6050_Init(i2cFd, MPU6050_ADDR);
+    MPU6050_RingInit(&ring, ringStorage, RING_SAMPLES);
+    memset(&stats, 0, sizeof(stats));
+    HostMpu6050_Advance(5000); // samples before the FIFO is on are not in it
+    if (MPU6050_FifoEnable(i2cFd, MPU6050_ADDR, sampleRateDiv) != 0) {
+        Fail("FIFO enable", sampleRateDiv);
+    }
+}
+
+static void TestEnable(void)
+{
+    Start(4);
+    if (HostMpu6050_GetReg(MPU6050_CONFIG) != 0x01 ||
+        HostMpu6050_GetReg(MPU6050_SMPLRT_DIV) != 4 ||
+        HostMpu6050_GetReg(MPU6050_INT_ENABLE) != 0x10 ||
+        HostMpu6050_GetReg(MPU6050_FIFO_EN) != 0xf8 ||
+        HostMpu6050_GetReg(MPU6050_USER_CTRL) != 0x40 || HostMpu6050_FifoCount() != 0) {
+        Fail("FIFO registers", 0);
+    }
+
+    // 200 Hz: 10 frames in 50 ms, each the 14 bytes of a sample
+    uint32_t next = HostMpu6050_Latched() + 1;
+    HostMpu6050_Advance(50000);
+    if (HostMpu6050_FifoCount() != 10 * MPU6050_SAMPLE_LEN) {
+        Fail("FIFO bytes at 200 Hz", HostMpu6050_FifoCount());
+    }
+    unsigned long transactions = HostI2c_Transactions();
+    if (MPU6050_FifoDrain(i2cFd, MPU6050_ADDR, &ring, &stats) != 10 ||
+        HostI2c_Transactions() - transactions != 3 || PopInOrder(&next, "frame layout", 0) != 10 ||
+        stats.frames != 10 || stats.drains != 1 || stats.overflows != 0) {
+        Fail("drain of 10 frames", 0);
+    }
+
+    // An empty FIFO takes the two register reads only
+    transactions = HostI2c_Transactions();
+    if (MPU6050_FifoDrain(i2cFd, MPU6050_ADDR, &ring, &stats) != 0 ||
+        HostI2c_Transactions() - transactions != 2 || stats.drains != 1) {
+        Fail("drain of an empty FIFO", 0);
+    }
+}
+
+static void TestStreaming(void)
+{
+    for (unsigned long round = 0; round < ROUNDS; ++round) {
+        // As main.c says, 1 kHz needs more than the 100 kHz of the standard mode
+        static const uint32_t busSpeeds[] = {0, 100000, 400000, 1000000};
+        uint32_t busSpeed = busSpeeds[Random(4)];
+        uint8_t sampleRateDiv = (uint8_t)(busSpeed == 100000 ? 1 + Random(9) : Random(10));
+        Start(sampleRateDiv);
+        HostMpu6050_SetBusSpeed(busSpeed);
+        uint32_t next = HostMpu6050_Latched() + 1;
+        uint32_t frames = 0;
+        uint32_t drains = 0;
+
+        for (int drain = 0; drain < 10; ++drain) {
+            // Up to 40 ms, which with the frames that arrive during the drain stays short of
+            // the 73 frames that fill the FIFO
+            HostMpu6050_Advance(Random(40000));
+            size_t waiting = HostMpu6050_FifoCount() / MPU6050_SAMPLE_LEN;
+            unsigned long transactions = HostI2c_Transactions();
+            int result = MPU6050_FifoDrain(i2cFd, MPU6050_ADDR, &ring, &stats);
+            // The frames which arrive during the two register reads are drained too
+            unsigned long blocks = ((unsigned long)result + MPU6050_FIFO_BURST_FRAMES - 1) /
+                                   MPU6050_FIFO_BURST_FRAMES;
+            if (result < (int)waiting || HostI2c_Transactions() - transactions != 2 + blocks) {
+                Fail("drain, round", round);
+            }
+            if (PopInOrder(&next, "sample out of order, round", round) != (size_t)result) {
+                Fail("samples in the ring, round", round);
+            }
+            frames += (uint32_t)result;
+            drains += result > 0;
+        }
+        if (stats.frames != frames || stats.drains != drains || stats.overflows != 0) {
+            Fail("stats, round", round);
+        }
+    }
+    if (HostMpu6050_EmptyFifoReads() != 0) {
+        Fail("FIFO read empty", HostMpu6050_EmptyFifoReads());
+    }
+}
+
+static void TestOverflow(void)
+{
+    // At 1 kHz the 73 frames of the FIFO fill in 73 ms
+    Start(0);
+    unsigned long problems = HostLog_Problems();
+    HostMpu6050_Advance(80000);
+    if (HostMpu6050_FifoCount() != MPU6050_FIFO_SIZE) {
+        Fail("FIFO bytes after an overflow", HostMpu6050_FifoCount());
+    }
+    if (MPU6050_FifoDrain(i2cFd, MPU6050_ADDR, &ring, &stats) != 0 || stats.overflows != 1 ||
+        stats.frames != 0 || HostLog_Problems() != problems + 1 ||
+        HostMpu6050_FifoCount() != 0 || HostMpu6050_GetReg(MPU6050_USER_CTRL) != 0x40) {
+        Fail("overflow", 0);
+    }
+    uint32_t next = HostMpu6050_Latched() + 1;
+    HostMpu6050_Advance(20000);
+    if (MPU6050_FifoDrain(i2cFd, MPU6050_ADDR, &ring, &stats) != 20 ||
+        PopInOrder(&next, "sample after an overflow", 0) != 20) {
+        Fail("drain after an overflow", 0);
+    }
+
+    // An overflow which leaves whole frames in the FIFO is still reported, by INT_STATUS
+    Start(0);
+    HostMpu6050_Advance(74000);
+    size_t count = HostMpu6050_FifoCount();
+    uint8_t head[MPU6050_SAMPLE_LEN];
+    uint8_t reg = MPU6050_FIFO_R_W;
+    I2CMaster_WriteThenRead(i2cFd, MPU6050_ADDR, &reg, 1, head, count % MPU6050_SAMPLE_LEN);
+    if (MPU6050_FifoDrain(i2cFd, MPU6050_ADDR, &ring, &stats) != 0 || stats.overflows != 1 ||
+        HostMpu6050_FifoCount() != 0) {
+        Fail("overflow of whole frames", count);
+    }
+
+    // A FIFO which does not hold whole frames is out of step with the frames
+    Start(0);
+    HostMpu6050_Advance(3000);
+    static const uint8_t stray[5] = {1, 2, 3, 4, 5};
+    HostMpu6050_FifoPush(stray, sizeof(stray));
+    if (MPU6050_FifoDrain(i2cFd, MPU6050_ADDR, &ring, &stats) != 0 || stats.overflows != 1 ||
+        HostMpu6050_FifoCount() != 0 || MPU6050_RingPop(&ring, &(MPU6050_Sample){0})) {
+        Fail("partial frame", 0);
+    }
+    next = HostMpu6050_Latched() + 1;
+    HostMpu6050_Advance(7000);
+    if (MPU6050_FifoDrain(i2cFd, MPU6050_ADDR, &ring, &stats) != 7 ||
+        PopInOrder(&next, "sample after a partial frame", 0) != 7) {
+        Fail("drain after a partial frame", 0);
+    }
+}
+
+static void TestRingAndErrors(void)
+{
+    // A ring of 8 keeps the newest 8 of 20 frames
+    static MPU6050_Sample small[8];
+    Start(0);
+    MPU6050_RingInit(&ring, small, 8);
+    uint32_t first = HostMpu6050_Latched() + 1;
+    HostMpu6050_Advance(20000);
+    uint32_t next = first + 12;
+    if (MPU6050_FifoDrain(i2cFd, MPU6050_ADDR, &ring, &stats) != 20 || ring.dropped != 12 ||
+        PopInOrder(&next, "sample of a full ring", 0) != 8) {
+        Fail("full ring", ring.dropped);
+    }
+
+    // The second of three block reads fails
+    Start(0);
+    next = HostMpu6050_Latched() + 1;
+    HostMpu6050_Advance(40000);
+    HostI2c_FailAfter(3, -1, EIO);
+    errno = 0;
+    if (MPU6050_FifoDrain(i2cFd, MPU6050_ADDR, &ring, &stats) != -1 || errno != EIO ||
+        stats.frames != MPU6050_FIFO_BURST_FRAMES ||
+        PopInOrder(&next, "sample before a failed read", 0) != MPU6050_FIFO_BURST_FRAMES) {
+        Fail("failed block read", stats.frames);
+    }
+    HostI2c_FailAfter(0, -1, EIO);
+    if (MPU6050_FifoDrain(i2cFd, MPU6050_ADDR, &ring, &stats) != -1) {
+        Fail("failed INT_STATUS read", 0);
+    }
+}
+
+static void TestMean(void)
+{
+    for (unsigned long round = 0; round < ROUNDS; ++round) {
+        MPU6050_SampleSum sum = {0};
+        uint32_t count = 1 + Random(2000);
+        int64_t total = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            int16_t value = (int16_t)(Random(65535) - 32767); // so that -value fits
+            MPU6050_SumAdd(&sum, &(MPU6050_Sample){value, 0, 0, (int16_t)-value, 0, 0, 1});
+            total += value;
+        }
+        // Nearest, halves away from zero, in doubles
+        double exact = (double)total / count;
+        int16_t expected = (int16_t)(exact < 0 ? -(int64_t)(-exact + 0.5) : (int64_t)(exact + 0.5));
+        MPU6050_Sample mean;
+        if (!MPU6050_SumMean(&sum, &mean) || mean.accelX != expected ||
+            mean.temp != -expected || mean.gyroZ != 1 || sum.count != count) {
+            Fail("mean, round", round);
+        }
+    }
+    MPU6050_SampleSum empty = {0};
+    if (MPU6050_SumMean(&empty, &(MPU6050_Sample){0})) {
+        Fail("mean of no sample", 0);
+    }
+}
+
+int main(void)
+{
+    TestEnable();
+    TestStreaming();
+    TestOverflow();
+    TestRingAndErrors();
+    TestMean();
+    printf("%lu failure(s)\n", failures);
+    return failures != 0;
+}
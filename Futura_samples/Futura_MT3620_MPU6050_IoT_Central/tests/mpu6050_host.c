@@ -0,0 +1,348 @@
+/* Futura MT3620 MPU6050: host stand-ins for the I2C master and the MPU6050, for the tests.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "mpu6050_host.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <applibs/i2c.h>
+
+#include "mpu6050.h"
+
+#define REG_COUNT 128
+
+// FIFO_EN bits, INT_STATUS bits and USER_CTRL bits
+#define FIFO_EN_TEMP 0x80
+#define FIFO_EN_XG 0x40
+#define FIFO_EN_YG 0x20
+#define FIFO_EN_ZG 0x10
+#define FIFO_EN_ACCEL 0x08
+#define INT_FIFO_OFLOW 0x10
+#define INT_DATA_RDY 0x01
+#define USER_CTRL_FIFO_EN 0x40
+#define USER_CTRL_FIFO_RESET 0x04
+
+static uint8_t regs[REG_COUNT];
+static uint8_t pointer = 0;
+static uint32_t latched = 0;
+static unsigned long latchEvery = 0;
+
+static uint8_t fifo[MPU6050_FIFO_SIZE];
+static size_t fifoHead = 0;
+static size_t fifoCount = 0;
+static unsigned long emptyFifoReads = 0;
+static uint64_t sinceSampleNs = 0;
+static uint32_t busHz = 0;
+
+static unsigned long transactions = 0;
+static unsigned long busBits = 0;
+static unsigned long failSkip = 0;
+static bool failArmed = false;
+static ssize_t failResult = -1;
+static int failError = 0;
+static unsigned long problems = 0;
+
+int Log_Debug(const char *fmt, ...)
+{
+    if (strncmp(fmt, "WARNING", 7) == 0 || strncmp(fmt, "ERROR", 5) == 0) {
+        ++problems;
+    }
+    return 0;
+}
+
+unsigned long HostLog_Problems(void)
+{
+    return problems;
+}
+
+void HostMpu6050_Reset(void)
+{
+    memset(regs, 0, sizeof(regs));
+    regs[MPU6050_WHO_AM_I] = MPU6050_ADDR;
+    regs[MPU6050_PWR_MGMT_1] = 0x40; // SLEEP
+    pointer = 0;
+    latchEvery = 0;
+    fifoHead = 0;
+    fifoCount = 0;
+    emptyFifoReads = 0;
+    sinceSampleNs = 0;
+    busHz = 0;
+    failArmed = false;
+    transactions = 0;
+    busBits = 0;
+    HostMpu6050_Latch(0);
+}
+
+uint8_t HostMpu6050_GetReg(uint8_t reg)
+{
+    return regs[reg % REG_COUNT];
+}
+
+void HostMpu6050_SetReg(uint8_t reg, uint8_t value)
+{
+    regs[reg % REG_COUNT] = value;
+}
+
+// MurmurHash3 finaliser, a bijection
+static uint32_t Mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+void HostMpu6050_SampleBytes(uint32_t n, uint8_t raw[14])
+{
+    // Channel c of sample n is the low half of Mix(7 n + c): 7 n + c differ for all n and c
+    // below 2^32 / 7, and so do their mixes, in 16 bits for all but a few pairs.
+    for (uint32_t c = 0; c < 7; ++c) {
+        uint32_t value = Mix(7 * n + c);
+        raw[2 * c] = (uint8_t)(value >> 8);
+        raw[2 * c + 1] = (uint8_t)value;
+    }
+}
+
+void HostMpu6050_Latch(uint32_t n)
+{
+    latched = n;
+    HostMpu6050_SampleBytes(n, &regs[MPU6050_ACCEL_XOUT_H]);
+}
+
+void HostMpu6050_LatchEvery(unsigned long every)
+{
+    latchEvery = every;
+}
+
+uint32_t HostMpu6050_Latched(void)
+{
+    return latched;
+}
+
+void HostMpu6050_FifoPush(const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        if (fifoCount == MPU6050_FIFO_SIZE) {
+            fifoHead = (fifoHead + 1) % MPU6050_FIFO_SIZE;
+            --fifoCount;
+            regs[MPU6050_INT_STATUS] |= INT_FIFO_OFLOW;
+        }
+        fifo[(fifoHead + fifoCount) % MPU6050_FIFO_SIZE] = data[i];
+        ++fifoCount;
+    }
+}
+
+size_t HostMpu6050_FifoCount(void)
+{
+    return fifoCount;
+}
+
+unsigned long HostMpu6050_EmptyFifoReads(void)
+{
+    return emptyFifoReads;
+}
+
+// Latches the next sample and appends the enabled groups of it to the FIFO.
+static void Sample(void)
+{
+    HostMpu6050_Latch(latched + 1);
+    regs[MPU6050_INT_STATUS] |= INT_DATA_RDY;
+    if ((regs[MPU6050_USER_CTRL] & USER_CTRL_FIFO_EN) == 0) {
+        return;
+    }
+
+    const uint8_t *out = &regs[MPU6050_ACCEL_XOUT_H];
+    uint8_t enabled = regs[MPU6050_FIFO_EN];
+    if (enabled & FIFO_EN_ACCEL) {
+        HostMpu6050_FifoPush(out, 6);
+    }
+    if (enabled & FIFO_EN_TEMP) {
+        HostMpu6050_FifoPush(out + 6, 2);
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        if (enabled & (FIFO_EN_XG >> axis)) {
+            HostMpu6050_FifoPush(out + 8 + 2 * axis, 2);
+        }
+    }
+}
+
+// Sample period: the gyro output rate, 8 kHz with DLPF_CFG 0 or 7, else 1 kHz, divided by
+// 1 + SMPLRT_DIV
+static uint64_t SamplePeriodNs(void)
+{
+    uint8_t dlpf = regs[MPU6050_CONFIG] & 0x07;
+    uint64_t outputPeriodNs = dlpf == 0 || dlpf == 7 ? 125000 : 1000000;
+    return outputPeriodNs * (1 + regs[MPU6050_SMPLRT_DIV]);
+}
+
+static void AdvanceNs(uint64_t ns)
+{
+    sinceSampleNs += ns;
+    while (sinceSampleNs >= SamplePeriodNs()) {
+        sinceSampleNs -= SamplePeriodNs();
+        Sample();
+    }
+}
+
+void HostMpu6050_Advance(uint32_t microseconds)
+{
+    AdvanceNs((uint64_t)microseconds * 1000);
+}
+
+void HostMpu6050_SetBusSpeed(uint32_t hz)
+{
+    busHz = hz;
+}
+
+unsigned long HostI2c_Transactions(void)
+{
+    return transactions;
+}
+
+unsigned long HostI2c_BusBits(void)
+{
+    return busBits;
+}
+
+void HostI2c_FailAfter(unsigned long skip, ssize_t result, int error)
+{
+    failArmed = true;
+    failSkip = skip;
+    failResult = result;
+    failError = error;
+}
+
+static uint8_t ReadByte(void)
+{
+    if (pointer == MPU6050_FIFO_R_W) {
+        if (fifoCount == 0) {
+            ++emptyFifoReads;
+            return 0xff;
+        }
+        uint8_t value = fifo[fifoHead];
+        fifoHead = (fifoHead + 1) % MPU6050_FIFO_SIZE;
+        --fifoCount;
+        return value;
+    }
+
+    uint8_t value;
+    if (pointer == MPU6050_FIFO_COUNTH) {
+        value = (uint8_t)(fifoCount >> 8);
+    } else if (pointer == MPU6050_FIFO_COUNTH + 1) {
+        value = (uint8_t)fifoCount;
+    } else {
+        value = regs[pointer];
+    }
+    if (pointer == MPU6050_INT_STATUS) {
+        regs[MPU6050_INT_STATUS] = 0;
+    }
+    pointer = (uint8_t)((pointer + 1) % REG_COUNT);
+    return value;
+}
+
+static void WriteByte(uint8_t value)
+{
+    if (pointer == MPU6050_FIFO_R_W) {
+        HostMpu6050_FifoPush(&value, 1);
+        return;
+    }
+    if (pointer == MPU6050_USER_CTRL && (value & USER_CTRL_FIFO_RESET) != 0) {
+        fifoHead = 0;
+        fifoCount = 0;
+        value &= (uint8_t)~USER_CTRL_FIFO_RESET; // self-clearing
+    }
+    regs[pointer] = value;
+    pointer = (uint8_t)((pointer + 1) % REG_COUNT);
+}
+
+// Counts a transaction of writeLength then readLength bytes; returns false, with errno and
+// *result set, if it fails before reaching the chip.
+static bool StartTransaction(I2C_DeviceAddress address, size_t writeLength, size_t readLength,
+                             ssize_t *result)
+{
+    ++transactions;
+    if (latchEvery != 0 && transactions % latchEvery == 0) {
+        HostMpu6050_Latch(latched + 1);
+    }
+
+    if (failArmed && failSkip-- == 0) {
+        failArmed = false;
+        *result = failResult;
+        if (failResult < 0) {
+            errno = failError;
+        }
+        return false;
+    }
+    if (address != MPU6050_ADDR) {
+        // Nobody acknowledges the address byte
+        busBits += 1 + 9 + 1;
+        *result = -1;
+        errno = ENXIO;
+        return false;
+    }
+
+    unsigned long bits = 1 + 9 + 9 * writeLength + 1;
+    if (writeLength > 0 && readLength > 0) {
+        bits += 1 + 9 + 9 * readLength; // repeated START
+    } else {
+        bits += 9 * readLength;
+    }
+    busBits += bits;
+    if (busHz != 0) {
+        AdvanceNs((uint64_t)bits * 1000000000 / busHz);
+    }
+    return true;
+}
+
+ssize_t I2CMaster_Write(int fd, I2C_DeviceAddress address, const uint8_t *data, size_t length)
+{
+    (void)fd;
+    ssize_t result;
+    if (!StartTransaction(address, length, 0, &result)) {
+        return result;
+    }
+    if (length > 0) {
+        pointer = data[0] % REG_COUNT;
+        for (size_t i = 1; i < length; ++i) {
+            WriteByte(data[i]);
+        }
+    }
+    return (ssize_t)length;
+}
+
+ssize_t I2CMaster_Read(int fd, I2C_DeviceAddress address, uint8_t *buffer, size_t maxLength)
+{
+    (void)fd;
+    ssize_t result;
+    if (!StartTransaction(address, 0, maxLength, &result)) {
+        return result;
+    }
+    for (size_t i = 0; i < maxLength; ++i) {
+        buffer[i] = ReadByte();
+    }
+    return (ssize_t)maxLength;
+}
+
+ssize_t I2CMaster_WriteThenRead(int fd, I2C_DeviceAddress address, const uint8_t *writeData,
+                                size_t lenWriteData, uint8_t *readData, size_t lenReadData)
+{
+    (void)fd;
+    ssize_t result;
+    if (!StartTransaction(address, lenWriteData, lenReadData, &result)) {
+        return result;
+    }
+    if (lenWriteData > 0) {
+        pointer = writeData[0] % REG_COUNT;
+        for (size_t i = 1; i < lenWriteData; ++i) {
+            WriteByte(writeData[i]);
+        }
+    }
+    for (size_t i = 0; i < lenReadData; ++i) {
+        readData[i] = ReadByte();
+    }
+    return (ssize_t)(lenWriteData + lenReadData);
+}
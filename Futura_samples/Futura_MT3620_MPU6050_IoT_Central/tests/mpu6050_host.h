@@ -0,0 +1,88 @@
+/* Futura MT3620 MPU6050: host stand-ins for the I2C master and the MPU6050, for the tests.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// The tests build mpu6050.c natively over these functions. The I2C calls go to a model of
+// the MPU6050 register file (register map 4): a write sets the register pointer from its
+// first byte and stores the other bytes from there, and a read returns the registers from
+// the pointer on, which increments after each byte. Every call is one bus transaction; its
+// bits on the wire are counted as START, 9 bits per byte with the address byte, a repeated
+// START and address for WriteThenRead, and STOP.
+// The FIFO is modelled too (register map 4.6, 4.17, 4.30): at each sample of the rate set
+// by CONFIG and SMPLRT_DIV the chip latches the next sample and, while USER_CTRL FIFO_EN is
+// set, appends the groups enabled in FIFO_EN in register order; when the 1024 bytes are
+// full the oldest byte is lost and INT_STATUS FIFO_OFLOW is set. FIFO_COUNT gives the bytes
+// in the FIFO, FIFO_R_W pops one without incrementing the register pointer, USER_CTRL
+// FIFO_RESET empties it, and reading INT_STATUS clears it.
+
+/// <summary>
+///     Powers on the MPU6050: registers cleared, WHO_AM_I 0x68, asleep, FIFO empty, sample 0.
+/// </summary>
+void HostMpu6050_Reset(void);
+
+/// <summary>Reads a register, without side effects.</summary>
+uint8_t HostMpu6050_GetReg(uint8_t reg);
+
+/// <summary>Writes a register, without side effects.</summary>
+void HostMpu6050_SetReg(uint8_t reg, uint8_t value);
+
+/// <summary>
+///     Writes the 14 bytes of sample n, ACCEL_XOUT_H..GYRO_ZOUT_L: every channel differs,
+///     and differs from the same channel of the other samples.
+/// </summary>
+void HostMpu6050_SampleBytes(uint32_t n, uint8_t raw[14]);
+
+/// <summary>Latches sample n into the output registers.</summary>
+void HostMpu6050_Latch(uint32_t n);
+
+/// <summary>
+///     Latches the next sample after every transactions transactions, as the chip updates
+///     its output registers while the host reads them; 0 for never.
+/// </summary>
+void HostMpu6050_LatchEvery(unsigned long transactions);
+
+/// <summary>Number of the sample in the output registers.</summary>
+uint32_t HostMpu6050_Latched(void);
+
+/// <summary>
+///     Runs the chip for microseconds, latching samples, and filling the FIFO, at the
+///     sample rate.
+/// </summary>
+void HostMpu6050_Advance(uint32_t microseconds);
+
+/// <summary>
+///     Runs the chip for the time on the wire of every transaction, at busHz bits per
+///     second, before the transaction takes effect; 0 for no time.
+/// </summary>
+void HostMpu6050_SetBusSpeed(uint32_t busHz);
+
+/// <summary>Appends bytes to the FIFO, as a frame does.</summary>
+void HostMpu6050_FifoPush(const uint8_t *data, size_t length);
+
+/// <summary>Number of bytes in the FIFO.</summary>
+size_t HostMpu6050_FifoCount(void);
+
+/// <summary>Number of FIFO_R_W bytes read while the FIFO was empty.</summary>
+unsigned long HostMpu6050_EmptyFifoReads(void);
+
+/// <summary>Number of I2C transactions.</summary>
+unsigned long HostI2c_Transactions(void);
+
+/// <summary>Number of bits on the wire of the I2C transactions.</summary>
+unsigned long HostI2c_BusBits(void);
+
+/// <summary>
+///     Makes the transaction after the next skip ones return result, without reaching the
+///     chip, with errno set to error when result is -1.
+/// </summary>
+void HostI2c_FailAfter(unsigned long skip, ssize_t result, int error);
+
+/// <summary>Number of Log_Debug lines starting with "WARNING" or "ERROR", since the start.</summary>
+unsigned long HostLog_Problems(void);
@@ -0,0 +1,246 @@
+/* Futura MT3620 MPU6050: driver register access test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Runs mpu6050.c over the I2C stand-in of mpu6050_host.c, which models the register file of
+// the MPU6050 and counts the bus transactions. Checks that:
+// - MPU6050_Init reads WHO_AM_I, then writes the five configuration registers once, in six
+//   transactions, and fails with ENODEV for another chip, and with the errno of the bus, or
+//   EIO for a short transfer, when any of its transactions fails;
+// - MPU6050_ReadSample reads all seven channels of random samples in one transaction of
+//   156 bits, and decodes them; while the chip latches a new sample at every transaction,
+//   its channels still come from one sample;
+// - it fails with the errno of the bus, EIO for a short transfer and ENXIO for a chip
+//   which does not answer.
+// Prints the transactions and bus time per sample against the reads of main.c before the
+// driver: a status read, five configuration writes, and a register write and two 1-byte
+// reads per channel.
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <applibs/i2c.h>
+
+#include "mpu6050.h"
+#include "mpu6050_host.h"
+
+#define SAMPLES 20000
+// START, address, register, repeated START, address, 14 bytes, STOP
+#define BURST_BITS (1 + 9 + 9 + 1 + 9 + 14 * 9 + 1)
+
+static const int i2cFd = 3;
+static unsigned long failures = 0;
+
+static uint32_t rngState = 0x2545F491;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %lu\n", what, n);
+    }
+}
+
+// The channels of sample n, in the order of MPU6050_Sample
+static void ExpectedChannels(uint32_t n, int16_t channels[7])
+{
+    uint8_t raw[MPU6050_SAMPLE_LEN];
+    HostMpu6050_SampleBytes(n, raw);
+    for (int c = 0; c < 7; ++c) {
+        channels[c] = (int16_t)((uint16_t)raw[2 * c] << 8 | raw[2 * c + 1]);
+    }
+}
+
+static bool SampleIs(const MPU6050_Sample *sample, uint32_t n)
+{
+    int16_t c[7];
+    ExpectedChannels(n, c);
+    return sample->accelX == c[0] && sample->accelY == c[1] && sample->accelZ == c[2] &&
+           sample->temp == c[3] && sample->gyroX == c[4] && sample->gyroY == c[5] &&
+           sample->gyroZ == c[6];
+}
+
+// The per-tick reads of main.c before the driver
+static void ReadAsBefore(MPU6050_Sample *sample)
+{
+    static const uint8_t status = 0x00;
+    uint8_t value;
+    I2CMaster_WriteThenRead(i2cFd, MPU6050_ADDR, &status, 1, &value, 1);
+
+    static const uint8_t config[][2] = {
+        {MPU6050_SMPLRT_DIV, 0x00},   {MPU6050_CONFIG, 0x00},     {MPU6050_GYRO_CONFIG, 0x08},
+        {MPU6050_ACCEL_CONFIG, 0x00}, {MPU6050_PWR_MGMT_1, 0x01},
+    };
+    for (size_t i = 0; i < sizeof(config) / sizeof(config[0]); ++i) {
+        I2CMaster_Write(i2cFd, MPU6050_ADDR, config[i], 2);
+    }
+
+    static const uint8_t channelRegs[] = {0x3b, 0x3d, 0x3f, 0x41, 0x43, 0x45, 0x47};
+    int16_t channels[7];
+    for (int c = 0; c < 7; ++c) {
+        uint8_t hi, lo;
+        I2CMaster_Write(i2cFd, MPU6050_ADDR, &channelRegs[c], 1);
+        I2CMaster_Read(i2cFd, MPU6050_ADDR, &hi, 1);
+        I2CMaster_Read(i2cFd, MPU6050_ADDR, &lo, 1);
+        channels[c] = (int16_t)(hi << 8 | lo);
+    }
+    *sample = (MPU6050_Sample){channels[0], channels[1], channels[2], channels[3],
+                               channels[4], channels[5], channels[6]};
+}
+
+static void TestInit(void)
+{
+    HostMpu6050_Reset();
+    if (MPU6050_Init(i2cFd, MPU6050_ADDR) != 0 || HostI2c_Transactions() != 6) {
+        Fail("init transactions", HostI2c_Transactions());
+    }
+    if (HostMpu6050_GetReg(MPU6050_PWR_MGMT_1) != 0x01 ||
+        HostMpu6050_GetReg(MPU6050_SMPLRT_DIV) != 0x00 ||
+        HostMpu6050_GetReg(MPU6050_CONFIG) != 0x00 ||
+        HostMpu6050_GetReg(MPU6050_GYRO_CONFIG) != 0x08 ||
+        HostMpu6050_GetReg(MPU6050_ACCEL_CONFIG) != 0x00) {
+        Fail("init registers", 0);
+    }
+
+    // WHO_AM_I ignores bit 0 (AD0) and bit 7
+    HostMpu6050_Reset();
+    HostMpu6050_SetReg(MPU6050_WHO_AM_I, 0x69);
+    if (MPU6050_Init(i2cFd, MPU6050_ADDR) != 0) {
+        Fail("init with WHO_AM_I", 0x69);
+    }
+    HostMpu6050_Reset();
+    HostMpu6050_SetReg(MPU6050_WHO_AM_I, 0x70);
+    errno = 0;
+    if (MPU6050_Init(i2cFd, MPU6050_ADDR) != -1 || errno != ENODEV ||
+        HostI2c_Transactions() != 1 || HostMpu6050_GetReg(MPU6050_PWR_MGMT_1) != 0x40) {
+        Fail("init with WHO_AM_I", 0x70);
+    }
+
+    for (unsigned long k = 0; k < 6; ++k) {
+        HostMpu6050_Reset();
+        HostI2c_FailAfter(k, -1, ETIMEDOUT);
+        errno = 0;
+        if (MPU6050_Init(i2cFd, MPU6050_ADDR) != -1 || errno != ETIMEDOUT ||
+            HostI2c_Transactions() != k + 1) {
+            Fail("init with a failed transaction", k);
+        }
+        HostMpu6050_Reset();
+        HostI2c_FailAfter(k, 1, 0);
+        errno = 0;
+        if (MPU6050_Init(i2cFd, MPU6050_ADDR) != -1 || errno != EIO) {
+            Fail("init with a short transaction", k);
+        }
+    }
+}
+
+static void TestReadSample(void)
+{
+    HostMpu6050_Reset();
+    MPU6050_Init(i2cFd, MPU6050_ADDR);
+    for (unsigned long i = 0; i < SAMPLES; ++i) {
+        uint32_t n = Random(0x10000000);
+        HostMpu6050_Latch(n);
+        unsigned long transactions = HostI2c_Transactions();
+        unsigned long bits = HostI2c_BusBits();
+        MPU6050_Sample sample;
+        if (MPU6050_ReadSample(i2cFd, MPU6050_ADDR, &sample) != 0 || !SampleIs(&sample, n)) {
+            Fail("sample", i);
+        }
+        if (HostI2c_Transactions() - transactions != 1 || HostI2c_BusBits() - bits != BURST_BITS) {
+            Fail("sample transactions", i);
+        }
+    }
+
+    HostMpu6050_LatchEvery(1);
+    for (unsigned long i = 0; i < SAMPLES / 10; ++i) {
+        MPU6050_Sample sample;
+        if (MPU6050_ReadSample(i2cFd, MPU6050_ADDR, &sample) != 0 ||
+            !SampleIs(&sample, HostMpu6050_Latched())) {
+            Fail("sample torn by a new sample", i);
+        }
+    }
+
+    MPU6050_Sample sample;
+    HostI2c_FailAfter(0, -1, EBUSY);
+    errno = 0;
+    if (MPU6050_ReadSample(i2cFd, MPU6050_ADDR, &sample) != -1 || errno != EBUSY) {
+        Fail("sample with a failed transaction", 0);
+    }
+    HostI2c_FailAfter(0, 1 + MPU6050_SAMPLE_LEN - 1, 0);
+    errno = 0;
+    if (MPU6050_ReadSample(i2cFd, MPU6050_ADDR, &sample) != -1 || errno != EIO) {
+        Fail("sample with a short transaction", 0);
+    }
+    errno = 0;
+    if (MPU6050_ReadSample(i2cFd, MPU6050_ADDR + 1, &sample) != -1 || errno != ENXIO) {
+        Fail("sample from another address", 0);
+    }
+
+    // Datasheet example: -521 is 35 degrees
+    if (fabs(MPU6050_TempCelsius(-521) - 35.0) > 0.01) {
+        Fail("temperature", 0);
+    }
+}
+
+// Bus transactions and bits per sample of the reads of main.c before the driver and of
+// MPU6050_ReadSample, and how many of the samples mix channels of several samples
+static void CompareWithBefore(void)
+{
+    HostMpu6050_Reset();
+    MPU6050_Init(i2cFd, MPU6050_ADDR);
+    HostMpu6050_LatchEvery(8);
+
+    unsigned long transactions = HostI2c_Transactions();
+    unsigned long bits = HostI2c_BusBits();
+    unsigned long torn = 0;
+    for (int i = 0; i < 1000; ++i) {
+        MPU6050_Sample sample;
+        ReadAsBefore(&sample);
+        torn += !SampleIs(&sample, HostMpu6050_Latched());
+    }
+    double beforeTransactions = (HostI2c_Transactions() - transactions) / 1000.0;
+    double beforeBits = (HostI2c_BusBits() - bits) / 1000.0;
+
+    transactions = HostI2c_Transactions();
+    bits = HostI2c_BusBits();
+    unsigned long burstTorn = 0;
+    for (int i = 0; i < 1000; ++i) {
+        MPU6050_Sample sample;
+        MPU6050_ReadSample(i2cFd, MPU6050_ADDR, &sample);
+        burstTorn += !SampleIs(&sample, HostMpu6050_Latched());
+    }
+    double burstTransactions = (HostI2c_Transactions() - transactions) / 1000.0;
+    double burstBits = (HostI2c_BusBits() - bits) / 1000.0;
+    if (burstTorn != 0) {
+        Fail("burst samples torn", burstTorn);
+    }
+
+    // The wire only: each transaction also costs a syscall and the bus turnaround
+    printf("%-12s %12s %8s %12s %12s\n", "per sample", "transactions", "bits", "us at 100k",
+           "torn / 1000");
+    printf("%-12s %12.0f %8.0f %12.0f %12lu\n", "before", beforeTransactions, beforeBits,
+           beforeBits * 10, torn);
+    printf("%-12s %12.0f %8.0f %12.0f %12lu\n", "burst", burstTransactions, burstBits,
+           burstBits * 10, burstTorn);
+}
+
+int main(void)
+{
+    TestInit();
+    TestReadSample();
+    CompareWithBefore();
+    if (HostLog_Problems() == 0) {
+        Fail("no error logged", 0);
+    }
+    printf("%lu failure(s)\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,5 @@
+/* Host stand-in for applibs/log.h: mpu6050_host.c defines Log_Debug. */
+
+#pragma once
+
+int Log_Debug(const char *fmt, ...);
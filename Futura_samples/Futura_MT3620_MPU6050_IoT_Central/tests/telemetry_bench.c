@@ -0,0 +1,202 @@
+/* Futura MT3620 MPU6050: benchmark of the telemetry message of a button press.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Formats the seven MPU6050 channels of random samples three ways: as main.c did before
+// telemetry.c, one message per channel through two snprintf calls; in one message built with
+// parson; and in one message with the TelemetryBuilder. Reports per press the messages, the
+// payload bytes, the bytes on the wire, and the time to format them. The wire bytes add to
+// each message the MQTT 3.1.1 PUBLISH at QoS 1 to devices/<id>/messages/events/, with the
+// 128 hex digit device ID of Azure Sphere, its 4-byte PUBACK, and a 29-byte TLS 1.2 AES-GCM
+// record around each. Checks that the three carry the same values.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mpu6050.h"
+#include "parson.h"
+#include "telemetry.h"
+
+#define PRESSES 200000
+#define DEVICE_ID_LENGTH 128
+#define TLS_RECORD_BYTES 29
+#define PUBACK_BYTES 4
+
+static const char *const keys[7] = {"AccelX", "AccelY", "AccelZ", "GyroX",
+                                    "GyroY",  "GyroZ",  "TempMPU6050"};
+
+typedef struct {
+    int channels[6];
+    double temp;
+} Press;
+
+typedef struct {
+    unsigned long messages;
+    unsigned long payloadBytes;
+    unsigned long wireBytes;
+} Totals;
+
+static unsigned long failures = 0;
+
+static uint32_t rngState = 0x3C6EF372;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %lu\n", what, n);
+    }
+}
+
+static double NowSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+// Counts a message of payloadBytes, with its PUBLISH, PUBACK and TLS records
+static void Count(Totals *totals, size_t payloadBytes)
+{
+    // devices/<id>/messages/events/
+    size_t topic = 8 + DEVICE_ID_LENGTH + 17;
+    size_t remaining = 2 + topic + 2 + payloadBytes; // topic length, topic, packet ID
+    size_t publish = 1 + (remaining < 128 ? 1 : 2) + remaining;
+    ++totals->messages;
+    totals->payloadBytes += payloadBytes;
+    totals->wireBytes += publish + TLS_RECORD_BYTES + PUBACK_BYTES + TLS_RECORD_BYTES;
+}
+
+// main.c before telemetry.c: a snprintf of the value, then SendTelemetry's of the message
+static void FormatAsBefore(const Press *press, Totals *totals, double *values)
+{
+    static char eventBuffer[100];
+    char tempBuffer[20];
+    for (int c = 0; c < 7; ++c) {
+        int len = c < 6 ? snprintf(tempBuffer, 20, "%d", press->channels[c])
+                        : snprintf(tempBuffer, 20, "%.2lf", press->temp);
+        if (len < 0) {
+            continue;
+        }
+        len = snprintf(eventBuffer, sizeof(eventBuffer), "{ \"%s\": \"%s\" }", keys[c],
+                       tempBuffer);
+        if (len < 0) {
+            continue;
+        }
+        Count(totals, (size_t)len);
+        if (values != NULL) {
+            // The value is the string between the last two quotes
+            char *end = strrchr(eventBuffer, '"');
+            *end = '\0';
+            values[c] = atof(strrchr(eventBuffer, '"') + 1);
+        }
+    }
+}
+
+static const char *FormatWithParson(const Press *press, Totals *totals)
+{
+    static char message[256];
+    JSON_Value *root = json_value_init_object();
+    JSON_Object *object = json_value_get_object(root);
+    for (int c = 0; c < 6; ++c) {
+        json_object_set_number(object, keys[c], press->channels[c]);
+    }
+    json_object_set_number(object, keys[6], press->temp);
+    if (json_serialize_to_buffer(root, message, sizeof(message)) != JSONSuccess) {
+        message[0] = '\0';
+    }
+    json_value_free(root);
+    Count(totals, strlen(message));
+    return message;
+}
+
+static const char *FormatWithBuilder(const Press *press, Totals *totals)
+{
+    static char telemetryBuffer[160];
+    TelemetryBuilder telemetry;
+    Telemetry_Init(&telemetry, telemetryBuffer, sizeof(telemetryBuffer));
+    for (int c = 0; c < 6; ++c) {
+        Telemetry_AddInt(&telemetry, keys[c], press->channels[c]);
+    }
+    Telemetry_AddDouble(&telemetry, keys[6], press->temp);
+    const char *message = Telemetry_Finish(&telemetry);
+    Count(totals, message != NULL ? strlen(message) : 0);
+    return message;
+}
+
+static bool SameValues(const char *message, const double *values)
+{
+    JSON_Value *root = message != NULL ? json_parse_string(message) : NULL;
+    JSON_Object *object = json_value_get_object(root);
+    bool same = object != NULL && json_object_get_count(object) == 7;
+    for (int c = 0; same && c < 7; ++c) {
+        same = json_object_has_value_of_type(object, keys[c], JSONNumber) &&
+               fabs(json_object_get_number(object, keys[c]) - values[c]) < 0.006;
+    }
+    json_value_free(root);
+    return same;
+}
+
+static void RandomPress(Press *press)
+{
+    for (int c = 0; c < 6; ++c) {
+        press->channels[c] = (int)Random(65536) - 32768;
+    }
+    press->temp = MPU6050_TempCelsius((int16_t)(Random(65536) - 32768));
+}
+
+int main(void)
+{
+    static Press presses[1024];
+    for (size_t p = 0; p < sizeof(presses) / sizeof(presses[0]); ++p) {
+        RandomPress(&presses[p]);
+        double values[7];
+        Totals ignored = {0};
+        FormatAsBefore(&presses[p], &ignored, values);
+        if (!SameValues(FormatWithBuilder(&presses[p], &ignored), values) ||
+            !SameValues(FormatWithParson(&presses[p], &ignored), values)) {
+            Fail("values differ, press", p);
+        }
+    }
+
+    static const char *const names[3] = {"before", "parson", "builder"};
+    Totals totals[3] = {{0}};
+    double seconds[3];
+    for (int way = 0; way < 3; ++way) {
+        double start = NowSeconds();
+        for (unsigned long n = 0; n < PRESSES; ++n) {
+            const Press *press = &presses[n % (sizeof(presses) / sizeof(presses[0]))];
+            if (way == 0) {
+                FormatAsBefore(press, &totals[way], NULL);
+            } else if (way == 1) {
+                FormatWithParson(press, &totals[way]);
+            } else {
+                FormatWithBuilder(press, &totals[way]);
+            }
+        }
+        seconds[way] = NowSeconds() - start;
+    }
+
+    printf("%-8s  %8s  %13s  %10s  %9s\n", "press", "messages", "payload bytes", "wire bytes",
+           "format ns");
+    for (int way = 0; way < 3; ++way) {
+        printf("%-8s  %8.0f  %13.1f  %10.1f  %9.0f\n", names[way],
+               (double)totals[way].messages / PRESSES, (double)totals[way].payloadBytes / PRESSES,
+               (double)totals[way].wireBytes / PRESSES, seconds[way] / PRESSES * 1e9);
+    }
+    if (totals[2].messages != PRESSES || totals[0].messages != 7 * PRESSES) {
+        Fail("messages", totals[2].messages);
+    }
+    printf("%lu failure(s)\n", failures);
+    return failures != 0;
+}
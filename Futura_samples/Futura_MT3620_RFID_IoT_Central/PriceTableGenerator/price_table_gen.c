@@ -0,0 +1,353 @@
+/* Futura MT3620 generator of the RFID price table.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Reads tags and products, one per line as "UID,product", and writes price_table_data.c with
+// a minimal perfect hash over the UIDs, for price_table.h:
+//
+//     price_table_gen prices.csv price_table_data.c
+//
+// A UID is 4, 7 or 10 bytes in hex, with optional ':' or ' ' between bytes; the product is
+// the rest of the line. Empty lines and lines starting with '#' are skipped. Duplicate UIDs
+// are an error.
+//
+// The hash is CHD (compress, hash and displace): keys are spread over buckets, and buckets
+// are placed largest first, each trying displacements in turn until all its keys land on
+// free slots. When a bucket cannot be placed, which happens with few keys, everything starts
+// again with the next hash seed.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "price_table.h"
+
+// Keys per bucket: more makes the displacement table smaller and the generator slower.
+#define KEYS_PER_BUCKET 4
+// Displacements tried before a bucket of two or more keys is given up for a seed. A bucket of
+// one key lands on a random slot at each try, and gets SINGLE_KEY_TRIES tries per slot, so
+// that the last free slot is found too.
+#define MAX_TRIES 1000000u
+#define SINGLE_KEY_TRIES 64u
+// Seeds tried before giving up
+#define MAX_SEEDS 1000u
+
+typedef struct {
+    uint8_t uid[PRICE_TABLE_MAX_UID];
+    uint8_t size;
+    char *product;
+    uint64_t hash;
+    uint32_t bucket;
+} Entry;
+
+static Entry *entries = NULL;
+static uint32_t entryCount = 0;
+
+static void Fail(const char *path, unsigned long line, const char *message)
+{
+    fprintf(stderr, "%s:%lu: %s\n", path, line, message);
+    exit(1);
+}
+
+static void *Allocate(size_t size)
+{
+    void *memory = calloc(1, size ? size : 1);
+    if (memory == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return memory;
+}
+
+static int HexDigit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Parses the UID before the comma; returns its size, or 0 if it is not valid.
+static uint8_t ParseUid(const char *text, const char *end, uint8_t *uid)
+{
+    uint8_t size = 0;
+    while (text < end) {
+        if (*text == ':' || *text == ' ') {
+            ++text;
+            continue;
+        }
+        if (end - text < 2 || HexDigit(text[0]) < 0 || HexDigit(text[1]) < 0 ||
+            size == PRICE_TABLE_MAX_UID) {
+            return 0;
+        }
+        uid[size++] = (uint8_t)(HexDigit(text[0]) << 4 | HexDigit(text[1]));
+        text += 2;
+    }
+    return size == 4 || size == 7 || size == 10 ? size : 0;
+}
+
+static void ReadEntries(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+
+    uint32_t capacity = 0;
+    char line[1024];
+    unsigned long lineNumber = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        ++lineNumber;
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] == 0 || line[0] == '#') {
+            continue;
+        }
+
+        char *comma = strchr(line, ',');
+        if (comma == NULL) {
+            Fail(path, lineNumber, "expected UID,product");
+        }
+        if (entryCount == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            entries = realloc(entries, capacity * sizeof(Entry));
+            if (entries == NULL) {
+                Fail(path, lineNumber, "out of memory");
+            }
+        }
+
+        Entry *entry = &entries[entryCount];
+        memset(entry, 0, sizeof(*entry));
+        entry->size = ParseUid(line, comma, entry->uid);
+        if (entry->size == 0) {
+            Fail(path, lineNumber, "UID must be 4, 7 or 10 bytes in hex");
+        }
+        entry->product = strdup(comma + 1);
+        ++entryCount;
+    }
+    fclose(file);
+}
+
+static int CompareUids(const void *a, const void *b)
+{
+    const Entry *x = a;
+    const Entry *y = b;
+    if (x->size != y->size) {
+        return x->size - y->size;
+    }
+    return memcmp(x->uid, y->uid, x->size);
+}
+
+static void CheckDuplicates(const char *path)
+{
+    Entry *sorted = Allocate(entryCount * sizeof(Entry));
+    if (entryCount > 0) {
+        memcpy(sorted, entries, entryCount * sizeof(Entry));
+    }
+    qsort(sorted, entryCount, sizeof(Entry), CompareUids);
+    for (uint32_t i = 1; i < entryCount; ++i) {
+        if (CompareUids(&sorted[i - 1], &sorted[i]) == 0) {
+            fprintf(stderr, "%s: duplicate UID for \"%s\"\n", path, sorted[i].product);
+            exit(1);
+        }
+    }
+    free(sorted);
+}
+
+// Bucket sizes, for placing the largest first
+static uint32_t *bucketSizes;
+
+static int CompareBuckets(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    if (bucketSizes[x] != bucketSizes[y]) {
+        return bucketSizes[x] < bucketSizes[y] ? 1 : -1;
+    }
+    return x < y ? -1 : x > y;
+}
+
+// Finds a displacement for every bucket; slotEntries[slot] is the entry placed there.
+// Returns false if a bucket could not be placed with this seed.
+static bool Place(uint32_t seed, uint32_t bucketCount, uint32_t *displacements,
+                  uint32_t *slotEntries)
+{
+    bucketSizes = Allocate(bucketCount * sizeof(uint32_t));
+    uint32_t *bucketStart = Allocate((bucketCount + 1) * sizeof(uint32_t));
+    uint32_t *bucketFill = Allocate(bucketCount * sizeof(uint32_t));
+    uint32_t *bucketEntries = Allocate(entryCount * sizeof(uint32_t));
+    uint32_t *order = Allocate(bucketCount * sizeof(uint32_t));
+    bool *taken = Allocate(entryCount * sizeof(bool));
+    uint32_t *slots = Allocate(entryCount * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < entryCount; ++i) {
+        entries[i].hash = PriceTable_Hash(entries[i].uid, entries[i].size, seed);
+        entries[i].bucket = PriceTable_Bucket(entries[i].hash, bucketCount);
+        ++bucketSizes[entries[i].bucket];
+    }
+    for (uint32_t b = 0; b < bucketCount; ++b) {
+        bucketStart[b + 1] = bucketStart[b] + bucketSizes[b];
+        order[b] = b;
+    }
+    for (uint32_t i = 0; i < entryCount; ++i) {
+        uint32_t b = entries[i].bucket;
+        bucketEntries[bucketStart[b] + bucketFill[b]++] = i;
+    }
+    qsort(order, bucketCount, sizeof(uint32_t), CompareBuckets);
+
+    unsigned long totalTries = 0;
+    bool placed = true;
+    for (uint32_t o = 0; o < bucketCount && placed; ++o) {
+        uint32_t b = order[o];
+        uint32_t size = bucketSizes[b];
+        const uint32_t *keys = &bucketEntries[bucketStart[b]];
+        if (size == 0) {
+            continue;
+        }
+
+        uint64_t maxTries = size > 1 ? MAX_TRIES : (uint64_t)SINGLE_KEY_TRIES * entryCount;
+        uint32_t displacement = 0;
+        for (;; ++displacement) {
+            if (displacement == maxTries) {
+                placed = false;
+                break;
+            }
+            ++totalTries;
+            uint32_t k = 0;
+            for (; k < size; ++k) {
+                slots[k] = PriceTable_Slot(entries[keys[k]].hash, displacement, entryCount);
+                if (taken[slots[k]]) {
+                    break;
+                }
+                // Two keys of the bucket on the same slot
+                uint32_t j = 0;
+                while (j < k && slots[j] != slots[k]) {
+                    ++j;
+                }
+                if (j < k) {
+                    break;
+                }
+            }
+            if (k == size) {
+                break;
+            }
+        }
+
+        if (!placed) {
+            break;
+        }
+        displacements[b] = displacement;
+        for (uint32_t k = 0; k < size; ++k) {
+            taken[slots[k]] = true;
+            slotEntries[slots[k]] = keys[k];
+        }
+    }
+    if (placed) {
+        fprintf(stderr, "%u keys, %u buckets, seed %u, %lu displacements tried\n", entryCount,
+                bucketCount, seed, totalTries);
+    }
+
+    free(bucketSizes);
+    free(bucketStart);
+    free(bucketFill);
+    free(bucketEntries);
+    free(order);
+    free(taken);
+    free(slots);
+    return placed;
+}
+
+// Writes a C string literal; bytes outside printable ASCII, such as UTF-8, as octal escapes,
+// which always have three digits so that a following digit is not taken into them. '?' is
+// escaped too, against trigraphs.
+static void WriteString(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)text; *c != 0; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20 || *c >= 0x7F || *c == '?') {
+            fprintf(out, "\\%03o", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void Write(const char *inputPath, const char *path, uint32_t seed, uint32_t bucketCount,
+                  const uint32_t *displacements, const uint32_t *slotEntries)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        exit(1);
+    }
+
+    const char *inputName = strrchr(inputPath, '/');
+    inputName = inputName != NULL ? inputName + 1 : inputPath;
+    fprintf(out, "/* Generated by PriceTableGenerator from %s: do not edit. */\n\n", inputName);
+    fprintf(out, "#include \"price_table.h\"\n\n");
+
+    // At least one element, so that an empty table is still valid C.
+    fprintf(out, "static const PriceTable_Entry entries[%u] = {\n", entryCount ? entryCount : 1);
+    for (uint32_t slot = 0; slot < entryCount; ++slot) {
+        const Entry *entry = &entries[slotEntries[slot]];
+        fprintf(out, "    {{");
+        for (uint8_t i = 0; i < entry->size; ++i) {
+            fprintf(out, "%s0x%02X", i ? ", " : "", entry->uid[i]);
+        }
+        fprintf(out, "}, %u, ", entry->size);
+        WriteString(out, entry->product);
+        fprintf(out, "},\n");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const uint32_t displacements[%u] = {", bucketCount);
+    for (uint32_t b = 0; b < bucketCount; ++b) {
+        fprintf(out, "%s%u", b % 12 ? ", " : (b ? ",\n    " : "\n    "), displacements[b]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "const PriceTable priceTable = {entries, displacements, %u, %u, %u};\n",
+            entryCount, bucketCount, seed);
+    if (fclose(out) != 0) {
+        perror(path);
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s prices.csv price_table_data.c\n", argv[0]);
+        return 2;
+    }
+
+    ReadEntries(argv[1]);
+    CheckDuplicates(argv[1]);
+
+    uint32_t bucketCount = (entryCount + KEYS_PER_BUCKET - 1) / KEYS_PER_BUCKET;
+    if (bucketCount == 0) {
+        bucketCount = 1;
+    }
+    uint32_t *displacements = Allocate(bucketCount * sizeof(uint32_t));
+    uint32_t *slotEntries = Allocate(entryCount * sizeof(uint32_t));
+    uint32_t seed = 0;
+    while (!Place(seed, bucketCount, displacements, slotEntries)) {
+        if (++seed == MAX_SEEDS) {
+            fprintf(stderr, "could not place the keys\n");
+            return 1;
+        }
+    }
+    Write(argv[1], argv[2], seed, bucketCount, displacements, slotEntries);
+    return 0;
+}
@@ -26,23 +26,20 @@
 
 //CUSTOM libs
 #include "mfrc522.h"
+#include "rfid_tracker.h"
+#include "price_table.h"
 //HARDWARE DEFINITION
 #include <hw/sample_hardware.h>
 //IOTHUB libs
 #include "eventloop_timer_utilities.h"
-#include <iothub_client_core_common.h>
-#include <iothub_device_client_ll.h>
-#include <iothub_client_options.h>
-#include <iothubtransportmqtt.h>
-#include <iothub.h>
-#include <azure_sphere_provisioning.h>
-#include "parson.h" // used to parse Device Twin messages.
+#include "azure_connection.h"
+#include "button.h"
 
 uint8_t str_rfid[MAX_LEN]; //card ID
 uint8_t str_dump[10]; //card dump
 
 void bytetohex(char* xp, const char* bb, int n); // Converte l'array di byte in una stringa di byte
-map_str_t priceMap; // map for RFID PICC
+map_str_t priceMap; // RFID PICC aggiunte durante l'esecuzione: le altre sono in prices.csv
 
 static char eventBuffer[100] = { 0 };
 
@@ -58,54 +55,122 @@ void delay(int s)
     sleep(s);
 }
 
-static void RFIDTimerEventHandler(void)
+// Carte lette da un inventario: fino a 4 nel campo dell'antenna
+#define MAX_RFID_CARDS 4
+static mfrc522_uid rfidCards[MAX_RFID_CARDS];
+
+// Scansione del campo: lenta quando non ci sono carte, veloce finché ce n'è una, per
+// accorgersi presto della sua rimozione
+static const uint32_t idleScanPeriodMs = 1000;
+static const uint32_t presentScanPeriodMs = 250;
+// Una carta non trovata per questo tempo è stata rimossa: copre qualche scansione persa
+static const uint32_t cardHoldOffMs = 1000;
+static EventLoopTimer *rfidScanTimer = NULL;
+
+// Millisecondi del clock monotono modulo 2^32: se ne usano solo le differenze, giuste anche
+// dopo il giro, a 49,7 giorni; un long traboccherebbe a 24,8 giorni sull'A7 a 32 bit
+static uint32_t NowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec * 1000u + (uint32_t)(now.tv_nsec / 1000000);
+}
+
+// Cerca il prodotto nella tabella compilata da prices.csv, poi nella mappa
+static const char* LookupPrice(const mfrc522_uid* card, const char* hexstr)
+{
+    const char* price = PriceTable_Lookup(&priceTable, card->uid, card->size);
+    if (price == NULL)
+    {
+        char** val = map_get(&priceMap, hexstr);
+        price = val != NULL ? *val : NULL;
+    }
+    return price;
+}
+
+// Invia il prezzo di una carta presente nella tabella dei prezzi
+static void HandleRFIDCard(const mfrc522_uid* card, bool sendTelemetry)
 {
-    // Preparazione alla lettura dei tag
     uint8_t byte;
-    byte = mfrc522_read(ComIEnReg);
-    mfrc522_write(ComIEnReg, byte | 0x20);
-    byte = mfrc522_read(DivIEnReg);
-    mfrc522_write(DivIEnReg, byte | 0x80);
 
-    // Prova a leggere la scheda RFID    
-    byte = mfrc522_request(PICC_REQALL, str_rfid); // trova l'ID
+    Log_Debug("Card dumping: ");
+    for (byte = 0; byte < card->size; byte++)
+    {
+        Log_Debug("%02x", card->uid[byte]); // dump ID in byte array
+    }
+    // Converte l'array di byte in una stringa di byte: due cifre per byte
+    char hexstr[2 * sizeof(card->uid) + 1];
+    bytetohex(hexstr, (const char*)card->uid, 2 * card->size);
+    hexstr[2 * card->size] = 0;
+    Log_Debug("\nhex: %s\n", hexstr);
+    const char* price = LookupPrice(card, hexstr);
+    if (price != NULL)
+    {
+        Log_Debug("[MFRC522][INFO] Serial: %s\n", hexstr);
+        Log_Debug("[MAP][INFO] Map Price: %s\n", price);
+    }
 
-    if (byte == CARD_FOUND)
+    else
     {
-        Log_Debug("[MFRC522][INFO] Trovata card: %x\n", byte);
-
-        byte = mfrc522_get_card_serial(str_rfid);
-        
-        if (byte == CARD_FOUND)
-        {            
-            Log_Debug("Card dumping: "); 
-            for (byte = 0; byte < 8; byte++)
-            {                
-                Log_Debug("%x", str_rfid[byte]); // dump ID in byte array
-            }
-            // Converte l'array di byte in una stringa di byte
-            char hexstr[8];
-            bytetohex(hexstr, str_rfid, 8);
-            hexstr[8] = 0;
-            Log_Debug("\nhex: %x\n", hexstr);
-            int* val=0;
-            if (map_get(&priceMap, hexstr)>0)
-            {
-                val=map_get(&priceMap, hexstr);
-                Log_Debug("[MFRC522][INFO] Serial: %s\n", hexstr);
-                Log_Debug("[MAP][INFO] Map Price: %s\n", *val);
-            }
-                
-            else
-            {
-                Log_Debug("[MFRC522][INFO] Pre Serial: %s\n", hexstr);                
-                return;
-            }
-            
-            static const char* EventMsgTemplate = "%s";
-            int len = snprintf(eventBuffer, sizeof(eventBuffer), EventMsgTemplate, *val);
-            Log_Debug("[IoTCentral][INFO] Sending IoT Central Message: %s\n", eventBuffer);
-        }
+        Log_Debug("[MFRC522][INFO] Pre Serial: %s\n", hexstr);
+        return;
+    }
+
+    static const char* EventMsgTemplate = "%s";
+    int len = snprintf(eventBuffer, sizeof(eventBuffer), EventMsgTemplate, price);
+    Log_Debug("[IoTCentral][INFO] Sending IoT Central Message: %s\n", eventBuffer);
+    if (sendTelemetry)
+    {
+        AzureConnection_SendTelemetryValue("RFID", eventBuffer); //Contenuto della card RFID 
+    }
+}
+
+// Solo l'arrivo e la rimozione di una carta producono eventi, non ogni lettura
+static void RFIDTagEventHandler(RfidTracker_Event event, const RfidTracker_Tag* tag, void* context)
+{
+    if (event == RfidTracker_Arrived)
+    {
+        Log_Debug("[MFRC522][INFO] Card arrivata\n");
+        HandleRFIDCard(&tag->uid, true);
+    }
+    else
+    {
+        Log_Debug("[MFRC522][INFO] Card rimossa dopo %lu ms\n", (unsigned long)(uint32_t)(tag->lastSeenMs - tag->firstSeenMs));
+    }
+}
+
+static void ScheduleRFIDScan(uint32_t milliseconds)
+{
+    struct timespec delay = {.tv_sec = milliseconds / 1000,
+                             .tv_nsec = (milliseconds % 1000) * 1000000};
+    if (SetEventLoopTimerOneShot(rfidScanTimer, &delay) != 0) {
+        Log_Debug("ERROR: Could not arm RFID timer: %s (%d).\n", strerror(errno), errno);
+    }
+}
+
+// Riceve le carte trovate dall'inventario avviato da RFIDScanTimerEventHandler, nel ciclo degli eventi
+static void RFIDInventoryHandler(uint8_t status, const mfrc522_uid* uids, size_t count, void* context)
+{
+    if (status == ERROR)
+    {
+        Log_Debug("[MFRC522][WARNING] Inventario interrotto dopo %zu carte\n", count);
+    }
+    // Anche un inventario interrotto conferma le carte trovate
+    RfidTracker_Update(uids, count, NowMs());
+    ScheduleRFIDScan(RfidTracker_GetCount() > 0 ? presentScanPeriodMs : idleScanPeriodMs);
+}
+
+// Avvia l'inventario delle schede RFID senza bloccare il ciclo degli eventi:
+// mfrc522_init ha già preparato la lettura dei tag
+static void RFIDScanTimerEventHandler(EventLoopTimer* timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        return;
+    }
+    if (!mfrc522_inventory_async(rfidCards, MAX_RFID_CARDS, &RFIDInventoryHandler, NULL))
+    {
+        Log_Debug("[MFRC522][WARNING] Lettura già in corso o lettore non pronto\n");
+        ScheduleRFIDScan(idleScanPeriodMs);
     }
 }
 
@@ -114,21 +179,19 @@ typedef enum {
     ExitCode_Success = 0,
     ExitCode_TermHandler_SigTerm = 1,
     ExitCode_Main_EventLoopFail = 2,
-    ExitCode_ButtonTimer_Consume = 3,
-    ExitCode_AzureTimer_Consume = 4,
     ExitCode_Init_EventLoop = 5,
     ExitCode_Init_MessageButton = 6,
     ExitCode_Init_OrientationButton = 7,
     ExitCode_Init_TwinStatusLed = 8,
-    ExitCode_Init_ButtonPollTimer = 9,
-    ExitCode_Init_AzureTimer = 10,
-    ExitCode_IsButtonPressed_GetValue = 11,    
+    ExitCode_Init_Buttons = 9,
+    ExitCode_Init_AzureConnection = 10,
     ExitCode_Init_OpenMaster = 12,
     ExitCode_Init_SetBusSpeed = 13,
     ExitCode_Init_SetTimeout = 14,
     ExitCode_Init_SetDefaultTarget = 15,
     ExitCode_Main_Led = 16,    
     ExitCode_Init_RegisterIo = 17,
+    ExitCode_Init_RFID = 18,
 } ExitCode;
 
 // function declarations
@@ -138,50 +201,23 @@ static void TerminationHandler(int signalNumber);
 // Azure IoT Central/Central defines.
 #define SCOPEID_LENGTH 20
 static char scopeId[SCOPEID_LENGTH]; // ScopeId for the Azure IoT Central application, set in app_manifest.json, CmdArgs
-static IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle = NULL;
-static const int keepalivePeriodSeconds = 20;
-static bool iothubAuthenticated = false;
-static void sendRFIDCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context);
-static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload,size_t payloadSize, void *userContextCallback);
-static void TwinReportBoolState(const char *propertyName, bool propertyValue);
-static void ReportStatusCallback(int result, void *context);
-static const char *GetReasonString(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason);
-static const char *getAzureSphereProvisioningResultString(AZURE_SPHERE_PROV_RETURN_VALUE provisioningResult);
-static void SendTelemetry(const unsigned char *key, const unsigned char *value);
-static void SetupAzureClient(void);
 
 // Initialization/Cleanup
 static ExitCode InitPeripheralsAndHandlers(void);
-static void CloseFdAndPrintError(int fd, const char *fdName);
 static void ClosePeripheralsAndHandlers(void);
 
-// File descriptors - initialized to invalid value Buttons
-static int sendRFIDButtonGpioFd = -1;
-
 // LED
 static int deviceTwinStatusLedGpioFd = -1;
 
-// Timer / polling
+// Event loop
 static EventLoop *eventLoop = NULL;
-static EventLoopTimer *buttonPollTimer = NULL;
-static EventLoopTimer *azureTimer = NULL;
 
-// Azure IoT poll periods
-static const int AzureIoTDefaultPollPeriodSeconds = 5;
-static const int AzureIoTMinReconnectPeriodSeconds = 60;
-static const int AzureIoTMaxReconnectPeriodSeconds = 10 * 60;
-static int azureIoTPollPeriodSeconds = -1;
 
-// Button state variables
-static GPIO_Value_Type sendRFIDButtonState = GPIO_Value_High;
-
-static void ButtonPollTimerEventHandler(EventLoopTimer *timer);
-static bool IsButtonPressed(int fd, GPIO_Value_Type *oldState);
-static void sendRFIDButtonHandler(void);
+// Button handlers
+static void sendRFIDButtonHandler(Button_Event event, unsigned int clicks, void *context);
 
 
 static bool deviceIsUp = false; // Orientation
-static void AzureTimerEventHandler(EventLoopTimer *timer);
 
 // Signal handler for termination requests. This handler must be async-signal-safe.
 static void TerminationHandler(int signalNumber)
@@ -195,12 +231,9 @@ int main(int argc, char *argv[])
 {
             
     map_init(&priceMap);
-    map_set(&priceMap, "83B03F16", "Modello 1: €100");
-    map_set(&priceMap, "4695CA32", "Modello 2: €200");
-    map_set(&priceMap, "31AC6A1C", "Modello 3: €300");
 
     // Avvio RFID Scanner
-    if (mfrc522_init())
+    if (mfrc522_init() == 0)
     {
         Log_Debug("RFID Scanner trovato!\n");
     }
@@ -230,9 +263,6 @@ int main(int argc, char *argv[])
     Log_Debug("Provo a determinare la versione dello scanner\n");
     uint8_t byte = mfrc522_read(VersionReg);
     Log_Debug("Version trovata %d (Hex: %x)\n", byte, byte); // RFID Version must be 0x92
-    delay(2);
-    RFIDTimerEventHandler();
-    delay(2);
 
     // Main loop
     while (exitCode == ExitCode_Success) {
@@ -249,42 +279,6 @@ int main(int argc, char *argv[])
 }
 
 
-// Button timer event:  Check the status of buttons 1 2 3
-
-static void ButtonPollTimerEventHandler(EventLoopTimer *timer)
-{
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_ButtonTimer_Consume;
-        return;
-    }
-    sendRFIDButtonHandler();        
-}
-
-// // // // // // // // // // // // // // // // // // 
-// Azure timer event:  Check connection status and send telemetry
-// // // // // // // // // // // // // // // // // // 
-static void AzureTimerEventHandler(EventLoopTimer *timer)
-{
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_AzureTimer_Consume;
-        return;
-    }
-
-    bool isNetworkReady = false;
-    if (Networking_IsNetworkingReady(&isNetworkReady) != -1) {
-        if (isNetworkReady && !iothubAuthenticated) {
-            SetupAzureClient();
-        }
-    } else {
-        Log_Debug("Failed to get Network state\n");
-    }
-
-    if (iothubAuthenticated) {        
-        IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
-    }
-}
-
-
 //     Set up SIGTERM termination handler, initialize peripherals, and set up event handlers.
 static ExitCode InitPeripheralsAndHandlers(void)
 {
@@ -300,337 +294,62 @@ static ExitCode InitPeripheralsAndHandlers(void)
     }
 
     
+    // I pulsanti condividono un solo timer, lento a riposo e veloce durante la pressione
+    if (Button_Init(eventLoop) != 0) {
+        return ExitCode_Init_Buttons;
+    }
+
     // Open button 1 GPIO as input
     Log_Debug("Apertura di SAMPLE_BUTTON_1 come input\n");
-    sendRFIDButtonGpioFd = GPIO_OpenAsInput(SAMPLE_BUTTON_1);
-    if (sendRFIDButtonGpioFd < 0) {
+    if (Button_Add(SAMPLE_BUTTON_1, &sendRFIDButtonHandler, NULL) != 0) {
         Log_Debug("ERROR: Could not open button 1: %s (%d).\n", strerror(errno), errno);
         return ExitCode_Init_MessageButton;
     }
 
+    AzureConnection_Config azureConfig = {.scopeId = scopeId};
+    if (AzureConnection_Init(eventLoop, &azureConfig) != 0) {
+        return ExitCode_Init_AzureConnection;
+    }
 
-
-    // Set up a timer to poll for button events
-    static const struct timespec buttonPressCheckPeriod = {.tv_sec = 0, .tv_nsec = 1000 * 1000};
-    buttonPollTimer = CreateEventLoopPeriodicTimer(eventLoop, &ButtonPollTimerEventHandler,
-                                                   &buttonPressCheckPeriod);
-    if (buttonPollTimer == NULL) {
-        return ExitCode_Init_ButtonPollTimer;
+    // Il comando in corso dell'MFRC522 viene controllato da un timer
+    if (mfrc522_async_init(eventLoop) != 0) {
+        return ExitCode_Init_RFID;
     }
 
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = {.tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0};
-    azureTimer =
-        CreateEventLoopPeriodicTimer(eventLoop, &AzureTimerEventHandler, &azureTelemetryPeriod);
-    if (azureTimer == NULL) {
-        return ExitCode_Init_AzureTimer;
+    // Le carte presenti vengono seguite da scansioni periodiche del campo
+    RfidTracker_Init(cardHoldOffMs, &RFIDTagEventHandler, NULL);
+    rfidScanTimer = CreateEventLoopDisarmedTimer(eventLoop, &RFIDScanTimerEventHandler);
+    if (rfidScanTimer == NULL) {
+        return ExitCode_Init_RFID;
     }
+    ScheduleRFIDScan(presentScanPeriodMs);
 
     
     return ExitCode_Success;
 }
 
 
-//     Closes a file descriptor and prints an error on failure.
-static void CloseFdAndPrintError(int fd, const char *fdName)
-{
-    if (fd >= 0) {
-        int result = close(fd);
-        if (result != 0) {
-            Log_Debug("ERROR: Could not close fd %s: %s (%d).\n", fdName, strerror(errno), errno);
-        }
-    }
-}
-
-
 //     Close peripherals and handlers.
 static void ClosePeripheralsAndHandlers(void)
 {
-    DisposeEventLoopTimer(buttonPollTimer);
-    DisposeEventLoopTimer(azureTimer);
+    Button_Cleanup();
+    DisposeEventLoopTimer(rfidScanTimer);
+    mfrc522_async_cleanup();
+    AzureConnection_Cleanup();
     EventLoop_Close(eventLoop);
-
-    Log_Debug("Closing file descriptors\n");
-        
-    
-    CloseFdAndPrintError(sendRFIDButtonGpioFd, "sendRFIDButton");
-    
 }
 
 
-//     Sets the IoT Central authentication state for the app
-//     The SAS Token expires which will set the authentication state
-
-static void HubConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result,
-                                        IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
-                                        void *userContextCallback)
-{
-    iothubAuthenticated = (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED);
-    Log_Debug("IoT Central Authenticated: %s\n", GetReasonString(reason));
-}
-
-
-//     Sets up the Azure IoT Central connection (creates the iothubClientHandle)
-//     When the SAS Token for a device expires the connection needs to be recreated
-//     which is why this is not simply a one time call.
-
-static void SetupAzureClient(void)
-{
-    if (iothubClientHandle != NULL) {
-        IoTHubDeviceClient_LL_Destroy(iothubClientHandle);
-    }
-
-    AZURE_SPHERE_PROV_RETURN_VALUE provResult =
-        IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning(scopeId, 10000,
-                                                                          &iothubClientHandle);
-    Log_Debug("IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning returned '%s'.\n",
-              getAzureSphereProvisioningResultString(provResult));
-
-    if (provResult.result != AZURE_SPHERE_PROV_RESULT_OK) {
-
-        // If fail to connect, reduce the polling frequency, starting at
-        // AzureIoTMinReconnectPeriodSeconds and with a backoff up to
-        // AzureIoTMaxReconnectPeriodSeconds
-        if (azureIoTPollPeriodSeconds == AzureIoTDefaultPollPeriodSeconds) {
-            azureIoTPollPeriodSeconds = AzureIoTMinReconnectPeriodSeconds;
-        } else {
-            azureIoTPollPeriodSeconds *= 2;
-            if (azureIoTPollPeriodSeconds > AzureIoTMaxReconnectPeriodSeconds) {
-                azureIoTPollPeriodSeconds = AzureIoTMaxReconnectPeriodSeconds;
-            }
-        }
-
-        struct timespec azureTelemetryPeriod = {azureIoTPollPeriodSeconds, 0};
-        SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
-
-        Log_Debug("ERROR: failure to create IoTHub Handle - will retry in %i seconds.\n",
-                  azureIoTPollPeriodSeconds);
-        return;
-    }
-
-    // Successfully connected, so make sure the polling frequency is back to the default
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = {.tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0};
-    SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
-
-    iothubAuthenticated = true;
-
-    if (IoTHubDeviceClient_LL_SetOption(iothubClientHandle, OPTION_KEEP_ALIVE,
-                                        &keepalivePeriodSeconds) != IOTHUB_CLIENT_OK) {
-        Log_Debug("ERROR: failure setting option \"%s\"\n", OPTION_KEEP_ALIVE);
-        return;
-    }
-
-    IoTHubDeviceClient_LL_SetDeviceTwinCallback(iothubClientHandle, TwinCallback, NULL);
-    IoTHubDeviceClient_LL_SetConnectionStatusCallback(iothubClientHandle,
-                                                      HubConnectionStatusCallback, NULL);
-}
-
-
-//     Callback invoked when a Device Twin update is received from IoT Central.
-//     Updates local state for 'showEvents' (bool).
-// <param name="payload">contains the Device Twin JSON document (desired and reported)</param>
-// <param name="payloadSize">size of the Device Twin JSON document</param>
-static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char *payload,
-                         size_t payloadSize, void *userContextCallback)
-{
-    size_t nullTerminatedJsonSize = payloadSize + 1;
-    char *nullTerminatedJsonString = (char *)malloc(nullTerminatedJsonSize);
-    if (nullTerminatedJsonString == NULL) {
-        Log_Debug("ERROR: Could not allocate buffer for twin update payload.\n");
-        abort();
-    }
-
-    // Copy the provided buffer to a null terminated buffer.
-    memcpy(nullTerminatedJsonString, payload, payloadSize);
-    // Add the null terminator at the end.
-    nullTerminatedJsonString[nullTerminatedJsonSize - 1] = 0;
-
-    JSON_Value *rootProperties = NULL;
-    rootProperties = json_parse_string(nullTerminatedJsonString);
-    if (rootProperties == NULL) {
-        Log_Debug("WARNING: Cannot parse the string as JSON content.\n");
-        goto cleanup;
-    }
-
-    JSON_Object *rootObject = json_value_get_object(rootProperties);
-    JSON_Object *desiredProperties = json_object_dotget_object(rootObject, "desired");
-    if (desiredProperties == NULL) {
-        desiredProperties = rootObject;
-    }
-
-
-cleanup:
-    // Release the allocated memory.
-    json_value_free(rootProperties);
-    free(nullTerminatedJsonString);
-}
-
-//     Converts the IoT Central connection status reason to a string.
-static const char *GetReasonString(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
-{
-    static char *reasonString = "unknown reason";
-    switch (reason) {
-    case IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_NO_NETWORK:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_NO_NETWORK";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_OK:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_OK"; // must be always this
-        break;
-    }
-    return reasonString;
-}
-
-
-//     Converts AZURE_SPHERE_PROV_RETURN_VALUE to a string.
-static const char *getAzureSphereProvisioningResultString(
-    AZURE_SPHERE_PROV_RETURN_VALUE provisioningResult)
-{
-    switch (provisioningResult.result) {
-    case AZURE_SPHERE_PROV_RESULT_OK:
-        return "AZURE_SPHERE_PROV_RESULT_OK"; // must be this
-    case AZURE_SPHERE_PROV_RESULT_INVALID_PARAM:
-        return "AZURE_SPHERE_PROV_RESULT_INVALID_PARAM";
-    case AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY:
-        return "AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY";
-    case AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY:
-        return "AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY";
-    case AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR:
-        return "AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR";
-    case AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR:
-        return "AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR";
-    default:
-        return "UNKNOWN_RETURN_VALUE";
-    }
-}
-
-
-//     Sends telemetry to IoT Central
-// <param name="key">The telemetry item to update</param>
-// <param name="value">new telemetry value</param>
-static void SendTelemetry(const unsigned char *key, const unsigned char *value)
-{
-    static char eventBuffer[100] = {0};
-    static const char *EventMsgTemplate = "{ \"%s\": \"%s\" }";
-    int len = snprintf(eventBuffer, sizeof(eventBuffer), EventMsgTemplate, key, value);
-    if (len < 0)
-        return;
-
-    Log_Debug("Sending IoT Central Message: %s\n", eventBuffer);
-
-    bool isNetworkingReady = false;
-
-    if ((Networking_IsNetworkingReady(&isNetworkingReady) == -1) || !isNetworkingReady) {
-        Log_Debug("WARNING: Cannot send IoTHubMessage because network is not up.\n");
-        return;
-    }
-
-    IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromString(eventBuffer);
-
-    if (messageHandle == 0) {
-        Log_Debug("WARNING: unable to create a new IoTHubMessage\n");
-        return;
-    }
-
-    if (IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle, sendRFIDCallback,
-                                             /*&callback_param*/ 0) != IOTHUB_CLIENT_OK) {
-        Log_Debug("WARNING: failed to hand over the message to IoTHubClient\n");
-    } else {
-        Log_Debug("INFO: IoTHubClient accepted the message for delivery\n");
-    }
-    
-    IoTHubMessage_Destroy(messageHandle);
-}
-
-
-//     Callback confirming message delivered to IoT Central.
-
-// <param name="result">Message delivery status</param>
-// <param name="context">User specified context</param>
-static void sendRFIDCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context)
-{
-    Log_Debug("INFO: Message received by IoT Central. Result is: %d\n", result);
-}
-
-
-//     Creates and enqueues a report containing the name and value pair of a Device Twin reported
-//     property. The report is not sent immediately, but it is sent on the next invocation of
-//     IoTHubDeviceClient_LL_DoWork().
-// <param name="propertyName">the IoT Central Device Twin property name</param>
-// <param name="propertyValue">the IoT Central Device Twin property value</param>
-static void TwinReportBoolState(const char *propertyName, bool propertyValue)
-{
-    if (iothubClientHandle == NULL) {
-        Log_Debug("ERROR: client not initialized\n");
-    } else {
-        static char reportedPropertiesString[30] = {0};
-        int len = snprintf(reportedPropertiesString, 30, "{\"%s\":%s}", propertyName,
-                           (propertyValue == true ? "true" : "false"));
-        if (len < 0)
-            return;
-
-        if (IoTHubDeviceClient_LL_SendReportedState(
-                iothubClientHandle, (unsigned char *)reportedPropertiesString,
-                strlen(reportedPropertiesString), ReportStatusCallback, 0) != IOTHUB_CLIENT_OK) {
-            Log_Debug("ERROR: failed to set reported state for '%s'.\n", propertyName);
-        } else {
-            Log_Debug("INFO: Reported state for '%s' to value '%s'.\n", propertyName,
-                      (propertyValue == true ? "true" : "false"));
-        }
-    }
-}
-
-
-//     Callback invoked when the Device Twin reported properties are accepted by IoT Central.
-static void ReportStatusCallback(int result, void *context)
-{
-    Log_Debug("INFO: Device Twin reported properties update result: HTTP status code %d\n", result);
-}
-
-
-
-// Il pulsante di controllo è stato premuto.
-// <param name = "fd"> Il descrittore di file del pulsante </param>
-// <param name = "oldState"> Vecchio stato del pulsante (premuto o rilasciato) </param>
-// <return> true se premuto, false in caso contrario </returns>
-static bool IsButtonPressed(int fd, GPIO_Value_Type *oldState)
-{
-    bool isButtonPressed = false;
-    GPIO_Value_Type newState;
-    int result = GPIO_GetValue(fd, &newState);
-    if (result != 0) {
-        Log_Debug("ERROR: Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
-        exitCode = ExitCode_IsButtonPressed_GetValue;
-    } else {
-        // Il pulsante viene premuto se è basso e diverso dall'ultimo stato noto.
-        isButtonPressed = (newState != *oldState) && (newState == GPIO_Value_Low);
-        *oldState = newState;
-    }
-    return isButtonPressed;
-}
 
 
 // La pressione del pulsante 1 invierà l'evento RFID ad Azure IoT Central
-static void sendRFIDButtonHandler(void)
+static void sendRFIDButtonHandler(Button_Event event, unsigned int clicks, void *context)
 {
-    if (IsButtonPressed(sendRFIDButtonGpioFd, &sendRFIDButtonState)) {       
-        RFIDTimerEventHandler();
-        SendTelemetry("RFID", eventBuffer); //Contenuto della card RFID 
+    if (event == Button_Pressed) {
+        // Invia di nuovo le carte presenti, senza leggerle
+        for (size_t i = 0; i < RfidTracker_GetCount(); i++) {
+            HandleRFIDCard(&RfidTracker_GetTag(i)->uid, true);
+        }
     }
 }
 
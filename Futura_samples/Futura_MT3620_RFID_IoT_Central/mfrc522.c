@@ -35,6 +35,7 @@
 #include <applibs/log.h>
 
 #include "mfrc522.h"
+#include "eventloop_timer_utilities.h"
 
 #include <unistd.h>
 
@@ -66,7 +67,7 @@ static bool CheckTransferSize(const char* desc, size_t expectedBytes, ssize_t ac
 	return true;
 }
 
-uint8_t mfrc522_init(void)
+int mfrc522_init(void)
 {
 	// Initialize the SPIMaster Config struct
 	// https://docs.microsoft.com/en-us/azure-sphere/reference/applibs-reference/applibs-spi/function-spimaster-initconfig
@@ -82,7 +83,7 @@ uint8_t mfrc522_init(void)
 	int ret = SPIMaster_InitConfig(&config);
 	if (ret != 0) {
 		Log_Debug("ERROR: SPIMaster_InitConfig = %d errno = %s (%d)\n", ret, strerror(errno), errno);
-		return;
+		return -1;
 	}
 
 	config.csPolarity = SPI_ChipSelectPolarity_ActiveLow;
@@ -91,7 +92,7 @@ uint8_t mfrc522_init(void)
 	Log_Debug("[SPI] Opened SPI Interface\n");
 	if (spiFd < 0) {
 		Log_Debug("ERROR: SPIMaster_Open: errno=%d (%s)\n", errno, strerror(errno));
-		return;
+		return -1;
 	}
 
 	int busSpeed = 4 * 1000 * 1000; // in Hz
@@ -140,49 +141,139 @@ uint8_t mfrc522_init(void)
 	{
 		mfrc522_write(TxControlReg, byte | 0x03);
 	}
+
+	// Interrupt configuration, which the reads do not change
+	mfrc522_set_bit_mask(ComIEnReg, 0x20);
+	mfrc522_set_bit_mask(DivIEnReg, 0x80);
+	return 0;
 }
 
-void mfrc522_write(uint8_t reg, uint8_t data)
+/// <summary>
+///    Writes bytes to one register in a single chip select frame. The MFRC522 stores
+///    every byte which follows the address byte at that address, so this fills the
+///    FIFO with one SPI transfer.
+/// </summary>
+/// <returns>true on success, or false on failure</returns>
+static bool mfrc522_write_frame(uint8_t reg, const uint8_t* data, size_t len)
 {
 	const size_t transferCount = 1;
 	SPIMaster_Transfer transfer;
+	uint8_t command[1 + FIFO_SIZE];
+
+	if (len > FIFO_SIZE) {
+		return false;
+	}
 
 	int result = SPIMaster_InitTransfers(&transfer, transferCount);
 	if (result != 0) {
-		return;
+		return false;
 	}
 
-	//const uint8_t command[] = { (reg << 1) & 0x7E, data };
-	const uint8_t command[] = { (reg << 1) & 0x7E, data };
+	command[0] = (reg << 1) & 0x7E;
+	memcpy(&command[1], data, len);
 	transfer.flags = SPI_TransferFlags_Write;
 	transfer.writeData = command;
-	transfer.length = sizeof(command);
+	transfer.length = 1 + len;
 
 	ssize_t transferredBytes = SPIMaster_TransferSequential(spiFd, &transfer, transferCount);
 
-	if (!CheckTransferSize("SPIMaster_TransferSequential (CTRL3_C)", transfer.length, transferredBytes)) {
+	if (!CheckTransferSize("SPIMaster_TransferSequential (write)", transfer.length, transferredBytes)) {
 		Log_Debug("Transfer size is not correct");
-		return;
+		return false;
 	}
+	return true;
+}
+
+void mfrc522_write(uint8_t reg, uint8_t data)
+{
+	mfrc522_write_frame(reg, &data, sizeof(data));
+}
+
+bool mfrc522_write_fifo(const uint8_t* data, size_t len)
+{
+	return mfrc522_write_frame(FIFODataReg, data, len);
 }
 
 uint8_t mfrc522_read(uint8_t reg)
 {
 	uint8_t readDataResult;
-	//uint8_t readCmd = ((reg << 1) & 0x7E) | 0x80; // Set bit 7 indicating it's a read command -> 0x80
-	uint8_t readCmd = ((reg << 1) & 0x7E | 0x80); // Set bit 7 indicating it's a read command -> 0x80
-	ssize_t transferredBytes = SPIMaster_WriteThenRead(spiFd, &readCmd, sizeof(readCmd), &readDataResult, sizeof(readDataResult));
 
-	if (!CheckTransferSize("SPIMaster_WriteThenRead (CTRL3_C)", sizeof(readCmd) + sizeof(readDataResult), transferredBytes)) {
-		Log_Debug("Transfer size is not correct");
+	if (!mfrc522_read_regs(&reg, &readDataResult, 1)) {
 		return -1;
 	}
 
-	//Log_Debug("INFO: READ=0x%02x (SPIMaster_WriteThenRead)\n", readDataResult);
+	//Log_Debug("INFO: READ=0x%02x\n", readDataResult);
 
 	return readDataResult;
 }
 
+/// <summary>
+///    Reads several registers in a single chip select frame, with one
+///    SPIMaster_TransferSequential call. In a read frame the MFRC522 returns the
+///    register addressed by each byte during the following byte, so the frame
+///    alternates one-byte address writes and one-byte reads. Each read clocks out
+///    0x00 rather than whatever MOSI holds while idle: it addresses the reserved
+///    register 0x00, which has no side effects, and as the last byte it ends the
+///    frame, as the datasheet (8.1.2.1) asks.
+/// </summary>
+/// <returns>true on success, or false on failure</returns>
+bool mfrc522_read_regs(const uint8_t* regs, uint8_t* values, size_t count)
+{
+	static const uint8_t readFill = 0x00;
+	SPIMaster_Transfer transfers[2 * FIFO_SIZE];
+	uint8_t addresses[FIFO_SIZE];
+	size_t transferCount = 2 * count;
+
+	if (count == 0 || count > FIFO_SIZE) {
+		return false;
+	}
+
+	int result = SPIMaster_InitTransfers(transfers, transferCount);
+	if (result != 0) {
+		return false;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		addresses[i] = ((regs[i] << 1) & 0x7E) | 0x80; // Set bit 7 indicating it's a read command -> 0x80
+		transfers[2 * i].flags = SPI_TransferFlags_Write;
+		transfers[2 * i].writeData = &addresses[i];
+		transfers[2 * i].length = 1;
+		transfers[2 * i + 1].flags = SPI_TransferFlags_Read | SPI_TransferFlags_Write;
+		transfers[2 * i + 1].writeData = &readFill;
+		transfers[2 * i + 1].readData = &values[i];
+		transfers[2 * i + 1].length = 1;
+	}
+
+	ssize_t transferredBytes = SPIMaster_TransferSequential(spiFd, transfers, transferCount);
+	if (!CheckTransferSize("SPIMaster_TransferSequential (read)", transferCount, transferredBytes)) {
+		Log_Debug("Transfer size is not correct");
+		return false;
+	}
+	return true;
+}
+
+bool mfrc522_read_fifo(uint8_t* data, size_t len)
+{
+	uint8_t regs[FIFO_SIZE];
+
+	if (len > FIFO_SIZE) {
+		return false;
+	}
+	memset(regs, FIFODataReg, len);
+	return mfrc522_read_regs(regs, data, len);
+}
+
+// Read-modify-write of the bits of a register: two SPI transfers.
+void mfrc522_set_bit_mask(uint8_t reg, uint8_t mask)
+{
+	mfrc522_write(reg, mfrc522_read(reg) | mask);
+}
+
+void mfrc522_clear_bit_mask(uint8_t reg, uint8_t mask)
+{
+	mfrc522_write(reg, mfrc522_read(reg) & (~mask));
+}
+
 
 //uint8_t mfrc522_read(uint8_t reg)
 //{
@@ -238,6 +329,38 @@ void mfrc522_reset()
 	mfrc522_write(CommandReg, SoftReset_CMD);
 }
 
+// Checks the answer to REQA/WUPA: the 16-bit ATQA
+static uint8_t mfrc522_check_request(uint8_t status, uint32_t backBits)
+{
+	if ((status != CARD_FOUND) || (backBits != 0x10))
+	{
+		status = ERROR;
+	}
+
+	return status;
+}
+
+// Checks the answer to the anti-collision command: 4 serial bytes and their XOR
+static uint8_t mfrc522_check_serial(uint8_t status, const uint8_t* serial_out)
+{
+	uint8_t i;
+	uint8_t serNumCheck = 0;
+
+	if (status == CARD_FOUND)
+	{
+		//Check card serial number
+		for (i = 0; i < 4; i++)
+		{
+			serNumCheck ^= serial_out[i];
+		}
+		if (serNumCheck != serial_out[i])
+		{
+			status = ERROR;
+		}
+	}
+	return status;
+}
+
 uint8_t	mfrc522_request(uint8_t req_mode, uint8_t* tag_type)
 {
 	uint8_t  status;
@@ -248,91 +371,130 @@ uint8_t	mfrc522_request(uint8_t req_mode, uint8_t* tag_type)
 	tag_type[0] = req_mode;
 	status = mfrc522_to_card(Transceive_CMD, tag_type, 1, tag_type, &backBits);
 
-	if ((status != CARD_FOUND) || (backBits != 0x10))
-	{
-		status = ERROR;
-	}
-
-	return status;
+	return mfrc522_check_request(status, backBits);
 }
 
-uint8_t mfrc522_to_card(uint8_t cmd, uint8_t* send_data, uint8_t send_data_len, uint8_t* back_data, uint32_t* back_data_len)
+// Interrupt bits which enable and end a command
+static void mfrc522_command_irqs(uint8_t cmd, uint8_t* irqEn, uint8_t* waitIRq)
 {
-	uint8_t status = ERROR;
-	uint8_t irqEn = 0x00;
-	uint8_t waitIRq = 0x00;
-	uint8_t lastBits;
-	uint8_t n;
-	uint8_t	tmp;
-	uint32_t i;
+	*irqEn = 0x00;
+	*waitIRq = 0x00;
 
 	switch (cmd)
 	{
 	case MFAuthent_CMD:		//Certification cards close
 	{
-		irqEn = 0x12;
-		waitIRq = 0x10;
+		*irqEn = 0x12;
+		*waitIRq = 0x10;
 		break;
 	}
 	case Transceive_CMD:	//Transmit FIFO data
 	{
-		irqEn = 0x77;
-		waitIRq = 0x30;
+		*irqEn = 0x77;
+		*waitIRq = 0x30;
+		break;
+	}
+	case Transmit_CMD:		//Transmit FIFO data, no answer expected
+	{
+		*irqEn = 0x50;
+		*waitIRq = 0x10;
 		break;
 	}
 	default:
 		break;
 	}
+}
 
+// Loads the FIFO and starts the command. framing is the BitFramingReg value (RxAlign and
+// TxLastBits) without StartSend. With TAuto set in TModeReg (mfrc522_init), the MFRC522
+// timer starts at the end of the transmission, and sets TimerIRq if no card answers within
+// its reload period, which ends the wait.
+static void mfrc522_start_command(uint8_t cmd, const uint8_t* send_data, uint8_t send_data_len, uint8_t framing)
+{
 	//mfrc522_write(ComIEnReg, irqEn|0x80);	//Interrupt request
-	n = mfrc522_read(ComIrqReg);
-	mfrc522_write(ComIrqReg, n & (~0x80));//clear all interrupt bits
-	n = mfrc522_read(FIFOLevelReg);
-	mfrc522_write(FIFOLevelReg, n | 0x80);//flush FIFO data
+	//Neither needs a read first: with Set1 = 0, the 1 bits clear the interrupt bits, and the
+	//other bits of FIFOLevelReg are read-only
+	mfrc522_write(ComIrqReg, 0x7F);//clear all interrupt bits
+	mfrc522_write(FIFOLevelReg, 0x80);//flush FIFO data
 
 	mfrc522_write(CommandReg, Idle_CMD);	//NO action; Cancel the current cmd???
 
 	//Writing data to the FIFO
-	for (i = 0; i < send_data_len; i++)
+	mfrc522_write_fifo(send_data, send_data_len);
+
+	//Execute the cmd; other commands than Transceive transmit at once
+	if (cmd != Transceive_CMD)
 	{
-		mfrc522_write(FIFODataReg, send_data[i]);
+		mfrc522_write(BitFramingReg, framing);
 	}
-
-	//Execute the cmd
 	mfrc522_write(CommandReg, cmd);
 	if (cmd == Transceive_CMD)
 	{
-		n = mfrc522_read(BitFramingReg);
-		mfrc522_write(BitFramingReg, n | 0x80);
+		mfrc522_write(BitFramingReg, framing | 0x80);	//StartSend
 	}
+}
 
-	//Waiting to receive data to complete
-	i = 2000;	//i according to the clock frequency adjustment, the operator M1 card maximum waiting time 25ms???
-	do
-	{
-		//CommIrqReg[7..0]
-		//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
-		n = mfrc522_read(ComIrqReg);
-		i--;
-	} while ((i != 0) && !(n & 0x01) && !(n & waitIRq));
+// Reads ComIrqReg into *irq; true when the command has ended or the timer has expired
+static bool mfrc522_command_done(uint8_t waitIRq, uint8_t* irq)
+{
+	//CommIrqReg[7..0]
+	//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
+	*irq = mfrc522_read(ComIrqReg);
+	return (*irq & 0x01) || (*irq & waitIRq);
+}
 
-	tmp = mfrc522_read(BitFramingReg);
+// Stops the transmission and collects the result of a command which has ended, or, when
+// completed is false, which was abandoned. On COLLISION the bits received before the
+// collision are in back_data, and coll_pos, when not NULL, is set to the position of the
+// first collision among the received bits, from 1.
+static uint8_t mfrc522_finish_command(uint8_t cmd, uint8_t irqEn, uint8_t irq, bool completed, uint8_t* back_data, uint32_t* back_data_len, uint8_t* coll_pos)
+{
+	uint8_t status = ERROR;
+	uint8_t lastBits;
+	uint8_t n;
+	uint8_t	tmp;
+
+	//Everything the result needs, in one transfer
+	static const uint8_t resultRegs[] = { BitFramingReg, ErrorReg, FIFOLevelReg, ControlReg, CollReg };
+	uint8_t result[sizeof(resultRegs)];
+	if (!mfrc522_read_regs(resultRegs, result, sizeof(resultRegs)))
+	{
+		mfrc522_clear_bit_mask(BitFramingReg, 0x80);
+		return ERROR;
+	}
+	tmp = result[0];
 	mfrc522_write(BitFramingReg, tmp & (~0x80));
 
-	if (i != 0)
+	if (completed)
 	{
-		if (!(mfrc522_read(ErrorReg) & 0x1B))	//BufferOvfl Collerr CRCErr ProtecolErr
+		if (!(result[1] & 0x13))	//BufferOvfl ParityErr ProtecolErr
 		{
 			status = CARD_FOUND;
-			if (n & irqEn & 0x01)
+			if (irq & irqEn & 0x01)
 			{
 				status = CARD_NOT_FOUND;			//??   
 			}
+			else if (result[1] & 0x08)	//CollErr
+			{
+				status = COLLISION;
+				if (result[4] & 0x20)	//CollPosNotValid
+				{
+					status = ERROR;
+				}
+				else if (coll_pos != NULL)
+				{
+					*coll_pos = result[4] & 0x1F;
+					if (*coll_pos == 0)
+					{
+						*coll_pos = 32;
+					}
+				}
+			}
 
-			if (cmd == Transceive_CMD)
+			if (cmd == Transceive_CMD && status != ERROR)
 			{
-				n = mfrc522_read(FIFOLevelReg);
-				lastBits = mfrc522_read(ControlReg) & 0x07;
+				n = result[2];
+				lastBits = result[3] & 0x07;
 				if (lastBits)
 				{
 					*back_data_len = (n - 1) * 8 + lastBits;
@@ -352,9 +514,9 @@ uint8_t mfrc522_to_card(uint8_t cmd, uint8_t* send_data, uint8_t send_data_len,
 				}
 
 				//Reading the received data in FIFO
-				for (i = 0; i < n; i++)
+				if (!mfrc522_read_fifo(back_data, n))
 				{
-					back_data[i] = mfrc522_read(FIFODataReg);
+					status = ERROR;
 				}
 			}
 		}
@@ -371,12 +533,31 @@ uint8_t mfrc522_to_card(uint8_t cmd, uint8_t* send_data, uint8_t send_data_len,
 	return status;
 }
 
+uint8_t mfrc522_to_card(uint8_t cmd, uint8_t* send_data, uint8_t send_data_len, uint8_t* back_data, uint32_t* back_data_len)
+{
+	uint8_t irqEn;
+	uint8_t waitIRq;
+	uint8_t n;
+	uint32_t i;
+
+	mfrc522_command_irqs(cmd, &irqEn, &waitIRq);
+	//The callers set the framing in BitFramingReg
+	mfrc522_start_command(cmd, send_data, send_data_len, mfrc522_read(BitFramingReg) & 0x7F);
+
+	//Waiting to receive data to complete
+	i = 2000;	//i according to the clock frequency adjustment, the operator M1 card maximum waiting time 25ms???
+	do
+	{
+		i--;
+	} while (!mfrc522_command_done(waitIRq, &n) && (i != 0));
+
+	return mfrc522_finish_command(cmd, irqEn, n, i != 0, back_data, back_data_len, NULL);
+}
+
 
 uint8_t mfrc522_get_card_serial(uint8_t* serial_out)
 {
 	uint8_t status;
-	uint8_t i;
-	uint8_t serNumCheck = 0;
 	uint32_t unLen;
 
 	mfrc522_write(BitFramingReg, 0x00);		//TxLastBists = BitFramingReg[2..0]
@@ -385,17 +566,553 @@ uint8_t mfrc522_get_card_serial(uint8_t* serial_out)
 	serial_out[1] = 0x20;
 	status = mfrc522_to_card(Transceive_CMD, serial_out, 2, serial_out, &unLen);
 
-	if (status == CARD_FOUND)
+	return mfrc522_check_serial(status, serial_out);
+}
+
+// Card operations are sequences of exchanges with the PICCs. A step function reads the
+// result of the previous exchange and prepares the next one, so the same operation runs
+// blocking, or from the event loop: there, each command is started, then ComIrqReg is
+// polled from a timer until the command ends. The MFRC522 timer ends a command which gets
+// no answer after about 15 ms, so the wait is bounded without blocking the event loop.
+// The board does not connect the MFRC522 IRQ pin.
+
+typedef struct {
+	uint8_t cmd;			//Transceive_CMD or Transmit_CMD
+	uint8_t data[MAX_LEN];	//sent, then received
+	uint8_t len;			//bytes to send
+	uint8_t framing;		//BitFramingReg: RxAlign << 4 | TxLastBits
+	uint8_t status;			//CARD_FOUND, CARD_NOT_FOUND, COLLISION or ERROR
+	uint32_t back_bits;		//bits received, counting the RxAlign bits of the first byte
+	uint8_t coll_pos;		//on COLLISION, see mfrc522_finish_command
+} mfrc522_exchange;
+
+// Reads the result of ex, which is zeroed before the first step, and prepares the next
+// exchange in ex; false when the operation has ended
+typedef bool (*mfrc522_step_fn)(mfrc522_exchange* ex);
+
+static void mfrc522_begin_exchange(mfrc522_exchange* ex, uint8_t* irqEn, uint8_t* waitIRq)
+{
+	mfrc522_command_irqs(ex->cmd, irqEn, waitIRq);
+	mfrc522_start_command(ex->cmd, ex->data, ex->len, ex->framing);
+}
+
+static void mfrc522_end_exchange(mfrc522_exchange* ex, uint8_t irqEn, uint8_t irq, bool completed)
+{
+	ex->back_bits = 0;
+	ex->coll_pos = 0;
+	ex->status = mfrc522_finish_command(ex->cmd, irqEn, irq, completed, ex->data, &ex->back_bits, &ex->coll_pos);
+}
+
+static void mfrc522_run_blocking(mfrc522_step_fn step)
+{
+	mfrc522_exchange ex;
+	uint8_t irqEn;
+	uint8_t waitIRq;
+	uint8_t n;
+	uint32_t i;
+
+	memset(&ex, 0, sizeof(ex));
+	while (step(&ex))
 	{
-		//Check card serial number
-		for (i = 0; i < 4; i++)
+		mfrc522_begin_exchange(&ex, &irqEn, &waitIRq);
+		i = 2000;
+		do
 		{
-			serNumCheck ^= serial_out[i];
+			i--;
+		} while (!mfrc522_command_done(waitIRq, &n) && (i != 0));
+		mfrc522_end_exchange(&ex, irqEn, n, i != 0);
+	}
+}
+
+// CRC_A of ISO/IEC 14443-3, appended to SELECT and HLTA, least significant byte first
+static uint16_t mfrc522_crc_a(const uint8_t* data, size_t len)
+{
+	uint16_t crc = 0x6363;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		uint8_t b = data[i] ^ (uint8_t)crc;
+		b ^= (uint8_t)(b << 4);
+		crc = (uint16_t)((crc >> 8) ^ ((uint16_t)b << 8) ^ ((uint16_t)b << 3) ^ (b >> 4));
+	}
+	return crc;
+}
+
+static void mfrc522_prepare_request(mfrc522_exchange* ex, uint8_t req_mode)
+{
+	ex->cmd = Transceive_CMD;
+	ex->data[0] = req_mode;
+	ex->len = 1;
+	ex->framing = 0x07;	//short frame: 7 bits
+}
+
+// Single card read: REQA/WUPA, then anti-collision at cascade level 1
+
+typedef enum {
+	Mfrc522_Read_Start,
+	Mfrc522_Read_Request,
+	Mfrc522_Read_Serial,
+} mfrc522_read_phase;
+
+static struct {
+	mfrc522_read_phase phase;
+	uint8_t req_mode;
+	uint8_t status;
+	uint8_t serial[5];
+} readCard;
+
+static bool mfrc522_read_step(mfrc522_exchange* ex)
+{
+	switch (readCard.phase) {
+	case Mfrc522_Read_Start:
+		mfrc522_prepare_request(ex, readCard.req_mode);
+		readCard.phase = Mfrc522_Read_Request;
+		return true;
+
+	case Mfrc522_Read_Request:
+		readCard.status = mfrc522_check_request(ex->status, ex->back_bits);
+		if (readCard.status != CARD_FOUND) {
+			return false;
 		}
-		if (serNumCheck != serial_out[i])
+		ex->data[0] = PICC_ANTICOLL;
+		ex->data[1] = 0x20;
+		ex->len = 2;
+		ex->framing = 0x00;
+		readCard.phase = Mfrc522_Read_Serial;
+		return true;
+
+	case Mfrc522_Read_Serial:
+	default:
+		readCard.status = mfrc522_check_serial(ex->status, ex->data);
+		memcpy(readCard.serial, ex->data, sizeof(readCard.serial));
+		return false;
+	}
+}
+
+// Inventory: ISO/IEC 14443-3 type A selection of every PICC in the field, one at a time,
+// walking the binary tree of UID bits. Each selection starts with WUPA, which wakes every
+// PICC, halted or not; the lower cascade levels already resolved are selected again with
+// their full CLn, then anti-collision frames extend the known UID bits until one PICC is
+// left. At each collision, the PICCs with a 1 are followed, and the 0 branch is kept for a
+// later selection. When the SAK has no cascade bit, the UID is complete, and HLTA halts the
+// PICC. The inventory ends when no branch is left.
+// REQA cannot be used after HLTA: a PICC woken from HALT by WUPA, which is not selected,
+// goes back to HALT, and would not answer it.
+
+#define CASCADE_TAG				0x88
+#define SAK_CASCADE				0x04
+// Branches left for later: each has a PICC behind it, so this is only reached with more
+// PICCs in the field than fit on the antenna
+#define MAX_INVENTORY_BRANCHES	16
+// Exchanges before an inventory is abandoned: about 40 per PICC with a 4-byte UID when
+// every anti-collision round resolves a single bit, for several PICCs
+#define MAX_INVENTORY_EXCHANGES	400
+
+typedef enum {
+	Mfrc522_Inventory_Start,
+	Mfrc522_Inventory_Request,
+	Mfrc522_Inventory_Reselect,
+	Mfrc522_Inventory_AntiCollision,
+	Mfrc522_Inventory_Select,
+	Mfrc522_Inventory_Halt,
+} mfrc522_inventory_phase;
+
+// Position in the tree: cascade level, and UID bits known
+typedef struct {
+	uint8_t level;			//cascade level, from 0
+	uint8_t known_bits;		//bits of cl known at this level
+	uint8_t cl[5];			//UID CLn: 4 bytes, then their XOR (BCC)
+	uint8_t uid[6];			//UID bytes of the lower levels, 3 per level
+} mfrc522_inventory_branch;
+
+static struct {
+	mfrc522_inventory_phase phase;
+	mfrc522_uid* uids;
+	size_t capacity;
+	size_t count;
+	uint8_t status;
+	unsigned int exchanges;
+	uint8_t silent;			//WUPA without answer in a row
+	uint8_t reselected;		//lower levels selected again since WUPA
+	mfrc522_inventory_branch start;		//where this selection started, resumed after a failure
+	mfrc522_inventory_branch at;
+	mfrc522_inventory_branch branches[MAX_INVENTORY_BRANCHES];
+	size_t branch_count;
+} inventory;
+
+static const uint8_t selectCodes[] = { PICC_ANTICOLL, PICC_ANTICOLL_CL2, PICC_ANTICOLL_CL3 };
+
+static void mfrc522_prepare_anticollision(mfrc522_exchange* ex)
+{
+	uint8_t bytes = inventory.at.known_bits / 8;
+	uint8_t bits = inventory.at.known_bits % 8;
+	uint8_t sent = bytes + (bits ? 1 : 0);
+
+	ex->cmd = Transceive_CMD;
+	ex->data[0] = selectCodes[inventory.at.level];
+	ex->data[1] = (uint8_t)(((2 + bytes) << 4) | bits);	//NVB: bytes and bits sent
+	memcpy(&ex->data[2], inventory.at.cl, sent);
+	ex->len = 2 + sent;
+	ex->framing = (uint8_t)((bits << 4) | bits);	//the answer continues the last byte sent
+}
+
+static void mfrc522_prepare_select(mfrc522_exchange* ex, uint8_t level, const uint8_t* cl)
+{
+	ex->cmd = Transceive_CMD;
+	ex->data[0] = selectCodes[level];
+	ex->data[1] = 0x70;	//NVB: all 40 bits
+	memcpy(&ex->data[2], cl, 5);
+	uint16_t crc = mfrc522_crc_a(ex->data, 7);
+	ex->data[7] = (uint8_t)crc;
+	ex->data[8] = (uint8_t)(crc >> 8);
+	ex->len = 9;
+	ex->framing = 0x00;
+}
+
+static void mfrc522_prepare_halt(mfrc522_exchange* ex)
+{
+	ex->cmd = Transmit_CMD;	//a PICC never answers HLTA
+	ex->data[0] = PICC_HALT;
+	ex->data[1] = 0x00;
+	uint16_t crc = mfrc522_crc_a(ex->data, 2);
+	ex->data[2] = (uint8_t)crc;
+	ex->data[3] = (uint8_t)(crc >> 8);
+	ex->len = 4;
+	ex->framing = 0x00;
+}
+
+// Merges the answer to an anti-collision frame into cl. The first received bit was stored
+// at bit RxAlign of the first byte, which continues the last byte sent.
+static void mfrc522_merge_anticollision(const mfrc522_exchange* ex, uint8_t valid_bits)
+{
+	uint8_t align = inventory.at.known_bits % 8;
+	uint8_t end = inventory.at.known_bits + valid_bits;
+
+	for (uint8_t bit = inventory.at.known_bits; bit < end && bit < 40; bit++)
+	{
+		uint8_t rx = bit - inventory.at.known_bits + align;	//position in the received bytes
+		uint8_t mask = (uint8_t)(1 << (bit % 8));
+		if (ex->data[rx / 8] & (1 << (rx % 8)))
 		{
-			status = ERROR;
+			inventory.at.cl[bit / 8] |= mask;
+		}
+		else
+		{
+			inventory.at.cl[bit / 8] &= (uint8_t)~mask;
 		}
 	}
-	return status;
-}
\ No newline at end of file
+}
+
+// Sends WUPA to select the PICCs from branch, again after a failure: the PICCs being
+// selected have gone back to IDLE, or HALT
+static void mfrc522_inventory_restart(mfrc522_exchange* ex, const mfrc522_inventory_branch* branch)
+{
+	inventory.start = *branch;
+	inventory.at = *branch;
+	inventory.reselected = 0;
+	mfrc522_prepare_request(ex, PICC_REQALL);
+	inventory.phase = Mfrc522_Inventory_Request;
+}
+
+// Selects the next lower level again, or resolves the current one
+static void mfrc522_inventory_descend(mfrc522_exchange* ex)
+{
+	if (inventory.reselected < inventory.at.level)
+	{
+		uint8_t cl[5] = { CASCADE_TAG };
+		memcpy(&cl[1], &inventory.at.uid[3 * inventory.reselected], 3);
+		cl[4] = cl[0] ^ cl[1] ^ cl[2] ^ cl[3];
+		mfrc522_prepare_select(ex, inventory.reselected, cl);
+		inventory.phase = Mfrc522_Inventory_Reselect;
+	}
+	else
+	{
+		mfrc522_prepare_anticollision(ex);
+		inventory.phase = Mfrc522_Inventory_AntiCollision;
+	}
+}
+
+static bool mfrc522_sak_valid(const mfrc522_exchange* ex)
+{
+	return ex->status == CARD_FOUND && ex->back_bits == 24 &&
+		mfrc522_crc_a(ex->data, 1) == (uint16_t)(ex->data[1] | (ex->data[2] << 8));
+}
+
+static bool mfrc522_inventory_step(mfrc522_exchange* ex)
+{
+	if (++inventory.exchanges > MAX_INVENTORY_EXCHANGES)
+	{
+		inventory.status = ERROR;
+		return false;
+	}
+
+	switch (inventory.phase) {
+	case Mfrc522_Inventory_Start:
+	{
+		mfrc522_write(CollReg, 0x00);	//ValuesAfterColl = 0: bits after a collision read 0
+		static const mfrc522_inventory_branch root;
+		mfrc522_inventory_restart(ex, &root);
+		return true;
+	}
+
+	case Mfrc522_Inventory_Request:
+		if (ex->status == CARD_NOT_FOUND)
+		{
+			//A PICC left READY or ACTIVE by an earlier read, or by a failed selection,
+			//goes back to IDLE on WUPA instead of answering it: try once more
+			if (++inventory.silent < 2)
+			{
+				mfrc522_inventory_restart(ex, &inventory.start);
+				return true;
+			}
+			return false;	//no PICC left
+		}
+		//Several PICCs answering at once collide in the ATQA, which is fine
+		inventory.silent = 0;
+		mfrc522_inventory_descend(ex);
+		return true;
+
+	case Mfrc522_Inventory_Reselect:
+		if (!mfrc522_sak_valid(ex) || !(ex->data[0] & SAK_CASCADE))
+		{
+			mfrc522_inventory_restart(ex, &inventory.start);
+			return true;
+		}
+		inventory.reselected++;
+		mfrc522_inventory_descend(ex);
+		return true;
+
+	case Mfrc522_Inventory_AntiCollision:
+		if (ex->status == COLLISION && inventory.at.known_bits + ex->coll_pos <= 32)
+		{
+			//keep the bits before the collision, follow the 1 branch, and keep the 0 one
+			if (inventory.branch_count == MAX_INVENTORY_BRANCHES)
+			{
+				inventory.status = ERROR;
+				return false;
+			}
+			mfrc522_merge_anticollision(ex, ex->coll_pos - 1);
+			inventory.at.known_bits += ex->coll_pos;
+			uint8_t byte = (inventory.at.known_bits - 1) / 8;
+			uint8_t mask = (uint8_t)(1 << ((inventory.at.known_bits - 1) % 8));
+			inventory.at.cl[byte] &= (uint8_t)~mask;
+			inventory.branches[inventory.branch_count++] = inventory.at;
+			inventory.at.cl[byte] |= mask;
+			mfrc522_prepare_anticollision(ex);
+			return true;
+		}
+		if (ex->status != CARD_FOUND || ex->back_bits != 40 - (inventory.at.known_bits & ~7u))
+		{
+			mfrc522_inventory_restart(ex, &inventory.start);
+			return true;
+		}
+		mfrc522_merge_anticollision(ex, 40 - inventory.at.known_bits);
+		if ((inventory.at.cl[0] ^ inventory.at.cl[1] ^ inventory.at.cl[2] ^ inventory.at.cl[3]) != inventory.at.cl[4])
+		{
+			mfrc522_inventory_restart(ex, &inventory.start);
+			return true;
+		}
+		mfrc522_prepare_select(ex, inventory.at.level, inventory.at.cl);
+		inventory.phase = Mfrc522_Inventory_Select;
+		return true;
+
+	case Mfrc522_Inventory_Select:
+		if (!mfrc522_sak_valid(ex))
+		{
+			mfrc522_inventory_restart(ex, &inventory.start);
+			return true;
+		}
+		if (ex->data[0] & SAK_CASCADE)
+		{
+			//cl[0] is the cascade tag, and the UID continues at the next level
+			if (inventory.at.cl[0] != CASCADE_TAG || inventory.at.level == 2)
+			{
+				mfrc522_inventory_restart(ex, &inventory.start);
+				return true;
+			}
+			memcpy(&inventory.at.uid[3 * inventory.at.level], &inventory.at.cl[1], 3);
+			inventory.at.level++;
+			inventory.at.known_bits = 0;
+			memset(inventory.at.cl, 0, sizeof(inventory.at.cl));
+			inventory.reselected = inventory.at.level;
+			mfrc522_prepare_anticollision(ex);
+			inventory.phase = Mfrc522_Inventory_AntiCollision;
+			return true;
+		}
+		if (inventory.count == inventory.capacity)
+		{
+			return false;	//no room for more UIDs
+		}
+		mfrc522_uid* uid = &inventory.uids[inventory.count++];
+		uid->size = 3 * inventory.at.level + 4;
+		memcpy(uid->uid, inventory.at.uid, 3 * inventory.at.level);
+		memcpy(&uid->uid[3 * inventory.at.level], inventory.at.cl, 4);
+		uid->sak = ex->data[0];
+		mfrc522_prepare_halt(ex);
+		inventory.phase = Mfrc522_Inventory_Halt;
+		return true;
+
+	case Mfrc522_Inventory_Halt:
+	default:
+		if (inventory.branch_count == 0)
+		{
+			return false;
+		}
+		inventory.silent = 0;
+		mfrc522_inventory_restart(ex, &inventory.branches[--inventory.branch_count]);
+		return true;
+	}
+}
+
+static void mfrc522_inventory_begin(mfrc522_uid* uids, size_t capacity)
+{
+	inventory.phase = Mfrc522_Inventory_Start;
+	inventory.uids = uids;
+	inventory.capacity = capacity;
+	inventory.count = 0;
+	inventory.status = CARD_NOT_FOUND;
+	inventory.exchanges = 0;
+	inventory.silent = 0;
+	inventory.branch_count = 0;
+}
+
+static uint8_t mfrc522_inventory_status(void)
+{
+	if (inventory.status == ERROR)
+	{
+		return ERROR;
+	}
+	return inventory.count > 0 ? CARD_FOUND : CARD_NOT_FOUND;
+}
+
+size_t mfrc522_inventory(mfrc522_uid* uids, size_t capacity, uint8_t* status)
+{
+	mfrc522_inventory_begin(uids, capacity);
+	mfrc522_run_blocking(mfrc522_inventory_step);
+	*status = mfrc522_inventory_status();
+	return inventory.count;
+}
+
+// Event loop runner
+
+// The first poll comes 1 ms after the start: a card answers REQA within a few hundred
+// microseconds
+static const struct timespec pollPeriod = { .tv_sec = 0, .tv_nsec = 1000 * 1000 };
+// Polls before a command is abandoned, well beyond the MFRC522 timer, in case the chip stops
+// answering
+#define MAX_POLLS	50
+
+static struct {
+	EventLoopTimer* timer;
+	mfrc522_step_fn step;	//NULL when idle
+	void (*complete)(void);
+	uint8_t irqEn;
+	uint8_t waitIRq;
+	unsigned int polls;
+	mfrc522_exchange ex;
+	mfrc522_card_callback cardCallback;
+	mfrc522_inventory_callback inventoryCallback;
+	void* context;
+} async;
+
+// Runs the next exchange of the operation, or completes it
+static void mfrc522_advance_async(void)
+{
+	if (async.step(&async.ex)) {
+		async.polls = 0;
+		mfrc522_begin_exchange(&async.ex, &async.irqEn, &async.waitIRq);
+		return;
+	}
+
+	DisarmEventLoopTimer(async.timer);
+	async.step = NULL;
+	async.complete();
+}
+
+static void mfrc522_poll_handler(EventLoopTimer* timer)
+{
+	uint8_t n;
+
+	if (ConsumeEventLoopTimerEvent(timer) != 0 || async.step == NULL) {
+		return;
+	}
+
+	bool done = mfrc522_command_done(async.waitIRq, &n);
+	if (!done && ++async.polls < MAX_POLLS) {
+		return;
+	}
+
+	mfrc522_end_exchange(&async.ex, async.irqEn, n, done);
+	mfrc522_advance_async();
+}
+
+static bool mfrc522_start_async(mfrc522_step_fn step, void (*complete)(void))
+{
+	memset(&async.ex, 0, sizeof(async.ex));
+	async.step = step;
+	async.complete = complete;
+	if (SetEventLoopTimerPeriod(async.timer, &pollPeriod) != 0) {
+		async.step = NULL;
+		return false;
+	}
+	mfrc522_advance_async();
+	return true;
+}
+
+static bool mfrc522_async_busy(void)
+{
+	return async.timer == NULL || async.step != NULL;
+}
+
+int mfrc522_async_init(EventLoop* eventLoop)
+{
+	async.timer = CreateEventLoopDisarmedTimer(eventLoop, &mfrc522_poll_handler);
+	if (async.timer == NULL) {
+		Log_Debug("ERROR: Could not create the MFRC522 poll timer: %s (%d).\n", strerror(errno), errno);
+		return -1;
+	}
+	async.step = NULL;
+	return 0;
+}
+
+void mfrc522_async_cleanup(void)
+{
+	DisposeEventLoopTimer(async.timer);
+	async.timer = NULL;
+	async.step = NULL;
+}
+
+static void mfrc522_read_complete(void)
+{
+	async.cardCallback(readCard.status, readCard.serial, async.context);
+}
+
+bool mfrc522_read_card_async(uint8_t req_mode, mfrc522_card_callback callback, void* context)
+{
+	if (mfrc522_async_busy()) {
+		return false;
+	}
+
+	async.cardCallback = callback;
+	async.context = context;
+	readCard.phase = Mfrc522_Read_Start;
+	readCard.req_mode = req_mode;
+	return mfrc522_start_async(mfrc522_read_step, mfrc522_read_complete);
+}
+
+static void mfrc522_inventory_complete(void)
+{
+	async.inventoryCallback(mfrc522_inventory_status(), inventory.uids, inventory.count, async.context);
+}
+
+bool mfrc522_inventory_async(mfrc522_uid* uids, size_t capacity, mfrc522_inventory_callback callback, void* context)
+{
+	if (mfrc522_async_busy()) {
+		return false;
+	}
+
+	async.inventoryCallback = callback;
+	async.context = context;
+	mfrc522_inventory_begin(uids, capacity);
+	return mfrc522_start_async(mfrc522_inventory_step, mfrc522_inventory_complete);
+}
@@ -23,15 +23,20 @@
 #ifndef MFRC522_H
 #define MFRC522_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <applibs/eventloop.h>
 #include "mfrc522_cmd.h"
 #include "mfrc522_reg.h"
 
 #define CARD_FOUND		1
 #define CARD_NOT_FOUND	2
 #define ERROR			3
+#define COLLISION		4				// several cards answered; see mfrc522_inventory
 
 #define MAX_LEN			16
+#define FIFO_SIZE		64				// bytes in the MFRC522 FIFO, and most registers read at once
 
  //Card types
 #define Mifare_UltraLight 	0x4400
@@ -44,6 +49,8 @@
 # define PICC_REQIDL          0x26               // find the antenna area does not enter hibernation
 # define PICC_REQALL          0x52               // find all the cards antenna area
 # define PICC_ANTICOLL        0x93               // anti-collision
+# define PICC_ANTICOLL_CL2    0x95               // anti-collision, cascade level 2
+# define PICC_ANTICOLL_CL3    0x97               // anti-collision, cascade level 3
 # define PICC_SElECTTAG       0x93               // election card
 # define PICC_AUTHENT1A       0x60               // authentication key A
 # define PICC_AUTHENT1B       0x61               // authentication key B
@@ -55,12 +62,46 @@
 # define PICC_TRANSFER        0xB0               // save the data in the buffer
 # define PICC_HALT            0x50               // Sleep
 
-uint8_t mfrc522_init(void);
+// Opens the SPI interface and configures the MFRC522: 0 on success, -1 on failure
+int mfrc522_init(void);
 void mfrc522_reset(void);
 void mfrc522_write(uint8_t reg, uint8_t data);
 uint8_t mfrc522_read(uint8_t reg);
+bool mfrc522_read_regs(const uint8_t* regs, uint8_t* values, size_t count);
+bool mfrc522_write_fifo(const uint8_t* data, size_t len);
+bool mfrc522_read_fifo(uint8_t* data, size_t len);
+void mfrc522_set_bit_mask(uint8_t reg, uint8_t mask);
+void mfrc522_clear_bit_mask(uint8_t reg, uint8_t mask);
 uint8_t	mfrc522_request(uint8_t req_mode, uint8_t* tag_type);
 uint8_t mfrc522_to_card(uint8_t cmd, uint8_t* send_data, uint8_t send_data_len, uint8_t* back_data, uint32_t* back_data_len);
 uint8_t mfrc522_get_card_serial(uint8_t* serial_out);
 
+// Called on the event loop when mfrc522_read_card_async ends. status is CARD_FOUND,
+// CARD_NOT_FOUND or ERROR; on CARD_FOUND, serial holds the 4 serial bytes and their XOR.
+typedef void (*mfrc522_card_callback)(uint8_t status, const uint8_t* serial, void* context);
+
+// Non-blocking card read, the equivalent of mfrc522_request followed by
+// mfrc522_get_card_serial. Do not call the blocking functions while a read is in progress.
+int mfrc522_async_init(EventLoop* eventLoop);
+void mfrc522_async_cleanup(void);
+bool mfrc522_read_card_async(uint8_t req_mode, mfrc522_card_callback callback, void* context);
+
+// UID of a card, with 4, 7 or 10 bytes, and its SAK (select acknowledge)
+typedef struct mfrc522_uid {
+	uint8_t uid[10];
+	uint8_t size;
+	uint8_t sak;
+} mfrc522_uid;
+
+// Called on the event loop when mfrc522_inventory_async ends, with the UIDs found. status is
+// CARD_FOUND, CARD_NOT_FOUND, or ERROR if the inventory was abandoned; uids holds the UIDs
+// found before.
+typedef void (*mfrc522_inventory_callback)(uint8_t status, const mfrc522_uid* uids, size_t count, void* context);
+
+// Selects every card in the field, with anti-collision and cascade levels 1 to 3, then halts
+// it, and stores its UID in uids. Stops when uids is full. Cards halted by a previous
+// inventory are woken up, so each inventory returns every card in the field.
+size_t mfrc522_inventory(mfrc522_uid* uids, size_t capacity, uint8_t* status);
+bool mfrc522_inventory_async(mfrc522_uid* uids, size_t capacity, mfrc522_inventory_callback callback, void* context);
+
 #endif
\ No newline at end of file
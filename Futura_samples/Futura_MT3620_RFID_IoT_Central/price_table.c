@@ -0,0 +1,24 @@
+/* Futura MT3620 price table of RFID tags, compiled into the image.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <string.h>
+
+#include "price_table.h"
+
+const char *PriceTable_Lookup(const PriceTable *table, const uint8_t *uid, size_t size)
+{
+    if (table->count == 0 || size > PRICE_TABLE_MAX_UID) {
+        return NULL;
+    }
+
+    uint64_t hash = PriceTable_Hash(uid, size, table->seed);
+    uint32_t displacement = table->displacements[PriceTable_Bucket(hash, table->bucketCount)];
+    const PriceTable_Entry *entry = &table->entries[PriceTable_Slot(hash, displacement, table->count)];
+
+    // A UID which is not in the table lands on some other entry.
+    if (entry->size != size || memcmp(entry->uid, uid, size) != 0) {
+        return NULL;
+    }
+    return entry->product;
+}
@@ -0,0 +1,105 @@
+/* Futura MT3620 price table of RFID tags, compiled into the image.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The table is a minimal perfect hash over the raw UIDs, generated from prices.csv by
+// PriceTableGenerator into price_table_data.c: see README.md. Keys are spread over
+// buckets, about 4 per bucket, and each bucket has a displacement chosen by the generator
+// so that its keys land on free slots, with a hash seed for which that succeeds. A lookup
+// hashes the UID once, picks the slot from the hash and the displacement of its bucket,
+// and compares the UID stored there.
+
+// Largest UID, with three cascade levels
+#define PRICE_TABLE_MAX_UID 10
+
+/// <summary>
+/// A tag and its product.
+/// </summary>
+typedef struct {
+    uint8_t uid[PRICE_TABLE_MAX_UID];
+    uint8_t size;
+    const char *product;
+} PriceTable_Entry;
+
+/// <summary>
+/// The generated table: count entries, in slot order, bucketCount displacements, and the
+/// seed of the hash.
+/// </summary>
+typedef struct {
+    const PriceTable_Entry *entries;
+    const uint32_t *displacements;
+    uint32_t count;
+    uint32_t bucketCount;
+    uint32_t seed;
+} PriceTable;
+
+/// <summary>
+/// The table generated from prices.csv.
+/// </summary>
+extern const PriceTable priceTable;
+
+/// <summary>
+/// Hash of a UID: FNV-1a over its bytes, from a basis changed by the seed, then the
+/// MurmurHash3 finaliser, since FNV-1a leaves the high bits of short keys, used for the
+/// bucket, poorly mixed.
+/// </summary>
+static inline uint64_t PriceTable_Hash(const uint8_t *uid, size_t size, uint32_t seed)
+{
+    uint64_t hash = 0xCBF29CE484222325ull ^ (seed * 0x9E3779B97F4A7C15ull);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= uid[i];
+        hash *= 0x100000001B3ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/// <summary>
+/// Maps a 32-bit value onto [0, range) with a multiplication instead of a division.
+/// </summary>
+static inline uint32_t PriceTable_Reduce(uint32_t value, uint32_t range)
+{
+    return (uint32_t)(((uint64_t)value * range) >> 32);
+}
+
+/// <summary>
+/// Bucket of a hash, from its high half.
+/// </summary>
+static inline uint32_t PriceTable_Bucket(uint64_t hash, uint32_t bucketCount)
+{
+    return PriceTable_Reduce((uint32_t)(hash >> 32), bucketCount);
+}
+
+/// <summary>
+/// Slot of a hash, given the displacement of its bucket: the low half of the hash, offset
+/// by the displacement and mixed again with the MurmurHash3 32-bit finaliser, so that each
+/// displacement sends the keys of a bucket to unrelated slots.
+/// </summary>
+static inline uint32_t PriceTable_Slot(uint64_t hash, uint32_t displacement, uint32_t count)
+{
+    uint32_t value = (uint32_t)hash + displacement * 0x9E3779B9u;
+    value ^= value >> 16;
+    value *= 0x85EBCA6Bu;
+    value ^= value >> 13;
+    value *= 0xC2B2AE35u;
+    value ^= value >> 16;
+    return PriceTable_Reduce(value, count);
+}
+
+/// <summary>
+/// Looks up a tag in a table.
+/// </summary>
+/// <param name="table">Table, usually &amp;priceTable.</param>
+/// <param name="uid">UID of the tag.</param>
+/// <param name="size">UID size in bytes: 4, 7 or 10.</param>
+/// <returns>The product of the tag, or NULL if the table does not have it.</returns>
+const char *PriceTable_Lookup(const PriceTable *table, const uint8_t *uid, size_t size);
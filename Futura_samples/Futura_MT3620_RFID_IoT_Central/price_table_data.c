@@ -0,0 +1,15 @@
+/* Generated by PriceTableGenerator from prices.csv: do not edit. */
+
+#include "price_table.h"
+
+static const PriceTable_Entry entries[3] = {
+    {{0x31, 0xAC, 0x6A, 0x1C}, 4, "Modello 3: \342\202\254300"},
+    {{0x83, 0xB0, 0x3F, 0x16}, 4, "Modello 1: \342\202\254100"},
+    {{0x46, 0x95, 0xCA, 0x32}, 4, "Modello 2: \342\202\254200"},
+};
+
+static const uint32_t displacements[1] = {
+    0
+};
+
+const PriceTable priceTable = {entries, displacements, 3, 1, 0};
@@ -0,0 +1,76 @@
+/* Futura MT3620 RFID tag presence tracking.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <applibs/log.h>
+
+#include "rfid_tracker.h"
+
+static RfidTracker_Tag tags[RFID_TRACKER_MAX_TAGS];
+static size_t tagCount = 0;
+
+static uint32_t holdOff = 0;
+static RfidTracker_EventFn eventHandler = NULL;
+static void *eventContext = NULL;
+
+static bool SameUid(const mfrc522_uid *a, const mfrc522_uid *b)
+{
+    return a->size == b->size && memcmp(a->uid, b->uid, a->size) == 0;
+}
+
+void RfidTracker_Init(uint32_t holdOffMs, RfidTracker_EventFn handler, void *context)
+{
+    tagCount = 0;
+    holdOff = holdOffMs;
+    eventHandler = handler;
+    eventContext = context;
+}
+
+void RfidTracker_Update(const mfrc522_uid *uids, size_t count, uint32_t nowMs)
+{
+    for (size_t i = 0; i < count; ++i) {
+        size_t t = 0;
+        while (t < tagCount && !SameUid(&tags[t].uid, &uids[i])) {
+            ++t;
+        }
+        if (t < tagCount) {
+            tags[t].lastSeenMs = nowMs;
+            continue;
+        }
+        if (tagCount == RFID_TRACKER_MAX_TAGS) {
+            Log_Debug("WARNING: RFID tag table full, tag ignored.\n");
+            continue;
+        }
+
+        RfidTracker_Tag *tag = &tags[tagCount++];
+        tag->uid = uids[i];
+        tag->firstSeenMs = nowMs;
+        tag->lastSeenMs = nowMs;
+        eventHandler(RfidTracker_Arrived, tag, eventContext);
+    }
+
+    // Departed tags are replaced by the last one, so the table stays packed. The difference
+    // is taken in uint32_t, which is right across the wrap of the clock.
+    size_t t = 0;
+    while (t < tagCount) {
+        if ((uint32_t)(nowMs - tags[t].lastSeenMs) > holdOff) {
+            eventHandler(RfidTracker_Departed, &tags[t], eventContext);
+            tags[t] = tags[--tagCount];
+        } else {
+            ++t;
+        }
+    }
+}
+
+size_t RfidTracker_GetCount(void)
+{
+    return tagCount;
+}
+
+const RfidTracker_Tag *RfidTracker_GetTag(size_t index)
+{
+    return index < tagCount ? &tags[index] : NULL;
+}
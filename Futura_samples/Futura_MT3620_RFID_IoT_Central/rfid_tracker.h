@@ -0,0 +1,72 @@
+/* Futura MT3620 RFID tag presence tracking.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mfrc522.h"
+
+// Largest number of tags present at once; further tags are ignored until one departs
+#define RFID_TRACKER_MAX_TAGS 8
+
+/// <summary>
+/// Tag presence events.
+/// </summary>
+typedef enum {
+    /// <summary>A UID was found that was not present.</summary>
+    RfidTracker_Arrived = 0,
+    /// <summary>A present UID has not been found for longer than the hold-off.</summary>
+    RfidTracker_Departed = 1,
+} RfidTracker_Event;
+
+/// <summary>
+/// A tag in the field, with the times, in milliseconds, it was first and last found. Times
+/// are milliseconds of the monotonic clock modulo 2^32; only their differences count, so
+/// they stay right across the wrap, after 49.7 days.
+/// </summary>
+typedef struct {
+    mfrc522_uid uid;
+    uint32_t firstSeenMs;
+    uint32_t lastSeenMs;
+} RfidTracker_Tag;
+
+/// <summary>
+/// Called from RfidTracker_Update for every arrival and departure.
+/// </summary>
+/// <param name="event">Event that occurred.</param>
+/// <param name="tag">Tag; on departure, it is removed once the handler returns.</param>
+/// <param name="context">Context passed to RfidTracker_Init.</param>
+typedef void (*RfidTracker_EventFn)(RfidTracker_Event event, const RfidTracker_Tag *tag,
+                                    void *context);
+
+/// <summary>
+/// Empties the tag table.
+/// </summary>
+/// <param name="holdOffMs">Time a tag may go unseen before it departs. Scans miss a tag
+/// now and then, so this should span a few scan periods.</param>
+/// <param name="handler">Event handler.</param>
+/// <param name="context">Passed to the handler.</param>
+void RfidTracker_Init(uint32_t holdOffMs, RfidTracker_EventFn handler, void *context);
+
+/// <summary>
+/// Records the UIDs found by a scan: UIDs not present arrive, present ones are seen
+/// again, and present ones unseen for longer than the hold-off depart. A scan that
+/// ended early may pass only the UIDs it found.
+/// </summary>
+/// <param name="uids">UIDs found.</param>
+/// <param name="count">Number of UIDs.</param>
+/// <param name="nowMs">Time of the scan, in milliseconds.</param>
+void RfidTracker_Update(const mfrc522_uid *uids, size_t count, uint32_t nowMs);
+
+/// <summary>
+/// Returns the number of tags present.
+/// </summary>
+size_t RfidTracker_GetCount(void);
+
+/// <summary>
+/// Returns a present tag, with index below RfidTracker_GetCount.
+/// </summary>
+const RfidTracker_Tag *RfidTracker_GetTag(size_t index);
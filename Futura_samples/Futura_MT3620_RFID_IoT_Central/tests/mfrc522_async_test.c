@@ -0,0 +1,267 @@
+/* Futura MT3620 RFID: MFRC522 event loop card read test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Runs mfrc522_read_card_async over the stand-ins of mfrc522_host.c, firing the poll timer as
+// the event loop would. Checks that:
+// - mfrc522_read_card_async refuses to start before mfrc522_async_init, and while a read is
+//   in progress;
+// - it returns once the first command is started, and each timer period makes one ComIrqReg
+//   read, a single syscall, until the command ends and the next one starts;
+// - the callback comes once, with the ATQA check and the UID of random cards, after as many
+//   periods as the MFRC522 takes, and with the status of the blocking functions when no
+//   card answers;
+// - a command which never ends is abandoned after 50 periods, with ERROR;
+// - the timer is disarmed when the read ends, a read can start from the callback, and
+//   mfrc522_async_cleanup drops a read in progress without a callback.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mfrc522.h"
+#include "mfrc522_host.h"
+
+#define ROUNDS 20000
+// MAX_POLLS of mfrc522.c
+#define ABANDON_PERIODS 50
+
+static uint8_t cardUid[5];
+static bool cardPresent = false;
+static unsigned long failures = 0;
+
+static unsigned int callbacks = 0;
+static uint8_t lastStatus = 0;
+static uint8_t lastSerial[5];
+static void *lastContext = NULL;
+static bool restartFromCallback = false;
+
+static uint32_t rngState = 0x2545F491;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %lu\n", what, n);
+    }
+}
+
+static void CardField(const uint8_t *tx, size_t txBits, HostRf_Answer *answer)
+{
+    if (!cardPresent) {
+        return;
+    }
+    if (txBits == 7 && (tx[0] == PICC_REQIDL || tx[0] == PICC_REQALL)) {
+        answer->data[0] = 0x04;
+        answer->data[1] = 0x00;
+        answer->bits = 16;
+    } else if (txBits == 16 && tx[0] == PICC_ANTICOLL && tx[1] == 0x20) {
+        memcpy(answer->data, cardUid, sizeof(cardUid));
+        answer->bits = 40;
+    }
+}
+
+static void NewCard(void)
+{
+    for (int i = 0; i < 4; ++i) {
+        cardUid[i] = (uint8_t)Random(256);
+    }
+    cardUid[4] = cardUid[0] ^ cardUid[1] ^ cardUid[2] ^ cardUid[3];
+}
+
+static void OnCard(uint8_t status, const uint8_t *serial, void *context)
+{
+    ++callbacks;
+    lastStatus = status;
+    memcpy(lastSerial, serial, sizeof(lastSerial));
+    lastContext = context;
+    if (restartFromCallback) {
+        restartFromCallback = false;
+        if (!mfrc522_read_card_async(PICC_REQIDL, OnCard, context)) {
+            Fail("no read from the callback", 0);
+        }
+    }
+}
+
+// Fires the timer until the read ends, checking that each period makes one syscall unless it
+// starts the next command; returns the periods, or UINT32_MAX if the read does not end
+static uint32_t RunRead(uint32_t limit)
+{
+    unsigned int before = callbacks;
+    for (uint32_t periods = 1; periods <= limit; ++periods) {
+        if (!HostTimer_IsArmed()) {
+            Fail("timer disarmed during a read", periods);
+            return UINT32_MAX;
+        }
+        unsigned long syscalls = HostSpi_Syscalls();
+        unsigned long commands = HostMfrc522_Commands();
+        HostTimer_Fire();
+        if (callbacks != before) {
+            return periods;
+        }
+        if (HostMfrc522_Commands() == commands && HostSpi_Syscalls() - syscalls != 1) {
+            Fail("syscalls in a waiting period", HostSpi_Syscalls() - syscalls);
+        }
+    }
+    return UINT32_MAX;
+}
+
+static void TestRefusals(void)
+{
+    HostMfrc522_Reset();
+    if (mfrc522_read_card_async(PICC_REQIDL, OnCard, NULL)) {
+        Fail("read started before mfrc522_async_init", 0);
+    }
+    if (mfrc522_init() != 0 || mfrc522_async_init(NULL) != 0) {
+        Fail("init failed", 0);
+    }
+    HostMfrc522_SetField(CardField);
+    cardPresent = true;
+    NewCard();
+    HostMfrc522_SetPolls(3, 15);
+    if (!mfrc522_read_card_async(PICC_REQIDL, OnCard, NULL)) {
+        Fail("read not started", 0);
+    }
+    if (mfrc522_read_card_async(PICC_REQIDL, OnCard, NULL)) {
+        Fail("second read started during a read", 0);
+    }
+    if (RunRead(100) == UINT32_MAX || lastStatus != CARD_FOUND) {
+        Fail("first read did not end", 0);
+    }
+}
+
+static void TestReads(void)
+{
+    unsigned long maxStartSyscalls = 0;
+    for (unsigned long round = 0; round < ROUNDS; ++round) {
+        uint32_t polls = Random(8);
+        uint32_t timeoutPolls = 5 + Random(20);
+        cardPresent = Random(4) != 0;
+        NewCard();
+        HostMfrc522_SetPolls(polls, timeoutPolls);
+
+        unsigned int before = callbacks;
+        unsigned long syscalls = HostSpi_Syscalls();
+        void *context = (void *)(uintptr_t)(round + 1);
+        if (!mfrc522_read_card_async(PICC_REQIDL, OnCard, context)) {
+            Fail("read not started, round", round);
+            continue;
+        }
+        // Only the start of REQA: the ComIrqReg reads come from the timer.
+        if (callbacks != before) {
+            Fail("read ended without a period, round", round);
+            continue;
+        }
+        if (HostSpi_Syscalls() - syscalls > maxStartSyscalls) {
+            maxStartSyscalls = HostSpi_Syscalls() - syscalls;
+        }
+
+        uint32_t periods = RunRead(4 * ABANDON_PERIODS);
+        if (periods == UINT32_MAX) {
+            Fail("read did not end, round", round);
+            continue;
+        }
+        // Each command ends at the ComIrqReg read after the polls of the model, and a card
+        // read has two commands.
+        uint32_t expected = cardPresent ? 2 * (polls + 1) : timeoutPolls + 1;
+        if (periods != expected) {
+            Fail("periods of a read", periods);
+        }
+        if (callbacks != before + 1 || lastContext != context) {
+            Fail("callbacks of a read, round", round);
+        }
+        if (cardPresent && (lastStatus != CARD_FOUND || memcmp(lastSerial, cardUid, 5) != 0)) {
+            Fail("card not read, round", round);
+        }
+        if (HostTimer_IsArmed()) {
+            Fail("timer armed after a read, round", round);
+        }
+        HostTimer_Fire();
+        if (callbacks != before + 1) {
+            Fail("callback after the end, round", round);
+        }
+
+        if (!cardPresent) {
+            uint8_t str[MAX_LEN];
+            HostMfrc522_SetPolls(polls, timeoutPolls);
+            uint8_t status = mfrc522_request(PICC_REQIDL, str);
+            if (lastStatus != status || status == CARD_FOUND) {
+                Fail("status without a card differs from the blocking read", lastStatus);
+            }
+        }
+    }
+    printf("%lu syscalls at most to start a read\n", maxStartSyscalls);
+}
+
+static void TestAbandon(void)
+{
+    cardPresent = true;
+    NewCard();
+    HostMfrc522_SetPolls(UINT32_MAX, UINT32_MAX);
+    unsigned int before = callbacks;
+    if (!mfrc522_read_card_async(PICC_REQIDL, OnCard, NULL)) {
+        Fail("read not started", 0);
+        return;
+    }
+    uint32_t periods = RunRead(4 * ABANDON_PERIODS);
+    if (periods != ABANDON_PERIODS || callbacks != before + 1 || lastStatus != ERROR) {
+        Fail("stuck command not abandoned after periods", periods);
+    }
+    if (HostTimer_IsArmed()) {
+        Fail("timer armed after an abandoned read", 0);
+    }
+}
+
+static void TestRestartAndCleanup(void)
+{
+    HostMfrc522_SetPolls(1, 15);
+    cardPresent = true;
+    NewCard();
+    restartFromCallback = true;
+    unsigned int before = callbacks;
+    if (!mfrc522_read_card_async(PICC_REQIDL, OnCard, NULL)) {
+        Fail("read not started", 0);
+        return;
+    }
+    RunRead(100);
+    if (callbacks != before + 1 || !HostTimer_IsArmed()) {
+        Fail("read from the callback not running", callbacks - before);
+    }
+    if (RunRead(100) == UINT32_MAX || lastStatus != CARD_FOUND) {
+        Fail("read from the callback did not end", 0);
+    }
+
+    if (!mfrc522_read_card_async(PICC_REQIDL, OnCard, NULL)) {
+        Fail("read not started", 0);
+        return;
+    }
+    before = callbacks;
+    mfrc522_async_cleanup();
+    HostTimer_Fire();
+    if (callbacks != before || HostTimer_IsArmed()) {
+        Fail("read continued after cleanup", 0);
+    }
+    if (mfrc522_read_card_async(PICC_REQIDL, OnCard, NULL)) {
+        Fail("read started after cleanup", 0);
+    }
+    if (mfrc522_async_init(NULL) != 0 || !mfrc522_read_card_async(PICC_REQIDL, OnCard, NULL) ||
+        RunRead(100) == UINT32_MAX || lastStatus != CARD_FOUND) {
+        Fail("no read after a new init", 0);
+    }
+}
+
+int main(void)
+{
+    TestRefusals();
+    TestReads();
+    TestAbandon();
+    TestRestartAndCleanup();
+    printf("%u reads, %lu failure(s)\n", callbacks, failures);
+    return failures != 0;
+}
@@ -0,0 +1,382 @@
+/* Futura MT3620 RFID: host stand-ins for the SPI interface and the MFRC522, for the tests.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "mfrc522_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <applibs/spi.h>
+
+#include "mfrc522.h"
+
+#define REG_COUNT 64
+
+static uint8_t regs[REG_COUNT];
+static uint8_t fifo[FIFO_SIZE];
+static size_t fifoCount = 0;
+static HostRf_Field rfField = NULL;
+static uint32_t answerPolls = 1;
+static uint32_t timeoutPolls = 15;
+static uint32_t pollsLeft = UINT32_MAX; // ComIrqReg reads before pendingIrq is set
+static uint8_t pendingIrq = 0;
+static unsigned long commands = 0;
+
+static bool failOpen = false;
+static unsigned long syscalls = 0;
+static unsigned long idleReadBytes = 0;
+static unsigned long badFrameEnds = 0;
+
+// The SPI frame: its mode, and the register of the next byte.
+static bool frameStarted = false;
+static bool frameWrite = false;
+static uint8_t frameReg = 0;
+
+static struct EventLoopTimer {
+    EventLoopTimerHandler handler;
+    bool armed;
+} timer;
+
+int Log_Debug(const char *fmt, ...)
+{
+    (void)fmt;
+    return 0;
+}
+
+unsigned int HostSleep(unsigned int seconds)
+{
+    (void)seconds;
+    return 0;
+}
+
+void HostMfrc522_Reset(void)
+{
+    memset(regs, 0, sizeof(regs));
+    fifoCount = 0;
+    rfField = NULL;
+    answerPolls = 1;
+    timeoutPolls = 15;
+    pollsLeft = UINT32_MAX;
+    pendingIrq = 0;
+    commands = 0;
+    failOpen = false;
+}
+
+void HostMfrc522_SetField(HostRf_Field field)
+{
+    rfField = field;
+}
+
+void HostMfrc522_SetPolls(uint32_t answer, uint32_t timeout)
+{
+    answerPolls = answer;
+    timeoutPolls = timeout;
+}
+
+uint8_t HostMfrc522_GetReg(uint8_t reg)
+{
+    return regs[reg % REG_COUNT];
+}
+
+void HostMfrc522_SetReg(uint8_t reg, uint8_t value)
+{
+    regs[reg % REG_COUNT] = value;
+}
+
+unsigned long HostMfrc522_Commands(void)
+{
+    return commands;
+}
+
+void HostSpi_FailOpen(bool fail)
+{
+    failOpen = fail;
+}
+
+unsigned long HostSpi_Syscalls(void)
+{
+    return syscalls;
+}
+
+unsigned long HostSpi_IdleReadBytes(void)
+{
+    return idleReadBytes;
+}
+
+unsigned long HostSpi_BadFrameEnds(void)
+{
+    return badFrameEnds;
+}
+
+// Sends the FIFO with the framing of BitFramingReg, and stores the answer as the MFRC522
+// does: from bit RxAlign of the first byte, with RxLastBits in ControlReg, and on a
+// collision, CollErr, the position in CollReg, and the later bits cleared unless
+// ValuesAfterColl is set.
+static void Execute(uint8_t command)
+{
+    ++commands;
+    uint8_t txLastBits = regs[BitFramingReg] & 0x07;
+    uint8_t rxAlign = (regs[BitFramingReg] >> 4) & 0x07;
+    size_t txBits = fifoCount == 0 ? 0 : (fifoCount - 1) * 8 + (txLastBits ? txLastBits : 8);
+    uint8_t tx[FIFO_SIZE];
+    memcpy(tx, fifo, fifoCount);
+    fifoCount = 0;
+
+    HostRf_Answer answer;
+    memset(&answer, 0, sizeof(answer));
+    answer.collision = -1;
+    if (rfField != NULL) {
+        rfField(tx, txBits, &answer);
+    }
+
+    regs[ErrorReg] = 0;
+    regs[ControlReg] = 0;
+    regs[CollReg] = (regs[CollReg] & 0x80) | 0x20; // CollPosNotValid
+    if (command == Transmit_CMD) {
+        pendingIrq = 0x50; // TxIRq, IdleIRq
+        pollsLeft = 0;
+        return;
+    }
+    if (answer.bits == 0) {
+        pendingIrq = 0x41; // TxIRq, TimerIRq
+        pollsLeft = timeoutPolls;
+        return;
+    }
+
+    size_t bits = answer.bits;
+    if (answer.collision >= 0) {
+        regs[ErrorReg] |= 0x08; // CollErr
+        // CollPos counts the received bits from 1, and 0 stands for 32; a collision beyond
+        // does not fit.
+        if (answer.collision < 32) {
+            regs[CollReg] = (regs[CollReg] & 0x80) | (uint8_t)((answer.collision + 1) & 0x1F);
+        }
+        if ((regs[CollReg] & 0x80) == 0) {
+            for (size_t bit = (size_t)answer.collision; bit < bits; ++bit) {
+                answer.data[bit / 8] &= (uint8_t)~(1 << (bit % 8));
+            }
+        }
+    }
+    memset(fifo, 0, sizeof(fifo));
+    for (size_t bit = 0; bit < bits; ++bit) {
+        if (answer.data[bit / 8] & (1 << (bit % 8))) {
+            fifo[(bit + rxAlign) / 8] |= (uint8_t)(1 << ((bit + rxAlign) % 8));
+        }
+    }
+    fifoCount = (rxAlign + bits + 7) / 8;
+    regs[ControlReg] = (uint8_t)((rxAlign + bits) % 8);
+    pendingIrq = 0x70; // TxIRq, RxIRq, IdleIRq
+    pollsLeft = answerPolls;
+}
+
+static uint8_t ReadReg(uint8_t reg)
+{
+    switch (reg) {
+    case FIFODataReg: {
+        if (fifoCount == 0) {
+            return 0;
+        }
+        uint8_t value = fifo[0];
+        memmove(fifo, fifo + 1, --fifoCount);
+        return value;
+    }
+    case FIFOLevelReg:
+        return (uint8_t)fifoCount;
+    case ComIrqReg:
+        if (pollsLeft != UINT32_MAX && pollsLeft-- == 0) {
+            regs[ComIrqReg] |= pendingIrq;
+            pollsLeft = UINT32_MAX;
+        }
+        return regs[ComIrqReg];
+    default:
+        return regs[reg];
+    }
+}
+
+static void WriteReg(uint8_t reg, uint8_t value)
+{
+    switch (reg) {
+    case FIFODataReg:
+        if (fifoCount == FIFO_SIZE) {
+            regs[ErrorReg] |= 0x10; // BufferOvfl
+        } else {
+            fifo[fifoCount++] = value;
+        }
+        return;
+    case FIFOLevelReg:
+        if (value & 0x80) {
+            fifoCount = 0;
+        }
+        return;
+    case ComIrqReg:
+        // Set1 sets the marked bits, otherwise they are cleared.
+        if (value & 0x80) {
+            regs[reg] |= value & 0x7F;
+        } else {
+            regs[reg] &= (uint8_t)~value;
+        }
+        return;
+    case CommandReg:
+        regs[reg] = value & 0x0F;
+        if (value == Transmit_CMD) {
+            Execute(Transmit_CMD);
+        } else if (value == Idle_CMD || value == SoftReset_CMD) {
+            pollsLeft = UINT32_MAX;
+        }
+        return;
+    case BitFramingReg:
+        regs[reg] = value;
+        if ((value & 0x80) && regs[CommandReg] == Transceive_CMD) {
+            Execute(Transceive_CMD);
+        }
+        return;
+    default:
+        regs[reg] = value;
+        return;
+    }
+}
+
+static uint8_t FrameByte(uint8_t mosi)
+{
+    uint8_t miso = 0;
+    if (!frameStarted) {
+        frameStarted = true;
+        frameWrite = (mosi & 0x80) == 0;
+    } else if (frameWrite) {
+        WriteReg(frameReg, mosi);
+        return 0;
+    } else {
+        miso = ReadReg(frameReg);
+    }
+    frameReg = (mosi >> 1) & 0x3F;
+    return miso;
+}
+
+int SPIMaster_InitConfig(SPIMaster_Config *config)
+{
+    memset(config, 0, sizeof(*config));
+    return 0;
+}
+
+int SPIMaster_Open(SPI_InterfaceId interfaceId, SPI_ChipSelectId chipSelectId,
+                   const SPIMaster_Config *config)
+{
+    (void)interfaceId;
+    (void)chipSelectId;
+    (void)config;
+    ++syscalls;
+    return failOpen ? -1 : 3;
+}
+
+int SPIMaster_SetBusSpeed(int fd, uint32_t speedInHz)
+{
+    (void)fd;
+    (void)speedInHz;
+    ++syscalls;
+    return 0;
+}
+
+int SPIMaster_SetMode(int fd, SPI_Mode mode)
+{
+    (void)fd;
+    (void)mode;
+    ++syscalls;
+    return 0;
+}
+
+int SPIMaster_SetBitOrder(int fd, SPI_BitOrder order)
+{
+    (void)fd;
+    (void)order;
+    ++syscalls;
+    return 0;
+}
+
+int SPIMaster_InitTransfers(SPIMaster_Transfer *transfers, size_t transferCount)
+{
+    memset(transfers, 0, transferCount * sizeof(*transfers));
+    return 0;
+}
+
+ssize_t SPIMaster_TransferSequential(int fd, const SPIMaster_Transfer *transfers,
+                                     size_t transferCount)
+{
+    (void)fd;
+    ++syscalls;
+    frameStarted = false;
+    ssize_t total = 0;
+    uint8_t mosi = 0xFF;
+    for (size_t i = 0; i < transferCount; ++i) {
+        const SPIMaster_Transfer *transfer = &transfers[i];
+        bool read = (transfer->flags & SPI_TransferFlags_Read) != 0;
+        bool write = (transfer->flags & SPI_TransferFlags_Write) != 0;
+        if ((!read && !write) || (read && transfer->readData == NULL) ||
+            (write && transfer->writeData == NULL)) {
+            return -1;
+        }
+        for (size_t b = 0; b < transfer->length; ++b) {
+            mosi = 0xFF;
+            if (write) {
+                mosi = transfer->writeData[b];
+            } else {
+                ++idleReadBytes;
+            }
+            uint8_t miso = FrameByte(mosi);
+            if (read) {
+                transfer->readData[b] = miso;
+            }
+        }
+        total += (ssize_t)transfer->length;
+    }
+    if (frameStarted && !frameWrite && mosi != 0x00) {
+        ++badFrameEnds;
+    }
+    return total;
+}
+
+EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
+{
+    (void)eventLoop;
+    timer.handler = handler;
+    timer.armed = false;
+    return &timer;
+}
+
+void DisposeEventLoopTimer(EventLoopTimer *t)
+{
+    if (t != NULL) {
+        t->armed = false;
+    }
+}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *t)
+{
+    (void)t;
+    return 0;
+}
+
+int SetEventLoopTimerPeriod(EventLoopTimer *t, const struct timespec *period)
+{
+    t->armed = period->tv_sec != 0 || period->tv_nsec != 0;
+    return 0;
+}
+
+int DisarmEventLoopTimer(EventLoopTimer *t)
+{
+    t->armed = false;
+    return 0;
+}
+
+bool HostTimer_IsArmed(void)
+{
+    return timer.armed;
+}
+
+void HostTimer_Fire(void)
+{
+    if (timer.armed) {
+        timer.handler(&timer);
+    }
+}
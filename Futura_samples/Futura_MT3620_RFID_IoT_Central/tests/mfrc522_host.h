@@ -0,0 +1,83 @@
+/* Futura MT3620 RFID: host stand-ins for the SPI interface and the MFRC522, for the tests.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eventloop_timer_utilities.h"
+
+// The tests build mfrc522.c natively over these functions. SPIMaster_TransferSequential
+// feeds each transfer, byte by byte, to a model of the MFRC522 SPI interface (datasheet
+// 8.1.2): the first byte of a chip select frame gives the mode and the first address, in a
+// read frame each further byte addresses the register which the next byte returns, and in a
+// write frame each further byte is stored at the first address. The registers, the FIFO and
+// the Transceive and Transmit commands are modelled, and the PICCs in the RF field are
+// those of the test, through HostRf_Field. Every SPI call counts as a syscall.
+
+/// <summary>Largest answer of the PICCs, in bits.</summary>
+#define HOST_RF_MAX_BITS 64
+
+/// <summary>What the PCD receives after a frame.</summary>
+typedef struct {
+    /// <summary>Bits received, least significant bit of each byte first; 0 for no answer.</summary>
+    size_t bits;
+    /// <summary>The bits.</summary>
+    uint8_t data[HOST_RF_MAX_BITS / 8];
+    /// <summary>First bit, from 0, where the answers of several PICCs differ, or -1.</summary>
+    int collision;
+} HostRf_Answer;
+
+/// <summary>
+///     The RF field: the PICCs receive a frame of txBits bits from the PCD, least significant
+///     bit of each byte first, and answer in *answer, which is zeroed before the call.
+/// </summary>
+typedef void (*HostRf_Field)(const uint8_t *tx, size_t txBits, HostRf_Answer *answer);
+
+/// <summary>Powers on the MFRC522, with its registers and FIFO cleared, and no field.</summary>
+void HostMfrc522_Reset(void);
+
+/// <summary>Sets the RF field, or NULL for an empty one.</summary>
+void HostMfrc522_SetField(HostRf_Field field);
+
+/// <summary>
+///     Sets how many ComIrqReg reads a command takes to end, when a PICC answers and when
+///     none does and the MFRC522 timer ends it; UINT32_MAX for never.
+/// </summary>
+void HostMfrc522_SetPolls(uint32_t answerPolls, uint32_t timeoutPolls);
+
+/// <summary>Reads a register, without side effects.</summary>
+uint8_t HostMfrc522_GetReg(uint8_t reg);
+
+/// <summary>Writes a register, without side effects.</summary>
+void HostMfrc522_SetReg(uint8_t reg, uint8_t value);
+
+/// <summary>Number of Transceive and Transmit commands executed.</summary>
+unsigned long HostMfrc522_Commands(void);
+
+/// <summary>Makes SPIMaster_Open fail, or succeed again.</summary>
+void HostSpi_FailOpen(bool fail);
+
+/// <summary>Number of SPI syscalls.</summary>
+unsigned long HostSpi_Syscalls(void);
+
+/// <summary>
+///     Number of bytes read without a byte to write, during which MOSI holds whatever it
+///     idles at, which the model takes as 0xFF.
+/// </summary>
+unsigned long HostSpi_IdleReadBytes(void);
+
+/// <summary>Number of read frames whose last byte is not 0x00, as datasheet 8.1.2.1 asks.</summary>
+unsigned long HostSpi_BadFrameEnds(void);
+
+/// <summary>
+///     Returns true while the timer which the MFRC522 code created is armed. The stand-in of
+///     Timerlib only holds that timer.
+/// </summary>
+bool HostTimer_IsArmed(void);
+
+/// <summary>Runs the handler of the timer, as the event loop does at each period.</summary>
+void HostTimer_Fire(void);
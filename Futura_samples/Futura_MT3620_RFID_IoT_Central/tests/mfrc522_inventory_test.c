@@ -0,0 +1,321 @@
+/* Futura MT3620 RFID: MFRC522 inventory test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Runs mfrc522_inventory and mfrc522_inventory_async over the MFRC522 stand-in of
+// mfrc522_host.c, with the PICCs of picc_host.c in the field. Checks that:
+// - an inventory returns every PICC in the field once, with its UID size and final SAK, and
+//   leaves it halted, and a later inventory wakes them again;
+// - pairs and triples of PICCs whose UIDs differ from one bit on resolve at every bit of
+//   CLn, at cascade levels 1 to 3, so the collisions fall at every offset within a byte,
+//   and after frames which end within a byte, with CollPos counting from the first bit
+//   received, as the stand-ins model it;
+// - random fields of up to 16 PICCs with 4, 7 and 10-byte UIDs, many sharing long prefixes,
+//   give the same results blocking and from the event loop;
+// - the inventory stops when the UID array is full, and a field without PICCs gives
+//   CARD_NOT_FOUND.
+// It prints the exchanges, SPI syscalls and timer periods an inventory takes.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mfrc522.h"
+#include "mfrc522_host.h"
+#include "picc_host.h"
+
+#define ROUNDS 400
+#define MAX_UIDS HOST_PICC_MAX
+
+static unsigned long failures = 0;
+static unsigned long inventories = 0;
+
+static bool inventoryDone = false;
+static uint8_t inventoryStatus = 0;
+static size_t inventoryCount = 0;
+
+static uint32_t rngState = 0x6C078965;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %lu\n", what, n);
+    }
+}
+
+static void RandomUid(uint8_t *uid, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        uid[i] = (uint8_t)Random(256);
+    }
+    // The cascade tag cannot start a UID
+    if (uid[0] == 0x88) {
+        uid[0] = 0x08;
+    }
+}
+
+// Flips bit of the UID CLn at a cascade level: below the last level, CLn starts with the
+// cascade tag, so bit is 8 to 31. Returns false, and leaves the UID, when the UID would
+// start with the cascade tag.
+static bool FlipClBit(uint8_t *uid, size_t size, unsigned int level, unsigned int bit)
+{
+    unsigned int levels = size == 4 ? 1 : size == 7 ? 2 : 3;
+    unsigned int byte = 3 * level + bit / 8 - (level + 1 < levels ? 1 : 0);
+    uint8_t mask = (uint8_t)(1 << (bit % 8));
+    if (byte == 0 && (uid[0] ^ mask) == 0x88) {
+        return false;
+    }
+    uid[byte] ^= mask;
+    return true;
+}
+
+static void OnInventory(uint8_t status, const mfrc522_uid *uids, size_t count, void *context)
+{
+    (void)uids;
+    (void)context;
+    inventoryDone = true;
+    inventoryStatus = status;
+    inventoryCount = count;
+}
+
+// Runs an inventory, blocking or from the event loop; periods is set to the timer periods
+static size_t RunInventory(bool async, mfrc522_uid *uids, size_t capacity, uint8_t *status,
+                           unsigned long *periods)
+{
+    ++inventories;
+    *periods = 0;
+    if (!async) {
+        return mfrc522_inventory(uids, capacity, status);
+    }
+    inventoryDone = false;
+    if (!mfrc522_inventory_async(uids, capacity, OnInventory, NULL)) {
+        Fail("inventory not started", inventories);
+        *status = ERROR;
+        return 0;
+    }
+    if (mfrc522_inventory_async(uids, capacity, OnInventory, NULL)) {
+        Fail("second inventory started", inventories);
+    }
+    while (!inventoryDone && *periods < 1000000) {
+        HostTimer_Fire();
+        ++*periods;
+    }
+    if (!inventoryDone) {
+        Fail("inventory did not end", inventories);
+    }
+    *status = inventoryStatus;
+    return inventoryCount;
+}
+
+// Every PICC of the field found once, and halted
+static void CheckFound(const mfrc522_uid *uids, size_t count, uint8_t status, const char *what)
+{
+    size_t piccs = HostPicc_Count();
+    if (status != (piccs ? CARD_FOUND : CARD_NOT_FOUND) || count != piccs) {
+        Fail(what, count);
+        return;
+    }
+    for (size_t i = 0; i < piccs; ++i) {
+        size_t size;
+        const uint8_t *uid = HostPicc_Uid(i, &size);
+        size_t found = 0;
+        for (size_t j = 0; j < count; ++j) {
+            if (uids[j].size == size && memcmp(uids[j].uid, uid, size) == 0) {
+                ++found;
+                if (uids[j].sak != 0x08) {
+                    Fail("cascade bit in the final SAK", uids[j].sak);
+                }
+            }
+        }
+        if (found != 1 || HostPicc_GetState(i) != HostPicc_Halt) {
+            Fail(what, i);
+        }
+    }
+}
+
+static void TestEmpty(void)
+{
+    mfrc522_uid uids[MAX_UIDS];
+    uint8_t status;
+    unsigned long periods;
+    HostPicc_Clear();
+    for (int async = 0; async < 2; ++async) {
+        size_t count = RunInventory(async, uids, MAX_UIDS, &status, &periods);
+        CheckFound(uids, count, status, "PICC found in an empty field");
+    }
+}
+
+// PICCs whose UIDs differ from each bit of CLn on, at each cascade level
+static void TestEveryBit(void)
+{
+    static const size_t sizes[] = {4, 7, 10};
+    mfrc522_uid uids[MAX_UIDS];
+    uint8_t status;
+    unsigned long periods;
+    for (size_t s = 0; s < 3; ++s) {
+        unsigned int levels = (unsigned int)s + 1;
+        for (unsigned int level = 0; level < levels; ++level) {
+            unsigned int firstBit = level + 1 < levels ? 8 : 0;
+            for (unsigned int bit = firstBit; bit < 32; ++bit) {
+                uint8_t a[10];
+                uint8_t b[10];
+                uint8_t c[10];
+                unsigned int cBit = bit + 1 + Random(31 - bit);
+                bool flipped;
+                do {
+                    RandomUid(a, sizes[s]);
+                    memcpy(b, a, sizes[s]);
+                    memcpy(c, a, sizes[s]);
+                    flipped = FlipClBit(b, sizes[s], level, bit) &&
+                              FlipClBit(c, sizes[s], level, bit) &&
+                              (bit == 31 || FlipClBit(c, sizes[s], level, cBit));
+                } while (!flipped);
+                HostPicc_Clear();
+                HostPicc_Add(a, sizes[s]);
+                HostPicc_Add(b, sizes[s]);
+                if (bit < 31) {
+                    // A third PICC which follows b, and differs after the collision
+                    HostPicc_Add(c, sizes[s]);
+                }
+                size_t count = RunInventory(bit % 2, uids, MAX_UIDS, &status, &periods);
+                CheckFound(uids, count, status, "pair differing at one bit not resolved");
+                count = RunInventory(bit % 2 == 0, uids, MAX_UIDS, &status, &periods);
+                CheckFound(uids, count, status, "halted pair not found again");
+            }
+        }
+    }
+}
+
+// A random field: the first PICCs have random UIDs, the others copy one and change a bit
+static void RandomField(size_t piccs)
+{
+    uint8_t uids[HOST_PICC_MAX][10];
+    size_t sizes[HOST_PICC_MAX];
+    HostPicc_Clear();
+    for (size_t i = 0; i < piccs; ++i) {
+        if (i < 2 || Random(2) == 0) {
+            sizes[i] = Random(3) == 0 ? 7 : Random(4) == 0 ? 10 : 4;
+            RandomUid(uids[i], sizes[i]);
+        } else {
+            size_t from = Random((uint32_t)i);
+            sizes[i] = sizes[from];
+            memcpy(uids[i], uids[from], sizes[i]);
+            unsigned int levels = sizes[i] == 4 ? 1 : sizes[i] == 7 ? 2 : 3;
+            unsigned int level = Random(levels);
+            unsigned int firstBit = level + 1 < levels ? 8 : 0;
+            if (!FlipClBit(uids[i], sizes[i], level, firstBit + Random(32 - firstBit))) {
+                --i;
+                continue;
+            }
+        }
+        bool duplicate = false;
+        for (size_t j = 0; j < i; ++j) {
+            duplicate |= sizes[j] == sizes[i] && memcmp(uids[j], uids[i], sizes[i]) == 0;
+        }
+        if (duplicate) {
+            --i;
+            continue;
+        }
+        HostPicc_Add(uids[i], sizes[i]);
+    }
+}
+
+static void TestRandomFields(void)
+{
+    static const size_t piccCounts[] = {1, 2, 3, 4, 8, 16};
+    mfrc522_uid uids[MAX_UIDS];
+    uint8_t status;
+    unsigned long periods;
+    unsigned long collisions[3] = {0};
+    unsigned long splitCollisions[3] = {0};
+
+    printf("PICCs  exchanges  collisions  SPI syscalls  timer periods\n");
+    for (size_t p = 0; p < sizeof(piccCounts) / sizeof(piccCounts[0]); ++p) {
+        unsigned long exchanges = 0;
+        unsigned long frameCollisions = 0;
+        unsigned long syscalls = 0;
+        unsigned long totalPeriods = 0;
+        for (unsigned long round = 0; round < ROUNDS; ++round) {
+            RandomField(piccCounts[p]);
+            HostMfrc522_SetPolls(Random(3), 15);
+            unsigned long commands = HostMfrc522_Commands();
+            unsigned long before = HostSpi_Syscalls();
+            size_t count = RunInventory(true, uids, MAX_UIDS, &status, &periods);
+            CheckFound(uids, count, status, "random field not resolved from the event loop");
+            exchanges += HostMfrc522_Commands() - commands;
+            syscalls += HostSpi_Syscalls() - before;
+            totalPeriods += periods;
+            const HostPicc_Stats *stats = HostPicc_GetStats();
+            for (int level = 0; level < 3; ++level) {
+                frameCollisions += stats->collisions[level];
+                collisions[level] += stats->collisions[level];
+                splitCollisions[level] += stats->splitCollisions[level];
+            }
+            if (stats->malformed != 0) {
+                Fail("malformed frames", stats->malformed);
+            }
+
+            count = RunInventory(false, uids, MAX_UIDS, &status, &periods);
+            CheckFound(uids, count, status, "random field not resolved blocking");
+        }
+        printf("%5zu  %9.1f  %10.1f  %12.1f  %13.1f\n", piccCounts[p], (double)exchanges / ROUNDS,
+               (double)frameCollisions / ROUNDS, (double)syscalls / ROUNDS,
+               (double)totalPeriods / ROUNDS);
+    }
+    printf("collisions by cascade level: %lu, %lu, %lu; after a split byte: %lu, %lu, %lu\n",
+           collisions[0], collisions[1], collisions[2], splitCollisions[0], splitCollisions[1],
+           splitCollisions[2]);
+    // The test is worth something only if the fields had those collisions.
+    for (int level = 0; level < 3; ++level) {
+        if (splitCollisions[level] == 0) {
+            Fail("no collision after a split byte at level", (unsigned long)level + 1);
+        }
+    }
+    HostMfrc522_SetPolls(1, 15);
+}
+
+static void TestCapacity(void)
+{
+    mfrc522_uid uids[MAX_UIDS];
+    uint8_t status;
+    unsigned long periods;
+    for (int async = 0; async < 2; ++async) {
+        RandomField(5);
+        size_t count = RunInventory(async, uids, 2, &status, &periods);
+        if (count != 2 || status != CARD_FOUND ||
+            (uids[0].size == uids[1].size && memcmp(uids[0].uid, uids[1].uid, uids[0].size) == 0)) {
+            Fail("inventory beyond its capacity", count);
+        }
+    }
+
+    // Halted PICCs do not answer REQA
+    RandomField(3);
+    size_t count = RunInventory(false, uids, MAX_UIDS, &status, &periods);
+    CheckFound(uids, count, status, "small field not resolved");
+    uint8_t str[MAX_LEN];
+    if (mfrc522_request(PICC_REQIDL, str) == CARD_FOUND) {
+        Fail("a halted PICC answered REQA", 0);
+    }
+}
+
+int main(void)
+{
+    HostMfrc522_Reset();
+    if (mfrc522_init() != 0 || mfrc522_async_init(NULL) != 0) {
+        Fail("init failed", 0);
+    }
+    HostMfrc522_SetField(HostPicc_Field);
+    TestEmpty();
+    TestEveryBit();
+    TestRandomFields();
+    TestCapacity();
+    printf("%lu inventories, %lu failure(s)\n", inventories, failures);
+    return failures != 0;
+}
@@ -0,0 +1,220 @@
+/* Futura MT3620 RFID: MFRC522 SPI access test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Runs mfrc522.c over the SPI stand-in of mfrc522_host.c, which models the frames of the
+// MFRC522 and counts the SPI syscalls. Checks that:
+// - mfrc522_init returns -1 when the SPI interface does not open, and 0 once it has
+//   configured the timer, the antenna and the interrupt enables;
+// - mfrc522_read_regs returns random lists of registers, and mfrc522_read_fifo and
+//   mfrc522_write_fifo move up to FIFO_SIZE bytes, each in one syscall, and every byte
+//   read clocks out an explicit byte rather than the idle MOSI level, 0x00 at the end of
+//   each read frame;
+// - a card read, mfrc522_request then mfrc522_get_card_serial, returns the ATQA and the
+//   UID of random cards within 24 syscalls plus two per ComIrqReg poll, and a command
+//   which no card answers ends with the MFRC522 timer.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mfrc522.h"
+#include "mfrc522_host.h"
+
+#define ROUNDS 20000
+
+static uint8_t cardUid[5];
+static bool cardPresent = false;
+static unsigned long failures = 0;
+
+static uint32_t rngState = 0x9E3779B9;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %lu\n", what, n);
+    }
+}
+
+// A card which answers REQA and WUPA with its ATQA, and the anti-collision frame of cascade
+// level 1 with its UID and BCC.
+static void CardField(const uint8_t *tx, size_t txBits, HostRf_Answer *answer)
+{
+    if (!cardPresent) {
+        return;
+    }
+    if (txBits == 7 && (tx[0] == PICC_REQIDL || tx[0] == PICC_REQALL)) {
+        answer->data[0] = 0x04;
+        answer->data[1] = 0x00;
+        answer->bits = 16;
+    } else if (txBits == 16 && tx[0] == PICC_ANTICOLL && tx[1] == 0x20) {
+        memcpy(answer->data, cardUid, sizeof(cardUid));
+        answer->bits = 40;
+    }
+}
+
+static void TestInit(void)
+{
+    HostMfrc522_Reset();
+    HostSpi_FailOpen(true);
+    if (mfrc522_init() != -1) {
+        Fail("init succeeded without SPI", 0);
+    }
+    HostSpi_FailOpen(false);
+    if (mfrc522_init() != 0) {
+        Fail("init failed", 0);
+    }
+    static const struct {
+        uint8_t reg;
+        uint8_t value;
+    } expected[] = {{TModeReg, 0x8D}, {TPrescalerReg, 0x3E}, {TReloadReg_1, 30},
+                    {TReloadReg_2, 0}, {TxASKReg, 0x40},     {ModeReg, 0x3D}};
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+        if (HostMfrc522_GetReg(expected[i].reg) != expected[i].value) {
+            Fail("register not configured", expected[i].reg);
+        }
+    }
+    if ((HostMfrc522_GetReg(TxControlReg) & 0x03) != 0x03 ||
+        (HostMfrc522_GetReg(ComIEnReg) & 0x20) == 0 ||
+        (HostMfrc522_GetReg(DivIEnReg) & 0x80) == 0) {
+        Fail("antenna or interrupts not enabled", 0);
+    }
+}
+
+static void TestRegisters(void)
+{
+    // Registers without side effects in the model.
+    static const uint8_t plain[] = {ModeReg,   TxModeReg,  RxModeReg,    TxControlReg, TxASKReg,
+                                    TModeReg,  TPrescalerReg, TReloadReg_1, TReloadReg_2,
+                                    WaterLevelReg, Status2Reg, DivIrqReg};
+    for (unsigned long round = 0; round < ROUNDS; ++round) {
+        uint8_t regs[FIFO_SIZE];
+        uint8_t values[FIFO_SIZE];
+        size_t count = 1 + Random(Random(4) == 0 ? FIFO_SIZE : 8);
+        for (size_t i = 0; i < sizeof(plain); ++i) {
+            HostMfrc522_SetReg(plain[i], (uint8_t)Random(256));
+        }
+        for (size_t i = 0; i < count; ++i) {
+            regs[i] = plain[Random(sizeof(plain))];
+        }
+        unsigned long before = HostSpi_Syscalls();
+        if (!mfrc522_read_regs(regs, values, count)) {
+            Fail("registers not read, count", count);
+            continue;
+        }
+        if (HostSpi_Syscalls() - before != 1) {
+            Fail("registers read in several syscalls, count", count);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (values[i] != HostMfrc522_GetReg(regs[i])) {
+                Fail("register value differs, round", round);
+                break;
+            }
+        }
+        if (mfrc522_read(regs[0]) != HostMfrc522_GetReg(regs[0])) {
+            Fail("single register differs, round", round);
+        }
+
+        uint8_t data[FIFO_SIZE];
+        uint8_t back[FIFO_SIZE];
+        size_t length = 1 + Random(FIFO_SIZE);
+        for (size_t i = 0; i < length; ++i) {
+            data[i] = (uint8_t)Random(256);
+        }
+        mfrc522_write(FIFOLevelReg, 0x80);
+        before = HostSpi_Syscalls();
+        if (!mfrc522_write_fifo(data, length) || mfrc522_read(FIFOLevelReg) != length ||
+            !mfrc522_read_fifo(back, length)) {
+            Fail("FIFO not written or read, length", length);
+        } else if (memcmp(back, data, length) != 0) {
+            Fail("FIFO data differs, length", length);
+        }
+        if (HostSpi_Syscalls() - before != 3) {
+            Fail("FIFO access in several syscalls, length", length);
+        }
+    }
+
+    uint8_t values[FIFO_SIZE + 1];
+    uint8_t regs[FIFO_SIZE + 1] = {0};
+    unsigned long before = HostSpi_Syscalls();
+    if (mfrc522_read_regs(regs, values, 0) || mfrc522_read_regs(regs, values, FIFO_SIZE + 1) ||
+        mfrc522_write_fifo(values, FIFO_SIZE + 1) || mfrc522_read_fifo(values, FIFO_SIZE + 1)) {
+        Fail("oversized access accepted", FIFO_SIZE + 1);
+    }
+    if (HostSpi_Syscalls() != before) {
+        Fail("oversized access made syscalls", HostSpi_Syscalls() - before);
+    }
+}
+
+static void TestCardRead(void)
+{
+    HostMfrc522_SetField(CardField);
+    cardPresent = true;
+    unsigned long maxSyscalls[6] = {0};
+    for (unsigned long round = 0; round < ROUNDS; ++round) {
+        uint32_t polls = 1 + Random(5);
+        HostMfrc522_SetPolls(polls, 15);
+        for (int i = 0; i < 4; ++i) {
+            cardUid[i] = (uint8_t)Random(256);
+        }
+        cardUid[4] = cardUid[0] ^ cardUid[1] ^ cardUid[2] ^ cardUid[3];
+
+        uint8_t str[MAX_LEN] = {0};
+        unsigned long before = HostSpi_Syscalls();
+        if (mfrc522_request(PICC_REQALL, str) != CARD_FOUND || str[0] != 0x04 || str[1] != 0x00) {
+            Fail("no ATQA, round", round);
+            continue;
+        }
+        if (mfrc522_get_card_serial(str) != CARD_FOUND || memcmp(str, cardUid, 5) != 0) {
+            Fail("UID differs, round", round);
+            continue;
+        }
+        unsigned long syscalls = HostSpi_Syscalls() - before;
+        if (syscalls > maxSyscalls[polls]) {
+            maxSyscalls[polls] = syscalls;
+        }
+        if (syscalls > 24 + 2 * polls) {
+            Fail("card read syscalls", syscalls);
+        }
+        if (HostMfrc522_GetReg(BitFramingReg) & 0x80) {
+            Fail("StartSend left set, round", round);
+        }
+    }
+    printf("card read: %lu, %lu, %lu, %lu and %lu syscalls with 1 to 5 polls\n", maxSyscalls[1],
+           maxSyscalls[2], maxSyscalls[3], maxSyscalls[4], maxSyscalls[5]);
+
+    // No card: the MFRC522 timer ends the REQA.
+    cardPresent = false;
+    HostMfrc522_SetPolls(1, 2);
+    uint8_t str[MAX_LEN] = {0};
+    unsigned long before = HostSpi_Syscalls();
+    if (mfrc522_request(PICC_REQALL, str) != ERROR) {
+        Fail("a REQA without answer found a card", 0);
+    }
+    printf("no card: %lu syscalls\n", HostSpi_Syscalls() - before);
+    if (HostMfrc522_GetReg(BitFramingReg) & 0x80) {
+        Fail("StartSend left set without a card", 0);
+    }
+}
+
+int main(void)
+{
+    TestInit();
+    TestRegisters();
+    TestCardRead();
+    if (HostSpi_IdleReadBytes() != 0) {
+        Fail("bytes read with the idle MOSI level", HostSpi_IdleReadBytes());
+    }
+    if (HostSpi_BadFrameEnds() != 0) {
+        Fail("read frames not ended with 0x00", HostSpi_BadFrameEnds());
+    }
+    printf("%lu syscalls, %lu failure(s)\n", HostSpi_Syscalls(), failures);
+    return failures != 0;
+}
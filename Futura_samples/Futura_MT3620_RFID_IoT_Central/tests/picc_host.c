@@ -0,0 +1,230 @@
+/* Futura MT3620 RFID: host simulator of the PICCs in the RF field, for the tests.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "picc_host.h"
+
+#include <string.h>
+
+#define REQA 0x26
+#define WUPA 0x52
+#define HLTA 0x50
+#define CASCADE_TAG 0x88
+#define SAK_CASCADE 0x04
+#define SAK_COMPLETE 0x08
+
+typedef struct {
+    uint8_t uid[10];
+    size_t size;
+    HostPicc_State state;
+    unsigned int level; // cascade level, from 0
+    bool halted;        // halted once: goes back to HALT rather than IDLE
+} Picc;
+
+static Picc piccs[HOST_PICC_MAX];
+static size_t piccCount = 0;
+static HostPicc_Stats stats;
+
+void HostPicc_Clear(void)
+{
+    piccCount = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+size_t HostPicc_Add(const uint8_t *uid, size_t size)
+{
+    Picc *picc = &piccs[piccCount];
+    memset(picc, 0, sizeof(*picc));
+    memcpy(picc->uid, uid, size);
+    picc->size = size;
+    picc->state = HostPicc_Idle;
+    return piccCount++;
+}
+
+size_t HostPicc_Count(void)
+{
+    return piccCount;
+}
+
+const uint8_t *HostPicc_Uid(size_t index, size_t *size)
+{
+    *size = piccs[index].size;
+    return piccs[index].uid;
+}
+
+HostPicc_State HostPicc_GetState(size_t index)
+{
+    return piccs[index].state;
+}
+
+const HostPicc_Stats *HostPicc_GetStats(void)
+{
+    return &stats;
+}
+
+static uint16_t CrcA(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0x6363;
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t b = data[i] ^ (uint8_t)crc;
+        b ^= (uint8_t)(b << 4);
+        crc = (uint16_t)((crc >> 8) ^ ((uint16_t)b << 8) ^ ((uint16_t)b << 3) ^ (b >> 4));
+    }
+    return crc;
+}
+
+static bool CrcValid(const uint8_t *tx, size_t length)
+{
+    uint16_t crc = CrcA(tx, length - 2);
+    return tx[length - 2] == (uint8_t)crc && tx[length - 1] == (uint8_t)(crc >> 8);
+}
+
+static unsigned int Levels(const Picc *picc)
+{
+    return picc->size == 4 ? 1 : picc->size == 7 ? 2 : 3;
+}
+
+// UID CLn of a level: the cascade tag and 3 UID bytes below the last level, then the BCC
+static void Cl(const Picc *picc, unsigned int level, uint8_t cl[5])
+{
+    if (level + 1 < Levels(picc)) {
+        cl[0] = CASCADE_TAG;
+        memcpy(&cl[1], &picc->uid[3 * level], 3);
+    } else {
+        memcpy(cl, &picc->uid[3 * level], 4);
+    }
+    cl[4] = cl[0] ^ cl[1] ^ cl[2] ^ cl[3];
+}
+
+static bool GetBit(const uint8_t *data, size_t bit)
+{
+    return (data[bit / 8] >> (bit % 8)) & 1;
+}
+
+static void Deselect(Picc *picc)
+{
+    if (picc->state == HostPicc_Ready || picc->state == HostPicc_Active) {
+        picc->state = picc->halted ? HostPicc_Halt : HostPicc_Idle;
+    }
+}
+
+// Answer of one PICC to a frame, in out; returns its bits, or 0 for none
+static size_t PiccFrame(Picc *picc, const uint8_t *tx, size_t txBits, uint8_t *out)
+{
+    if (txBits == 7 && (tx[0] == REQA || tx[0] == WUPA)) {
+        if (picc->state == HostPicc_Idle || (tx[0] == WUPA && picc->state == HostPicc_Halt)) {
+            picc->state = HostPicc_Ready;
+            picc->level = 0;
+            out[0] = (uint8_t)((Levels(picc) - 1) << 6) | 0x04; // UID size, bit frame anticollision
+            out[1] = 0x00;
+            return 16;
+        }
+        Deselect(picc);
+        return 0;
+    }
+
+    if (txBits == 32 && tx[0] == HLTA && tx[1] == 0x00) {
+        if (!CrcValid(tx, 4)) {
+            ++stats.malformed;
+        } else if (picc->state == HostPicc_Active) {
+            picc->state = HostPicc_Halt;
+            picc->halted = true;
+            return 0;
+        }
+        Deselect(picc);
+        return 0;
+    }
+
+    bool selectCode = txBits >= 16 && (tx[0] == 0x93 || tx[0] == 0x95 || tx[0] == 0x97);
+    if (!selectCode || picc->state != HostPicc_Ready) {
+        Deselect(picc);
+        return 0;
+    }
+    if ((unsigned int)(tx[0] - 0x93) / 2 != picc->level) {
+        return 0; // another cascade level: not for this PICC
+    }
+
+    uint8_t cl[5];
+    Cl(picc, picc->level, cl);
+    if (tx[1] == 0x70) {
+        // SELECT: the whole CLn and CRC_A
+        if (txBits != 72 || !CrcValid(tx, 9)) {
+            ++stats.malformed;
+            Deselect(picc);
+            return 0;
+        }
+        if (memcmp(&tx[2], cl, 5) != 0) {
+            Deselect(picc);
+            return 0;
+        }
+        uint8_t sak = SAK_COMPLETE;
+        if (picc->level + 1 < Levels(picc)) {
+            sak = SAK_CASCADE;
+            ++picc->level;
+        } else {
+            picc->state = HostPicc_Active;
+        }
+        uint16_t crc = CrcA(&sak, 1);
+        out[0] = sak;
+        out[1] = (uint8_t)crc;
+        out[2] = (uint8_t)(crc >> 8);
+        return 24;
+    }
+
+    // Anti-collision: NVB gives the bytes, with SEL and NVB, and the bits sent
+    size_t known = ((size_t)(tx[1] >> 4) - 2) * 8 + (tx[1] & 0x0F);
+    if ((tx[1] >> 4) < 2 || (tx[1] & 0x0F) > 7 || known >= 40 || known != txBits - 16) {
+        ++stats.malformed;
+        return 0;
+    }
+    for (size_t bit = 0; bit < known; ++bit) {
+        if (GetBit(&tx[2], bit) != GetBit(cl, bit)) {
+            return 0;
+        }
+    }
+    for (size_t bit = known; bit < 40; ++bit) {
+        if (GetBit(cl, bit)) {
+            out[(bit - known) / 8] |= (uint8_t)(1 << ((bit - known) % 8));
+        }
+    }
+    return 40 - known;
+}
+
+void HostPicc_Field(const uint8_t *tx, size_t txBits, HostRf_Answer *answer)
+{
+    ++stats.frames;
+    uint8_t first[HOST_RF_MAX_BITS / 8];
+    for (size_t i = 0; i < piccCount; ++i) {
+        uint8_t out[HOST_RF_MAX_BITS / 8] = {0};
+        size_t bits = PiccFrame(&piccs[i], tx, txBits, out);
+        if (bits == 0) {
+            continue;
+        }
+        if (answer->bits == 0) {
+            memcpy(first, out, sizeof(first));
+            memcpy(answer->data, out, sizeof(out));
+            answer->bits = bits;
+            continue;
+        }
+        // Answers to the same frame have the same length: the PCD sees the bits of both,
+        // and the first one which differs
+        for (size_t bit = 0; bit < bits; ++bit) {
+            if (GetBit(out, bit) != GetBit(first, bit) &&
+                (answer->collision < 0 || bit < (size_t)answer->collision)) {
+                answer->collision = (int)bit;
+            }
+        }
+        for (size_t b = 0; b < sizeof(out); ++b) {
+            answer->data[b] |= out[b];
+        }
+    }
+
+    if (answer->collision >= 0 && txBits >= 16 && tx[1] != 0x70 &&
+        (tx[0] == 0x93 || tx[0] == 0x95 || tx[0] == 0x97)) {
+        unsigned int level = (unsigned int)(tx[0] - 0x93) / 2;
+        ++stats.collisions[level];
+        if (tx[1] & 0x07) {
+            ++stats.splitCollisions[level];
+        }
+    }
+}
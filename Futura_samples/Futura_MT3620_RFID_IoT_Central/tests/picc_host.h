@@ -0,0 +1,70 @@
+/* Futura MT3620 RFID: host simulator of the PICCs in the RF field, for the tests.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mfrc522_host.h"
+
+// ISO/IEC 14443-3 type A PICCs with 4, 7 or 10-byte UIDs, in the field of the MFRC522
+// stand-in through HostPicc_Field. Each PICC follows the states IDLE, READY, ACTIVE and HALT:
+// REQA wakes the IDLE ones and WUPA the HALT ones too, the anti-collision frames of its
+// current cascade level get the rest of its UID CLn from the READY ones whose CLn starts
+// with the bits sent, SELECT with its full CLn moves it to the next level or to ACTIVE, and
+// HLTA halts it. Any other frame sends a READY or ACTIVE PICC back to IDLE, or to HALT if
+// it was halted before. When several PICCs answer, the PCD receives the OR of their answers,
+// and the first bit where they differ is the collision, counted from the first bit received
+// as the MFRC522 counts CollPos.
+
+/// <summary>Most PICCs in the field.</summary>
+#define HOST_PICC_MAX 32
+
+/// <summary>State of a PICC.</summary>
+typedef enum {
+    HostPicc_Idle,
+    HostPicc_Ready,
+    HostPicc_Active,
+    HostPicc_Halt,
+} HostPicc_State;
+
+/// <summary>Counts of the frames the PICCs received.</summary>
+typedef struct {
+    /// <summary>Frames received.</summary>
+    unsigned long frames;
+    /// <summary>Answers with a collision, by cascade level of the anti-collision frame.</summary>
+    unsigned long collisions[3];
+    /// <summary>
+    ///     Of those, the collisions received after a split byte: the frame sent a number of
+    ///     bits of CLn which is not a multiple of 8, so the answer starts within a byte.
+    /// </summary>
+    unsigned long splitCollisions[3];
+    /// <summary>Frames which no PICC can take: a wrong CRC_A, NVB or length.</summary>
+    unsigned long malformed;
+} HostPicc_Stats;
+
+/// <summary>Empties the field, and clears the counts.</summary>
+void HostPicc_Clear(void);
+
+/// <summary>Puts a PICC in the field, in IDLE; returns its index.</summary>
+/// <param name="uid">The UID.</param>
+/// <param name="size">4, 7 or 10.</param>
+size_t HostPicc_Add(const uint8_t *uid, size_t size);
+
+/// <summary>Number of PICCs in the field.</summary>
+size_t HostPicc_Count(void);
+
+/// <summary>UID of a PICC, and its size.</summary>
+const uint8_t *HostPicc_Uid(size_t index, size_t *size);
+
+/// <summary>State of a PICC.</summary>
+HostPicc_State HostPicc_GetState(size_t index);
+
+/// <summary>Counts since HostPicc_Clear.</summary>
+const HostPicc_Stats *HostPicc_GetStats(void);
+
+/// <summary>The field, for HostMfrc522_SetField.</summary>
+void HostPicc_Field(const uint8_t *tx, size_t txBits, HostRf_Answer *answer);
@@ -0,0 +1,49 @@
+/* Futura MT3620 RFID: writer of the price lists for the generated table tests.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Writes the first count keys of price_uids.h with their products, as prices.csv does, for
+// PriceTableGenerator. The UIDs are written with ':', ' ' or nothing between the bytes, and
+// comments and empty lines are mixed in, as the generator accepts them:
+//
+//     price_csv count prices.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "price_uids.h"
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s count prices.csv\n", argv[0]);
+        return 2;
+    }
+    unsigned long count = strtoul(argv[1], NULL, 10);
+    FILE *out = fopen(argv[2], "w");
+    if (out == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    static const char *const separators[] = {"", ":", " "};
+    fprintf(out, "# %lu generated tags\n", count);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t uid[10];
+        char product[64];
+        uint8_t size = PriceUids_Uid(i, uid);
+        PriceUids_Product(i, product, sizeof(product));
+        for (uint8_t b = 0; b < size; ++b) {
+            fprintf(out, "%s%02X", b ? separators[i % 3] : "", uid[b]);
+        }
+        fprintf(out, ",%s\n", product);
+        if (i % 1000 == 999) {
+            fprintf(out, "\n# %u\n", i + 1);
+        }
+    }
+    if (fclose(out) != 0) {
+        perror(argv[2]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+/* Futura MT3620 RFID: benchmark of the price table against the map.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Looks up the keys of a table which PriceTableGenerator built from price_uids.h, half of
+// them present and half not, with PriceTable_Lookup over the raw UID, and as main.c did
+// before the table, with bytetohex then map_get on a map_str_t filled at startup. Reports
+// the time per lookup of each, the time and heap the map takes to fill, counted through
+// the malloc of map.c, and the size of the table in the image. Both lookups must agree on
+// every key.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "map.h"
+#include "price_table.h"
+#include "price_uids.h"
+
+#define LOOKUPS 1000000
+// Keys looked up in turn: few enough to stay in the cache, as the reader sees few tags
+#define KEYS 1024
+#define RUNS 5
+
+static size_t heapBytes = 0;
+
+// map.c allocates through these, to count its heap
+void *CountedMalloc(size_t size)
+{
+    size_t *block = malloc(sizeof(size_t) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    *block = size;
+    heapBytes += size;
+    return block + 1;
+}
+
+void *CountedRealloc(void *memory, size_t size)
+{
+    size_t *block = memory ? (size_t *)memory - 1 : NULL;
+    size_t old = block ? *block : 0;
+    block = realloc(block, sizeof(size_t) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    *block = size;
+    heapBytes += size - old;
+    return block + 1;
+}
+
+void CountedFree(void *memory)
+{
+    if (memory != NULL) {
+        size_t *block = (size_t *)memory - 1;
+        heapBytes -= *block;
+        free(block);
+    }
+}
+
+// The conversion of main.c
+static void bytetohex(char *xp, const char *bb, int n)
+{
+    const char xx[] = "0123456789ABCDEF";
+    while (--n >= 0) xp[n] = xx[(bb[n >> 1] >> ((1 - (n & 1)) << 2)) & 0xF];
+}
+
+static double NowSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+    uint32_t count = priceTable.count;
+    char hex[2 * PRICE_TABLE_MAX_UID + 1];
+
+    double start = NowSeconds();
+    map_str_t map;
+    map_init(&map);
+    for (uint32_t i = 0; i < count; ++i) {
+        const PriceTable_Entry *entry = &priceTable.entries[i];
+        bytetohex(hex, (const char *)entry->uid, 2 * entry->size);
+        hex[2 * entry->size] = '\0';
+        map_set(&map, hex, (char *)entry->product);
+    }
+    double setupSeconds = NowSeconds() - start;
+
+    // Even keys are in the table, odd ones are not
+    static uint8_t keys[KEYS][PRICE_TABLE_MAX_UID];
+    static uint8_t sizes[KEYS];
+    for (uint32_t k = 0; k < KEYS; ++k) {
+        uint32_t i = k % 2 ? count + k : PriceUids_Mix(k) % count;
+        sizes[k] = PriceUids_Uid(i, keys[k]);
+    }
+
+    double tableSeconds = 1e9;
+    double mapSeconds = 1e9;
+    unsigned long errors = 0;
+    for (int run = 0; run < RUNS; ++run) {
+        unsigned long tableFound = 0;
+        start = NowSeconds();
+        for (uint32_t n = 0; n < LOOKUPS; ++n) {
+            uint32_t k = n % KEYS;
+            tableFound += PriceTable_Lookup(&priceTable, keys[k], sizes[k]) != NULL;
+        }
+        double seconds = NowSeconds() - start;
+        tableSeconds = seconds < tableSeconds ? seconds : tableSeconds;
+
+        unsigned long mapFound = 0;
+        start = NowSeconds();
+        for (uint32_t n = 0; n < LOOKUPS; ++n) {
+            uint32_t k = n % KEYS;
+            bytetohex(hex, (const char *)keys[k], 2 * sizes[k]);
+            hex[2 * sizes[k]] = '\0';
+            mapFound += map_get(&map, hex) != NULL;
+        }
+        seconds = NowSeconds() - start;
+        mapSeconds = seconds < mapSeconds ? seconds : mapSeconds;
+
+        if (tableFound != mapFound || tableFound != LOOKUPS / 2) {
+            ++errors;
+        }
+    }
+
+    for (uint32_t k = 0; k < KEYS; ++k) {
+        const char *product = PriceTable_Lookup(&priceTable, keys[k], sizes[k]);
+        bytetohex(hex, (const char *)keys[k], 2 * sizes[k]);
+        hex[2 * sizes[k]] = '\0';
+        char **mapped = map_get(&map, hex);
+        if ((product == NULL) != (mapped == NULL) || (product != NULL && product != *mapped)) {
+            fprintf(stderr, "key %u: the table and the map differ\n", k);
+            ++errors;
+        }
+    }
+
+    size_t tableBytes = count * sizeof(PriceTable_Entry) + priceTable.bucketCount * sizeof(uint32_t);
+    printf("%7s  %8s  %8s  %9s  %9s  %10s\n", "keys", "table ns", "map ns", "map setup",
+           "map heap", "table size");
+    printf("%7u  %8.1f  %8.1f  %6.2f ms  %7.1f KB  %7.1f KB\n", count,
+           tableSeconds / LOOKUPS * 1e9, mapSeconds / LOOKUPS * 1e9, setupSeconds * 1e3,
+           heapBytes / 1024.0, tableBytes / 1024.0);
+    map_deinit(&map);
+    printf("%lu error(s)\n", errors);
+    return errors != 0;
+}
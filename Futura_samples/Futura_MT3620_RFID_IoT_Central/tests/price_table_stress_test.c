@@ -0,0 +1,101 @@
+/* Futura MT3620 RFID: stress test of a generated price table.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Looks up the table which PriceTableGenerator built from the 50000 keys of price_uids.h,
+// written by price_csv, and checks that:
+// - the table has one entry per key and about one displacement per 4 keys, and every key
+//   lands on its own slot, so the hash is perfect and minimal;
+// - PriceTable_Lookup returns the product of every key;
+// - it returns NULL for 200000 keys which are not in the table, for the keys cut short or
+//   extended by a byte, and for sizes beyond PRICE_TABLE_MAX_UID.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "price_table.h"
+#include "price_uids.h"
+
+#define KEYS 50000
+#define MISSES 200000
+
+static unsigned long failures = 0;
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %lu\n", what, n);
+    }
+}
+
+static double NowSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+    if (priceTable.count != KEYS || priceTable.bucketCount != (KEYS + 3) / 4) {
+        Fail("table size", priceTable.count);
+    }
+
+    bool *used = calloc(priceTable.count, sizeof(bool));
+    double start = NowSeconds();
+    for (uint32_t i = 0; i < KEYS; ++i) {
+        uint8_t uid[PRICE_TABLE_MAX_UID + 1] = {0};
+        char product[64];
+        uint8_t size = PriceUids_Uid(i, uid);
+        PriceUids_Product(i, product, sizeof(product));
+        const char *found = PriceTable_Lookup(&priceTable, uid, size);
+        if (found == NULL || strcmp(found, product) != 0) {
+            Fail("key not found", i);
+            continue;
+        }
+
+        uint64_t hash = PriceTable_Hash(uid, size, priceTable.seed);
+        uint32_t bucket = PriceTable_Bucket(hash, priceTable.bucketCount);
+        uint32_t slot = PriceTable_Slot(hash, priceTable.displacements[bucket], priceTable.count);
+        if (slot >= priceTable.count || used[slot]) {
+            Fail("slot taken twice", slot);
+        } else {
+            used[slot] = true;
+        }
+
+        // The key cut short or extended by a byte is another UID
+        if (PriceTable_Lookup(&priceTable, uid, size - 1) != NULL ||
+            PriceTable_Lookup(&priceTable, uid, size + 1) != NULL) {
+            Fail("key of the wrong size found", i);
+        }
+    }
+    double hitSeconds = NowSeconds() - start;
+    free(used);
+
+    start = NowSeconds();
+    for (uint32_t i = KEYS; i < KEYS + MISSES; ++i) {
+        uint8_t uid[10];
+        uint8_t size = PriceUids_Uid(i, uid);
+        if (PriceTable_Lookup(&priceTable, uid, size) != NULL) {
+            Fail("absent key found", i);
+        }
+    }
+    double missSeconds = NowSeconds() - start;
+
+    uint8_t uid[PRICE_TABLE_MAX_UID + 1];
+    PriceUids_Uid(0, uid);
+    uid[PRICE_TABLE_MAX_UID] = 0;
+    if (PriceTable_Lookup(&priceTable, uid, 0) != NULL ||
+        PriceTable_Lookup(&priceTable, uid, PRICE_TABLE_MAX_UID + 1) != NULL) {
+        Fail("key of an impossible size found", 0);
+    }
+
+    printf("%u keys, %u buckets, seed %u; %.0f ns per hit with the checks, %.0f ns per miss\n",
+           priceTable.count, priceTable.bucketCount, priceTable.seed, hitSeconds / KEYS * 1e9,
+           missSeconds / MISSES * 1e9);
+    printf("%lu failure(s)\n", failures);
+    return failures != 0;
+}
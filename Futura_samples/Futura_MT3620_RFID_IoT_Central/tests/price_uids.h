@@ -0,0 +1,45 @@
+/* Futura MT3620 RFID: UIDs and products of the generated price tables, for the tests.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Key i of the tables which price_csv writes and the tests look up again. Its first 4 bytes
+// are the MurmurHash3 finaliser of i, which is a bijection, so all the keys differ and keys
+// from count on are never in a table of count keys. Three keys in ten have 7 bytes, one in
+// ten has 10.
+
+static inline uint32_t PriceUids_Mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/// <summary>Writes key i into uid, and returns its size.</summary>
+static inline uint8_t PriceUids_Uid(uint32_t i, uint8_t uid[10])
+{
+    uint8_t size = i % 10 < 3 ? 7 : i % 10 == 9 ? 10 : 4;
+    uint32_t first = PriceUids_Mix(i);
+    uint32_t rest = PriceUids_Mix(first ^ 0x9E3779B9u);
+    uint32_t last = PriceUids_Mix(rest);
+    for (int b = 0; b < 4; ++b) {
+        uid[b] = (uint8_t)(first >> (8 * b));
+        uid[4 + b] = (uint8_t)(rest >> (8 * b));
+    }
+    uid[8] = (uint8_t)last;
+    uid[9] = (uint8_t)(last >> 8);
+    return size;
+}
+
+/// <summary>Writes the product of key i, with a UTF-8 euro sign, into product.</summary>
+static inline void PriceUids_Product(uint32_t i, char *product, size_t size)
+{
+    snprintf(product, size, "Prodotto %u: \xE2\x82\xAC%u", i, 1 + PriceUids_Mix(i) % 1000);
+}
@@ -0,0 +1,254 @@
+/* Futura MT3620 RFID: tag presence tracking test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Feeds RfidTracker_Update with random scans of tags which enter and leave the field, and
+// which scans miss now and then, and checks against a model of the tracker that:
+// - a tag arrives at the first scan which finds it, once, and not again while present;
+// - a tag departs at the first scan more than the hold-off after it was last found, once,
+//   with its first and last times, and can arrive again later; missed scans within the
+//   hold-off do not make it depart;
+// - a full table ignores new tags, with a warning, until a tag departs;
+// - RfidTracker_GetCount and RfidTracker_GetTag list the present tags.
+// The same scans run with the clock started at 0, just before 2^31 ms and just before
+// 2^32 ms, where the millisecond count wraps, must give the same events.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "rfid_tracker.h"
+
+#define SCANS 20000
+#define TAGS 14
+#define HOLD_OFF_MS 1000u
+#define MAX_EVENTS (4 * SCANS)
+
+typedef struct {
+    RfidTracker_Event event;
+    size_t tag;
+    uint32_t atMs; // from the start of the run
+} Event;
+
+static mfrc522_uid uids[TAGS];
+static unsigned long failures = 0;
+static unsigned long warnings = 0;
+
+static Event events[MAX_EVENTS];
+static size_t eventCount = 0;
+static uint32_t baseMs = 0;
+static uint32_t scanMs = 0;
+
+// The model: present tags, and when they were first and last found
+static bool present[TAGS];
+static uint32_t firstMs[TAGS];
+static uint32_t lastMs[TAGS];
+
+static uint32_t rngState;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %lu\n", what, n);
+    }
+}
+
+int Log_Debug(const char *fmt, ...)
+{
+    if (strstr(fmt, "WARNING") != NULL) {
+        ++warnings;
+    }
+    return 0;
+}
+
+static size_t TagIndex(const mfrc522_uid *uid)
+{
+    for (size_t i = 0; i < TAGS; ++i) {
+        if (uid->size == uids[i].size && memcmp(uid->uid, uids[i].uid, uid->size) == 0) {
+            return i;
+        }
+    }
+    return TAGS;
+}
+
+static void OnTag(RfidTracker_Event event, const RfidTracker_Tag *tag, void *context)
+{
+    (void)context;
+    size_t i = TagIndex(&tag->uid);
+    if (i == TAGS) {
+        Fail("event for an unknown tag", event);
+        return;
+    }
+    if (event == RfidTracker_Arrived && (tag->firstSeenMs != scanMs || tag->lastSeenMs != scanMs)) {
+        Fail("arrival times differ from the scan", i);
+    }
+    if (event == RfidTracker_Departed &&
+        (tag->firstSeenMs != firstMs[i] || tag->lastSeenMs != lastMs[i])) {
+        Fail("departure times differ from the model", i);
+    }
+    if (eventCount < MAX_EVENTS) {
+        events[eventCount++] = (Event){.event = event, .tag = i, .atMs = scanMs - baseMs};
+    }
+}
+
+static bool SameEvents(const Event *a, const Event *b, size_t count)
+{
+    for (size_t e = 0; e < count; ++e) {
+        if (a[e].event != b[e].event || a[e].tag != b[e].tag || a[e].atMs != b[e].atMs) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t ModelCount(void)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < TAGS; ++i) {
+        count += present[i];
+    }
+    return count;
+}
+
+// One run from the clock at start; returns the events in events[0..eventCount)
+static void Run(uint32_t start)
+{
+    bool inField[TAGS] = {false};
+    memset(present, 0, sizeof(present));
+    eventCount = 0;
+    warnings = 0;
+    baseMs = start;
+    scanMs = start;
+    rngState = 0x1B873593;
+    RfidTracker_Init(HOLD_OFF_MS, OnTag, NULL);
+
+    unsigned long expectedWarnings = 0;
+    for (unsigned long scan = 0; scan < SCANS; ++scan) {
+        // Scan periods of the sample, with now and then a long gap
+        scanMs += Random(20) == 0 ? 1000 + Random(3000) : 50 + Random(600);
+        for (size_t i = 0; i < TAGS; ++i) {
+            if (Random(40) == 0) {
+                inField[i] = !inField[i];
+            }
+        }
+        mfrc522_uid found[TAGS];
+        size_t foundIndex[TAGS];
+        size_t count = 0;
+        for (size_t i = 0; i < TAGS; ++i) {
+            if (inField[i] && Random(5) != 0) {
+                foundIndex[count] = i;
+                found[count++] = uids[i];
+            }
+        }
+
+        // What the model expects from this scan
+        size_t expectedArrivals[TAGS];
+        size_t arrivals = 0;
+        bool departs[TAGS] = {false};
+        size_t departures = 0;
+        for (size_t f = 0; f < count; ++f) {
+            size_t i = foundIndex[f];
+            if (present[i]) {
+                lastMs[i] = scanMs;
+            } else if (ModelCount() == RFID_TRACKER_MAX_TAGS) {
+                ++expectedWarnings;
+            } else {
+                present[i] = true;
+                firstMs[i] = lastMs[i] = scanMs;
+                expectedArrivals[arrivals++] = i;
+            }
+        }
+        for (size_t i = 0; i < TAGS; ++i) {
+            if (present[i] && (uint32_t)(scanMs - lastMs[i]) > HOLD_OFF_MS) {
+                departs[i] = true;
+                ++departures;
+            }
+        }
+
+        size_t before = eventCount;
+        RfidTracker_Update(found, count, scanMs);
+        for (size_t i = 0; i < TAGS; ++i) {
+            if (departs[i]) {
+                present[i] = false;
+            }
+        }
+
+        // Arrivals in the order found, then the departures in any order
+        if (eventCount - before != arrivals + departures) {
+            Fail("events of a scan", scan);
+            continue;
+        }
+        for (size_t a = 0; a < arrivals; ++a) {
+            const Event *e = &events[before + a];
+            if (e->event != RfidTracker_Arrived || e->tag != expectedArrivals[a]) {
+                Fail("arrival differs from the model, scan", scan);
+            }
+        }
+        for (size_t d = before + arrivals; d < eventCount; ++d) {
+            if (events[d].event != RfidTracker_Departed || !departs[events[d].tag]) {
+                Fail("departure differs from the model, scan", scan);
+            }
+            departs[events[d].tag] = false;
+        }
+
+        if (RfidTracker_GetCount() != ModelCount()) {
+            Fail("count differs from the model, scan", scan);
+            continue;
+        }
+        for (size_t t = 0; t < RfidTracker_GetCount(); ++t) {
+            size_t i = TagIndex(&RfidTracker_GetTag(t)->uid);
+            if (i == TAGS || !present[i] || RfidTracker_GetTag(t)->lastSeenMs != lastMs[i]) {
+                Fail("listed tag differs from the model, scan", scan);
+            }
+        }
+        if (RfidTracker_GetTag(RfidTracker_GetCount()) != NULL) {
+            Fail("tag listed beyond the count, scan", scan);
+        }
+    }
+    if (warnings != expectedWarnings) {
+        Fail("table full warnings", warnings);
+    }
+}
+
+int main(void)
+{
+    rngState = 0x85EBCA6B;
+    for (size_t i = 0; i < TAGS; ++i) {
+        uids[i].size = i % 3 == 0 ? 7 : 4;
+        for (size_t b = 0; b < uids[i].size; ++b) {
+            uids[i].uid[b] = (uint8_t)Random(256);
+        }
+        uids[i].uid[0] = (uint8_t)i; // distinct
+    }
+
+    static Event firstRun[MAX_EVENTS];
+    static const uint32_t starts[] = {0, 0x7FFFF000u, 0xFFFFF000u};
+    size_t firstCount = 0;
+    unsigned long arrivals = 0;
+    for (size_t s = 0; s < sizeof(starts) / sizeof(starts[0]); ++s) {
+        Run(starts[s]);
+        if (s == 0) {
+            memcpy(firstRun, events, eventCount * sizeof(Event));
+            firstCount = eventCount;
+            for (size_t e = 0; e < eventCount; ++e) {
+                arrivals += events[e].event == RfidTracker_Arrived;
+            }
+            printf("%zu events, %lu arrivals, %lu warnings of a full table\n", eventCount,
+                   arrivals, warnings);
+        } else if (eventCount != firstCount || !SameEvents(firstRun, events, eventCount)) {
+            Fail("events differ with the clock started at", starts[s]);
+        }
+    }
+    if (warnings == 0) {
+        Fail("the table was never full", 0);
+    }
+    printf("%lu failure(s)\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,31 @@
+/* Host stand-in for the Azure Sphere SDK header of the same name, for the tests. */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+typedef int SPI_InterfaceId;
+typedef int SPI_ChipSelectId;
+typedef uint32_t SPI_ChipSelectPolarity;
+enum { SPI_ChipSelectPolarity_ActiveLow = 1 };
+typedef uint32_t SPI_Mode;
+enum { SPI_Mode_0 = 1 };
+typedef uint32_t SPI_BitOrder;
+enum { SPI_BitOrder_MsbFirst = 1 };
+typedef uint32_t SPI_TransferFlags;
+enum { SPI_TransferFlags_None = 0, SPI_TransferFlags_Read = 1, SPI_TransferFlags_Write = 2 };
+typedef struct { uint32_t z__magicAndVersion; SPI_ChipSelectPolarity csPolarity; } SPIMaster_Config;
+typedef struct {
+    uint32_t z__magicAndVersion;
+    SPI_TransferFlags flags;
+    const uint8_t *writeData;
+    uint8_t *readData;
+    size_t length;
+} SPIMaster_Transfer;
+int SPIMaster_InitConfig(SPIMaster_Config *config);
+int SPIMaster_Open(SPI_InterfaceId interfaceId, SPI_ChipSelectId chipSelectId, const SPIMaster_Config *config);
+int SPIMaster_SetBusSpeed(int fd, uint32_t speedInHz);
+int SPIMaster_SetMode(int fd, SPI_Mode mode);
+int SPIMaster_SetBitOrder(int fd, SPI_BitOrder order);
+int SPIMaster_InitTransfers(SPIMaster_Transfer *transfers, size_t transferCount);
+ssize_t SPIMaster_TransferSequential(int fd, const SPIMaster_Transfer *transfers, size_t transferCount);
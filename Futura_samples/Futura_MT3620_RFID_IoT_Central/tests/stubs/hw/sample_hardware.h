@@ -0,0 +1,5 @@
+/* Host stand-in for the hardware definition of the same name, for the tests. */
+
+#pragma once
+#define SAMPLE_ISU1_SPI 1
+#define MT3620_SPI_CS_A 0
@@ -0,0 +1,118 @@
+/* Futura MT3620 aggregation of samples acquired by the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "acquisition.h"
+
+// Samples are 12 bits wide.
+#define MAX_SAMPLE 0xFFF
+
+void Acquisition_Init(AcquisitionStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    Acquisition_ResetWindow(stats);
+}
+
+void Acquisition_MakeCommand(AcquisitionCommand *command, Acquisition_CommandCode code,
+                             uint8_t channel, uint32_t valueMs)
+{
+    command->magic = ACQUISITION_COMMAND_MAGIC;
+    command->command = (uint8_t)code;
+    command->channel = channel;
+    command->reserved = 0;
+    command->valueMs = valueMs;
+}
+
+Acquisition_AddResult Acquisition_AddBatch(AcquisitionStats *stats, const void *message,
+                                           size_t size)
+{
+    AcquisitionBatchHeader header;
+    if (size == 0 || ((const uint8_t *)message)[0] != ACQUISITION_BATCH_MAGIC) {
+        return Acquisition_NotBatch;
+    }
+    if (size < sizeof(header)) {
+        return Acquisition_Invalid;
+    }
+    memcpy(&header, message, sizeof(header));
+    if (header.version != ACQUISITION_BATCH_VERSION ||
+        size != sizeof(header) + header.sampleCount * sizeof(AcquisitionSample)) {
+        return Acquisition_Invalid;
+    }
+
+    if (stats->sequenceValid && header.sequence != stats->nextSequence) {
+        stats->lostBatches += header.sequence - stats->nextSequence;
+    }
+    stats->sequenceValid = true;
+    stats->nextSequence = header.sequence + 1;
+    stats->droppedSamples = header.droppedSamples;
+
+    const uint8_t *samples = (const uint8_t *)message + sizeof(header);
+    for (uint16_t i = 0; i < header.sampleCount; ++i) {
+        AcquisitionSample sample;
+        memcpy(&sample, samples + i * sizeof(sample), sizeof(sample));
+        if (sample.channel >= ACQUISITION_CHANNEL_COUNT) {
+            continue;
+        }
+
+        AcquisitionChannelStats *channel = &stats->channels[sample.channel];
+        ++channel->count;
+        channel->sum += sample.value;
+        if (sample.value < channel->min) {
+            channel->min = sample.value;
+        }
+        if (sample.value > channel->max) {
+            channel->max = sample.value;
+        }
+    }
+    return Acquisition_Added;
+}
+
+int Acquisition_FormatTelemetry(const AcquisitionStats *stats, float fullScaleVolts, char *json,
+                                size_t size)
+{
+    const float voltsPerCount = fullScaleVolts / (float)MAX_SAMPLE;
+    size_t length = 0;
+    bool any = false;
+
+    for (int i = 0; i < ACQUISITION_CHANNEL_COUNT; ++i) {
+        const AcquisitionChannelStats *channel = &stats->channels[i];
+        if (channel->count == 0) {
+            continue;
+        }
+
+        float mean = (float)channel->sum / (float)channel->count * voltsPerCount;
+        int written = snprintf(json + length, size - length,
+                               "%s\"ADC%d\":%.3f,\"ADC%d_min\":%.3f,\"ADC%d_max\":%.3f",
+                               any ? "," : "{", i, mean, i, channel->min * voltsPerCount, i,
+                               channel->max * voltsPerCount);
+        if (written < 0 || (size_t)written >= size - length) {
+            return -1;
+        }
+        length += (size_t)written;
+        any = true;
+    }
+    if (!any) {
+        return 0;
+    }
+
+    int written = snprintf(json + length, size - length,
+                           ",\"RTA_lostBatches\":%u,\"RTA_droppedSamples\":%u}",
+                           stats->lostBatches, stats->droppedSamples);
+    if (written < 0 || (size_t)written >= size - length) {
+        return -1;
+    }
+    return (int)(length + (size_t)written);
+}
+
+void Acquisition_ResetWindow(AcquisitionStats *stats)
+{
+    for (int i = 0; i < ACQUISITION_CHANNEL_COUNT; ++i) {
+        stats->channels[i].count = 0;
+        stats->channels[i].sum = 0;
+        stats->channels[i].min = MAX_SAMPLE;
+        stats->channels[i].max = 0;
+    }
+}
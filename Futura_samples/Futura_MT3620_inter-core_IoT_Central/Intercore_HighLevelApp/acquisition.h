@@ -0,0 +1,156 @@
+/* Futura MT3620 aggregation of samples acquired by the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Commands and sample batches of the RTApp acquisition engine (logical-acquisition.h), and
+// readings of its DHT22 driver (logical-dht.h). Both definitions must match.
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t command;
+    uint8_t channel;
+    uint8_t reserved;
+    uint32_t valueMs;
+} AcquisitionCommand;
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t version;
+    uint16_t sampleCount;
+    uint32_t sequence;
+    uint32_t droppedSamples;
+} AcquisitionBatchHeader;
+
+typedef struct __attribute__((packed)) {
+    uint32_t timestampUs;
+    uint16_t value;
+    uint8_t channel;
+    uint8_t reserved;
+} AcquisitionSample;
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t status;
+    uint8_t attempts;
+    uint8_t reserved;
+    int16_t temperatureTenths;
+    uint16_t humidityTenths;
+    uint32_t timestampUs;
+    uint32_t statusCounts[5];
+} DhtReading;
+
+#define ACQUISITION_COMMAND_MAGIC 0xF8
+#define ACQUISITION_BATCH_MAGIC 0xF9
+#define ACQUISITION_BATCH_VERSION 1
+#define ACQUISITION_CHANNEL_COUNT 8
+#define DHT_READING_MAGIC 0xFA
+
+/// <summary>
+/// Outcome of a DHT22 read, in DhtReading.status and as the index of DhtReading.statusCounts.
+/// </summary>
+typedef enum {
+    DhtStatus_Ok = 0,
+    DhtStatus_NoResponse = 1,
+    DhtStatus_BadTiming = 2,
+    DhtStatus_Checksum = 3,
+    DhtStatus_Interrupted = 4,
+} DhtStatus;
+
+/// <summary>
+/// Command codes of AcquisitionCommand.
+/// </summary>
+typedef enum {
+    /// <summary>Starts sampling the channels which have a period.</summary>
+    Acquisition_Start = 1,
+    /// <summary>Stops sampling; the samples which are waiting are sent.</summary>
+    Acquisition_Stop = 2,
+    /// <summary>Sets the period of a channel in milliseconds; 0 stops sampling it.</summary>
+    Acquisition_SetPeriod = 3,
+    /// <summary>Sets the longest time in milliseconds that a sample waits to be sent.</summary>
+    Acquisition_SetLatency = 4,
+    /// <summary>Sets the time in milliseconds between DHT22 readings; 0 stops reading.</summary>
+    Acquisition_SetDhtPeriod = 5,
+    /// <summary>
+    ///     Sends the last ACQUISITION_WINDOW_SAMPLES raw values of a channel as one intercore
+    ///     transfer of little-endian 16-bit values. The first command for a channel starts
+    ///     recording it.
+    /// </summary>
+    Acquisition_SendWindow = 6,
+} Acquisition_CommandCode;
+
+/// <summary>
+/// Result of Acquisition_AddBatch.
+/// </summary>
+typedef enum {
+    /// <summary>The message is not a batch; handle it as another kind of message.</summary>
+    Acquisition_NotBatch = 0,
+    /// <summary>The samples were added.</summary>
+    Acquisition_Added = 1,
+    /// <summary>The message starts like a batch but is malformed; it was ignored.</summary>
+    Acquisition_Invalid = 2,
+} Acquisition_AddResult;
+
+/// <summary>
+/// Summary of the samples of one channel since the last Acquisition_ResetWindow.
+/// </summary>
+typedef struct {
+    uint32_t count;
+    uint16_t min;
+    uint16_t max;
+    uint64_t sum;
+} AcquisitionChannelStats;
+
+/// <summary>
+/// Aggregates the batches sent by the RTApp. Initialize with Acquisition_Init; the fields
+/// are private.
+/// </summary>
+typedef struct {
+    AcquisitionChannelStats channels[ACQUISITION_CHANNEL_COUNT];
+    bool sequenceValid;
+    uint32_t nextSequence;
+    uint32_t lostBatches;
+    uint32_t droppedSamples;
+} AcquisitionStats;
+
+/// <summary>
+/// Initializes the aggregation state.
+/// </summary>
+void Acquisition_Init(AcquisitionStats *stats);
+
+/// <summary>
+/// Fills in a command for the RTApp, which the caller sends as it is.
+/// </summary>
+/// <param name="channel">Channel, for Acquisition_SetPeriod; otherwise 0.</param>
+/// <param name="valueMs">Argument in milliseconds, where the command takes one.</param>
+void Acquisition_MakeCommand(AcquisitionCommand *command, Acquisition_CommandCode code,
+                             uint8_t channel, uint32_t valueMs);
+
+/// <summary>
+/// Adds the samples of a batch received from the RTApp. A gap in the batch sequence numbers
+/// is counted as lost batches.
+/// </summary>
+/// <param name="message">Message payload.</param>
+/// <param name="size">Message size in bytes.</param>
+Acquisition_AddResult Acquisition_AddBatch(AcquisitionStats *stats, const void *message,
+                                           size_t size);
+
+/// <summary>
+/// Formats the mean, minimum and maximum of each channel which has samples as a JSON
+/// telemetry message, in volts, with the counts of lost batches and dropped samples.
+/// </summary>
+/// <param name="fullScaleVolts">Voltage of the largest sample value.</param>
+/// <param name="json">Buffer for the message.</param>
+/// <param name="size">Size of the buffer in bytes.</param>
+/// <returns>The message length; 0 if no channel has samples; -1 if the buffer is too small.</returns>
+int Acquisition_FormatTelemetry(const AcquisitionStats *stats, float fullScaleVolts, char *json,
+                                size_t size);
+
+/// <summary>
+/// Clears the per-channel summaries, to start the next telemetry period.
+/// </summary>
+void Acquisition_ResetWindow(AcquisitionStats *stats);
@@ -0,0 +1,99 @@
+/* Futura MT3620 reassembly of intercore transfers.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <string.h>
+
+#include "intercore_reassembly.h"
+
+void IntercoreReassembly_Init(IntercoreReassembly *reassembly, void *buffer, size_t capacity)
+{
+    memset(reassembly, 0, sizeof(*reassembly));
+    reassembly->buffer = (uint8_t *)buffer;
+    reassembly->capacity = capacity;
+}
+
+// Abandons the transfer in progress. Its remaining fragments are discarded as they arrive.
+static IntercoreReassembly_Result Drop(IntercoreReassembly *reassembly)
+{
+    reassembly->active = false;
+    reassembly->discarding = true;
+    reassembly->discardId = reassembly->transferId;
+    ++reassembly->droppedTransfers;
+    return IntercoreReassembly_Dropped;
+}
+
+IntercoreReassembly_Result IntercoreReassembly_Add(IntercoreReassembly *reassembly,
+                                                   const void *message, size_t size,
+                                                   const uint8_t **data, size_t *dataSize)
+{
+    IntercoreFragmentHeader header;
+    if (size < sizeof(header) || ((const uint8_t *)message)[0] != INTERCORE_TRANSFER_MAGIC) {
+        return IntercoreReassembly_NotFragment;
+    }
+    memcpy(&header, message, sizeof(header));
+    const uint8_t *fragmentData = (const uint8_t *)message + sizeof(header);
+    size_t fragmentSize = size - sizeof(header);
+
+    // Every fragment sent is numbered, so a gap means fragments were lost. Whatever was
+    // missed, the transfer in progress cannot complete.
+    if (reassembly->sequenceValid && header.sequence != reassembly->nextSequence) {
+        reassembly->lostFragments += (uint16_t)(header.sequence - reassembly->nextSequence);
+        if (reassembly->active) {
+            Drop(reassembly);
+        }
+    }
+    reassembly->sequenceValid = true;
+    reassembly->nextSequence = (uint16_t)(header.sequence + 1);
+
+    if (header.index == 0) {
+        // A new transfer replaces one which did not complete.
+        if (reassembly->active) {
+            Drop(reassembly);
+        }
+        reassembly->active = true;
+        reassembly->transferId = header.transferId;
+        reassembly->count = header.count;
+        reassembly->nextIndex = 0;
+        reassembly->size = 0;
+    } else if (!reassembly->active || header.transferId != reassembly->transferId ||
+               header.index != reassembly->nextIndex || header.count != reassembly->count) {
+        if (reassembly->active) {
+            return Drop(reassembly);
+        }
+        // Count a transfer whose start was missed once, not once per fragment.
+        if (!reassembly->discarding || header.transferId != reassembly->discardId) {
+            reassembly->discarding = true;
+            reassembly->discardId = header.transferId;
+            ++reassembly->droppedTransfers;
+        }
+        return IntercoreReassembly_Dropped;
+    }
+
+    if (header.count == 0 || fragmentSize > reassembly->capacity - reassembly->size) {
+        return Drop(reassembly);
+    }
+
+    memcpy(reassembly->buffer + reassembly->size, fragmentData, fragmentSize);
+    reassembly->size += fragmentSize;
+    ++reassembly->nextIndex;
+
+    if (reassembly->nextIndex < reassembly->count) {
+        return IntercoreReassembly_Pending;
+    }
+
+    reassembly->active = false;
+    *data = reassembly->buffer;
+    *dataSize = reassembly->size;
+    return IntercoreReassembly_Complete;
+}
+
+uint32_t IntercoreReassembly_GetLostFragments(const IntercoreReassembly *reassembly)
+{
+    return reassembly->lostFragments;
+}
+
+uint32_t IntercoreReassembly_GetDroppedTransfers(const IntercoreReassembly *reassembly)
+{
+    return reassembly->droppedTransfers;
+}
@@ -0,0 +1,76 @@
+/* Futura MT3620 reassembly of intercore transfers.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fragments as ContinueIntercoreTransfer in the RTApp writes them.
+#include "transfer-fragment.h"
+
+/// <summary>
+/// Result of IntercoreReassembly_Add.
+/// </summary>
+typedef enum {
+    /// <summary>The message is not a fragment; handle it as a plain message.</summary>
+    IntercoreReassembly_NotFragment = 0,
+    /// <summary>The fragment was stored; more are needed.</summary>
+    IntercoreReassembly_Pending = 1,
+    /// <summary>The fragment completed a transfer.</summary>
+    IntercoreReassembly_Complete = 2,
+    /// <summary>The fragment was discarded, and with it the transfer it belongs to.</summary>
+    IntercoreReassembly_Dropped = 3,
+} IntercoreReassembly_Result;
+
+/// <summary>
+/// Reassembles one transfer at a time into a buffer supplied by the caller, which bounds the
+/// memory used. Initialize with IntercoreReassembly_Init; the fields are private.
+/// </summary>
+typedef struct {
+    uint8_t *buffer;
+    size_t capacity;
+    size_t size;
+    bool active;
+    uint16_t transferId;
+    uint8_t nextIndex;
+    uint8_t count;
+    bool discarding; // fragments of discardId are ignored
+    uint16_t discardId;
+    bool sequenceValid;
+    uint16_t nextSequence;
+    uint32_t lostFragments;
+    uint32_t droppedTransfers;
+} IntercoreReassembly;
+
+/// <summary>
+/// Initializes the reassembly state.
+/// </summary>
+/// <param name="buffer">Storage for a transfer; larger transfers are dropped.</param>
+/// <param name="capacity">Size of the buffer in bytes.</param>
+void IntercoreReassembly_Init(IntercoreReassembly *reassembly, void *buffer, size_t capacity);
+
+/// <summary>
+/// Adds a message received from the RTApp. A gap in the fragment sequence numbers means that
+/// fragments were lost: the transfer in progress is dropped, since it cannot be completed.
+/// </summary>
+/// <param name="message">Message payload.</param>
+/// <param name="size">Message size in bytes.</param>
+/// <param name="data">On IntercoreReassembly_Complete, set to the transfer data, which stays
+/// valid until the next call.</param>
+/// <param name="dataSize">On IntercoreReassembly_Complete, set to the transfer size.</param>
+IntercoreReassembly_Result IntercoreReassembly_Add(IntercoreReassembly *reassembly,
+                                                   const void *message, size_t size,
+                                                   const uint8_t **data, size_t *dataSize);
+
+/// <summary>
+/// Returns the number of fragments known to be lost.
+/// </summary>
+uint32_t IntercoreReassembly_GetLostFragments(const IntercoreReassembly *reassembly);
+
+/// <summary>
+/// Returns the number of transfers dropped because of lost, unexpected or oversized fragments.
+/// </summary>
+uint32_t IntercoreReassembly_GetDroppedTransfers(const IntercoreReassembly *reassembly);
@@ -26,29 +26,18 @@
 #include <hw/sample_hardware.h>
 
 //IOTHUB libs
-#include <iothub_client_core_common.h>
-#include <iothub_device_client_ll.h>
-#include <iothub_client_options.h>
-#include <iothubtransportmqtt.h>
-#include <iothub.h>
-#include <azure_sphere_provisioning.h>
-#include "parson.h" // used to parse Device Twin messages.
+#include "azure_connection.h"
+#include "intercore_reassembly.h"
+#include "acquisition.h"
+#include "trace_frame.h"
 
 static char eventBuffer[100] = { 0 };
 // Timer 
-static EventLoopTimer* azureTimer = NULL;
 
-// Azure IoT poll periods
-static const int AzureIoTDefaultPollPeriodSeconds = 5;
-static const int AzureIoTMinReconnectPeriodSeconds = 60;
-static const int AzureIoTMaxReconnectPeriodSeconds = 10 * 60;
 
-static int azureIoTPollPeriodSeconds = -1;
 
 
 
-static void AzureTimerEventHandler(EventLoopTimer* timer);
-
 
 typedef enum {
     ExitCode_Success = 0,
@@ -57,46 +46,53 @@ typedef enum {
     ExitCode_SendMsg_Send = 3,
     ExitCode_SocketHandler_Recv = 4,
     ExitCode_Init_EventLoop = 5,
-    ExitCode_Init_SendTimer = 6,
+    ExitCode_Init_UploadTimer = 6,
     ExitCode_Init_Connection = 7,
     ExitCode_Init_SetSockOpt = 8,
     ExitCode_Init_RegisterIo = 9,
     ExitCode_Main_EventLoopFail = 10,    
-    ExitCode_AzureTimer_Consume = 12,  
     ExitCode_Init_TwinStatusLed = 15,    
-    ExitCode_Init_AzureTimer = 17,
+    ExitCode_Init_AzureConnection = 17,
 } ExitCode;
 
 static int sockFd = -1;
 static EventLoop* eventLoop = NULL;
-static EventLoopTimer* sendTimer = NULL;
+static EventLoopTimer* uploadTimer = NULL;
 static EventRegistration* socketEventReg = NULL;
 static volatile sig_atomic_t exitCode = ExitCode_Success;
 
 static const char rtAppComponentId[] = "005180bc-402f-4cb3-a662-72937dbcde47";
 
+// Largest message the RTApp can send; longer data arrives as a fragmented transfer.
+#define MAX_RTA_MESSAGE_SIZE 1040
+// Largest fragmented transfer that is reassembled; larger ones are dropped.
+#define MAX_RTA_TRANSFER_SIZE (16 * 1024)
+
+static uint8_t transferBuffer[MAX_RTA_TRANSFER_SIZE];
+static IntercoreReassembly reassembly;
+
+// The RTApp samples the ADC channel of the board 10 times a second, and sends the samples
+// at least once a second. The HLApp uploads their summary every 10 seconds.
+static const uint32_t acquisitionPeriodMs = 100;
+static const uint32_t acquisitionLatencyMs = 1000;
+static const struct timespec uploadPeriod = { .tv_sec = 10, .tv_nsec = 0 };
+// ADC reference voltage, which is the voltage of the largest sample.
+static const float adcFullScaleVolts = 2.5f;
+static AcquisitionStats acquisitionStats;
+// The RTApp reads the DHT22 every 10 seconds, and retries sooner after a failed read.
+static const uint32_t dhtPeriodMs = 10000;
+
 static void TerminationHandler(int signalNumber);
-static void SendTimerEventHandler(EventLoopTimer* timer);
-static void SendMessageToRTApp(void);
+static void UploadTimerEventHandler(EventLoopTimer* timer);
+static bool SendCommandToRTApp(Acquisition_CommandCode code, uint8_t channel, uint32_t valueMs);
+static bool HandleDhtReading(const uint8_t* data, size_t size);
+static void HandleWaveformWindow(const uint8_t* data, size_t size);
 static void SocketEventHandler(EventLoop* el, int fd, EventLoop_IoEvents events, void* context);
 static ExitCode InitHandlers(void);
 static void CloseHandlers(void);
 // Azure IoT Central/Central defines.
 #define SCOPEID_LENGTH 20
 static char scopeId[SCOPEID_LENGTH]; // ScopeId for the Azure IoT Central application, set in app_manifest.json, CmdArgs
-static IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle = NULL;
-static const int keepalivePeriodSeconds = 20;
-static bool iothubAuthenticated = false;
-static void SendMessageCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* context);
-static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char* payload,
-    size_t payloadSize, void* userContextCallback);
-static void TwinReportBoolState(const char* propertyName, bool propertyValue);
-static void ReportStatusCallback(int result, void* context);
-static const char* GetReasonString(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason);
-static const char* getAzureSphereProvisioningResultString(
-    AZURE_SPHERE_PROV_RETURN_VALUE provisioningResult);
-static void SendTelemetry(const unsigned char* key, const unsigned char* value);
-static void SetupAzureClient(void);
 /// <summary>
 ///     Signal handler for termination requests. This handler must be async-signal-safe.
 /// </summary>
@@ -107,60 +103,184 @@ static void TerminationHandler(int signalNumber)
 }
 
 /// <summary>
-///     Handle send timer event by writing data to the real-time capable application.
+///     Handle upload timer event by sending the summary of the samples received from the
+///     real-time capable application since the previous upload.
 /// </summary>
-static void SendTimerEventHandler(EventLoopTimer* timer)
+static void UploadTimerEventHandler(EventLoopTimer* timer)
 {
     if (ConsumeEventLoopTimerEvent(timer) != 0) {
         exitCode = ExitCode_TimerHandler_Consume;
         return;
     }
 
-    SendMessageToRTApp();
+    char json[512];
+    int length = Acquisition_FormatTelemetry(&acquisitionStats, adcFullScaleVolts, json,
+                                             sizeof(json));
+    if (length > 0) {
+        Log_Debug("Uploading: %s\n", json);
+        AzureConnection_SendTelemetry(json);
+    } else if (length == 0) {
+        Log_Debug("WARNING: No samples received from the RTApp.\n");
+    }
+    Acquisition_ResetWindow(&acquisitionStats);
+
+    // The raw waveform since the previous upload arrives as a transfer.
+    SendCommandToRTApp(Acquisition_SendWindow, SAMPLE_POTENTIOMETER_ADC_CHANNEL, 0);
 }
 
 /// <summary>
-///     Helper function for TimerEventHandler sends message to real-time capable application.
+///     Sends an acquisition command to the real-time capable application.
 /// </summary>
-static void SendMessageToRTApp(void)
+/// <returns>false if the command could not be sent.</returns>
+static bool SendCommandToRTApp(Acquisition_CommandCode code, uint8_t channel, uint32_t valueMs)
 {
-    // Send "hl-app-to-rt-app-%02d" message to RTApp, where the number cycles from 00 to 99.
-    static int iter = 0;
-
-    static char txMessage[32];
-    snprintf(txMessage, sizeof(txMessage), "hl-app-to-rt-app-%02d", iter);
-    iter = (iter + 1) % 100;
-    Log_Debug("Sending: %s\n", txMessage);
+    AcquisitionCommand command;
+    Acquisition_MakeCommand(&command, code, channel, valueMs);
 
-    int bytesSent = send(sockFd, txMessage, strlen(txMessage), 0);
+    int bytesSent = send(sockFd, &command, sizeof(command), 0);
     if (bytesSent == -1) {
         Log_Debug("ERROR: Unable to send message: %d (%s)\n", errno, strerror(errno));
         exitCode = ExitCode_SendMsg_Send;
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+///     Sends a DHT22 reading of the real-time capable application as telemetry, or logs why
+///     the read failed.
+/// </summary>
+/// <returns>false if the message is not a DHT22 reading.</returns>
+static bool HandleDhtReading(const uint8_t* data, size_t size)
+{
+    static const char* const statusNames[] = {"ok", "no response", "bad timing", "checksum",
+                                              "interrupted"};
+    DhtReading reading;
+
+    if (size == 0 || data[0] != DHT_READING_MAGIC) {
+        return false;
+    }
+    if (size != sizeof(reading)) {
+        Log_Debug("WARNING: RTA DHT22 reading malformed: %zu bytes.\n", size);
+        return true;
+    }
+    memcpy(&reading, data, sizeof(reading));
+
+    if (reading.status != DhtStatus_Ok) {
+        const char* statusName = reading.status < sizeof(statusNames) / sizeof(statusNames[0])
+                                     ? statusNames[reading.status]
+                                     : "unknown";
+        Log_Debug("WARNING: DHT22 read failed (%s), attempt %u. Since startup: %u ok, "
+                  "%u no response, %u bad timing, %u checksum, %u interrupted.\n",
+                  statusName, reading.attempts, reading.statusCounts[DhtStatus_Ok],
+                  reading.statusCounts[DhtStatus_NoResponse],
+                  reading.statusCounts[DhtStatus_BadTiming],
+                  reading.statusCounts[DhtStatus_Checksum],
+                  reading.statusCounts[DhtStatus_Interrupted]);
+        return true;
+    }
+
+    char value[20];
+    float temperature = (float)reading.temperatureTenths / 10.0f;
+    float humidity = (float)reading.humidityTenths / 10.0f;
+    Log_Debug("DHT22: %.1f *C, %.1f %% after %u attempts.\n", temperature, humidity,
+              reading.attempts);
+    if (snprintf(value, sizeof(value), "%3.2f", temperature) > 0) {
+        AzureConnection_SendTelemetryValue("Temperature", value);
+    }
+    if (snprintf(value, sizeof(value), "%3.2f", humidity) > 0) {
+        AzureConnection_SendTelemetryValue("Humidity", value);
+    }
+    return true;
+}
+
+/// <summary>
+///     Logs the waveform window which the RTApp sends as a transfer on Acquisition_SendWindow.
+/// </summary>
+static void HandleWaveformWindow(const uint8_t* data, size_t size)
+{
+    size_t count = size / sizeof(uint16_t);
+    uint16_t min = UINT16_MAX;
+    uint16_t max = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t value = (uint16_t)(data[2 * i] | (data[2 * i + 1] << 8));
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+    }
+    if (count == 0) {
+        Log_Debug("RTA waveform window empty.\n");
         return;
     }
+    Log_Debug("RTA waveform window: %zu values from %u to %u.\n", count, min, max);
+}
+
+/// <summary>
+///     Logs an event of a trace frame from the RTApp, which TraceFrame_Decode renders with
+///     the format strings of the RTApp's trace-events.h. Trace events are not telemetry.
+/// </summary>
+static void LogTraceLine(const char* line, void* context)
+{
+    Log_Debug("RTA %s\n", line);
 }
 
 /// <summary>
 ///     Handle socket event by reading incoming data from real-time capable application.
+///     The RTApp may signal once for several messages, so every pending message is read.
 /// </summary>
 static void SocketEventHandler(EventLoop* el, int fd, EventLoop_IoEvents events, void* context)
 {
-    static int iter = 0;
-    const size_t receiveBufferSize = 256;
+    const size_t receiveBufferSize = MAX_RTA_MESSAGE_SIZE;
     uint8_t receiveBuffer[receiveBufferSize + 1]; // allow extra byte for string termination
     int bytesRead;
+    const uint8_t* transfer;
+    size_t transferSize;
+
+    // Read incoming RTA data until the socket is empty
+    while ((bytesRead = recv(fd, receiveBuffer, receiveBufferSize, MSG_DONTWAIT)) >= 0) {
+        switch (IntercoreReassembly_Add(&reassembly, receiveBuffer, (size_t)bytesRead, &transfer,
+                                        &transferSize)) {
+        case IntercoreReassembly_NotFragment: {
+            TraceFrame_Result traced =
+                TraceFrame_Decode(receiveBuffer, (size_t)bytesRead, LogTraceLine, NULL);
+            if (traced == TraceFrame_Invalid) {
+                Log_Debug("WARNING: RTA trace frame malformed: %d bytes.\n", bytesRead);
+            }
+            if (traced != TraceFrame_NotFrame) {
+                break;
+            }
+            Acquisition_AddResult added =
+                Acquisition_AddBatch(&acquisitionStats, receiveBuffer, (size_t)bytesRead);
+            if (added == Acquisition_Invalid) {
+                Log_Debug("WARNING: RTA sample batch malformed: %d bytes.\n", bytesRead);
+            }
+            if (added != Acquisition_NotBatch ||
+                HandleDhtReading(receiveBuffer, (size_t)bytesRead)) {
+                break;
+            }
+            // print and sendtelemetry
+            receiveBuffer[bytesRead] = 0;
+            Log_Debug("RTA received %d bytes: '%s'.\n", bytesRead, (char*)receiveBuffer);
+            AzureConnection_SendTelemetryValue("RTA", (char*)receiveBuffer);
+            break;
+        }
+        case IntercoreReassembly_Complete:
+            HandleWaveformWindow(transfer, transferSize);
+            break;
+        case IntercoreReassembly_Dropped:
+            Log_Debug("WARNING: RTA transfer dropped (%u fragments lost, %u transfers dropped).\n",
+                      IntercoreReassembly_GetLostFragments(&reassembly),
+                      IntercoreReassembly_GetDroppedTransfers(&reassembly));
+            break;
+        case IntercoreReassembly_Pending:
+            break;
+        }
+    }
 
-    // Read incoming RTA data 
-    bytesRead = recv(fd, receiveBuffer, sizeof(receiveBuffer), 0);
-
-    if (bytesRead > 0) {
-        // print and sendtelemetry
-        receiveBuffer[bytesRead] = 0;
-        Log_Debug("RTA received %d bytes: '%s'.\n", bytesRead, (char*)receiveBuffer);
-        SendTelemetry("RTA", (char*)receiveBuffer);
-        
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        Log_Debug("ERROR: Unable to receive message: %d (%s)\n", errno, strerror(errno));
+        exitCode = ExitCode_SocketHandler_Recv;
     }
-    Log_Debug("\n");
 }
 
 /// <summary>
@@ -184,20 +304,19 @@ static ExitCode InitHandlers(void)
         return ExitCode_Init_EventLoop;
     }
 
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = { .tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0 };
-    azureTimer =
-        CreateEventLoopPeriodicTimer(eventLoop, &AzureTimerEventHandler, &azureTelemetryPeriod);
-    if (azureTimer == NULL) {
-        return ExitCode_Init_AzureTimer;
+    AzureConnection_Config azureConfig = {.scopeId = scopeId};
+    if (AzureConnection_Init(eventLoop, &azureConfig) != 0) {
+        return ExitCode_Init_AzureConnection;
+    }
+
+    // Register a timer to upload the summary of the samples.
+    uploadTimer = CreateEventLoopPeriodicTimer(eventLoop, &UploadTimerEventHandler, &uploadPeriod);
+    if (uploadTimer == NULL) {
+        return ExitCode_Init_UploadTimer;
     }
 
-    // Register a one second timer to send a message to the RTApp.
-    /*static const struct timespec sendPeriod = { .tv_sec = 1, .tv_nsec = 0 };
-    sendTimer = CreateEventLoopPeriodicTimer(eventLoop, &SendTimerEventHandler, &sendPeriod);
-    if (sendTimer == NULL) {
-        return ExitCode_Init_SendTimer;
-    }*/
+    IntercoreReassembly_Init(&reassembly, transferBuffer, sizeof(transferBuffer));
+    Acquisition_Init(&acquisitionStats);
 
     // Open a connection to the RTApp.
     sockFd = Application_Connect(rtAppComponentId);
@@ -222,6 +341,16 @@ static ExitCode InitHandlers(void)
         return ExitCode_Init_RegisterIo;
     }
 
+    // Configure and start acquisition, DHT22 reads and the waveform window on the RTApp.
+    if (!SendCommandToRTApp(Acquisition_SetLatency, 0, acquisitionLatencyMs) ||
+        !SendCommandToRTApp(Acquisition_SetPeriod, SAMPLE_POTENTIOMETER_ADC_CHANNEL,
+                            acquisitionPeriodMs) ||
+        !SendCommandToRTApp(Acquisition_Start, 0, 0) ||
+        !SendCommandToRTApp(Acquisition_SetDhtPeriod, 0, dhtPeriodMs) ||
+        !SendCommandToRTApp(Acquisition_SendWindow, SAMPLE_POTENTIOMETER_ADC_CHANNEL, 0)) {
+        return ExitCode_SendMsg_Send;
+    }
+
     return ExitCode_Success;
 }
 
@@ -245,8 +374,9 @@ static void CloseFdAndPrintError(int fd, const char* fdName)
 /// </summary>
 static void CloseHandlers(void)
 {
-    DisposeEventLoopTimer(sendTimer);
+    DisposeEventLoopTimer(uploadTimer);
     EventLoop_UnregisterIo(eventLoop, socketEventReg);
+    AzureConnection_Cleanup();
     EventLoop_Close(eventLoop);
 
     Log_Debug("Closing file descriptors.\n");
@@ -258,341 +388,6 @@ static void CloseHandlers(void)
 
 
 
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-// Main entry point 
-//int main(int argc, char* argv[])
-//{
-//    Log_Debug("RX UART application starting.\n");
-//
-//    bool isNetworkingReady = false;
-//    if ((Networking_IsNetworkingReady(&isNetworkingReady) == -1) || !isNetworkingReady) {
-//        Log_Debug("WARNING: Network is not ready. Device cannot connect until network is ready.\n");
-//    }
-//
-//    if (argc == 2) {
-//        Log_Debug("Setting Azure Scope ID %s\n", argv[1]);
-//        strncpy(scopeId, argv[1], SCOPEID_LENGTH);
-//    }
-//    else {
-//        Log_Debug("ScopeId needs to be set in the app_manifest CmdArgs\n");
-//        return -1;
-//    }
-//
-//    exitCode = InitPeripheralsAndHandlers();
-//
-//    // Main loop
-//    while (exitCode == ExitCode_Success) {
-//        EventLoop_Run_Result result = EventLoop_Run(eventLoop, -1, true);
-//        // Continue if interrupted by signal, e.g. due to breakpoint being set.
-//        if (result == EventLoop_Run_Failed && errno != EINTR) {
-//            exitCode = ExitCode_Main_EventLoopFail;
-//        }
-//    }
-//
-//    ClosePeripheralsAndHandlers();
-//    Log_Debug("Application exiting.\n");
-//    return exitCode;
-//}
-
-
-
-// // // // // // // // // // // // // // // // // // 
-// Azure timer event:  Check connection status and send telemetry
-// // // // // // // // // // // // // // // // // // 
-static void AzureTimerEventHandler(EventLoopTimer* timer)
-{
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_AzureTimer_Consume;
-        return;
-    }
-
-    bool isNetworkReady = false;
-    if (Networking_IsNetworkingReady(&isNetworkReady) != -1) {
-        if (isNetworkReady && !iothubAuthenticated) {
-            SetupAzureClient();
-        }
-    }
-    else {
-        Log_Debug("Failed to get Network state\n");
-    }
-
-    if (iothubAuthenticated) {
-        IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
-    }
-}
-
-
-// Sets the IoT Central authentication state for the app
-// The SAS Token expires which will set the authentication state
-static void HubConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result,
-    IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
-    void* userContextCallback)
-{
-    iothubAuthenticated = (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED);
-    Log_Debug("IoT Central Authenticated: %s\n", GetReasonString(reason));
-}
-
-
-// Sets up the Azure IoT Central connection (creates the iothubClientHandle)
-// When the SAS Token for a device expires the connection needs to be recreated
-// which is why this is not simply a one time call.
-
-static void SetupAzureClient(void)
-{
-    if (iothubClientHandle != NULL) {
-        IoTHubDeviceClient_LL_Destroy(iothubClientHandle);
-    }
-
-    AZURE_SPHERE_PROV_RETURN_VALUE provResult =
-        IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning(scopeId, 10000,
-            &iothubClientHandle);
-    Log_Debug("IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning returned '%s'.\n",
-        getAzureSphereProvisioningResultString(provResult));
-
-    if (provResult.result != AZURE_SPHERE_PROV_RESULT_OK) {
-
-        // If fail to connect, reduce the polling frequency, starting at
-        // AzureIoTMinReconnectPeriodSeconds and with a backoff up to
-        // AzureIoTMaxReconnectPeriodSeconds
-        if (azureIoTPollPeriodSeconds == AzureIoTDefaultPollPeriodSeconds) {
-            azureIoTPollPeriodSeconds = AzureIoTMinReconnectPeriodSeconds;
-        }
-        else {
-            azureIoTPollPeriodSeconds *= 2;
-            if (azureIoTPollPeriodSeconds > AzureIoTMaxReconnectPeriodSeconds) {
-                azureIoTPollPeriodSeconds = AzureIoTMaxReconnectPeriodSeconds;
-            }
-        }
-
-        struct timespec azureTelemetryPeriod = { azureIoTPollPeriodSeconds, 0 };
-        SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
-
-        Log_Debug("ERROR: failure to create IoTHub Handle - will retry in %i seconds.\n",
-            azureIoTPollPeriodSeconds);
-        return;
-    }
-
-    // Successfully connected, so make sure the polling frequency is back to the default
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = { .tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0 };
-    SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
-
-    iothubAuthenticated = true;
-
-    if (IoTHubDeviceClient_LL_SetOption(iothubClientHandle, OPTION_KEEP_ALIVE,
-        &keepalivePeriodSeconds) != IOTHUB_CLIENT_OK) {
-        Log_Debug("ERROR: failure setting option \"%s\"\n", OPTION_KEEP_ALIVE);
-        return;
-    }
-
-    IoTHubDeviceClient_LL_SetDeviceTwinCallback(iothubClientHandle, TwinCallback, NULL);
-    IoTHubDeviceClient_LL_SetConnectionStatusCallback(iothubClientHandle,
-        HubConnectionStatusCallback, NULL);
-}
-
-
-// Callback invoked when a Device Twin update is received from IoT Central.
-// Updates local state for 'showEvents' (bool).
-// <param name="payload">contains the Device Twin JSON document (desired and reported)</param>
-// <param name="payloadSize">size of the Device Twin JSON document</param>
-static void TwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char* payload,
-    size_t payloadSize, void* userContextCallback)
-{
-    size_t nullTerminatedJsonSize = payloadSize + 1;
-    char* nullTerminatedJsonString = (char*)malloc(nullTerminatedJsonSize);
-    if (nullTerminatedJsonString == NULL) {
-        Log_Debug("ERROR: Could not allocate buffer for twin update payload.\n");
-        abort();
-    }
-
-    // Copy the provided buffer to a null terminated buffer.
-    memcpy(nullTerminatedJsonString, payload, payloadSize);
-    // Add the null terminator at the end.
-    nullTerminatedJsonString[nullTerminatedJsonSize - 1] = 0;
-
-    JSON_Value* rootProperties = NULL;
-    rootProperties = json_parse_string(nullTerminatedJsonString);
-    if (rootProperties == NULL) {
-        Log_Debug("WARNING: Cannot parse the string as JSON content.\n");
-        goto cleanup;
-    }
-
-    JSON_Object* rootObject = json_value_get_object(rootProperties);
-    JSON_Object* desiredProperties = json_object_dotget_object(rootObject, "desired");
-    if (desiredProperties == NULL) {
-        desiredProperties = rootObject;
-    }
-
-
-cleanup:
-    // Release the allocated memory.
-    json_value_free(rootProperties);
-    free(nullTerminatedJsonString);
-}
-
-// Converts the IoT Central connection status reason to a string.
-static const char* GetReasonString(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
-{
-    static char* reasonString = "unknown reason";
-    switch (reason) {
-    case IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_NO_NETWORK:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_NO_NETWORK";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR";
-        break;
-    case IOTHUB_CLIENT_CONNECTION_OK:
-        reasonString = "IOTHUB_CLIENT_CONNECTION_OK"; // must be always this
-        break;
-    }
-    return reasonString;
-}
-
-
-// Converts AZURE_SPHERE_PROV_RETURN_VALUE to a string.
-
-static const char* getAzureSphereProvisioningResultString(
-    AZURE_SPHERE_PROV_RETURN_VALUE provisioningResult)
-{
-    switch (provisioningResult.result) {
-    case AZURE_SPHERE_PROV_RESULT_OK:
-        return "AZURE_SPHERE_PROV_RESULT_OK"; // must be this
-    case AZURE_SPHERE_PROV_RESULT_INVALID_PARAM:
-        return "AZURE_SPHERE_PROV_RESULT_INVALID_PARAM";
-    case AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY:
-        return "AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY";
-    case AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY:
-        return "AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY";
-    case AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR:
-        return "AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR";
-    case AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR:
-        return "AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR";
-    default:
-        return "UNKNOWN_RETURN_VALUE";
-    }
-}
-
-
-// Sends telemetry to IoT Central
-// <param name="key">The telemetry item to update</param>
-// <param name="value">new telemetry value</param>
-static void SendTelemetry(const unsigned char* key, const unsigned char* value)
-{
-    static char eventBuffer[100] = { 0 };
-    static const char* EventMsgTemplate = "{ \"%s\": \"%s\" }";
-    int len = snprintf(eventBuffer, sizeof(eventBuffer), EventMsgTemplate, key, value);
-    if (len < 0)
-        return;
-
-    Log_Debug("Sending IoT Central Message: %s\n", eventBuffer);
-
-    bool isNetworkingReady = false;
-
-    if ((Networking_IsNetworkingReady(&isNetworkingReady) == -1) || !isNetworkingReady) {
-        Log_Debug("WARNING: Cannot send IoTHubMessage because network is not up.\n");
-        return;
-    }
-
-    IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromString(eventBuffer);
-
-    if (messageHandle == 0) {
-        Log_Debug("WARNING: unable to create a new IoTHubMessage\n");
-        return;
-    }
-
-    if (IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle, SendMessageCallback,
-        /*&callback_param*/ 0) != IOTHUB_CLIENT_OK) {
-        Log_Debug("WARNING: failed to hand over the message to IoT Central Client\n");
-    }
-    else {
-        Log_Debug("INFO: IoT Central Client accepted the message for delivery\n");
-    }
-
-    IoTHubMessage_Destroy(messageHandle);
-}
-
-
-// Callback confirming message delivered to IoT Central.
-// <param name="result">Message delivery status</param>
-// <param name="context">User specified context</param>
-static void SendMessageCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* context)
-{
-    Log_Debug("INFO: Message received by IoT Central. Result is: %d\n", result);
-}
-
-
-// Creates and enqueues a report containing the name and value pair of a Device Twin reported
-// property. The report is not sent immediately, but it is sent on the next invocation of
-// IoTHubDeviceClient_LL_DoWork().
-// <param name="propertyName">the IoT Central Device Twin property name</param>
-// <param name="propertyValue">the IoT Central Device Twin property value</param>
-static void TwinReportBoolState(const char* propertyName, bool propertyValue)
-{
-    if (iothubClientHandle == NULL) {
-        Log_Debug("ERROR: client not initialized\n");
-    }
-    else {
-        static char reportedPropertiesString[30] = { 0 };
-        int len = snprintf(reportedPropertiesString, 30, "{\"%s\":%s}", propertyName,
-            (propertyValue == true ? "true" : "false"));
-        if (len < 0)
-            return;
-
-        if (IoTHubDeviceClient_LL_SendReportedState(
-            iothubClientHandle, (unsigned char*)reportedPropertiesString,
-            strlen(reportedPropertiesString), ReportStatusCallback, 0) != IOTHUB_CLIENT_OK) {
-            Log_Debug("ERROR: failed to set reported state for '%s'.\n", propertyName);
-        }
-        else {
-            Log_Debug("INFO: Reported state for '%s' to value '%s'.\n", propertyName,
-                (propertyValue == true ? "true" : "false"));
-        }
-    }
-}
-
-
-// Callback invoked when the Device Twin reported properties are accepted by IoT Central.
-static void ReportStatusCallback(int result, void* context)
-{
-    Log_Debug("INFO: Device Twin reported properties update result: HTTP status code %d\n", result);
-}
-
-
-
-
-
 int main(int argc, char* argv[])
 {
     Log_Debug("Futura High-level intercore application starting\n");
@@ -645,6 +440,6 @@ int main(int argc, char* argv[])
 //        // print and sendtelemetry
 //        receiveBuffer[bytesRead] = 0;
 //        Log_Debug("UART received %d bytes: '%s'.\n", bytesRead, (char*)receiveBuffer);
-//        SendTelemetry("UART", (char*)receiveBuffer);
+//        AzureConnection_SendTelemetryValue("UART", (char*)receiveBuffer);
 //    }
 //}
@@ -0,0 +1,94 @@
+/* Futura MT3620 decoding of binary trace frames from the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "trace_frame.h"
+
+#define FRAME_HEADER_SIZE 4
+#define RECORD_HEADER_SIZE 8
+// Long enough for the longest format of trace-events.h with its arguments.
+#define MAX_LINE_SIZE 160
+
+static const char *const formats[] = {
+#define TRACE_EVENT(identifier, format) format,
+#include "trace-events.h"
+#undef TRACE_EVENT
+};
+
+#define EVENT_COUNT (sizeof(formats) / sizeof(formats[0]))
+
+static uint32_t Get16(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t Get32(const uint8_t *p)
+{
+    return Get16(p) | (Get16(p + 2) << 16);
+}
+
+// Checks that the frame body is a whole number of well-formed events.
+static bool ValidateBody(const uint8_t *body, size_t size)
+{
+    size_t offset = 0;
+    while (offset < size) {
+        if (size - offset < RECORD_HEADER_SIZE) {
+            return false;
+        }
+        uint32_t argCount = body[offset + 2];
+        if (argCount > TRACE_MAX_ARGS || body[offset + 3] != 0) {
+            return false;
+        }
+        offset += RECORD_HEADER_SIZE + argCount * sizeof(uint32_t);
+    }
+    return offset == size && size != 0;
+}
+
+TraceFrame_Result TraceFrame_Decode(const void *message, size_t size,
+                                    TraceFrame_LineHandler handler, void *context)
+{
+    const uint8_t *frame = message;
+    if (size == 0 || frame[0] != TRACE_FRAME_MAGIC) {
+        return TraceFrame_NotFrame;
+    }
+    if (size < FRAME_HEADER_SIZE || frame[1] != TRACE_FRAME_VERSION ||
+        Get16(frame + 2) != size - FRAME_HEADER_SIZE ||
+        !ValidateBody(frame + FRAME_HEADER_SIZE, size - FRAME_HEADER_SIZE)) {
+        return TraceFrame_Invalid;
+    }
+
+    size_t offset = FRAME_HEADER_SIZE;
+    while (offset < size) {
+        const uint8_t *record = frame + offset;
+        uint32_t id = Get16(record);
+        uint32_t argCount = record[2];
+        uint32_t timestampUs = Get32(record + 4);
+        uint32_t args[TRACE_MAX_ARGS] = {0};
+        for (uint32_t i = 0; i < argCount; ++i) {
+            args[i] = Get32(record + RECORD_HEADER_SIZE + i * sizeof(uint32_t));
+        }
+
+        char line[MAX_LINE_SIZE];
+        int length = snprintf(line, sizeof(line), "[%5u.%06u] ", timestampUs / 1000000,
+                              timestampUs % 1000000);
+        if (id < EVENT_COUNT) {
+            snprintf(line + length, sizeof(line) - (size_t)length, formats[id], args[0], args[1],
+                     args[2], args[3]);
+        } else {
+            // The RTApp was built with a newer event table than this app.
+            length += snprintf(line + length, sizeof(line) - (size_t)length,
+                               "unknown event %u:", id);
+            for (uint32_t i = 0; i < argCount; ++i) {
+                length += snprintf(line + length, sizeof(line) - (size_t)length, " %08x", args[i]);
+            }
+        }
+        handler(line, context);
+
+        offset += RECORD_HEADER_SIZE + argCount * sizeof(uint32_t);
+    }
+    return TraceFrame_Decoded;
+}
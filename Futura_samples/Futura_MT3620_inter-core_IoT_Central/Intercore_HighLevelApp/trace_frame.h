@@ -0,0 +1,43 @@
+/* Futura MT3620 decoding of binary trace frames from the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stddef.h>
+
+// Frames of the RTApp trace log (logical-trace.h), which FlushTraceToIntercore sends one per
+// message. The definitions must match.
+#define TRACE_FRAME_MAGIC 0xF7
+#define TRACE_FRAME_VERSION 1
+#define TRACE_MAX_ARGS 4
+
+/// <summary>
+/// Result of TraceFrame_Decode.
+/// </summary>
+typedef enum {
+    /// <summary>The message is not a trace frame; handle it as another kind of message.</summary>
+    TraceFrame_NotFrame = 0,
+    /// <summary>Every event of the frame was passed to the handler.</summary>
+    TraceFrame_Decoded = 1,
+    /// <summary>The message starts like a frame but is malformed; nothing was decoded.</summary>
+    TraceFrame_Invalid = 2,
+} TraceFrame_Result;
+
+/// <summary>
+/// Receives one decoded event as a line of text, without a newline.
+/// </summary>
+typedef void (*TraceFrame_LineHandler)(const char *line, void *context);
+
+/// <summary>
+/// Renders the events of a trace frame with the format strings of the RTApp's
+/// trace-events.h, one line per event, prefixed with the GPT3 time of the event in seconds:
+/// "[   12.345678] RTApp started". Events which the table does not know are printed with
+/// their identifier and arguments in hexadecimal.
+/// </summary>
+/// <param name="message">Message payload.</param>
+/// <param name="size">Message size in bytes.</param>
+/// <param name="handler">Function which is called for each event, in order.</param>
+/// <param name="context">Passed to the handler.</param>
+TraceFrame_Result TraceFrame_Decode(const void *message, size_t size,
+                                    TraceFrame_LineHandler handler, void *context);
@@ -0,0 +1,365 @@
+/* Futura MT3620 sensor acquisition on the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "logical-acquisition.h"
+
+#include "logical-dht.h"
+#include "logical-dpc.h"
+#include "logical-timer.h"
+#include "logical-trace.h"
+#include "logical-transfer.h"
+#include "mt3620-baremetal.h"
+#include "mt3620-timer.h"
+
+typedef struct {
+    AcquisitionBatchHeader header;
+    AcquisitionSample samples[ACQUISITION_BATCH_SAMPLES];
+} Batch;
+
+_Static_assert(sizeof(AcquisitionCommand) == 8, "AcquisitionCommand is sent as it is");
+_Static_assert(sizeof(AcquisitionBatchHeader) == 12, "AcquisitionBatchHeader is sent as it is");
+_Static_assert(sizeof(AcquisitionSample) == 8, "AcquisitionSample is sent as it is");
+_Static_assert(__builtin_offsetof(Batch, samples) == sizeof(AcquisitionBatchHeader),
+               "Samples must follow the header");
+_Static_assert(sizeof(Batch) <= INTERCORE_MAX_PAYLOAD_LEN, "A batch must fit in one message");
+
+// Batches waiting to be sent, and the one being filled. When all of them are waiting, new
+// samples are dropped and counted, so that a slow HLApp does not stall sampling.
+#define BATCH_COUNT 4
+_Static_assert((BATCH_COUNT & (BATCH_COUNT - 1)) == 0, "BATCH_COUNT must be a power of two");
+
+// Longest period and latency, so that intervals stay far below the GPT3 wraparound.
+static const uint32_t maxIntervalMs = 3600 * 1000;
+// Delay before batches and windows which did not fit in the outbound buffer are sent again.
+static const uint32_t retryMs = 10;
+
+static void HandleSampleTimerIrq(void);
+static void HandleRetryTimerIrq(void);
+static void SampleDeferred(void);
+
+static IntercoreComm *acquisitionIcc = NULL;
+static ComponentId recipient;
+
+// Configuration, which the DPCs change with interrupts blocked.
+static uint32_t periodsMs[ACQUISITION_CHANNEL_COUNT] = {0};
+static uint32_t latencyMs = 1000;
+static uint32_t tickMs = 0;
+static bool running = false;
+
+// Owned by the timer interrupt. Each channel is due when its count reaches zero.
+static uint32_t remainingMs[ACQUISITION_CHANNEL_COUNT];
+// The channels which the timer interrupt found due, for SampleDeferred to convert.
+static volatile uint32_t dueChannels = 0;
+// Changed by the interrupt and, with interrupts blocked, by the DPCs.
+static volatile uint32_t droppedSamples = 0;
+
+// The rest is owned by the DPCs, SampleDeferred and the commands, which run one at a time in
+// the main loop, so the batches are filled and sent without racing each other.
+static uint32_t sequence = 0;
+static uint32_t fillStartUs = 0;
+
+// Free-running batch indices. The batches from sendIndex up to fillIndex are waiting for
+// SendBatches, which advances sendIndex; SampleDeferred fills batch fillIndex and advances
+// fillIndex when it is complete.
+static Batch batches[BATCH_COUNT];
+static uint32_t fillIndex = 0;
+static uint32_t sendIndex = 0;
+
+// The waveform window. SampleDeferred records the values of windowChannel in windowValues;
+// AcquisitionCommand_SendWindow copies them, oldest first, to windowData, which windowTransfer
+// sends while windowSending is set.
+static uint32_t windowChannel = ACQUISITION_CHANNEL_COUNT; // none
+static uint16_t windowValues[ACQUISITION_WINDOW_SAMPLES];
+static uint32_t windowRecorded = 0; // free-running
+static uint16_t windowData[ACQUISITION_WINDOW_SAMPLES];
+static IntercoreTransfer windowTransfer;
+static bool windowSending = false;
+
+static SoftTimer sampleTimer = {.next = NULL, .running = false, .cb = HandleSampleTimerIrq};
+static SoftTimer retryTimer = {.next = NULL, .running = false, .cb = HandleRetryTimerIrq};
+static CallbackNode sampleNode = {
+    .enqueued = false, .cb = SampleDeferred, .priority = DpcPriority_Normal};
+
+static uint32_t Gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0) {
+        uint32_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+// Hands the batch being filled over to SendBatches.
+static void CompleteBatch(void)
+{
+    Batch *batch = &batches[fillIndex % BATCH_COUNT];
+    batch->header.magic = ACQUISITION_BATCH_MAGIC;
+    batch->header.version = ACQUISITION_BATCH_VERSION;
+    batch->header.sequence = sequence++;
+    batch->header.droppedSamples = droppedSamples;
+    ++fillIndex;
+}
+
+static void AppendSample(uint32_t channel, uint16_t value, uint32_t timestampUs)
+{
+    if (fillIndex - sendIndex == BATCH_COUNT) {
+        uint32_t prevBasePri = BlockIrqs();
+        ++droppedSamples;
+        RestoreIrqs(prevBasePri);
+        return;
+    }
+
+    Batch *batch = &batches[fillIndex % BATCH_COUNT];
+    uint32_t count = batch->header.sampleCount;
+    if (count == 0) {
+        fillStartUs = timestampUs;
+    }
+    batch->samples[count] = (AcquisitionSample){
+        .timestampUs = timestampUs, .value = value, .channel = (uint8_t)channel, .reserved = 0};
+    batch->header.sampleCount = (uint16_t)(count + 1);
+
+    if (count + 1 == ACQUISITION_BATCH_SAMPLES) {
+        CompleteBatch();
+    }
+}
+
+// Runs every tickMs, the greatest common divisor of the channel periods, and finds the
+// channels which are due. The soft timer reloads from its previous expiry, so the sampling
+// instants do not drift. The scan polls the ADC for up to tens of microseconds, or far longer
+// if it stops, so SampleDeferred converts the channels in the main loop. A channel which is
+// due again before the main loop converted it loses the earlier sample, which is counted.
+static void HandleSampleTimerIrq(void)
+{
+    uint32_t dueMask = 0;
+    for (uint32_t channel = 0; channel < ACQUISITION_CHANNEL_COUNT; ++channel) {
+        if (periodsMs[channel] == 0) {
+            continue;
+        }
+        if (remainingMs[channel] == 0) {
+            dueMask |= UINT32_C(1) << channel;
+            remainingMs[channel] = periodsMs[channel];
+        }
+        remainingMs[channel] -= tickMs;
+    }
+
+    droppedSamples += (uint32_t)__builtin_popcount(dueChannels & dueMask);
+    dueChannels |= dueMask;
+    // This also sends a partial batch whose latency has passed.
+    EnqueueDeferredProc(&sampleNode);
+}
+
+static void HandleRetryTimerIrq(void)
+{
+    EnqueueDeferredProc(&sampleNode);
+}
+
+// Sends the waiting batches in one call, so that the HLApp takes one interrupt for all of them.
+static void SendBatches(void)
+{
+    static uint32_t lastFailedSequence = UINT32_MAX;
+
+    IntercoreMessage messages[BATCH_COUNT];
+    uint32_t first = sendIndex;
+    size_t count = fillIndex - first;
+    if (count == 0) {
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        Batch *batch = &batches[(first + i) % BATCH_COUNT];
+        messages[i].data = batch;
+        messages[i].size =
+            sizeof(batch->header) + batch->header.sampleCount * sizeof(AcquisitionSample);
+    }
+
+    size_t sent;
+    IntercoreResult icr = IntercoreSendBatch(acquisitionIcc, &recipient, messages, count, &sent);
+    for (size_t i = 0; i < sent; ++i) {
+        batches[(first + i) % BATCH_COUNT].header.sampleCount = 0;
+        ++sendIndex;
+    }
+
+    if (icr != Intercore_OK) {
+        // The retry timer tries again. Only trace the first failure of a batch.
+        const Batch *batch = &batches[(first + sent) % BATCH_COUNT];
+        if (batch->header.sequence != lastFailedSequence) {
+            lastFailedSequence = batch->header.sequence;
+            TRACE2(TraceAcquisitionSendFailed, batch->header.sequence, icr);
+        }
+    }
+}
+
+// Copies the recorded window to windowData and starts sending it.
+static bool StartWindow(uint32_t channel)
+{
+    if (channel >= ACQUISITION_CHANNEL_COUNT || windowSending) {
+        return false;
+    }
+    if (channel != windowChannel) {
+        windowChannel = channel;
+        windowRecorded = 0;
+    }
+
+    uint32_t count = windowRecorded < ACQUISITION_WINDOW_SAMPLES ? windowRecorded
+                                                                 : ACQUISITION_WINDOW_SAMPLES;
+    for (uint32_t i = 0; i < count; ++i) {
+        windowData[i] = windowValues[(windowRecorded - count + i) % ACQUISITION_WINDOW_SAMPLES];
+    }
+    StartIntercoreTransfer(&windowTransfer, windowData, count * sizeof(windowData[0]));
+    windowSending = true;
+    return true;
+}
+
+// Sends as much of the window as the outbound buffer holds; the retry timer sends the rest.
+static void SendWindow(void)
+{
+    if (windowSending &&
+        ContinueIntercoreTransfer(acquisitionIcc, &recipient, &windowTransfer) == Intercore_OK) {
+        windowSending = false;
+    }
+}
+
+// Hands the partial batch over to SendBatches once its first sample has waited for latencyMs,
+// or at once after a stop, when nothing else will complete it. While earlier batches are
+// still waiting to be sent, it is filled instead, so that the batches hold as many samples
+// as possible until the HLApp catches up.
+static void CompletePartialBatch(uint32_t nowUs)
+{
+    const Batch *batch = &batches[fillIndex % BATCH_COUNT];
+    if (fillIndex == sendIndex && batch->header.sampleCount != 0 &&
+        (!running || nowUs - fillStartUs >= latencyMs * 1000)) {
+        CompleteBatch();
+    }
+}
+
+// Converts the channels which are due in one scan, and sends the complete batches.
+static void SampleDeferred(void)
+{
+    uint32_t prevBasePri = BlockIrqs();
+    uint32_t dueMask = dueChannels;
+    dueChannels = 0;
+    RestoreIrqs(prevBasePri);
+
+    uint32_t nowUs = MT3620_Gpt_GetTimestampUs();
+    if (dueMask != 0) {
+        uint16_t values[ACQUISITION_CHANNEL_COUNT];
+        if (MT3620_Adc_ReadChannels(dueMask, values)) {
+            for (uint32_t channel = 0; channel < ACQUISITION_CHANNEL_COUNT; ++channel) {
+                if ((dueMask & (UINT32_C(1) << channel)) != 0) {
+                    AppendSample(channel, values[channel], nowUs);
+                    if (channel == windowChannel) {
+                        windowValues[windowRecorded++ % ACQUISITION_WINDOW_SAMPLES] =
+                            values[channel];
+                    }
+                }
+            }
+        } else {
+            TRACE1(TraceAcquisitionAdcTimeout, dueMask);
+        }
+    }
+
+    CompletePartialBatch(nowUs);
+    SendBatches();
+    // The partial batch of a stop follows the batches which were waiting.
+    CompletePartialBatch(nowUs);
+    SendBatches();
+    SendWindow();
+    // Retry what did not fit in the outbound buffer, also when the sample timer is stopped or
+    // its ticks are far apart.
+    if (fillIndex != sendIndex || windowSending) {
+        StartSoftTimer(&retryTimer, retryMs, 0);
+    }
+}
+
+// Starts, restarts or stops the sample timer after the configuration has changed. Every
+// channel is converted at the first tick, so the channels keep a common phase. Call with
+// interrupts blocked.
+static void Reschedule(void)
+{
+    tickMs = 0;
+    for (uint32_t channel = 0; channel < ACQUISITION_CHANNEL_COUNT; ++channel) {
+        tickMs = Gcd(tickMs, periodsMs[channel]);
+        remainingMs[channel] = 0;
+    }
+
+    if (running && tickMs != 0) {
+        StartSoftTimer(&sampleTimer, tickMs, tickMs);
+    } else {
+        StopSoftTimer(&sampleTimer);
+    }
+}
+
+void SetupAcquisition(IntercoreComm *icc)
+{
+    acquisitionIcc = icc;
+}
+
+bool HandleAcquisitionCommand(const ComponentId *sender, const void *data, size_t size)
+{
+    if (size == 0 || *(const uint8_t *)data != ACQUISITION_COMMAND_MAGIC) {
+        return false;
+    }
+
+    AcquisitionCommand command;
+    if (size != sizeof(command)) {
+        TRACE2(TraceAcquisitionCommandRejected, 0, size);
+        return true;
+    }
+    __builtin_memcpy(&command, data, sizeof(command));
+
+    bool valid = true;
+    uint32_t prevBasePri = BlockIrqs();
+    switch (command.command) {
+    case AcquisitionCommand_Start:
+        running = true;
+        Reschedule();
+        break;
+
+    case AcquisitionCommand_Stop:
+        // SampleDeferred below sends what was sampled before the stop.
+        running = false;
+        Reschedule();
+        break;
+
+    case AcquisitionCommand_SetPeriod:
+        valid = command.channel < ACQUISITION_CHANNEL_COUNT && command.valueMs <= maxIntervalMs;
+        if (valid) {
+            periodsMs[command.channel] = command.valueMs;
+            Reschedule();
+        }
+        break;
+
+    case AcquisitionCommand_SetLatency:
+        valid = command.valueMs <= maxIntervalMs;
+        if (valid) {
+            latencyMs = command.valueMs;
+        }
+        break;
+
+    case AcquisitionCommand_SetDhtPeriod:
+        valid = command.valueMs <= maxIntervalMs && SetDhtPeriod(sender, command.valueMs);
+        break;
+
+    case AcquisitionCommand_SendWindow:
+        valid = StartWindow(command.channel);
+        break;
+
+    default:
+        valid = false;
+        break;
+    }
+    if (valid) {
+        recipient = *sender;
+    }
+    RestoreIrqs(prevBasePri);
+
+    if (!valid) {
+        TRACE2(TraceAcquisitionCommandRejected, command.command, size);
+        return true;
+    }
+
+    TRACE3(TraceAcquisitionCommand, command.command, command.channel, command.valueMs);
+    SampleDeferred();
+    return true;
+}
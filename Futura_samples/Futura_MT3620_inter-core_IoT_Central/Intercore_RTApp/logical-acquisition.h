@@ -0,0 +1,119 @@
+/* Futura MT3620 sensor acquisition on the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "logical-intercore.h"
+#include "mt3620-adc.h"
+
+// The HLApp controls acquisition with commands, and receives the samples in batches. Both are
+// intercore messages, little-endian, which start with a magic byte that differs from the
+// other message types (fragments, trace frames). The HLApp has its own definitions of these
+// formats, in acquisition.h; both must match.
+
+/// <summary>First byte of an <see cref="AcquisitionCommand" />.</summary>
+#define ACQUISITION_COMMAND_MAGIC 0xF8
+/// <summary>First byte of an <see cref="AcquisitionBatchHeader" />.</summary>
+#define ACQUISITION_BATCH_MAGIC 0xF9
+/// <summary>Format version, the second byte of a batch.</summary>
+#define ACQUISITION_BATCH_VERSION 1
+
+/// <summary>Number of channels which can be sampled. Channel n is ADC channel n.</summary>
+#define ACQUISITION_CHANNEL_COUNT MT3620_ADC_CHANNEL_COUNT
+/// <summary>Most samples in a batch.</summary>
+#define ACQUISITION_BATCH_SAMPLES 64
+/// <summary>
+///     Values in a waveform window, 4 KB, which is sent as a transfer of several messages.
+///     See <see cref="AcquisitionCommand_SendWindow" />.
+/// </summary>
+#define ACQUISITION_WINDOW_SAMPLES 2048
+
+/// <summary>Command codes of <see cref="AcquisitionCommand" />.</summary>
+typedef enum {
+    /// <summary>Starts sampling the channels which have a period.</summary>
+    AcquisitionCommand_Start = 1,
+    /// <summary>Stops sampling, and sends the samples which are waiting.</summary>
+    AcquisitionCommand_Stop = 2,
+    /// <summary>Sets the period of channel in milliseconds; 0 stops sampling it.</summary>
+    AcquisitionCommand_SetPeriod = 3,
+    /// <summary>
+    ///     Sets the longest time in milliseconds that a sample waits for its batch to be
+    ///     sent. A batch is also sent when it is full.
+    /// </summary>
+    AcquisitionCommand_SetLatency = 4,
+    /// <summary>
+    ///     Sets the time in milliseconds between DHT22 readings; 0 stops reading. See
+    ///     <see cref="SetDhtPeriod" />.
+    /// </summary>
+    AcquisitionCommand_SetDhtPeriod = 5,
+    /// <summary>
+    ///     Sends the last <see cref="ACQUISITION_WINDOW_SAMPLES" /> raw values of channel,
+    ///     oldest first, as one intercore transfer (logical-transfer.h) of little-endian 16-bit
+    ///     values. The values of one channel are kept; the first command for a channel starts
+    ///     recording it, so its window is empty. Rejected while a window is being sent.
+    /// </summary>
+    AcquisitionCommand_SendWindow = 6
+} AcquisitionCommandCode;
+
+/// <summary>Command from the HLApp.</summary>
+typedef struct {
+    /// <summary>Always <see cref="ACQUISITION_COMMAND_MAGIC" />.</summary>
+    uint8_t magic;
+    /// <summary>An <see cref="AcquisitionCommandCode" />.</summary>
+    uint8_t command;
+    /// <summary>Channel, for <see cref="AcquisitionCommand_SetPeriod" />.</summary>
+    uint8_t channel;
+    /// <summary>Zero.</summary>
+    uint8_t reserved;
+    /// <summary>Argument in milliseconds, where the command takes one.</summary>
+    uint32_t valueMs;
+} AcquisitionCommand;
+
+/// <summary>Start of a batch of samples, which are <see cref="AcquisitionSample" />.</summary>
+typedef struct {
+    /// <summary>Always <see cref="ACQUISITION_BATCH_MAGIC" />.</summary>
+    uint8_t magic;
+    /// <summary>Always <see cref="ACQUISITION_BATCH_VERSION" />.</summary>
+    uint8_t version;
+    /// <summary>Number of samples which follow.</summary>
+    uint16_t sampleCount;
+    /// <summary>Incremented for each batch, so the HLApp can detect lost batches.</summary>
+    uint32_t sequence;
+    /// <summary>Samples dropped since startup because no batch was free.</summary>
+    uint32_t droppedSamples;
+} AcquisitionBatchHeader;
+
+/// <summary>One conversion of one channel.</summary>
+typedef struct {
+    /// <summary>GPT3 time of the scan which produced the sample, in microseconds.</summary>
+    uint32_t timestampUs;
+    /// <summary>Raw 12-bit value.</summary>
+    uint16_t value;
+    /// <summary>Channel which was converted.</summary>
+    uint8_t channel;
+    /// <summary>Zero.</summary>
+    uint8_t reserved;
+} AcquisitionSample;
+
+/// <summary>
+///     Prepares the acquisition engine. A <see cref="SoftTimer" /> schedules the samples,
+///     so call <see cref="SetupSoftTimers" /> first, and a DPC converts them.
+///     Nothing is sampled until the HLApp sends <see cref="AcquisitionCommand_Start" />.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+void SetupAcquisition(IntercoreComm *icc);
+
+/// <summary>
+///     Applies a message from the HLApp if it is an <see cref="AcquisitionCommand" />.
+///     Batches are then sent to the sender of the command. Call this from DPC context.
+/// </summary>
+/// <param name="sender">Component ID of the HLApp which sent the message.</param>
+/// <param name="data">Message payload.</param>
+/// <param name="size">Payload size in bytes.</param>
+/// <returns>false if the message is not a command, which the caller should then handle.</returns>
+bool HandleAcquisitionCommand(const ComponentId *sender, const void *data, size_t size);
@@ -0,0 +1,230 @@
+/* Futura MT3620 DHT22 temperature and humidity sensor on the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "logical-dht.h"
+
+#include "logical-dpc.h"
+#include "logical-timer.h"
+#include "logical-trace.h"
+#include "mt3620-baremetal.h"
+#include "mt3620-gpio.h"
+#include "mt3620-timer.h"
+
+_Static_assert(sizeof(DhtReadingMessage) == 32, "DhtReadingMessage is sent as it is");
+
+// Start pulse. The DHT22 needs at least 1ms; the timer resolution is 1ms, so ask for 2ms.
+static const uint32_t startLowMs = 2;
+
+// Pulse widths in microseconds. The sensor answers with 80us low and 80us high, then sends each
+// bit as 50us low followed by 26-28us high for 0 or 70us high for 1. The limits allow for the
+// tolerance of the sensor and for the sampling of the line.
+static const uint32_t responseMinUs = 50;
+static const uint32_t responseMaxUs = 120;
+static const uint32_t bitLowMinUs = 25;
+static const uint32_t bitLowMaxUs = 95;
+static const uint32_t bitHighMinUs = 10;
+static const uint32_t bitHighMaxUs = 100;
+static const uint32_t oneThresholdUs = 48;
+
+// The sensor answers 20-40us after the line is released, and each edge follows the previous one
+// within 100us. Sampling stops when the line has been still for longer than this.
+static const uint32_t edgeTimeoutUs = 250;
+
+// Longest time between two samples of the line. Edges are timed to within this, which is far
+// below the 20us margin around oneThresholdUs, and no pulse can be missed.
+static const uint32_t maxSampleGapUs = 12;
+
+// Edges which precede the bits: the response low and high, and the fall which starts bit 0.
+#define RESPONSE_EDGES 3
+#define DATA_BITS 40
+
+static void HandleDhtTimerIrq(void);
+static void ReadDhtDeferred(void);
+
+static IntercoreComm *dhtIcc = NULL;
+static ComponentId recipient;
+static uint32_t dhtGpio = 0;
+static uint32_t periodMs = 0;
+static bool startPulse = false;
+
+static SoftTimer dhtTimer = {.next = NULL, .running = false, .cb = HandleDhtTimerIrq};
+// Sampling starts when the line is released, and must not wait behind other DPCs longer than
+// the start pulse tolerates, so this runs first.
+static CallbackNode readNode = {
+    .enqueued = false, .cb = ReadDhtDeferred, .priority = DpcPriority_High};
+
+static uint8_t attempts = 0;
+static uint32_t statusCounts[DHT_STATUS_COUNT] = {0};
+
+static bool InRange(uint32_t value, uint32_t min, uint32_t max)
+{
+    return value >= min && value <= max;
+}
+
+DhtStatus DecodeDhtEdges(const DhtEdge *edges, size_t count, uint8_t *data)
+{
+    if (count < RESPONSE_EDGES) {
+        return DhtStatus_NoResponse;
+    }
+    if (edges[0].high || !edges[1].high || edges[2].high ||
+        !InRange(edges[1].timeUs - edges[0].timeUs, responseMinUs, responseMaxUs) ||
+        !InRange(edges[2].timeUs - edges[1].timeUs, responseMinUs, responseMaxUs)) {
+        return DhtStatus_BadTiming;
+    }
+    if (count < RESPONSE_EDGES + 2 * DATA_BITS) {
+        return DhtStatus_BadTiming;
+    }
+
+    for (size_t i = 0; i < 5; ++i) {
+        data[i] = 0;
+    }
+
+    // Edges alternate, so each bit is a rise followed by a fall.
+    uint32_t fallUs = edges[RESPONSE_EDGES - 1].timeUs;
+    for (size_t bit = 0; bit < DATA_BITS; ++bit) {
+        const DhtEdge *rise = &edges[RESPONSE_EDGES + 2 * bit];
+        const DhtEdge *fall = rise + 1;
+        uint32_t lowUs = rise->timeUs - fallUs;
+        uint32_t highUs = fall->timeUs - rise->timeUs;
+        if (!InRange(lowUs, bitLowMinUs, bitLowMaxUs) ||
+            !InRange(highUs, bitHighMinUs, bitHighMaxUs)) {
+            return DhtStatus_BadTiming;
+        }
+
+        data[bit / 8] = (uint8_t)(data[bit / 8] << 1);
+        if (highUs > oneThresholdUs) {
+            data[bit / 8] |= 1;
+        }
+        fallUs = fall->timeUs;
+    }
+
+    uint8_t sum = (uint8_t)(data[0] + data[1] + data[2] + data[3]);
+    return sum == data[4] ? DhtStatus_Ok : DhtStatus_Checksum;
+}
+
+// Releases the line and records its edges until the transfer ends.
+static DhtStatus CaptureEdges(DhtEdge *edges, size_t *count, uint32_t *startUs)
+{
+    MT3620_Gpio_ConfigureInput(dhtGpio);
+    uint32_t releaseUs = MT3620_Gpt_GetTimestampUs();
+    uint32_t lastSampleUs = releaseUs;
+    uint32_t lastEdgeUs = releaseUs;
+    bool level = false;
+
+    *startUs = releaseUs;
+    *count = 0;
+    while (*count < DHT_MAX_EDGES) {
+        uint32_t nowUs = MT3620_Gpt_GetTimestampUs();
+        bool high = MT3620_Gpio_Read(dhtGpio);
+
+        if (nowUs - lastSampleUs > maxSampleGapUs) {
+            return DhtStatus_Interrupted;
+        }
+        lastSampleUs = nowUs;
+
+        if (high != level) {
+            // The pull-up takes a moment to raise the line after it is released.
+            if (*count > 0 || !high) {
+                edges[*count] = (DhtEdge){.timeUs = nowUs - releaseUs, .high = high};
+                ++*count;
+            }
+            level = high;
+            lastEdgeUs = nowUs;
+        } else if (nowUs - lastEdgeUs > edgeTimeoutUs) {
+            break;
+        }
+    }
+    return DhtStatus_Ok;
+}
+
+static void SendReading(DhtStatus status, const uint8_t *data, uint32_t startUs)
+{
+    DhtReadingMessage message = {
+        .magic = DHT_READING_MAGIC, .status = (uint8_t)status, .attempts = attempts,
+        .reserved = 0, .temperatureTenths = 0, .humidityTenths = 0, .timestampUs = startUs};
+    if (status == DhtStatus_Ok) {
+        message.humidityTenths = (uint16_t)((data[0] << 8) | data[1]);
+        int16_t magnitude = (int16_t)(((data[2] & 0x7F) << 8) | data[3]);
+        message.temperatureTenths = (data[2] & 0x80) != 0 ? (int16_t)-magnitude : magnitude;
+    }
+    __builtin_memcpy(message.statusCounts, statusCounts, sizeof(message.statusCounts));
+
+    IntercoreResult icr = IntercoreSend(dhtIcc, &recipient, &message, sizeof(message));
+    if (icr != Intercore_OK) {
+        TRACE1(TraceIntercoreSendFailed, icr);
+    }
+}
+
+static void ReadDhtDeferred(void)
+{
+    DhtEdge edges[DHT_MAX_EDGES];
+    size_t count;
+    uint32_t startUs;
+    uint8_t data[5] = {0};
+
+    DhtStatus status = CaptureEdges(edges, &count, &startUs);
+    if (status == DhtStatus_Ok) {
+        status = DecodeDhtEdges(edges, count, data);
+    }
+
+    if (attempts < UINT8_MAX) {
+        ++attempts;
+    }
+    ++statusCounts[status];
+    if (status != DhtStatus_Ok) {
+        TRACE2(TraceDhtReadFailed, status, count);
+    }
+    SendReading(status, data, startUs);
+    if (status == DhtStatus_Ok) {
+        attempts = 0;
+    }
+
+    // The start pulse is part of the interval.
+    uint32_t prevBasePri = BlockIrqs();
+    if (periodMs != 0) {
+        uint32_t delayMs = status == DhtStatus_Ok ? periodMs : DHT_MIN_INTERVAL_MS;
+        StartSoftTimer(&dhtTimer, delayMs - startLowMs, 0);
+    }
+    RestoreIrqs(prevBasePri);
+}
+
+// Drives the start pulse, then hands over to ReadDhtDeferred when it has lasted long enough.
+static void HandleDhtTimerIrq(void)
+{
+    if (!startPulse) {
+        MT3620_Gpio_ConfigureOutput(dhtGpio, false);
+        startPulse = true;
+        StartSoftTimer(&dhtTimer, startLowMs, 0);
+    } else {
+        startPulse = false;
+        EnqueueDeferredProc(&readNode);
+    }
+}
+
+void SetupDht(IntercoreComm *icc, uint32_t gpio)
+{
+    dhtIcc = icc;
+    dhtGpio = gpio;
+    MT3620_Gpio_ConfigureInput(gpio);
+}
+
+bool SetDhtPeriod(const ComponentId *newRecipient, uint32_t newPeriodMs)
+{
+    if (newPeriodMs != 0 && newPeriodMs < DHT_MIN_INTERVAL_MS) {
+        return false;
+    }
+
+    uint32_t prevBasePri = BlockIrqs();
+    recipient = *newRecipient;
+    bool wasReading = periodMs != 0;
+    periodMs = newPeriodMs;
+    // A read in progress schedules the next one itself.
+    if (periodMs != 0 && !wasReading && !startPulse && !readNode.enqueued) {
+        StartSoftTimer(&dhtTimer, DHT_MIN_INTERVAL_MS, 0);
+    } else if (periodMs == 0 && !startPulse) {
+        StopSoftTimer(&dhtTimer);
+    }
+    RestoreIrqs(prevBasePri);
+    return true;
+}
@@ -0,0 +1,111 @@
+/* Futura MT3620 DHT22 temperature and humidity sensor on the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "logical-intercore.h"
+
+// Every read is reported to the HLApp in a DhtReadingMessage. The HLApp has its own
+// definition of this format, in acquisition.h; both must match.
+
+/// <summary>First byte of a <see cref="DhtReadingMessage" />.</summary>
+#define DHT_READING_MAGIC 0xFA
+
+/// <summary>The sensor needs this long between two reads, including failed ones.</summary>
+#define DHT_MIN_INTERVAL_MS 2000
+
+/// <summary>Outcome of a read.</summary>
+typedef enum {
+    /// <summary>The reading is valid.</summary>
+    DhtStatus_Ok = 0,
+    /// <summary>The sensor did not answer the start pulse.</summary>
+    DhtStatus_NoResponse = 1,
+    /// <summary>A pulse was too short or too long, or the transfer ended early.</summary>
+    DhtStatus_BadTiming = 2,
+    /// <summary>All 40 bits were received, but the checksum does not match.</summary>
+    DhtStatus_Checksum = 3,
+    /// <summary>An interrupt delayed the sampling of the line too much to time the edges.</summary>
+    DhtStatus_Interrupted = 4
+} DhtStatus;
+
+/// <summary>Number of <see cref="DhtStatus" /> values.</summary>
+#define DHT_STATUS_COUNT 5
+
+/// <summary>Result of a read, sent to the HLApp after each attempt.</summary>
+typedef struct {
+    /// <summary>Always <see cref="DHT_READING_MAGIC" />.</summary>
+    uint8_t magic;
+    /// <summary>A <see cref="DhtStatus" />.</summary>
+    uint8_t status;
+    /// <summary>Attempts since the previous valid reading, including this one; at most 255.</summary>
+    uint8_t attempts;
+    /// <summary>Zero.</summary>
+    uint8_t reserved;
+    /// <summary>Temperature in tenths of a degree Celsius; 0 unless the reading is valid.</summary>
+    int16_t temperatureTenths;
+    /// <summary>Relative humidity in tenths of a percent; 0 unless the reading is valid.</summary>
+    uint16_t humidityTenths;
+    /// <summary>GPT3 time of the start of the transfer, in microseconds.</summary>
+    uint32_t timestampUs;
+    /// <summary>Reads since startup, indexed by <see cref="DhtStatus" />.</summary>
+    uint32_t statusCounts[DHT_STATUS_COUNT];
+} DhtReadingMessage;
+
+/// <summary>Edge on the data line, which the decoder turns into bits.</summary>
+typedef struct {
+    /// <summary>Time since the line was released, in microseconds.</summary>
+    uint32_t timeUs;
+    /// <summary>Level after the edge.</summary>
+    bool high;
+} DhtEdge;
+
+/// <summary>
+///     Most edges in a transfer: the response (falling, rising, falling), two for each of the
+///     40 bits, and the release of the line.
+/// </summary>
+#define DHT_MAX_EDGES 84
+
+/// <summary>
+///     Prepares to read a DHT22 on the supplied GPIO, which needs a pull-up. Reads use a
+///     <see cref="SoftTimer" />, so call <see cref="SetupSoftTimers" /> first. Nothing is read
+///     until <see cref="SetDhtPeriod" /> is called.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="gpio">GPIO of the data line; see <see cref="MT3620_GPIO_COUNT" />.</param>
+void SetupDht(IntercoreComm *icc, uint32_t gpio);
+
+/// <summary>
+///     <para>
+///         Starts or stops periodic reads. After a failed read the next attempt comes after
+///         <see cref="DHT_MIN_INTERVAL_MS" />, rather than after a full period.
+///     </para>
+///     <para>
+///         Each read holds the line low for a few milliseconds from a timer, then samples it
+///         in DPC context for about 5ms, timing the edges with GPT3. Interrupts stay enabled;
+///         one which delays sampling ends the read as <see cref="DhtStatus_Interrupted" />.
+///     </para>
+/// </summary>
+/// <param name="recipient">HLApp which receives the readings.</param>
+/// <param name="periodMs">
+///     Time between valid readings in milliseconds, at least <see cref="DHT_MIN_INTERVAL_MS" />,
+///     or 0 to stop.
+/// </param>
+/// <returns>false if the period is too short.</returns>
+bool SetDhtPeriod(const ComponentId *recipient, uint32_t periodMs);
+
+/// <summary>
+///     Decodes the edges of a transfer. This does not touch the hardware, so it can be
+///     exercised with recorded or synthesized edges.
+/// </summary>
+/// <param name="edges">Edges after the line was released, in order.</param>
+/// <param name="count">Number of edges.</param>
+/// <param name="data">Set to the five bytes of the transfer, if all of them were received.</param>
+/// <returns>
+///     <see cref="DhtStatus_Ok" /> if the checksum matches; otherwise the failure.
+/// </returns>
+DhtStatus DecodeDhtEdges(const DhtEdge *edges, size_t count, uint8_t *data);
@@ -3,16 +3,29 @@
 
 #include "logical-dpc.h"
 
-static CallbackNode *volatile callbacks = NULL;
+#include "mt3620-timer.h"
+
+// One FIFO list per priority. A node is appended at the tail and removed from the head, and
+// readyLevels has bit n set when list n is not empty, so both ends are O(1).
+static CallbackNode *volatile heads[DPC_PRIORITY_COUNT] = {NULL};
+static CallbackNode *volatile tails[DPC_PRIORITY_COUNT] = {NULL};
+static volatile uint32_t readyLevels = 0;
 
 void EnqueueDeferredProc(CallbackNode *node)
 {
     uint32_t prevBasePri = BlockIrqs();
     if (!node->enqueued) {
-        CallbackNode *prevHead = callbacks;
+        DpcPriority priority = node->priority;
         node->enqueued = true;
-        callbacks = node;
-        node->next = prevHead;
+        node->next = NULL;
+        node->enqueuedUs = MT3620_Gpt_GetTimestampUs();
+        if (heads[priority] == NULL) {
+            heads[priority] = node;
+        } else {
+            tails[priority]->next = node;
+        }
+        tails[priority] = node;
+        readyLevels |= UINT32_C(1) << priority;
     }
     RestoreIrqs(prevBasePri);
 }
@@ -21,15 +34,30 @@ void InvokeDeferredProcs(void)
 {
     CallbackNode *node;
     do {
+        node = NULL;
+        uint32_t enqueuedUs = 0;
         uint32_t prevBasePri = BlockIrqs();
-        node = callbacks;
-        if (node) {
+        if (readyLevels != 0) {
+            // The highest priority level with a pending node.
+            int priority = 31 - __builtin_clz(readyLevels);
+            node = heads[priority];
             node->enqueued = false;
-            callbacks = node->next;
+            // Read before an interrupt can enqueue the node again.
+            enqueuedUs = node->enqueuedUs;
+            heads[priority] = node->next;
+            if (heads[priority] == NULL) {
+                tails[priority] = NULL;
+                readyLevels &= ~(UINT32_C(1) << priority);
+            }
         }
         RestoreIrqs(prevBasePri);
 
         if (node) {
+            uint32_t latencyUs = MT3620_Gpt_GetTimestampUs() - enqueuedUs;
+            if (latencyUs > node->maxLatencyUs) {
+                node->maxLatencyUs = latencyUs;
+            }
+            ++node->runCount;
             (*node->cb)();
         }
     } while (node);
@@ -4,9 +4,27 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "mt3620-baremetal.h"
 
+/// <summary>
+///     Order in which enqueued DPCs are run by <see cref="InvokeDeferredProcs" />. A DPC
+///     of higher priority runs before any DPC of lower priority; DPCs of equal priority
+///     run in the order in which they were enqueued.
+/// </summary>
+typedef enum {
+    /// <summary>Default for a zero-initialized node.</summary>
+    DpcPriority_Low = 0,
+    /// <summary>For example, periodic work scheduled from a timer.</summary>
+    DpcPriority_Normal = 1,
+    /// <summary>For example, draining the mailbox, which must not wait behind timers.</summary>
+    DpcPriority_High = 2
+} DpcPriority;
+
+/// <summary>Number of <see cref="DpcPriority" /> levels.</summary>
+#define DPC_PRIORITY_COUNT 3
+
 /// <summary>
 ///     <para>
 ///         This node is used to build a linked list of deferred procedure calls (DPCs)
@@ -25,12 +43,24 @@ typedef struct CallbackNode {
     ///     the processor leaves interrupt context.
     /// </summary>
     Callback cb;
+    /// <summary>Initialize to the priority of the DPC.</summary>
+    DpcPriority priority;
+    /// <summary>Internal use. GPT timestamp of the last enqueue, in microseconds.</summary>
+    uint32_t enqueuedUs;
+    /// <summary>Number of times the DPC has run. The application may reset it.</summary>
+    uint32_t runCount;
+    /// <summary>
+    ///     Longest time in microseconds between enqueueing the DPC and running it.
+    ///     The application may reset it.
+    /// </summary>
+    uint32_t maxLatencyUs;
 } CallbackNode;
 
 /// <summary>
 ///     This function should be called from an interrupt service routine.
 ///     It schedules a function to be run when the core leaves IRQ context.
-///     The callbacks will be run by <see cref="InvokeDeferredProcs" />.
+///     The callbacks will be run by <see cref="InvokeDeferredProcs" />. A node which
+///     is already enqueued is not enqueued again.
 /// </summary>
 /// <param name="node">
 ///     Contains function to schedule. This object must exist until the deferred
@@ -42,6 +72,7 @@ void EnqueueDeferredProc(CallbackNode *node);
 ///     Runs any DPCs which have been scheduled with <see cref="EnqueueDeferredProc" />.
 ///     The RTApp will typically set up its resources and then go into a loop
 ///     which waits for an interrupt, and then calls this function to schedule
-///     enqueued DPCs.
+///     enqueued DPCs. The highest-priority DPC is chosen again after each one runs,
+///     so a DPC enqueued by an interrupt meanwhile does not wait for lower-priority ones.
 /// </summary>
 void InvokeDeferredProcs(void);
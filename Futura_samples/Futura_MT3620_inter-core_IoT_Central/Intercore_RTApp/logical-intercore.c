@@ -4,89 +4,26 @@
 #include <stdbool.h>
 
 #include "logical-intercore.h"
+#include "logical-ringbuffer.h"
 
 #include "mt3620-baremetal.h"
 #include "mt3620-intercore.h"
+#include "mt3620-timer.h"
 
-/// <summary>
-///     The inbound and outbound buffers track how much data has been written
-///     written to, and read from, each shared buffer.
-/// </summary>
-struct BufferHeaderImpl {
-    /// <summary>
-    ///     <para>
-    ///         <see cref="IntercoreSend" /> uses this value to store the last position written to
-    ///         by the real-time capable application.
-    ///     </para>
-    ///     <para>
-    ///         <see cref="IntercoreRecv" /> uses this value to find the last position
-    ///         written to by the high-level application.
-    ///     </para>
-    /// </summary>
-    uint32_t writePosition;
-    /// <summary>
-    ///     <para>
-    ///         <see cref="IntercoreSend" /> uses this value to find the last position read from by
-    ///         the high-level application.
-    ///     </para>
-    ///     <para>
-    ///         <see cref="IntercoreRecv" /> uses this value to store the last position read from by
-    ///         the real-time capable application.
-    ///     </para>
-    /// </summary>
-    uint32_t readPosition;
-    /// <summary>Align up to 64 bytes, to match high-level L2 cache line.</summary>
-    uint32_t reserved[14];
-};
-
-static uint32_t GetBufferSize(uint32_t bufferBase);
 static BufferHeader *GetBufferHeader(uint32_t bufferBase);
 
-static uint8_t *DataAreaOffset8(BufferHeader *header, uint32_t offset);
-static uint32_t RoundUp(uint32_t value, uint32_t alignment);
+static void NotifyMessagesSent(IntercoreComm *icc, uint32_t count);
+static void SignalWaitingMessages(IntercoreComm *icc);
+static void HandleCoalesceTimerIrq(void);
 
-static uint32_t ReadInboundCircular(const IntercoreComm *icc, uint32_t startPos, void *dest,
-                                    size_t len);
-static uint32_t WriteOutboundCircular(const IntercoreComm *icc, uint32_t startPos, const void *src,
-                                      size_t size);
-
-// If intercore debugging is enabled and the application detects a corrupt buffer,
-// it will spin forever in the Assert function. The user can then use a debugger
-// to see the type of corruption was detected.
-
-#define DEBUG_INTERCORE
-#ifdef DEBUG_INTERCORE
-
-static void Assert(bool cond)
-{
-    if (cond) {
-        return;
-    }
-
-    for (;;) {
-        // empty.
-    }
-}
-
-#define INTERCORE_ASSERT(c) Assert(c)
-
-#else
-
-#define INTERCORE_ASSERT(c)
-
-#endif
-
-// The buffer size is encoded as a power of two in the bottom five bits.
-static uint32_t GetBufferSize(uint32_t bufferBase)
-{
-    return (UINT32_C(1) << (bufferBase & 0x1F));
-}
+// GPT callbacks take no argument, so the coalescing timer finds its handle here.
+static IntercoreComm *coalescingIcc = NULL;
 
 // The buffer header is a pointer is a 32-byte aligned pointer which is
 // stored in the top 27 bits.
 static BufferHeader *GetBufferHeader(uint32_t bufferBase)
 {
-    return (BufferHeader *)(bufferBase & ~0x1F);
+    return (BufferHeader *)(uintptr_t)(bufferBase & ~0x1F);
 }
 
 IntercoreResult SetupIntercoreComm(IntercoreComm *icc, Callback recvCallback)
@@ -94,245 +31,275 @@ IntercoreResult SetupIntercoreComm(IntercoreComm *icc, Callback recvCallback)
     uint32_t inboundBase, outboundBase;
     MT3620_SetupIntercoreComm(&inboundBase, &outboundBase, recvCallback);
 
-    uint32_t totalInboundBufSize = GetBufferSize(inboundBase);
-    uint32_t totalOutboundBufSize = GetBufferSize(outboundBase);
+    BufferHeader *inbound = GetBufferHeader(inboundBase);
+    BufferHeader *outbound = GetBufferHeader(outboundBase);
 
-    INTERCORE_ASSERT(totalInboundBufSize > sizeof(BufferHeader));
-    INTERCORE_ASSERT(totalOutboundBufSize > sizeof(BufferHeader));
+    // Each core stores its read position in the header of the buffer it sends on.
+    InitRingBuffer(&icc->inbound, inbound, GetRingBufferSize(inboundBase),
+                   &inbound->writePosition, &outbound->readPosition);
+    InitRingBuffer(&icc->outbound, outbound, GetRingBufferSize(outboundBase),
+                   &outbound->writePosition, &inbound->readPosition);
 
-    // Reduce buffer sizes to exclude headers.
-    icc->inboundBufSize = totalInboundBufSize - sizeof(BufferHeader);
-    icc->outboundBufSize = totalOutboundBufSize - sizeof(BufferHeader);
-
-    icc->inbound = GetBufferHeader(inboundBase);
-    icc->outbound = GetBufferHeader(outboundBase);
+    icc->reservedPayload = NULL;
+    icc->peekPending = false;
+    icc->coalesceMaxMessages = 0;
+    icc->unsignalledMessages = 0;
 
     return Intercore_OK;
 }
 
-// Converts offset into shared buffer into a memory pointer.
-static uint8_t *DataAreaOffset8(BufferHeader *header, uint32_t offset)
+IntercoreResult IntercorePeek(IntercoreComm *icc, ComponentId *srcAppId, const void **data,
+                              size_t *size)
 {
-    // Data storage area following header in buffer.
-    uint8_t *dataStart = (uint8_t *)(header + 1);
+    // Don't read message content until have seen that remote write position has been updated.
+    // Corresponding release occurs on high-level core.
+    uint32_t remoteWritePosition = AcquireRingWritePosition(&icc->inbound);
+    // Last position read from by this RTApp.
+    uint32_t localReadPosition = *icc->inbound.readPosition;
+
+    uint32_t position, senderPayloadSize;
+    if (!ReadRingBlockHeader(&icc->inbound, localReadPosition, remoteWritePosition, srcAppId,
+                             &position, &senderPayloadSize)) {
+        return Intercore_Recv_NoBlockSize;
+    }
+
+    // The payload is used in place unless it wraps around the end of the buffer.
+    if (position + senderPayloadSize <= icc->inbound.size) {
+        *data = GetRingData(&icc->inbound, position);
+        position += senderPayloadSize;
+    } else {
+        if (senderPayloadSize > sizeof(icc->recvWrap)) {
+            return Intercore_Recv_BufferTooSmall;
+        }
+        *data = icc->recvWrap;
+        position = ReadRingCircular(&icc->inbound, position, icc->recvWrap, senderPayloadSize);
+    }
+    *size = senderPayloadSize;
 
-    // Offset within data storage area.
-    return dataStart + offset;
+    icc->peekedEnd = NextRingBlockPosition(&icc->inbound, position);
+    icc->peekPending = true;
+
+    return Intercore_OK;
 }
 
-static uint32_t RoundUp(uint32_t value, uint32_t alignment)
+void IntercoreRelease(IntercoreComm *icc)
 {
-    // alignment must be a power of two.
-    return (value + (alignment - 1)) & ~(alignment - 1);
+    if (!icc->peekPending) {
+        return;
+    }
+    icc->peekPending = false;
+
+    // Corresponding acquire occurs on high-level core.
+    PublishRingReadPosition(&icc->inbound, icc->peekedEnd);
+
+    MT3620_SignalHLCoreMessageReceived();
 }
 
-// Helper function for IntercoreRecv. Reads data from the inbound buffer,
-// and wraps around to start of buffer if required. Returns updated read position.
-static uint32_t ReadInboundCircular(const IntercoreComm *icc, uint32_t startPos, void *dest,
-                                    size_t size)
+IntercoreResult IntercoreRecv(IntercoreComm *icc, ComponentId *srcAppId, void *dest, size_t *size)
 {
-    uint32_t availToEnd = icc->inboundBufSize - startPos;
+    ComponentId sender;
+    const void *payload;
+    size_t payloadSize;
+    IntercoreResult icr = IntercorePeek(icc, &sender, &payload, &payloadSize);
+    if (icr != Intercore_OK) {
+        return icr;
+    }
 
-    uint32_t readFromEnd = size;
-    // If the available data wraps around the end of the buffer then only read
-    // availToEnd bytes before subsequently reading from the start of the buffer.
-    if (size > availToEnd) {
-        readFromEnd = availToEnd;
+    // The caller-supplied buffer must be large enough to contain the payload. If not, the
+    // message is left in the buffer.
+    if (payloadSize > *size) {
+        icc->peekPending = false;
+        return Intercore_Recv_BufferTooSmall;
     }
 
-    uint8_t *dest8 = (uint8_t *)dest;
-    const uint8_t *src8 = DataAreaOffset8(icc->inbound, startPos);
-    __builtin_memcpy(dest, src8, readFromEnd);
+    *srcAppId = sender;
+    __builtin_memcpy(dest, payload, payloadSize);
+    *size = payloadSize;
 
-    // If block wrapped around the end of the buffer, then read remainder from start.
-    __builtin_memcpy(dest8 + readFromEnd, DataAreaOffset8(icc->inbound, 0), size - readFromEnd);
+    IntercoreRelease(icc);
 
-    uint32_t finalPos = startPos + size;
-    if (finalPos > icc->inboundBufSize) {
-        finalPos -= icc->inboundBufSize;
+    return Intercore_OK;
+}
+
+// Raises the mailbox interrupt for messages which have been published, or defers it according
+// to IntercoreSetSendCoalescing.
+static void NotifyMessagesSent(IntercoreComm *icc, uint32_t count)
+{
+    if (icc->coalesceMaxMessages <= 1) {
+        MT3620_SignalHLCoreMessageSent();
+        return;
+    }
+
+    // The coalescing timer callback runs in interrupt context.
+    uint32_t prevBasePri = BlockIrqs();
+    bool first = (icc->unsignalledMessages == 0);
+    icc->unsignalledMessages += count;
+    if (icc->unsignalledMessages >= icc->coalesceMaxMessages) {
+        SignalWaitingMessages(icc);
+    } else if (first) {
+        MT3620_Gpt_LaunchTimerMs(icc->coalesceTimer, icc->coalesceMaxDelayMs,
+                                 HandleCoalesceTimerIrq);
     }
-    return finalPos;
+    RestoreIrqs(prevBasePri);
 }
 
-IntercoreResult IntercoreRecv(IntercoreComm *icc, ComponentId *srcAppId, void *dest, size_t *size)
+// Raises the mailbox interrupt for the messages which were waiting for it, and cancels the
+// coalescing timer, so that it does not interrupt for nothing, or signal the next message early
+// if it has already expired. Call with interrupts blocked.
+static void SignalWaitingMessages(IntercoreComm *icc)
 {
-    // Don't read message content until have seen that remote write position has been updated.
-    // Corresponding release occurs on high-level core.
-    uint32_t remoteWritePosition;
-    __atomic_load(&icc->inbound->writePosition, &remoteWritePosition, __ATOMIC_ACQUIRE);
-    // Last position read from by this RTApp.
-    uint32_t localReadPosition = icc->outbound->readPosition;
+    icc->unsignalledMessages = 0;
+    MT3620_Gpt_CancelTimer(icc->coalesceTimer);
+    MT3620_SignalHLCoreMessageSent();
+}
 
-    // sanity check read and write positions
-    INTERCORE_ASSERT(remoteWritePosition < icc->inboundBufSize);
-    INTERCORE_ASSERT((remoteWritePosition % RINGBUFFER_ALIGNMENT) == 0);
-    INTERCORE_ASSERT(localReadPosition < icc->inboundBufSize);
-    INTERCORE_ASSERT((localReadPosition % RINGBUFFER_ALIGNMENT) == 0);
+// Runs in interrupt context when the oldest unsignalled message has waited for the maximum delay.
+static void HandleCoalesceTimerIrq(void)
+{
+    IntercoreFlush(coalescingIcc);
+}
 
-    // Get the maximum amount of available data. The actual block size may be
-    // smaller than this.
+// Checks for space and writes the header of a block at localWritePosition, which need not
+// have been published yet, and records the reservation in icc.
+static IntercoreResult ReserveBlock(IntercoreComm *icc, uint32_t localWritePosition,
+                                    const ComponentId *destAppId, size_t size)
+{
+    icc->reservedPayload = NULL;
 
-    uint32_t availData;
-    // If data is contiguous in buffer then difference between write and read positions...
-    if (remoteWritePosition >= localReadPosition) {
-        availData = remoteWritePosition - localReadPosition;
-    }
-    // ...else data wraps around end and resumes at start of buffer
-    else {
-        availData = remoteWritePosition - localReadPosition + icc->inboundBufSize;
+    if (size > INTERCORE_MAX_PAYLOAD_LEN) {
+        return Intercore_Send_MessageTooLarge;
     }
 
-    // The amount of available data must be at least enough to hold the block size.
-    // If not, caller will assume that no message was available.
-    const size_t blockSizeSize = sizeof(uint32_t);
-    if (availData < blockSizeSize) {
-        return Intercore_Recv_NoBlockSize;
+    // Last position read by HLApp. Corresponding release occurs on high-level core.
+    uint32_t remoteReadPosition = AcquireRingReadPosition(&icc->outbound);
+
+    uint32_t position;
+    if (!WriteRingBlockHeader(&icc->outbound, localWritePosition, remoteReadPosition, destAppId,
+                              size, &position)) {
+        return Intercore_Send_NotEnoughBufferSpace;
     }
 
-    // The block size must be stored in four contiguous bytes before wraparound.
-    uint32_t dataToEnd = icc->inboundBufSize - localReadPosition;
-    INTERCORE_ASSERT(blockSizeSize <= dataToEnd);
-
-    // The block size followed by the actual block can be no longer than the available data.
-    uint32_t blockSize;
-    localReadPosition = ReadInboundCircular(icc, localReadPosition, &blockSize, sizeof(blockSize));
-    uint32_t totalBlockSize;
-    // clang-tidy fails with "error: use of unknown builtin '__builtin_add_overflow_p'"
-#ifndef __clang_analyzer__
-    INTERCORE_ASSERT(!__builtin_add_overflow_p(blockSizeSize, blockSize, totalBlockSize));
-#endif
-    totalBlockSize = blockSizeSize + blockSize;
-    INTERCORE_ASSERT(totalBlockSize <= availData);
-
-    // The payload contains a sender ID (16 bytes) followed by a reserved word
-    // (4 bytes) followed by the sender-supplied data.
-    const uint32_t senderComponentIdSize = sizeof(*srcAppId);
-    const uint32_t reservedWordSize = sizeof(uint32_t);
-    const uint32_t minReqBlockSize = senderComponentIdSize + reservedWordSize;
-    INTERCORE_ASSERT(blockSize >= minReqBlockSize);
-
-    // The caller-supplied buffer must be large enough to contain the payload in the buffer,
-    // excluding component ID and reserved word.
-    size_t senderPayloadSize = blockSize - minReqBlockSize;
-    if (senderPayloadSize > *size) {
-        return Intercore_Recv_BufferTooSmall;
+    // The payload is written in place unless it would wrap around the end of the buffer.
+    if (position + size <= icc->outbound.size) {
+        icc->reservedPayload = GetRingData(&icc->outbound, position);
+    } else {
+        icc->reservedPayload = icc->sendWrap;
     }
+    icc->reservedBlock = localWritePosition;
+    icc->reservedPayloadPos = position;
+    icc->reservedSize = size;
 
-    // Tell the caller the actual block size.
-    *size = senderPayloadSize;
+    return Intercore_OK;
+}
 
-    // Read the sender component ID, reserved word, and app-specific payload from the block.
-    // This may wraparound to the start of the buffer.
-    localReadPosition = ReadInboundCircular(icc, localReadPosition, srcAppId, sizeof(*srcAppId));
-    uint32_t reservedWord; // discarded
-    localReadPosition =
-        ReadInboundCircular(icc, localReadPosition, &reservedWord, sizeof(reservedWord));
-    localReadPosition = ReadInboundCircular(icc, localReadPosition, dest, senderPayloadSize);
-
-    // Align read position to next possible location for next buffer. This may wrap around.
-    localReadPosition = RoundUp(localReadPosition, RINGBUFFER_ALIGNMENT);
-    if (localReadPosition >= icc->inboundBufSize) {
-        localReadPosition -= icc->inboundBufSize;
+// Completes the reserved block without publishing it. Returns the position of the next block.
+static uint32_t CommitBlock(IntercoreComm *icc, size_t size)
+{
+    uint32_t payloadEnd;
+    if (icc->reservedPayload == icc->sendWrap) {
+        payloadEnd =
+            WriteRingCircular(&icc->outbound, icc->reservedPayloadPos, icc->sendWrap, size);
+    } else {
+        payloadEnd = icc->reservedPayloadPos + size;
     }
+    icc->reservedPayload = NULL;
 
-    // The message content must have been retrieved before the high-level core sees the read
-    // position has been updated. Corresponding acquire occurs on high-level core.
-    __atomic_store(&icc->outbound->readPosition, &localReadPosition, __ATOMIC_RELEASE);
+    return WriteRingBlockSize(&icc->outbound, icc->reservedBlock, size, payloadEnd);
+}
 
-    MT3620_SignalHLCoreMessageReceived();
+// Makes count blocks which end at localWritePosition visible to the HLApp.
+static void PublishBlocks(IntercoreComm *icc, uint32_t localWritePosition, uint32_t count)
+{
+    // Corresponding acquire is on high-level core.
+    PublishRingWritePosition(&icc->outbound, localWritePosition);
 
-    return Intercore_OK;
+    NotifyMessagesSent(icc, count);
 }
 
-// Helper function for IntercoreSend. Writes data to the outbound buffer,
-// and wraps around to start of buffer if required. Returns updated write position.
-static uint32_t WriteOutboundCircular(const IntercoreComm *icc, uint32_t startPos, const void *src,
-                                      size_t size)
+IntercoreResult IntercoreReserve(IntercoreComm *icc, const ComponentId *destAppId, size_t size,
+                                 void **payload)
 {
-    uint32_t spaceToEnd = icc->outboundBufSize - startPos;
-
-    uint32_t writeToEnd = size;
-    // If the new data would wrap around the end of the buffer then only write
-    // spaceToEnd bytes before subsequently writing to the start of the buffer.
-    if (size > spaceToEnd) {
-        writeToEnd = spaceToEnd;
+    IntercoreResult icr = ReserveBlock(icc, *icc->outbound.writePosition, destAppId, size);
+    if (icr == Intercore_Send_NotEnoughBufferSpace) {
+        // The HLApp cannot make space for messages it has not been told about.
+        IntercoreFlush(icc);
+    }
+    if (icr != Intercore_OK) {
+        return icr;
     }
 
-    const uint8_t *src8 = (const uint8_t *)src;
-    uint8_t *dest8 = DataAreaOffset8(icc->outbound, startPos);
-    __builtin_memcpy(dest8, src8, writeToEnd);
-    // If not enough space to write all data before end of buffer, then write remainder at start.
-    __builtin_memcpy(DataAreaOffset8(icc->outbound, 0), src8 + writeToEnd, size - writeToEnd);
+    *payload = icc->reservedPayload;
+    return Intercore_OK;
+}
 
-    uint32_t finalPos = startPos + size;
-    if (finalPos > icc->outboundBufSize) {
-        finalPos -= icc->outboundBufSize;
+IntercoreResult IntercoreCommit(IntercoreComm *icc, size_t size)
+{
+    if (icc->reservedPayload == NULL) {
+        return Intercore_Send_NoReservation;
+    }
+    if (size > icc->reservedSize) {
+        return Intercore_Send_MessageTooLarge;
     }
-    return finalPos;
+
+    PublishBlocks(icc, CommitBlock(icc, size), 1);
+    return Intercore_OK;
 }
 
 IntercoreResult IntercoreSend(IntercoreComm *icc, const ComponentId *destAppId, const void *data,
                               size_t size)
 {
-    if (size > INTERCORE_MAX_PAYLOAD_LEN) {
-        return Intercore_Send_MessageTooLarge;
-    }
-
-    // Last position read by HLApp. Corresponding release occurs on high-level core.
-    uint32_t remoteReadPosition;
-    __atomic_load(&icc->inbound->readPosition, &remoteReadPosition, __ATOMIC_ACQUIRE);
-    // Last position written to by RTApp.
-    uint32_t localWritePosition = icc->outbound->writePosition;
-
-    // Sanity check read and write positions.
-    INTERCORE_ASSERT(remoteReadPosition < icc->outboundBufSize);
-    INTERCORE_ASSERT((remoteReadPosition % RINGBUFFER_ALIGNMENT) == 0);
-    INTERCORE_ASSERT(localWritePosition < icc->outboundBufSize);
-    INTERCORE_ASSERT((localWritePosition % RINGBUFFER_ALIGNMENT) == 0);
-
-    // If the read pointer is behind the write pointer, then the free space
-    // wraps around, and the used space doesn't.
-    uint32_t availSpace;
-    if (remoteReadPosition <= localWritePosition) {
-        availSpace = remoteReadPosition - localWritePosition + icc->outboundBufSize;
-    } else {
-        availSpace = remoteReadPosition - localWritePosition;
+    void *payload;
+    IntercoreResult icr = IntercoreReserve(icc, destAppId, size, &payload);
+    if (icr != Intercore_OK) {
+        return icr;
     }
 
-    // Check whether there is enough space to enqueue the next block.
-    uint32_t reqBlockSize = 0;
-    reqBlockSize += sizeof(uint32_t);    // block size field
-    reqBlockSize += sizeof(ComponentId); // destination HLApp ID
-    reqBlockSize += sizeof(uint32_t);    // reserved word
-    reqBlockSize += size;                // payload
+    __builtin_memcpy(payload, data, size);
+    return IntercoreCommit(icc, size);
+}
 
-    if (availSpace < reqBlockSize + RINGBUFFER_ALIGNMENT) {
-        return Intercore_Send_NotEnoughBufferSpace;
+IntercoreResult IntercoreSendBatch(IntercoreComm *icc, const ComponentId *destAppId,
+                                   const IntercoreMessage *messages, size_t count, size_t *sent)
+{
+    IntercoreResult icr = Intercore_OK;
+    uint32_t localWritePosition = *icc->outbound.writePosition;
+    size_t i;
+
+    for (i = 0; i < count; ++i) {
+        icr = ReserveBlock(icc, localWritePosition, destAppId, messages[i].size);
+        if (icr != Intercore_OK) {
+            break;
+        }
+        __builtin_memcpy(icc->reservedPayload, messages[i].data, messages[i].size);
+        localWritePosition = CommitBlock(icc, messages[i].size);
     }
 
-    // The value in the block size field does not include the space taken by the
-    // block size field itself.
-    uint32_t blockSizeExcSizeField = reqBlockSize - sizeof(uint32_t);
-    localWritePosition = WriteOutboundCircular(icc, localWritePosition, &blockSizeExcSizeField,
-                                               sizeof(blockSizeExcSizeField));
-    localWritePosition =
-        WriteOutboundCircular(icc, localWritePosition, destAppId, sizeof(*destAppId));
-    uint32_t reservedWord = 0;
-    localWritePosition =
-        WriteOutboundCircular(icc, localWritePosition, &reservedWord, sizeof(reservedWord));
-    localWritePosition = WriteOutboundCircular(icc, localWritePosition, data, size);
-
-    // Advance write position to start of next possible block.
-    localWritePosition = RoundUp(localWritePosition, RINGBUFFER_ALIGNMENT);
-    if (localWritePosition >= icc->outboundBufSize) {
-        localWritePosition -= icc->outboundBufSize;
+    if (i > 0) {
+        PublishBlocks(icc, localWritePosition, (uint32_t)i);
+    }
+    if (icr == Intercore_Send_NotEnoughBufferSpace) {
+        IntercoreFlush(icc);
     }
 
-    // Ensure write position update is seen after new content has been written.
-    // Corresponding acquire is on high-level core.
-    __atomic_store(&icc->outbound->writePosition, &localWritePosition, __ATOMIC_RELEASE);
+    *sent = i;
+    return icr;
+}
 
-    MT3620_SignalHLCoreMessageSent();
+void IntercoreSetSendCoalescing(IntercoreComm *icc, uint32_t maxMessages, uint32_t maxDelayMs,
+                                TimerGpt timer)
+{
+    IntercoreFlush(icc);
+    icc->coalesceTimer = timer;
+    icc->coalesceMaxDelayMs = maxDelayMs;
+    icc->coalesceMaxMessages = maxMessages;
+    coalescingIcc = icc;
+}
 
-    return Intercore_OK;
+void IntercoreFlush(IntercoreComm *icc)
+{
+    uint32_t prevBasePri = BlockIrqs();
+    if (icc->unsignalledMessages > 0) {
+        SignalWaitingMessages(icc);
+    }
+    RestoreIrqs(prevBasePri);
 }
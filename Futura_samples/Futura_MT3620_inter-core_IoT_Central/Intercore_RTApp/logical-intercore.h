@@ -3,52 +3,64 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
-#include "mt3620-baremetal.h" // for Callback
+#include "logical-ringbuffer.h" // for ComponentId and RingBuffer
+#include "mt3620-baremetal.h"   // for Callback
+#include "mt3620-timer.h"       // for TimerGpt
 
-/// <summary>
-///     When sending a message, this is the recipient HLApp's component ID.
-///     When receiving a message, this is the sender HLApp's component ID.
-/// </summary>
-typedef struct {
-    /// <summary>4-byte little-endian word</summary>
-    uint32_t data1;
-    /// <summary>2-byte little-endian half</summary>
-    uint16_t data2;
-    /// <summary>2-byte little-endian half</summary>
-    uint16_t data3;
-    /// <summary>2 bytes (big-endian) followed by 6 bytes (big-endian)</summary>
-    uint8_t data4[8];
-} ComponentId;
-
-/// <summary>Blocks inside the shared buffer have this alignment.</summary>
-#define RINGBUFFER_ALIGNMENT 16
 /// <summary>
 ///     Maximum payload size in bytes. This does not include a header which
 ///     is prepended by <see cref="IntercoreSend" />.
 /// </summary>
 #define INTERCORE_MAX_PAYLOAD_LEN 1040
 
-typedef struct BufferHeaderImpl BufferHeader;
-
 /// <summary>
 ///     Encapsulates information which is used to send data to, and receive data from HLApps.
 ///     This object is a handle, so the caller should not read or write the contained data.
 ///     Initialize this object with <see cref="SetupIntercoreComm" />.
 /// </summary>
 typedef struct {
-    /// <summary>Buffer used to send data from the HLApp to the RTApp.</summary>
-    BufferHeader *inbound;
-    /// <summary>Buffer used to send data from the RTApp to the HLApp.</summary>
-    BufferHeader *outbound;
-    /// <summary>Inbound buffer size in bytes.</summary>
-    uint32_t inboundBufSize;
-    /// <summary>Outbound buffer size in bytes.</summary>
-    uint32_t outboundBufSize;
+    /// <summary>Ring used to send data from the HLApp to the RTApp.</summary>
+    RingBuffer inbound;
+    /// <summary>Ring used to send data from the RTApp to the HLApp.</summary>
+    RingBuffer outbound;
+    /// <summary>Payload area returned by <see cref="IntercoreReserve" />, NULL if none.</summary>
+    uint8_t *reservedPayload;
+    /// <summary>Position of the reserved block in the outbound buffer.</summary>
+    uint32_t reservedBlock;
+    /// <summary>Position of the reserved payload in the outbound buffer.</summary>
+    uint32_t reservedPayloadPos;
+    /// <summary>Payload size passed to <see cref="IntercoreReserve" />.</summary>
+    uint32_t reservedSize;
+    /// <summary>True between <see cref="IntercorePeek" /> and <see cref="IntercoreRelease" />.</summary>
+    bool peekPending;
+    /// <summary>Read position which follows the block returned by <see cref="IntercorePeek" />.</summary>
+    uint32_t peekedEnd;
+    /// <summary>Reserved payload which would wrap around the end of the outbound buffer.</summary>
+    uint8_t sendWrap[INTERCORE_MAX_PAYLOAD_LEN];
+    /// <summary>Peeked payload which wraps around the end of the inbound buffer.</summary>
+    uint8_t recvWrap[INTERCORE_MAX_PAYLOAD_LEN];
+    /// <summary>See <see cref="IntercoreSetSendCoalescing" />.</summary>
+    uint32_t coalesceMaxMessages;
+    /// <summary>See <see cref="IntercoreSetSendCoalescing" />.</summary>
+    uint32_t coalesceMaxDelayMs;
+    /// <summary>See <see cref="IntercoreSetSendCoalescing" />.</summary>
+    TimerGpt coalesceTimer;
+    /// <summary>Messages published since the HLApp was last signalled.</summary>
+    volatile uint32_t unsignalledMessages;
 } IntercoreComm;
 
+/// <summary>One message of a batch passed to <see cref="IntercoreSendBatch" />.</summary>
+typedef struct {
+    /// <summary>Data to send to the HLApp.</summary>
+    const void *data;
+    /// <summary>Amount of data in bytes.</summary>
+    size_t size;
+} IntercoreMessage;
+
 /// <summary>
 ///     Error codes which can occur when using the intercore buffers.
 ///     These are errors which can occur during normal use, for example
@@ -76,7 +88,10 @@ typedef enum {
     Intercore_Send_MessageTooLarge = 0x20,
 
     /// <summary>There was not enough space in the buffer to send the supplied message.</summary>
-    Intercore_Send_NotEnoughBufferSpace = 0x21
+    Intercore_Send_NotEnoughBufferSpace = 0x21,
+
+    /// <summary><see cref="IntercoreCommit" /> was called without a reservation.</summary>
+    Intercore_Send_NoReservation = 0x22
 } IntercoreResult;
 
 /// <summary>
@@ -124,3 +139,103 @@ IntercoreResult IntercoreRecv(IntercoreComm *icc, ComponentId *sender, void *des
 /// </returns>
 IntercoreResult IntercoreSend(IntercoreComm *icc, const ComponentId *recipient, const void *data,
                               size_t size);
+
+/// <summary>
+///     Reserves space for a message to the HLApp in the outbound buffer, so that the caller can
+///     write the payload in place. The message is not visible to the HLApp, and the HLApp is not
+///     signalled, until <see cref="IntercoreCommit" /> is called. Only one reservation can be
+///     open at a time; an uncommitted reservation is discarded by the next call to this
+///     function or to <see cref="IntercoreSend" />.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="recipient">HLApp which should receive the message.</param>
+/// <param name="size">Largest payload size in bytes which will be committed.</param>
+/// <param name="payload">
+///     On success, set to a contiguous area of size bytes for the payload. This points
+///     into the outbound buffer, except when the payload would wrap around its end: it then
+///     points to a staging area which <see cref="IntercoreCommit" /> copies into the buffer.
+/// </param>
+/// <returns>
+///     <see cref="Intercore_OK" /> on success; otherwise
+///     <see cref="Intercore_Send_MessageTooLarge"> or
+///     <see cref="Intercore_Send_NotEnoughBufferSpace" />, as for <see cref="IntercoreSend" />.
+/// </returns>
+IntercoreResult IntercoreReserve(IntercoreComm *icc, const ComponentId *recipient, size_t size,
+                                 void **payload);
+
+/// <summary>
+///     Publishes the message reserved by <see cref="IntercoreReserve" /> and signals the
+///     HLApp.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="size">Payload size in bytes, which may be less than the reserved size.</param>
+/// <returns>
+///     <see cref="Intercore_OK" /> on success; <see cref="Intercore_Send_NoReservation" />
+///     if there is no open reservation; or <see cref="Intercore_Send_MessageTooLarge"> if
+///     size is larger than the reserved size, in which case the reservation stays open.
+/// </returns>
+IntercoreResult IntercoreCommit(IntercoreComm *icc, size_t size);
+
+/// <summary>
+///     Gets the next incoming message from the HLApp without copying it out of the inbound
+///     buffer. The message stays in the buffer until <see cref="IntercoreRelease" /> is called.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="sender">Component ID which will be populated with the sending HLApp's ID.</param>
+/// <param name="data">
+///     Set to the payload. This points into the inbound buffer, except when the payload
+///     wraps around its end: it is then copied to a staging area in icc. It remains valid
+///     until <see cref="IntercoreRelease" /> is called.
+/// </param>
+/// <param name="size">Set to the amount of payload data.</param>
+/// <returns>
+///     <see cref="Intercore_OK" /> if a message was retrieved;
+///     <see cref="Intercore_Recv_NoBlockSize" /> if there was no message to retrieve; or
+///     <see cref="Intercore_Recv_BufferTooSmall" /> if the payload wraps around the end of the
+///     buffer and is larger than <see cref="INTERCORE_MAX_PAYLOAD_LEN" />.
+/// </returns>
+IntercoreResult IntercorePeek(IntercoreComm *icc, ComponentId *sender, const void **data,
+                              size_t *size);
+
+/// <summary>
+///     Removes the message returned by <see cref="IntercorePeek" /> from the inbound buffer
+///     and signals the HLApp. Has no effect if there is no such message.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+void IntercoreRelease(IntercoreComm *icc);
+
+/// <summary>
+///     Sends several messages to the HLApp. The messages are published together and the
+///     HLApp is signalled once, instead of once per message.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="recipient">HLApp which should receive the messages.</param>
+/// <param name="messages">Messages to send, in order.</param>
+/// <param name="count">Number of messages.</param>
+/// <param name="sent">Set to the number of messages which were sent.</param>
+/// <returns>
+///     <see cref="Intercore_OK" /> if every message was sent; otherwise the error, as for
+///     <see cref="IntercoreSend" />, which stopped the batch. The messages before it are sent.
+/// </returns>
+IntercoreResult IntercoreSendBatch(IntercoreComm *icc, const ComponentId *recipient,
+                                   const IntercoreMessage *messages, size_t count, size_t *sent);
+
+/// <summary>
+///     Defers the interrupt which tells the HLApp that messages were sent, so that one interrupt
+///     covers several messages. The HLApp is signalled when maxMessages messages are waiting,
+///     or maxDelayMs after the first of them was sent, whichever comes first, and whenever the
+///     outbound buffer is full. By default every send signals the HLApp.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="maxMessages">Messages per interrupt; 0 or 1 signals every send.</param>
+/// <param name="maxDelayMs">Longest time a message can wait for the interrupt.</param>
+/// <param name="timer">
+///     GPT used for the delay. It must not be used for anything else, and
+///     <see cref="MT3620_Gpt_Init" /> must have been called.
+/// </param>
+void IntercoreSetSendCoalescing(IntercoreComm *icc, uint32_t maxMessages, uint32_t maxDelayMs,
+                                TimerGpt timer);
+
+/// <summary>Signals the HLApp now if sent messages are waiting for a deferred interrupt.</summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+void IntercoreFlush(IntercoreComm *icc);
@@ -0,0 +1,233 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "logical-ringbuffer.h"
+
+// The payload of each block follows the block size field, the component ID and a reserved word.
+static const uint32_t blockSizeSize = sizeof(uint32_t);
+static const uint32_t blockHeaderSize = sizeof(ComponentId) + sizeof(uint32_t);
+
+static uint32_t RoundUp(uint32_t value, uint32_t alignment);
+
+// The buffer size is encoded as a power of two in the bottom five bits.
+uint32_t GetRingBufferSize(uint32_t bufferBase)
+{
+    return (UINT32_C(1) << (bufferBase & 0x1F));
+}
+
+void InitRingBuffer(RingBuffer *ring, BufferHeader *header, uint32_t totalSize,
+                    uint32_t *writePosition, uint32_t *readPosition)
+{
+    INTERCORE_ASSERT(totalSize > sizeof(BufferHeader));
+
+    // Data storage area following header in buffer.
+    ring->data = (uint8_t *)(header + 1);
+    ring->size = totalSize - sizeof(BufferHeader);
+    ring->writePosition = writePosition;
+    ring->readPosition = readPosition;
+}
+
+uint32_t AcquireRingWritePosition(const RingBuffer *ring)
+{
+    uint32_t position;
+    __atomic_load(ring->writePosition, &position, __ATOMIC_ACQUIRE);
+
+    // sanity check write position
+    INTERCORE_ASSERT(position < ring->size);
+    INTERCORE_ASSERT((position % RINGBUFFER_ALIGNMENT) == 0);
+    return position;
+}
+
+uint32_t AcquireRingReadPosition(const RingBuffer *ring)
+{
+    uint32_t position;
+    __atomic_load(ring->readPosition, &position, __ATOMIC_ACQUIRE);
+
+    // sanity check read position
+    INTERCORE_ASSERT(position < ring->size);
+    INTERCORE_ASSERT((position % RINGBUFFER_ALIGNMENT) == 0);
+    return position;
+}
+
+void PublishRingWritePosition(RingBuffer *ring, uint32_t position)
+{
+    // Ensure write position update is seen after new content has been written.
+    __atomic_store(ring->writePosition, &position, __ATOMIC_RELEASE);
+}
+
+void PublishRingReadPosition(RingBuffer *ring, uint32_t position)
+{
+    // The message content must have been retrieved before the sender sees the read
+    // position has been updated.
+    __atomic_store(ring->readPosition, &position, __ATOMIC_RELEASE);
+}
+
+uint8_t *GetRingData(const RingBuffer *ring, uint32_t position)
+{
+    // Offset within data storage area.
+    return ring->data + position;
+}
+
+static uint32_t RoundUp(uint32_t value, uint32_t alignment)
+{
+    // alignment must be a power of two.
+    return (value + (alignment - 1)) & ~(alignment - 1);
+}
+
+uint32_t NextRingBlockPosition(const RingBuffer *ring, uint32_t position)
+{
+    position = RoundUp(position, RINGBUFFER_ALIGNMENT);
+    if (position >= ring->size) {
+        position -= ring->size;
+    }
+    return position;
+}
+
+uint32_t ReadRingCircular(const RingBuffer *ring, uint32_t position, void *dest, size_t size)
+{
+    uint32_t availToEnd = ring->size - position;
+
+    uint32_t readFromEnd = size;
+    // If the available data wraps around the end of the buffer then only read
+    // availToEnd bytes before subsequently reading from the start of the buffer.
+    if (size > availToEnd) {
+        readFromEnd = availToEnd;
+    }
+
+    uint8_t *dest8 = (uint8_t *)dest;
+    __builtin_memcpy(dest8, GetRingData(ring, position), readFromEnd);
+
+    // If block wrapped around the end of the buffer, then read remainder from start.
+    __builtin_memcpy(dest8 + readFromEnd, GetRingData(ring, 0), size - readFromEnd);
+
+    uint32_t finalPos = position + size;
+    if (finalPos >= ring->size) {
+        finalPos -= ring->size;
+    }
+    return finalPos;
+}
+
+uint32_t WriteRingCircular(const RingBuffer *ring, uint32_t position, const void *src,
+                           size_t size)
+{
+    uint32_t spaceToEnd = ring->size - position;
+
+    uint32_t writeToEnd = size;
+    // If the new data would wrap around the end of the buffer then only write
+    // spaceToEnd bytes before subsequently writing to the start of the buffer.
+    if (size > spaceToEnd) {
+        writeToEnd = spaceToEnd;
+    }
+
+    const uint8_t *src8 = (const uint8_t *)src;
+    __builtin_memcpy(GetRingData(ring, position), src8, writeToEnd);
+    // If not enough space to write all data before end of buffer, then write remainder at start.
+    __builtin_memcpy(GetRingData(ring, 0), src8 + writeToEnd, size - writeToEnd);
+
+    uint32_t finalPos = position + size;
+    if (finalPos >= ring->size) {
+        finalPos -= ring->size;
+    }
+    return finalPos;
+}
+
+bool ReadRingBlockHeader(const RingBuffer *ring, uint32_t readPosition, uint32_t writePosition,
+                         ComponentId *componentId, uint32_t *payloadPosition,
+                         uint32_t *payloadSize)
+{
+    INTERCORE_ASSERT(readPosition < ring->size);
+    INTERCORE_ASSERT((readPosition % RINGBUFFER_ALIGNMENT) == 0);
+
+    // Get the maximum amount of available data. The actual block size may be
+    // smaller than this.
+
+    uint32_t availData;
+    // If data is contiguous in buffer then difference between write and read positions...
+    if (writePosition >= readPosition) {
+        availData = writePosition - readPosition;
+    }
+    // ...else data wraps around end and resumes at start of buffer
+    else {
+        availData = writePosition - readPosition + ring->size;
+    }
+
+    // The amount of available data must be at least enough to hold the block size.
+    // If not, caller will assume that no message was available.
+    if (availData < blockSizeSize) {
+        return false;
+    }
+
+    // The block size must be stored in four contiguous bytes before wraparound.
+    uint32_t dataToEnd = ring->size - readPosition;
+    INTERCORE_ASSERT(blockSizeSize <= dataToEnd);
+
+    // The block size followed by the actual block can be no longer than the available data.
+    uint32_t blockSize;
+    uint32_t position = ReadRingCircular(ring, readPosition, &blockSize, sizeof(blockSize));
+    uint32_t totalBlockSize;
+    // clang-tidy fails with "error: use of unknown builtin '__builtin_add_overflow_p'"
+#ifndef __clang_analyzer__
+    INTERCORE_ASSERT(!__builtin_add_overflow_p(blockSizeSize, blockSize, totalBlockSize));
+#endif
+    totalBlockSize = blockSizeSize + blockSize;
+    INTERCORE_ASSERT(totalBlockSize <= availData);
+
+    // The block contains a component ID (16 bytes) followed by a reserved word
+    // (4 bytes) followed by the payload.
+    INTERCORE_ASSERT(blockSize >= blockHeaderSize);
+
+    // Read the component ID and reserved word from the block.
+    // This may wraparound to the start of the buffer.
+    position = ReadRingCircular(ring, position, componentId, sizeof(*componentId));
+    uint32_t reservedWord; // discarded
+    position = ReadRingCircular(ring, position, &reservedWord, sizeof(reservedWord));
+
+    *payloadPosition = position;
+    *payloadSize = blockSize - blockHeaderSize;
+    return true;
+}
+
+bool WriteRingBlockHeader(const RingBuffer *ring, uint32_t writePosition, uint32_t readPosition,
+                          const ComponentId *componentId, size_t payloadSize,
+                          uint32_t *payloadPosition)
+{
+    INTERCORE_ASSERT(writePosition < ring->size);
+    INTERCORE_ASSERT((writePosition % RINGBUFFER_ALIGNMENT) == 0);
+
+    // If the read pointer is behind the write pointer, then the free space
+    // wraps around, and the used space doesn't.
+    uint32_t availSpace;
+    if (readPosition <= writePosition) {
+        availSpace = readPosition - writePosition + ring->size;
+    } else {
+        availSpace = readPosition - writePosition;
+    }
+
+    // Check whether there is enough space to enqueue the next block.
+    if (payloadSize > ring->size ||
+        availSpace < blockSizeSize + blockHeaderSize + payloadSize + RINGBUFFER_ALIGNMENT) {
+        return false;
+    }
+
+    // Write the header after the block size field. The block is aligned, so the block size
+    // field does not wrap around.
+    uint32_t position = writePosition + blockSizeSize;
+    position = WriteRingCircular(ring, position, componentId, sizeof(*componentId));
+    uint32_t reservedWord = 0;
+    position = WriteRingCircular(ring, position, &reservedWord, sizeof(reservedWord));
+
+    *payloadPosition = position;
+    return true;
+}
+
+uint32_t WriteRingBlockSize(const RingBuffer *ring, uint32_t writePosition, size_t payloadSize,
+                            uint32_t payloadEnd)
+{
+    // The value in the block size field does not include the space taken by the
+    // block size field itself.
+    uint32_t blockSizeExcSizeField = blockHeaderSize + payloadSize;
+    WriteRingCircular(ring, writePosition, &blockSizeExcSizeField, sizeof(blockSizeExcSizeField));
+
+    // Advance write position to start of next possible block.
+    return NextRingBlockPosition(ring, payloadEnd);
+}
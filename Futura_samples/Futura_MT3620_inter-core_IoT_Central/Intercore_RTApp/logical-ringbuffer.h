@@ -0,0 +1,205 @@
+/* Copyright (c) Microsoft Corporation. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// The ring buffer protocol which is shared with the high-level core. This file and
+// logical-ringbuffer.c do not touch the mailbox or any other hardware, so they also
+// compile for the host, for example to exercise the protocol from two threads.
+
+// If intercore debugging is enabled and the application detects a corrupt buffer,
+// it will spin forever in the Assert function. The user can then use a debugger
+// to see the type of corruption was detected. A host build can define
+// INTERCORE_ASSERT before including this file to report the failure instead.
+
+#define DEBUG_INTERCORE
+#ifndef INTERCORE_ASSERT
+#ifdef DEBUG_INTERCORE
+
+static inline void IntercoreAssert(bool cond)
+{
+    if (cond) {
+        return;
+    }
+
+    for (;;) {
+        // empty.
+    }
+}
+
+#define INTERCORE_ASSERT(c) IntercoreAssert(c)
+
+#else
+
+#define INTERCORE_ASSERT(c)
+
+#endif
+#endif
+
+/// <summary>
+///     When sending a message, this is the recipient HLApp's component ID.
+///     When receiving a message, this is the sender HLApp's component ID.
+/// </summary>
+typedef struct {
+    /// <summary>4-byte little-endian word</summary>
+    uint32_t data1;
+    /// <summary>2-byte little-endian half</summary>
+    uint16_t data2;
+    /// <summary>2-byte little-endian half</summary>
+    uint16_t data3;
+    /// <summary>2 bytes (big-endian) followed by 6 bytes (big-endian)</summary>
+    uint8_t data4[8];
+} ComponentId;
+
+/// <summary>Blocks inside the shared buffer have this alignment.</summary>
+#define RINGBUFFER_ALIGNMENT 16
+
+/// <summary>
+///     The inbound and outbound buffers track how much data has been written
+///     written to, and read from, each shared buffer.
+/// </summary>
+typedef struct BufferHeaderImpl {
+    /// <summary>
+    ///     <para>
+    ///         <see cref="IntercoreSend" /> uses this value to store the last position written to
+    ///         by the real-time capable application.
+    ///     </para>
+    ///     <para>
+    ///         <see cref="IntercoreRecv" /> uses this value to find the last position
+    ///         written to by the high-level application.
+    ///     </para>
+    /// </summary>
+    uint32_t writePosition;
+    /// <summary>
+    ///     <para>
+    ///         <see cref="IntercoreSend" /> uses this value to find the last position read from by
+    ///         the high-level application.
+    ///     </para>
+    ///     <para>
+    ///         <see cref="IntercoreRecv" /> uses this value to store the last position read from by
+    ///         the real-time capable application.
+    ///     </para>
+    /// </summary>
+    uint32_t readPosition;
+    /// <summary>Align up to 64 bytes, to match high-level L2 cache line.</summary>
+    uint32_t reserved[14];
+} BufferHeader;
+
+/// <summary>
+///     One direction of the shared memory. Each shared buffer holds the data of one direction,
+///     but the read position of that data is stored in the header of the other buffer, so
+///     that each core only writes to the header of the buffer it sends on.
+///     Initialize this object with <see cref="InitRingBuffer" />.
+/// </summary>
+typedef struct {
+    /// <summary>Data area, which follows the buffer header.</summary>
+    uint8_t *data;
+    /// <summary>Data area size in bytes.</summary>
+    uint32_t size;
+    /// <summary>Position after the last block written by the sender.</summary>
+    uint32_t *writePosition;
+    /// <summary>Position after the last block read by the receiver.</summary>
+    uint32_t *readPosition;
+} RingBuffer;
+
+/// <summary>
+///     Gets the total size of a shared buffer, including its header, from its 32-bit
+///     base value, which encodes the size as a power of two in the bottom five bits.
+/// </summary>
+uint32_t GetRingBufferSize(uint32_t bufferBase);
+
+/// <summary>Initializes one direction of the shared memory.</summary>
+/// <param name="ring">Object to populate.</param>
+/// <param name="header">Header of the shared buffer which holds the data.</param>
+/// <param name="totalSize">Size of that buffer in bytes, including its header.</param>
+/// <param name="writePosition">Sender's position, in the header of the data buffer.</param>
+/// <param name="readPosition">Receiver's position, in the header of the other buffer.</param>
+void InitRingBuffer(RingBuffer *ring, BufferHeader *header, uint32_t totalSize,
+                    uint32_t *writePosition, uint32_t *readPosition);
+
+/// <summary>
+///     Gets the sender's write position, with acquire semantics, so that the blocks before it
+///     can be read. Corresponding release is in <see cref="PublishRingWritePosition" />.
+/// </summary>
+uint32_t AcquireRingWritePosition(const RingBuffer *ring);
+
+/// <summary>
+///     Gets the receiver's read position, with acquire semantics, so that the space before it
+///     can be reused. Corresponding release is in <see cref="PublishRingReadPosition" />.
+/// </summary>
+uint32_t AcquireRingReadPosition(const RingBuffer *ring);
+
+/// <summary>Makes the blocks before position visible to the receiver.</summary>
+void PublishRingWritePosition(RingBuffer *ring, uint32_t position);
+
+/// <summary>Returns the space before position to the sender.</summary>
+void PublishRingReadPosition(RingBuffer *ring, uint32_t position);
+
+/// <summary>Converts a position in the data area into a memory pointer.</summary>
+uint8_t *GetRingData(const RingBuffer *ring, uint32_t position);
+
+/// <summary>
+///     Copies size bytes from the data area, wrapping around to its start if required.
+/// </summary>
+/// <returns>Position after the data.</returns>
+uint32_t ReadRingCircular(const RingBuffer *ring, uint32_t position, void *dest, size_t size);
+
+/// <summary>
+///     Copies size bytes into the data area, wrapping around to its start if required.
+/// </summary>
+/// <returns>Position after the data.</returns>
+uint32_t WriteRingCircular(const RingBuffer *ring, uint32_t position, const void *src,
+                           size_t size);
+
+/// <summary>
+///     Aligns the position which follows a block to the next possible location for the next
+///     block. This may wrap around.
+/// </summary>
+uint32_t NextRingBlockPosition(const RingBuffer *ring, uint32_t position);
+
+/// <summary>
+///     Finds the block at readPosition, if the sender has written one. Each block holds a
+///     4-byte block size, the component ID, a reserved word and the payload.
+/// </summary>
+/// <param name="ring">Inbound direction.</param>
+/// <param name="readPosition">Position of the block.</param>
+/// <param name="writePosition">Write position, from <see cref="AcquireRingWritePosition" />.</param>
+/// <param name="componentId">Set to the component ID stored in the block.</param>
+/// <param name="payloadPosition">Set to the position of the payload.</param>
+/// <param name="payloadSize">Set to the payload size in bytes.</param>
+/// <returns>false if the buffer does not hold a block.</returns>
+bool ReadRingBlockHeader(const RingBuffer *ring, uint32_t readPosition, uint32_t writePosition,
+                         ComponentId *componentId, uint32_t *payloadPosition,
+                         uint32_t *payloadSize);
+
+/// <summary>
+///     Checks that a block with a payload of payloadSize bytes fits at writePosition, and writes
+///     its component ID and reserved word. The block size is written by
+///     <see cref="WriteRingBlockSize" /> once the payload is complete. One alignment unit is
+///     always left free, so that equal read and write positions mean an empty buffer.
+/// </summary>
+/// <param name="ring">Outbound direction.</param>
+/// <param name="writePosition">Position of the block.</param>
+/// <param name="readPosition">Read position, from <see cref="AcquireRingReadPosition" />.</param>
+/// <param name="componentId">Component ID to store in the block.</param>
+/// <param name="payloadSize">Payload size in bytes.</param>
+/// <param name="payloadPosition">Set to the position of the payload.</param>
+/// <returns>false if there is not enough space.</returns>
+bool WriteRingBlockHeader(const RingBuffer *ring, uint32_t writePosition, uint32_t readPosition,
+                          const ComponentId *componentId, size_t payloadSize,
+                          uint32_t *payloadPosition);
+
+/// <summary>
+///     Completes a block started by <see cref="WriteRingBlockHeader" /> by writing its size.
+/// </summary>
+/// <param name="ring">Outbound direction.</param>
+/// <param name="writePosition">Position of the block.</param>
+/// <param name="payloadSize">Final payload size in bytes, which may be less than reserved.</param>
+/// <param name="payloadEnd">Position which follows the payload.</param>
+/// <returns>Position of the next block.</returns>
+uint32_t WriteRingBlockSize(const RingBuffer *ring, uint32_t writePosition, size_t payloadSize,
+                            uint32_t payloadEnd);
@@ -0,0 +1,167 @@
+/* Futura MT3620 software timers for the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "logical-timer.h"
+
+static void HandleSoftTimerIrq(void);
+
+// Timers sorted by expiry. Each deltaMs is relative to the expiry of the previous timer, and
+// that of the first timer to listBaseUs, a GPT3 timestamp.
+static SoftTimer *volatile timers = NULL;
+static uint32_t listBaseUs = 0;
+static TimerGpt timerGpt = TimerGpt0;
+
+// Longest count loaded into the GPT. The interrupt then rebases the list, which keeps
+// elapsed times far below the GPT3 wraparound period of about 71 minutes.
+static const uint32_t maxLaunchMs = 60000;
+
+// GPT0 and GPT1 are clocked at about 1kHz and GPT3 at 1MHz, so the interrupt may come
+// slightly before GPT3 reaches the expiry. A timer this close to its expiry is run.
+static const uint32_t expirySlackUs = 250;
+
+// Microseconds since listBaseUs. This is negative for a short while after a timer runs
+// before its expiry, which becomes the base.
+static int32_t ElapsedUs(uint32_t nowUs)
+{
+    return (int32_t)(nowUs - listBaseUs);
+}
+
+// Moves listBaseUs forward, towards now, without changing any expiry, so that elapsed times
+// stay well within the GPT3 range. Call with interrupts blocked, on a list which is not empty.
+static void Rebase(uint32_t nowUs)
+{
+    int32_t elapsedUs = ElapsedUs(nowUs);
+    uint32_t elapsedMs = elapsedUs < 0 ? 0 : (uint32_t)elapsedUs / 1000;
+    if (elapsedMs > timers->deltaMs) {
+        elapsedMs = timers->deltaMs;
+    }
+    timers->deltaMs -= elapsedMs;
+    listBaseUs += elapsedMs * 1000;
+}
+
+// Inserts a timer which expires offsetMs after listBaseUs. Call with interrupts blocked.
+static void Insert(SoftTimer *timer, uint32_t offsetMs)
+{
+    SoftTimer *volatile *link = &timers;
+    while (*link != NULL && (*link)->deltaMs <= offsetMs) {
+        offsetMs -= (*link)->deltaMs;
+        link = &(*link)->next;
+    }
+    if (*link != NULL) {
+        (*link)->deltaMs -= offsetMs;
+    }
+    timer->deltaMs = offsetMs;
+    timer->next = *link;
+    timer->running = true;
+    *link = timer;
+}
+
+// Removes a running timer. Call with interrupts blocked.
+static void Remove(SoftTimer *timer)
+{
+    SoftTimer *volatile *link = &timers;
+    while (*link != timer) {
+        link = &(*link)->next;
+    }
+    if (timer->next != NULL) {
+        timer->next->deltaMs += timer->deltaMs;
+    }
+    *link = timer->next;
+    timer->next = NULL;
+    timer->running = false;
+}
+
+// Programs the GPT for the first timer. Call with interrupts blocked.
+static void Reprogram(uint32_t nowUs)
+{
+    if (timers == NULL) {
+        return;
+    }
+
+    Rebase(nowUs);
+    // A zero count does not expire, so a due timer is handled after one tick.
+    uint32_t delayMs = timers->deltaMs == 0 ? 1 : timers->deltaMs;
+    if (delayMs > maxLaunchMs) {
+        delayMs = maxLaunchMs;
+    }
+    // The GPT clock is only about 1kHz, so a long count is shortened to expire early rather
+    // than late; the interrupt then loads the remainder.
+    delayMs -= delayMs / 64;
+    MT3620_Gpt_LaunchTimerMs(timerGpt, delayMs, HandleSoftTimerIrq);
+}
+
+void SetupSoftTimers(TimerGpt gpt)
+{
+    timerGpt = gpt;
+}
+
+void StartSoftTimer(SoftTimer *timer, uint32_t delayMs, uint32_t periodMs)
+{
+    uint32_t prevBasePri = BlockIrqs();
+    uint32_t nowUs = MT3620_Gpt_GetTimestampUs();
+    if (timer->running) {
+        Remove(timer);
+    }
+
+    timer->periodMs = periodMs;
+    if (timers == NULL) {
+        listBaseUs = nowUs;
+    }
+    // Round the time since listBaseUs up, so that the timer does not expire early.
+    int32_t elapsedUs = ElapsedUs(nowUs);
+    uint32_t elapsedMs = elapsedUs < 0 ? 0 : ((uint32_t)elapsedUs + 999) / 1000;
+    Insert(timer, elapsedMs + delayMs);
+
+    if (timers == timer) {
+        Reprogram(nowUs);
+    }
+    RestoreIrqs(prevBasePri);
+}
+
+void StopSoftTimer(SoftTimer *timer)
+{
+    uint32_t prevBasePri = BlockIrqs();
+    if (timer->running) {
+        // The GPT is not reprogrammed. If the timer was first, the interrupt finds
+        // nothing due and programs the GPT for the next one.
+        Remove(timer);
+    }
+    RestoreIrqs(prevBasePri);
+}
+
+bool IsSoftTimerRunning(const SoftTimer *timer)
+{
+    return timer->running;
+}
+
+// Runs the callbacks of the timers which are due, then programs the GPT for the next one.
+static void HandleSoftTimerIrq(void)
+{
+    for (;;) {
+        uint32_t prevBasePri = BlockIrqs();
+        SoftTimer *timer = timers;
+        if (timer == NULL || (int64_t)timer->deltaMs * 1000 >
+                                 (int64_t)ElapsedUs(MT3620_Gpt_GetTimestampUs()) + expirySlackUs) {
+            RestoreIrqs(prevBasePri);
+            break;
+        }
+
+        // The expiry of this timer becomes the base, so a periodic timer is reloaded
+        // from its expiry and does not accumulate the interrupt latency.
+        listBaseUs += timer->deltaMs * 1000;
+        timers = timer->next;
+        timer->next = NULL;
+        timer->running = false;
+        if (timer->periodMs != 0) {
+            Insert(timer, timer->periodMs);
+        }
+        RestoreIrqs(prevBasePri);
+
+        timer->cb();
+    }
+
+    uint32_t prevBasePri = BlockIrqs();
+    Reprogram(MT3620_Gpt_GetTimestampUs());
+    RestoreIrqs(prevBasePri);
+}
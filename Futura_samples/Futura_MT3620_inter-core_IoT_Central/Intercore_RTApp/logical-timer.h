@@ -0,0 +1,58 @@
+/* Futura MT3620 software timers for the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mt3620-baremetal.h" // for Callback
+#include "mt3620-timer.h"     // for TimerGpt
+
+/// <summary>
+///     <para>
+///         A one-shot or periodic timer which is started with <see cref="StartSoftTimer" />.
+///         Any number of these share the GPT passed to <see cref="SetupSoftTimers" />.
+///     </para>
+///     <para>The application should not modify this object while the timer is running.</para>
+/// </summary>
+typedef struct SoftTimer {
+    /// <summary>Internal use. Initialize to NULL.</summary>
+    struct SoftTimer *next;
+    /// <summary>Internal use. Milliseconds after the expiry of the previous timer.</summary>
+    uint32_t deltaMs;
+    /// <summary>Internal use. 0 for a one-shot timer.</summary>
+    uint32_t periodMs;
+    /// <summary>Internal use. Initialize to false.</summary>
+    bool running;
+    /// <summary>
+    ///     Initialize to callback function which is invoked in interrupt context
+    ///     when the timer expires. It may start and stop timers, including this one.
+    /// </summary>
+    Callback cb;
+} SoftTimer;
+
+/// <summary>
+///     Reserves a GPT for the software timers. Call this once, after
+///     <see cref="MT3620_Gpt_Init" />. The GPT must not be used for anything else.
+/// </summary>
+/// <param name="gpt">Hardware timer which the software timers share.</param>
+void SetupSoftTimers(TimerGpt gpt);
+
+/// <summary>
+///     Starts a timer, or restarts it if it is running. The timers are kept in a list sorted
+///     by expiry, and the GPT is programmed for the earliest one. A periodic timer is reloaded
+///     from its previous expiry, not from the time its callback ran, so it does not drift.
+///     The resolution is one millisecond.
+/// </summary>
+/// <param name="timer">Timer to start. This object must exist until the timer is stopped.</param>
+/// <param name="delayMs">Time until the first expiry, in milliseconds.</param>
+/// <param name="periodMs">Time between expiries, in milliseconds, or 0 for a one-shot timer.</param>
+void StartSoftTimer(SoftTimer *timer, uint32_t delayMs, uint32_t periodMs);
+
+/// <summary>Stops a timer. Stopping a timer which is not running has no effect.</summary>
+void StopSoftTimer(SoftTimer *timer);
+
+/// <summary>Returns true if the timer is running.</summary>
+bool IsSoftTimerRunning(const SoftTimer *timer);
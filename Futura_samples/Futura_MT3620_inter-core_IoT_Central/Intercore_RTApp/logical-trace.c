@@ -0,0 +1,176 @@
+/* Futura MT3620 binary trace logging for the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "logical-trace.h"
+
+#include "mt3620-baremetal.h"
+#include "mt3620-timer.h"
+#include "mt3620-uart.h"
+
+// Events are stored with a fixed size, so that recording one is a few stores, and packed
+// when a frame is built.
+typedef struct {
+    uint16_t id;
+    uint8_t argCount;
+    uint32_t timestampUs;
+    uint32_t args[TRACE_MAX_ARGS];
+} TraceRecord;
+
+_Static_assert((TRACE_BUFFER_EVENTS & (TRACE_BUFFER_EVENTS - 1)) == 0,
+               "TRACE_BUFFER_EVENTS must be a power of two");
+
+#define FRAME_HEADER_SIZE 4
+#define RECORD_HEADER_SIZE 8
+#define MAX_RECORD_SIZE (RECORD_HEADER_SIZE + TRACE_MAX_ARGS * sizeof(uint32_t))
+// Largest frame, which fits in one intercore message.
+#define MAX_FRAME_SIZE INTERCORE_MAX_PAYLOAD_LEN
+// Largest frame written to the UART, so that one frame does not fill its buffer.
+#define MAX_UART_FRAME_SIZE 512
+
+static TraceRecord records[TRACE_BUFFER_EVENTS];
+// Free-running indices. head is advanced by TraceEvent with interrupts blocked, and tail
+// by the flush functions, which only run in the main loop.
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+static volatile uint32_t dropped = 0;
+
+static uint8_t frame[MAX_FRAME_SIZE];
+
+void TraceEvent(TraceEventId id, uint32_t argCount, uint32_t arg0, uint32_t arg1,
+                uint32_t arg2, uint32_t arg3)
+{
+    uint32_t prevBasePri = BlockIrqs();
+    uint32_t index = head;
+    if (index - tail == TRACE_BUFFER_EVENTS) {
+        ++dropped;
+    } else {
+        TraceRecord *record = &records[index % TRACE_BUFFER_EVENTS];
+        record->id = (uint16_t)id;
+        record->argCount = (uint8_t)argCount;
+        record->timestampUs = MT3620_Gpt_GetTimestampUs();
+        record->args[0] = arg0;
+        record->args[1] = arg1;
+        record->args[2] = arg2;
+        record->args[3] = arg3;
+        head = index + 1;
+    }
+    RestoreIrqs(prevBasePri);
+}
+
+static uint8_t *Put16(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    return p + 2;
+}
+
+static uint8_t *Put32(uint8_t *p, uint32_t value)
+{
+    p = Put16(p, value);
+    return Put16(p, value >> 16);
+}
+
+static uint8_t *PutRecord(uint8_t *p, uint32_t id, uint32_t argCount, uint32_t timestampUs,
+                          const uint32_t *args)
+{
+    p = Put16(p, id);
+    *p++ = (uint8_t)argCount;
+    *p++ = 0;
+    p = Put32(p, timestampUs);
+    for (uint32_t i = 0; i < argCount; ++i) {
+        p = Put32(p, args[i]);
+    }
+    return p;
+}
+
+// Packs buffered events into frame, up to capacity bytes, without consuming them. Sets
+// *events to the number of events packed and *overflow to the dropped count reported.
+// Returns the frame size, or 0 if there is nothing to send.
+static size_t BuildFrame(size_t capacity, uint32_t *events, uint32_t *overflow)
+{
+    uint8_t *p = frame + FRAME_HEADER_SIZE;
+    const uint8_t *end = frame + capacity;
+
+    *overflow = dropped;
+    if (*overflow != 0) {
+        uint32_t args[1] = {*overflow};
+        p = PutRecord(p, TraceOverflow, 1, MT3620_Gpt_GetTimestampUs(), args);
+    }
+
+    uint32_t index = tail;
+    uint32_t last = head;
+    while (index != last) {
+        const TraceRecord *record = &records[index % TRACE_BUFFER_EVENTS];
+        if (p + RECORD_HEADER_SIZE + record->argCount * sizeof(uint32_t) > end) {
+            break;
+        }
+        p = PutRecord(p, record->id, record->argCount, record->timestampUs, record->args);
+        ++index;
+    }
+    *events = index - tail;
+
+    size_t size = (size_t)(p - frame);
+    if (size == FRAME_HEADER_SIZE) {
+        return 0;
+    }
+    frame[0] = TRACE_FRAME_MAGIC;
+    frame[1] = TRACE_FRAME_VERSION;
+    Put16(frame + 2, (uint32_t)(size - FRAME_HEADER_SIZE));
+    return size;
+}
+
+// Consumes the events and the dropped count which were sent in a frame.
+static void ConsumeFrame(uint32_t events, uint32_t overflow)
+{
+    tail += events;
+
+    uint32_t prevBasePri = BlockIrqs();
+    dropped -= overflow;
+    RestoreIrqs(prevBasePri);
+}
+
+void FlushTraceToUart(void)
+{
+    for (;;) {
+        size_t capacity = Uart_GetTxFreeSpace();
+        if (capacity > MAX_UART_FRAME_SIZE) {
+            capacity = MAX_UART_FRAME_SIZE;
+        }
+        if (capacity < FRAME_HEADER_SIZE + MAX_RECORD_SIZE) {
+            return;
+        }
+
+        uint32_t events, overflow;
+        size_t size = BuildFrame(capacity, &events, &overflow);
+        if (size == 0) {
+            return;
+        }
+
+        Uart_EnqueueBytes(frame, size);
+        ConsumeFrame(events, overflow);
+    }
+}
+
+IntercoreResult FlushTraceToIntercore(IntercoreComm *icc, const ComponentId *recipient)
+{
+    for (;;) {
+        uint32_t events, overflow;
+        size_t size = BuildFrame(MAX_FRAME_SIZE, &events, &overflow);
+        if (size == 0) {
+            return Intercore_OK;
+        }
+
+        void *payload;
+        IntercoreResult icr = IntercoreReserve(icc, recipient, size, &payload);
+        if (icr != Intercore_OK) {
+            return icr;
+        }
+        __builtin_memcpy(payload, frame, size);
+        icr = IntercoreCommit(icc, size);
+        if (icr != Intercore_OK) {
+            return icr;
+        }
+        ConsumeFrame(events, overflow);
+    }
+}
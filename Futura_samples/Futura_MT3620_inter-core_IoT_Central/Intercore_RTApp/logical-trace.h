@@ -0,0 +1,74 @@
+/* Futura MT3620 binary trace logging for the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "logical-intercore.h"
+
+/// <summary>Trace event identifiers, from trace-events.h.</summary>
+typedef enum {
+#define TRACE_EVENT(identifier, format) identifier,
+#include "trace-events.h"
+#undef TRACE_EVENT
+    /// <summary>Number of trace events.</summary>
+    TraceEventCount
+} TraceEventId;
+
+/// <summary>Largest number of arguments of an event.</summary>
+#define TRACE_MAX_ARGS 4
+/// <summary>Number of events held until the next flush. Must be a power of two.</summary>
+#define TRACE_BUFFER_EVENTS 256
+
+/// <summary>
+///     First byte of a trace frame. It differs from the first byte of fragments
+///     (<see cref="INTERCORE_TRANSFER_MAGIC" />) and is not printable, so the decoder and the
+///     HLApp can tell frames from text and other messages.
+/// </summary>
+#define TRACE_FRAME_MAGIC 0xF7
+/// <summary>Format version, the second byte of a trace frame.</summary>
+#define TRACE_FRAME_VERSION 1
+
+// A frame is a 4-byte header: TRACE_FRAME_MAGIC, TRACE_FRAME_VERSION and the length of the
+// rest of the frame as a little-endian 16-bit value. Then follow the events, each of them
+// a 16-bit identifier, an 8-bit argument count, a zero byte, a 32-bit GPT3 timestamp in
+// microseconds and the arguments, all little-endian.
+
+/// <summary>
+///     Records an event: its identifier, a GPT3 timestamp and the arguments. This only
+///     copies a few words into a buffer in TCM, so it may be called from any context,
+///     including interrupts. When the buffer is full the event is dropped and counted; the
+///     count is reported as <see cref="TraceOverflow" /> with the next flushed events.
+///     Use the TRACE0 to TRACE4 macros rather than calling this function directly.
+/// </summary>
+void TraceEvent(TraceEventId id, uint32_t argCount, uint32_t arg0, uint32_t arg1,
+                uint32_t arg2, uint32_t arg3);
+
+#define TRACE0(id) TraceEvent((id), 0, 0, 0, 0, 0)
+#define TRACE1(id, a) TraceEvent((id), 1, (uint32_t)(a), 0, 0, 0)
+#define TRACE2(id, a, b) TraceEvent((id), 2, (uint32_t)(a), (uint32_t)(b), 0, 0)
+#define TRACE3(id, a, b, c) TraceEvent((id), 3, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c), 0)
+#define TRACE4(id, a, b, c, d) \
+    TraceEvent((id), 4, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c), (uint32_t)(d))
+
+/// <summary>
+///     Writes the buffered events to the debug UART as binary frames, through the buffered
+///     output of mt3620-uart.h. Events which do not fit in the UART transmit buffer stay
+///     buffered until the next call. Call this from the main loop, not from interrupts.
+/// </summary>
+void FlushTraceToUart(void);
+
+/// <summary>
+///     Sends the buffered events to an HLApp as binary frames, one frame per message.
+///     Events which do not fit in the outbound buffer stay buffered until the next call.
+///     Call this from the main loop, not from interrupts.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="recipient">HLApp which should receive the frames.</param>
+/// <returns>
+///     <see cref="Intercore_OK" /> if every event was sent, otherwise the result of
+///     <see cref="IntercoreReserve" /> which stopped the flush.
+/// </returns>
+IntercoreResult FlushTraceToIntercore(IntercoreComm *icc, const ComponentId *recipient);
@@ -0,0 +1,75 @@
+/* Futura MT3620 intercore transfers larger than one message.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "logical-transfer.h"
+
+static uint16_t nextTransferId = 0;
+static uint16_t nextSequence = 0;
+
+IntercoreResult StartIntercoreTransfer(IntercoreTransfer *transfer, const void *data, size_t size)
+{
+    if (size > INTERCORE_TRANSFER_MAX_LEN) {
+        return Intercore_Send_MessageTooLarge;
+    }
+
+    transfer->data = (const uint8_t *)data;
+    transfer->size = size;
+    transfer->offset = 0;
+    transfer->transferId = nextTransferId++;
+    transfer->index = 0;
+    // An empty transfer is still sent, as one fragment without data.
+    size_t count = (size + INTERCORE_FRAGMENT_DATA_LEN - 1) / INTERCORE_FRAGMENT_DATA_LEN;
+    transfer->count = (uint8_t)(count == 0 ? 1 : count);
+
+    return Intercore_OK;
+}
+
+IntercoreResult ContinueIntercoreTransfer(IntercoreComm *icc, const ComponentId *recipient,
+                                          IntercoreTransfer *transfer)
+{
+    IntercoreResult icr = Intercore_OK;
+
+    while (!IsIntercoreTransferComplete(transfer)) {
+        size_t dataSize = transfer->size - transfer->offset;
+        if (dataSize > INTERCORE_FRAGMENT_DATA_LEN) {
+            dataSize = INTERCORE_FRAGMENT_DATA_LEN;
+        }
+
+        // Write the fragment in place, so the data is copied once.
+        void *payload;
+        icr = IntercoreReserve(icc, recipient, sizeof(IntercoreFragmentHeader) + dataSize, &payload);
+        if (icr != Intercore_OK) {
+            break;
+        }
+
+        IntercoreFragmentHeader header = {.magic = INTERCORE_TRANSFER_MAGIC,
+                                          .index = transfer->index,
+                                          .count = transfer->count,
+                                          .reserved = 0,
+                                          .transferId = transfer->transferId,
+                                          .sequence = nextSequence};
+        uint8_t *payload8 = (uint8_t *)payload;
+        __builtin_memcpy(payload8, &header, sizeof(header));
+        __builtin_memcpy(payload8 + sizeof(header), transfer->data + transfer->offset, dataSize);
+
+        icr = IntercoreCommit(icc, sizeof(header) + dataSize);
+        if (icr != Intercore_OK) {
+            break;
+        }
+
+        ++nextSequence;
+        ++transfer->index;
+        transfer->offset += dataSize;
+    }
+
+    // Do not leave the last fragments waiting for a coalesced interrupt.
+    IntercoreFlush(icc);
+
+    return icr;
+}
+
+bool IsIntercoreTransferComplete(const IntercoreTransfer *transfer)
+{
+    return transfer->index == transfer->count;
+}
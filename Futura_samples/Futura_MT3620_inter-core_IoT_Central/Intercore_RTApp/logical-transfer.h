@@ -0,0 +1,64 @@
+/* Futura MT3620 intercore transfers larger than one message.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "logical-intercore.h"
+#include "transfer-fragment.h" // for IntercoreFragmentHeader, shared with the HLApp
+
+/// <summary>Transfer data carried by each fragment except the last.</summary>
+#define INTERCORE_FRAGMENT_DATA_LEN (INTERCORE_MAX_PAYLOAD_LEN - sizeof(IntercoreFragmentHeader))
+/// <summary>Maximum transfer size in bytes.</summary>
+#define INTERCORE_TRANSFER_MAX_LEN (255 * INTERCORE_FRAGMENT_DATA_LEN)
+
+/// <summary>
+///     State of a transfer in progress. Initialize with <see cref="StartIntercoreTransfer" />;
+///     the caller should not read or write the contained data.
+/// </summary>
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+    uint16_t transferId;
+    uint8_t index;
+    uint8_t count;
+} IntercoreTransfer;
+
+/// <summary>
+///     Prepares a transfer. Nothing is sent until <see cref="ContinueIntercoreTransfer" />
+///     is called.
+/// </summary>
+/// <param name="transfer">Transfer state to initialize.</param>
+/// <param name="data">
+///     Data to send. It is not copied, so it must not change until the transfer is complete.
+/// </param>
+/// <param name="size">Amount of data in bytes.</param>
+/// <returns>
+///     <see cref="Intercore_OK" /> on success, or <see cref="Intercore_Send_MessageTooLarge" />
+///     if size is larger than <see cref="INTERCORE_TRANSFER_MAX_LEN" />.
+/// </returns>
+IntercoreResult StartIntercoreTransfer(IntercoreTransfer *transfer, const void *data, size_t size);
+
+/// <summary>
+///     Sends as many of the remaining fragments as the outbound buffer can hold. The outbound
+///     buffer is usually smaller than a large transfer, so call this again, for example from a
+///     timer, until it returns <see cref="Intercore_OK" />. Plain messages may be sent between
+///     the fragments, but only one transfer can be in progress at a time.
+/// </summary>
+/// <param name="icc">Handle which was initialized by <see cref="SetupIntercoreComm" /></param>
+/// <param name="recipient">HLApp which should receive the transfer.</param>
+/// <param name="transfer">Transfer started by <see cref="StartIntercoreTransfer" />.</param>
+/// <returns>
+///     <see cref="Intercore_OK" /> once every fragment has been sent, or
+///     <see cref="Intercore_Send_NotEnoughBufferSpace" /> if fragments remain.
+/// </returns>
+IntercoreResult ContinueIntercoreTransfer(IntercoreComm *icc, const ComponentId *recipient,
+                                          IntercoreTransfer *transfer);
+
+/// <summary>Returns true once every fragment of the transfer has been sent.</summary>
+bool IsIntercoreTransferComplete(const IntercoreTransfer *transfer);
@@ -1,22 +1,35 @@
-#include <ctype.h>
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <errno.h>
+#include "logical-acquisition.h"
+#include "logical-dht.h"
 #include "logical-dpc.h"
 #include "logical-intercore.h"
+#include "logical-trace.h"
+#include "logical-timer.h"
+#include "mt3620-adc.h"
 #include "mt3620-baremetal.h"
+#include "mt3620-uart.h"
 #include "mt3620-uart-poll.h"
 #include "mt3620-intercore.h"
 #include "mt3620-timer.h"
 extern uint32_t StackTop; // &StackTop == end of TCM
 static IntercoreComm icc;
-static const uint32_t sendTimerIntervalMs = 5000;
+// The HLApp which last sent a message receives the trace frames. Only the main loop and its
+// DPCs use these.
+static ComponentId traceRecipient;
+static bool traceRecipientKnown = false;
+
+// SENS_DHT on the Futura board, MT3620 PIN5.
+#define DHT_GPIO 0
+
+// Acquisition batches, DHT readings and the trace frames which the main loop flushes, sent
+// within SEND_COALESCING_DELAY_MS of each other, share one mailbox interrupt, up to
+// SEND_COALESCING_MESSAGES of them. GPT1 times the delay; the software timers use GPT0.
+#define SEND_COALESCING_MESSAGES 8
+#define SEND_COALESCING_DELAY_MS 10
 static _Noreturn void DefaultExceptionHandler(void);
-static void HandleSendTimerIrq(void);
-static void HandleSendTimerDeferred(void);
-static void PrintBytes(const void *buf, int start, int end);
-static void PrintGuid(const ComponentId *cid);
 static _Noreturn void RTCoreMain(void);
 
 #define INTERRUPT_COUNT 100 // from datasheet
@@ -39,84 +52,25 @@ __attribute__((used)) = {
 
     [INT_TO_EXC(0)] = (uintptr_t)DefaultExceptionHandler,
     [INT_TO_EXC(1)] = (uintptr_t)MT3620_Gpt_HandleIrq1,
-    [INT_TO_EXC(2)... INT_TO_EXC(10)] = (uintptr_t)DefaultExceptionHandler,
+    [INT_TO_EXC(2)... INT_TO_EXC(3)] = (uintptr_t)DefaultExceptionHandler,
+    [INT_TO_EXC(4)] = (uintptr_t)Uart_HandleIrq4,
+    [INT_TO_EXC(5)... INT_TO_EXC(10)] = (uintptr_t)DefaultExceptionHandler,
     [INT_TO_EXC(11)] = (uintptr_t)MT3620_HandleMailboxIrq11,
     [INT_TO_EXC(12)... INT_TO_EXC(INTERRUPT_COUNT - 1)] = (uintptr_t)DefaultExceptionHandler};
 
 // If the applications end up in this function then an unexpected exception has occurred.
+// Interrupts cannot be relied upon here, so the message is written with the polled UART.
 static _Noreturn void DefaultExceptionHandler(void)
 {
+    Uart_WriteStringPoll("Unexpected exception\r\n");
     for (;;) {
         // empty.
     }
 }
 
-// Runs in IRQ context and schedules HandleSendTimerDeferred to run later.
-static void HandleSendTimerIrq(void)
-{
-    static CallbackNode cbn = {.enqueued = false, .cb = HandleSendTimerDeferred};
-    EnqueueDeferredProc(&cbn);
-}
-
-// Queued by HandleSendTimerIrq. Sends a message to the HLApp.
-static void HandleSendTimerDeferred(void)
-{
-    static int iter = 0;
-    // The component ID for IntercoreComms_HighLevelApp.
-    static const ComponentId hlAppId = {.data1 = 0x25025d2c,
-                                        .data2 = 0x66da,
-                                        .data3 = 0x4448,
-                                        .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc, 0xdd, 0x36, 0x27}};
-
-    // The number cycles from "00" to "99".
-    static char txMsg[] = "00";
-    const size_t txMsgLen = sizeof(txMsg);
-
-    IntercoreResult icr = IntercoreSend(&icc, &hlAppId, txMsg, sizeof(txMsg) - 1);
-    if (icr != Intercore_OK) {
-        Uart_WriteStringPoll("IntercoreSend: ");
-        Uart_WriteIntegerPoll(icr);
-        Uart_WriteStringPoll("\r\n");
-    }
-
-    txMsg[txMsgLen - 3] = '0' + (iter / 10);
-    txMsg[txMsgLen - 2] = '0' + (iter % 10);
-    iter = (iter + 1) % 100;
-
-    MT3620_Gpt_LaunchTimerMs(TimerGpt0, sendTimerIntervalMs, HandleSendTimerIrq);
-}
-
-// Prints a sequence of bytes. If the start position occurs after the end
-// position, they are printed in reverse order. Therefore, this function can
-// print big- or little-endian values.
-static void PrintBytes(const void *buf, int start, int end)
-{
-    const uint8_t *buf8 = (const uint8_t *)buf;
-    int step = (end >= start) ? +1 : -1;
-
-    for (/* nop */; start != end; start += step) {
-        Uart_WriteHexBytePoll(buf8[start]);
-    }
-    Uart_WriteHexBytePoll(buf8[end]);
-}
-
-// Renders the supplied component ID as a string "00112233-4455-6677-8899-aabbccddeeff".
-// The first three values are interpreted as little-endian, and last two as big-endian.
-static void PrintGuid(const ComponentId *cid)
-{
-    PrintBytes(&cid->data1, 3, 0); // 4-byte little-endian word
-    Uart_WriteStringPoll("-");
-    PrintBytes(&cid->data2, 1, 0); // 2-byte little-endian half
-    Uart_WriteStringPoll("-");
-    PrintBytes(&cid->data3, 1, 0); // 2-byte little-endian half
-    Uart_WriteStringPoll("-");
-    PrintBytes(&cid->data4, 0, 1); // 2 bytes
-    Uart_WriteStringPoll("-");
-    PrintBytes(&cid->data4, 2, 7); // 6 bytes
-}
-
-// Runs with interrupts enabled. Retrieves messages from the inbound buffer
-// and prints their sender ID, length, and content (hex and text).
+// Runs with interrupts enabled. Retrieves messages from the inbound buffer, remembers their
+// sender as the recipient of trace frames, applies acquisition commands and traces the
+// sender ID, length, and first bytes of other messages.
 static void HandleReceivedMessageDeferred(void)
 {
     for (;;) {
@@ -133,40 +87,22 @@ static void HandleReceivedMessageDeferred(void)
 
         // Return if an error occurred.
         if (icr != Intercore_OK) {
-            Uart_WriteStringPoll("IntercoreRecv: ");
-            Uart_WriteIntegerPoll(icr);
-            Uart_WriteStringPoll("\r\n");
+            TRACE1(TraceIntercoreRecvFailed, icr);
             return;
         }
 
-        // Display sender component ID.
-        Uart_WriteStringPoll("Sender: ");
-        PrintGuid(&sender);
-        Uart_WriteStringPoll("\r\n");
-
-        Uart_WriteStringPoll("Message size: ");
-        Uart_WriteIntegerPoll((int)rxDataSize);
-        Uart_WriteStringPoll(" bytes:\r\n");
-
-        // Print message as hex.
-        Uart_WriteStringPoll("Hex: ");
-        for (uint32_t i = 0; i < rxDataSize; ++i) {
-            Uart_WriteHexBytePoll(rxData[i]);
-            if (i != rxDataSize - 1) {
-                Uart_WriteStringPoll(":");
-            }
-        }
-        Uart_WriteStringPoll("\r\n");
-
-        // Print message as text.
-        Uart_WriteStringPoll("Text: ");
-        for (uint32_t i = 0; i < rxDataSize; ++i) {
-            char c[2];
-            c[0] = isprint(rxData[i]) ? rxData[i] : '.';
-            c[1] = '\0';
-            Uart_WriteStringPoll(c);
+        traceRecipient = sender;
+        traceRecipientKnown = true;
+
+        if (HandleAcquisitionCommand(&sender, rxData, rxDataSize)) {
+            continue;
         }
-        Uart_WriteStringPoll("\r\n");
+
+        // Trace the sender and the first eight bytes, which the decoder prints as words.
+        uint32_t firstWords[2] = {0, 0};
+        __builtin_memcpy(firstWords, rxData,
+                         rxDataSize < sizeof(firstWords) ? rxDataSize : sizeof(firstWords));
+        TRACE4(TraceMessageReceived, sender.data1, rxDataSize, firstWords[0], firstWords[1]);
     }
 }
 
@@ -184,23 +120,34 @@ static _Noreturn void RTCoreMain(void)
     WriteReg32(SCB_BASE, 0x08, (uint32_t)ExceptionVectorTable);
 
     Uart_Init();
-    Uart_WriteStringPoll("--------------------------------\r\n");
-    Uart_WriteStringPoll("IntercoreComms_RTApp_MT3620_BareMetal\r\n");
-    Uart_WriteStringPoll("App built on: " __DATE__ ", " __TIME__ "\r\n");
+    Uart_InitTx();
+    Uart_EnqueueString("--------------------------------\r\n");
+    Uart_EnqueueString("IntercoreComms_RTApp_MT3620_BareMetal\r\n");
+    Uart_EnqueueString("App built on: " __DATE__ ", " __TIME__ "\r\n");
 
     MT3620_Gpt_Init();
+    TRACE0(TraceAppStarted);
+    SetupSoftTimers(TimerGpt0);
+    MT3620_Adc_Init();
 
     IntercoreResult icr = SetupIntercoreComm(&icc, HandleReceivedMessageDeferred);
     if (icr != Intercore_OK) {
-        Uart_WriteStringPoll("SetupIntercoreComm: ");
-        Uart_WriteIntegerPoll(icr);
-        Uart_WriteStringPoll("\r\n");
+        TRACE1(TraceIntercoreSetupFailed, icr);
     } else {
-        MT3620_Gpt_LaunchTimerMs(TimerGpt0, sendTimerIntervalMs, HandleSendTimerIrq);
+        IntercoreSetSendCoalescing(&icc, SEND_COALESCING_MESSAGES, SEND_COALESCING_DELAY_MS,
+                                   TimerGpt1);
+        SetupAcquisition(&icc);
+        SetupDht(&icc, DHT_GPIO);
     }
 
     for (;;) {
         InvokeDeferredProcs();
+        // Once an HLApp is known the events go to it; the UART takes those which do not fit
+        // in the outbound buffer, and the events from before.
+        if (traceRecipientKnown) {
+            FlushTraceToIntercore(&icc, &traceRecipient);
+        }
+        FlushTraceToUart();
         __asm__("wfi");
     }
 }
@@ -0,0 +1,78 @@
+/* Futura MT3620 ADC access from the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "mt3620-adc.h"
+
+#include "mt3620-baremetal.h"
+
+static const uintptr_t ADC_BASE = 0x38000000;
+
+// ADC_CTL0 fields.
+#define ADC_CTL0_FSM_EN (UINT32_C(1) << 0)
+#define ADC_CTL0_T_CH_SHIFT 4
+#define ADC_CTL0_T_INIT_SHIFT 9
+#define ADC_CTL0_CH_MAP_SHIFT 16
+
+// Settling times, in ADC clock cycles, before a scan and between channels. One sample per
+// channel, without averaging, and one-shot mode: PMODE_EN = 0.
+static const uint32_t ctl0Timing =
+    (UINT32_C(20) << ADC_CTL0_T_INIT_SHIFT) | (UINT32_C(8) << ADC_CTL0_T_CH_SHIFT);
+
+// Polls of the FIFO status before a scan is abandoned. This is well beyond the time taken by a
+// scan of every channel, so it only ends a scan if the ADC stopped.
+static const uint32_t scanTimeoutPolls = 10000;
+
+// ADC_FIFO_RBR holds the channel in bits 3:0 and the sample in bits 15:4.
+static void Pop(uint16_t *values, uint32_t *converted)
+{
+    // ADC_FIFO_RBR.
+    uint32_t entry = ReadReg32(ADC_BASE, 0x100);
+    uint32_t channel = entry & 0xF;
+    if (channel < MT3620_ADC_CHANNEL_COUNT) {
+        values[channel] = (uint16_t)((entry >> 4) & MT3620_ADC_MAX_SAMPLE);
+        *converted |= UINT32_C(1) << channel;
+    }
+}
+
+static bool IsSampleReady(void)
+{
+    // ADC_FIFO_LSR[0] -> data ready.
+    return (ReadReg32(ADC_BASE, 0x114) & 0x01) != 0;
+}
+
+void MT3620_Adc_Init(void)
+{
+    // ADC_CTL0 -> stop the state machine, select no channel.
+    WriteReg32(ADC_BASE, 0x00, ctl0Timing);
+}
+
+bool MT3620_Adc_ReadChannels(uint32_t channelMask, uint16_t *values)
+{
+    channelMask &= (UINT32_C(1) << MT3620_ADC_CHANNEL_COUNT) - 1;
+    if (channelMask == 0) {
+        return true;
+    }
+
+    // Discard samples left by a scan which timed out.
+    uint16_t stale[MT3620_ADC_CHANNEL_COUNT];
+    uint32_t discarded = 0;
+    while (IsSampleReady()) {
+        Pop(stale, &discarded);
+    }
+
+    // ADC_CTL0 -> channels to scan, start the state machine. It stops after one scan.
+    WriteReg32(ADC_BASE, 0x00,
+               ctl0Timing | (channelMask << ADC_CTL0_CH_MAP_SHIFT) | ADC_CTL0_FSM_EN);
+
+    uint32_t converted = 0;
+    for (uint32_t polls = 0; converted != channelMask && polls < scanTimeoutPolls; ++polls) {
+        if (IsSampleReady()) {
+            Pop(values, &converted);
+        }
+    }
+
+    // ADC_CTL0[0] = 0 -> ready for the next scan.
+    WriteReg32(ADC_BASE, 0x00, ctl0Timing);
+    return converted == channelMask;
+}
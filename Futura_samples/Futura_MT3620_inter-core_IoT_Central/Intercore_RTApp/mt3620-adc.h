@@ -0,0 +1,37 @@
+/* Futura MT3620 ADC access from the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// <summary>Number of channels of ADC controller 0.</summary>
+#define MT3620_ADC_CHANNEL_COUNT 8
+
+/// <summary>Largest sample value; samples are 12 bits wide.</summary>
+#define MT3620_ADC_MAX_SAMPLE 0xFFF
+
+/// <summary>
+///     Stops the ADC and sets its timing for one-shot scans. Call this once before
+///     <see cref="MT3620_Adc_ReadChannels" />. The app manifest must list
+///     "ADC-CONTROLLER-0" in the Adc capability.
+/// </summary>
+void MT3620_Adc_Init(void);
+
+/// <summary>
+///     Converts each channel in channelMask once, and waits for the results. A scan of
+///     every channel takes tens of microseconds, but if the ADC stops this polls its FIFO
+///     thousands of times before it gives up, so call it from a DPC rather than an interrupt.
+/// </summary>
+/// <param name="channelMask">Bit n set to convert channel n.</param>
+/// <param name="values">
+///     Array of <see cref="MT3620_ADC_CHANNEL_COUNT" /> entries. values[n] is set to the
+///     sample of each channel n in channelMask; the other entries are not changed.
+/// </param>
+/// <returns>
+///     false if the ADC did not return a sample for every channel in time. Entries of
+///     the channels which were converted are set regardless.
+/// </returns>
+bool MT3620_Adc_ReadChannels(uint32_t channelMask, uint16_t *values);
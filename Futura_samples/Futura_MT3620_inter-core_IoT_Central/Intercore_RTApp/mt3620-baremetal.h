@@ -26,6 +26,8 @@ static const uintptr_t NVIC_IPR_BASE = 0xE000E400;
 /// </summary>
 typedef void (*Callback)(void);
 
+#ifndef BAREMETAL_HOST
+
 /// <summary>
 ///     Write the supplied 8-bit value to an address formed from the supplied base
 ///     address and offset.
@@ -71,6 +73,15 @@ static inline uint32_t ReadReg32(uintptr_t baseAddr, size_t offset)
     return *(volatile uint32_t *)(baseAddr + offset);
 }
 
+#else
+
+// A host build, such as the tests, defines BAREMETAL_HOST and simulates the registers.
+void WriteReg8(uintptr_t baseAddr, size_t offset, uint8_t value);
+void WriteReg32(uintptr_t baseAddr, size_t offset, uint32_t value);
+uint32_t ReadReg32(uintptr_t baseAddr, size_t offset);
+
+#endif
+
 /// <summary>
 ///     <para>
 ///         Read a 32-bit register from the supplied address, clear the supplied bits,
@@ -119,8 +130,37 @@ static inline void SetReg32(uintptr_t baseAddr, size_t offset, uint32_t setBits)
     WriteReg32(baseAddr, offset, value);
 }
 
+#ifndef BAREMETAL_HOST
+
+/// <summary>Reads the BASEPRI register, ARM DDI 0403E.d SB1.4.3.</summary>
+static inline uint32_t ReadBasePri(void)
+{
+    uint32_t basePri;
+    __asm__ volatile("mrs %0, BASEPRI" : "=r"(basePri));
+    return basePri;
+}
+
+/// <summary>Writes the BASEPRI register, ARM DDI 0403E.d SB1.4.3.</summary>
+static inline void WriteBasePri(uint32_t basePri)
+{
+    __asm__ volatile("msr BASEPRI, %0" : : "r"(basePri) : "memory");
+}
+
+#else
+
+// A host build, such as the tests, defines BAREMETAL_HOST and provides the register.
+uint32_t ReadBasePri(void);
+void WriteBasePri(uint32_t basePri);
+
+#endif
+
 /// <summary>
-///     <para>Blocks interrupts at priority 1 level and above.</para>
+///     <para>
+///         Blocks interrupts of priority 1 and lower, that is every interrupt which this
+///         application uses. BASEPRI holds the priority in its top
+///         <see cref="IRQ_PRIORITY_BITS" /> bits, as the NVIC_IPR registers do, and the other
+///         bits read as zero, so BASEPRI 1 would mask nothing.
+///     </para>
 ///     <para>
 ///         Pair this with a call to <see cref="RestoreIrqs" /> to unblock interrupts.
 ///     </para>
@@ -131,11 +171,10 @@ static inline void SetReg32(uintptr_t baseAddr, size_t offset, uint32_t setBits)
 /// </returns>
 static inline uint32_t BlockIrqs(void)
 {
-    uint32_t prevBasePri;
-    uint32_t newBasePri = 1; // block IRQs priority 1 and above
+    uint32_t prevBasePri = ReadBasePri();
+    uint32_t newBasePri = 1 << (8 - IRQ_PRIORITY_BITS); // block IRQs priority 1 and lower
 
-    __asm__("mrs %0, BASEPRI" : "=r"(prevBasePri) :);
-    __asm__("msr BASEPRI, %0" : : "r"(newBasePri));
+    WriteBasePri(newBasePri);
     return prevBasePri;
 }
 
@@ -145,7 +184,7 @@ static inline uint32_t BlockIrqs(void)
 /// <param name="prevBasePri">Value returned from <see cref="BlockIrqs" />.</param>
 static inline void RestoreIrqs(uint32_t prevBasePri)
 {
-    __asm__("msr BASEPRI, %0" : : "r"(prevBasePri));
+    WriteBasePri(prevBasePri);
 }
 
 /// <summary>
@@ -0,0 +1,52 @@
+/* Futura MT3620 GPIO access from the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "mt3620-gpio.h"
+
+#include "mt3620-baremetal.h"
+
+// GPIO n is bit n % 4 of the block at GPIO_BLOCK_BASE + (n / 4) * GPIO_BLOCK_STRIDE.
+static const uintptr_t GPIO_BLOCK_BASE = 0x38010000;
+static const uintptr_t GPIO_BLOCK_STRIDE = 0x10000;
+
+static uintptr_t BlockBase(uint32_t gpio)
+{
+    return GPIO_BLOCK_BASE + (gpio / 4) * GPIO_BLOCK_STRIDE;
+}
+
+static uint32_t PinMask(uint32_t gpio)
+{
+    return UINT32_C(1) << (gpio % 4);
+}
+
+bool MT3620_Gpio_ConfigureOutput(uint32_t gpio, bool high)
+{
+    if (gpio >= MT3620_GPIO_COUNT) {
+        return false;
+    }
+
+    // Set the level before enabling the output, so that the GPIO does not glitch.
+    // GPIO_DOUT_SET or GPIO_DOUT_RESET.
+    WriteReg32(BlockBase(gpio), high ? 0x14 : 0x18, PinMask(gpio));
+    // GPIO_OE_SET.
+    WriteReg32(BlockBase(gpio), 0x24, PinMask(gpio));
+    return true;
+}
+
+bool MT3620_Gpio_ConfigureInput(uint32_t gpio)
+{
+    if (gpio >= MT3620_GPIO_COUNT) {
+        return false;
+    }
+
+    // GPIO_OE_RESET.
+    WriteReg32(BlockBase(gpio), 0x28, PinMask(gpio));
+    return true;
+}
+
+bool MT3620_Gpio_Read(uint32_t gpio)
+{
+    // GPIO_DIN.
+    return (ReadReg32(BlockBase(gpio), 0x04) & PinMask(gpio)) != 0;
+}
@@ -0,0 +1,28 @@
+/* Futura MT3620 GPIO access from the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// <summary>
+///     GPIOs 0 to 23 are supported: they are in the PWM/GPIO blocks, four to a block.
+///     The app manifest must list each GPIO which is used in the Gpio capability.
+/// </summary>
+#define MT3620_GPIO_COUNT 24
+
+/// <summary>Drives a GPIO to the supplied level.</summary>
+/// <returns>false if the GPIO is not supported.</returns>
+bool MT3620_Gpio_ConfigureOutput(uint32_t gpio, bool high);
+
+/// <summary>
+///     Stops driving a GPIO, so that it can be read. A line with a pull-up, such as a
+///     one-wire bus, is then released.
+/// </summary>
+/// <returns>false if the GPIO is not supported.</returns>
+bool MT3620_Gpio_ConfigureInput(uint32_t gpio);
+
+/// <summary>Reads the level of a GPIO, which must be supported.</summary>
+bool MT3620_Gpio_Read(uint32_t gpio);
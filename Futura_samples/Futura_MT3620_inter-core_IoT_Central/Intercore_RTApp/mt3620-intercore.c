@@ -50,6 +50,8 @@ void MT3620_SetupIntercoreComm(uint32_t *inboundBase, uint32_t *outboundBase, Ca
     recvCbNode.enqueued = false;
     recvCbNode.next = NULL;
     recvCbNode.cb = recvCallback;
+    // Draining the mailbox frees the inbound buffer, so it runs before timer DPCs.
+    recvCbNode.priority = DpcPriority_High;
 
     // Wait for the mailbox to be set up.
     while (true) {
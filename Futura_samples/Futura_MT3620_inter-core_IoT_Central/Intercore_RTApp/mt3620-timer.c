@@ -27,6 +27,21 @@ void MT3620_Gpt_Init(void)
     // IO CM4 GPT0 timer and GPT1 timer interrupt both use INT1.
     SetNvicPriority(1, GPT_PRIORITY);
     EnableNvicInterrupt(1);
+
+    // GPT3 has no interrupt. It counts up from GPT3_INIT, with one tick per OSC_CNT_1US + 1
+    // cycles of the 26MHz crystal.
+    // GPT3_CTRL[0] = 0 -> disable while it is reconfigured.
+    ClearReg32(GPT_BASE, 0x50, 0x01);
+    // GPT3_INIT = 0.
+    WriteReg32(GPT_BASE, 0x54, 0);
+    // GPT3_CTRL -> OSC_CNT_1US = 25 for 1MHz; enable timer.
+    WriteReg32(GPT_BASE, 0x50, (UINT32_C(25) << 16) | 0x01);
+}
+
+uint32_t MT3620_Gpt_GetTimestampUs(void)
+{
+    // GPT3_CNT.
+    return ReadReg32(GPT_BASE, 0x58);
 }
 
 void MT3620_Gpt_HandleIrq1(void)
@@ -72,3 +87,20 @@ void MT3620_Gpt_LaunchTimerMs(TimerGpt gpt, uint32_t periodMs, Callback callback
     // GPTx_CTRL -> auto clear; 1kHz, one shot, enable timer.
     WriteReg32(GPT_BASE, gptRegOffsets[gpt].ctrlRegOffset, 0x9);
 }
+
+void MT3620_Gpt_CancelTimer(TimerGpt gpt)
+{
+    uint32_t mask = UINT32_C(1) << gpt;
+
+    // GPTx_CTRL[0] = 0 -> disable.
+    ClearReg32(GPT_BASE, gptRegOffsets[gpt].ctrlRegOffset, 0x01);
+
+    // As in MT3620_Gpt_LaunchTimerMs, block timer ISRs while the shared IER is rewritten. An
+    // expiry which is already pending is cleared, so the ISR does not invoke the callback.
+    uint32_t prevBasePri = BlockIrqs();
+    // GPT_IER[gpt] = 0 -> disable interrupt.
+    ClearReg32(GPT_BASE, 0x04, mask);
+    // GPT_ISR[gpt] = 1 -> clear interrupt.
+    WriteReg32(GPT_BASE, 0x00, mask);
+    RestoreIrqs(prevBasePri);
+}
@@ -31,6 +31,14 @@ static const uint32_t GPT_PRIORITY = 2;
 /// </summary>
 void MT3620_Gpt_Init(void);
 
+/// <summary>
+///     Reads GPT3, which <see cref="MT3620_Gpt_Init" /> starts as a free-running
+///     microsecond counter. The count wraps around after about 71 minutes, so compute
+///     intervals as the unsigned difference of two timestamps.
+/// </summary>
+/// <returns>Microseconds since <see cref="MT3620_Gpt_Init" /> was called.</returns>
+uint32_t MT3620_Gpt_GetTimestampUs(void);
+
 /// <summary>
 ///     To use GPT0 or GPT1, install this function as the INT1 handler in the exception table.
 ///     Applications should not call this function directly.
@@ -60,3 +68,16 @@ void MT3620_Gpt_HandleIrq1(void);
 /// <param name="periodMs">Period in milliseconds.</param>
 /// <param name="callback">Function to invoke in interrupt context when the timer expires.</param>
 void MT3620_Gpt_LaunchTimerMs(TimerGpt gpt, uint32_t periodMs, Callback callback);
+
+/// <summary>
+///     <para>
+///         Stops a timer which was started with <see cref="Gpt_LaunchTimerMs" />, so that its
+///         callback is not invoked. Stopping a timer which has expired has no effect.
+///     </para>
+///     <para>
+///         Only call this function from the main application thread or from a timer callback,
+///         or with interrupts blocked.
+///     </para>
+/// </summary>
+/// <param name="gpt">Which hardware timer to stop.</param>
+void MT3620_Gpt_CancelTimer(TimerGpt gpt);
@@ -16,7 +16,8 @@ void Uart_Init(void);
 ///     <para>
 ///         Write a zero-terminated string to the debug UART. The zero terminator
 ///         is not written. This function will poll until the entire string has been
-///         written to the UART.
+///         written to the UART, so outside fault handlers prefer
+///         <see cref="Uart_EnqueueString" />, which returns without waiting.
 ///     </para>
 ///     <para>Call <see cref="Uart_Init" /> before calling this function.</para>
 /// </summary>
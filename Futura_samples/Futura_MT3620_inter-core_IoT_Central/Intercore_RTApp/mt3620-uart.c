@@ -0,0 +1,129 @@
+/* Futura MT3620 interrupt-driven debug UART output.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <stdbool.h>
+
+#include "mt3620-baremetal.h"
+#include "mt3620-uart.h"
+
+static const uintptr_t UART_BASE = 0x21040000;
+
+// Characters which can be written each time the transmit FIFO is empty.
+#define UART_TX_FIFO_DEPTH 16
+
+// The buffer size is a power of two, so the free-running indices wrap with a mask.
+_Static_assert((UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1)) == 0,
+               "UART_TX_BUFFER_SIZE must be a power of two");
+
+static uint8_t txBuffer[UART_TX_BUFFER_SIZE];
+// Written by the enqueueing code, with interrupts blocked.
+static volatile uint32_t txHead = 0;
+// Written by the UART interrupt.
+static volatile uint32_t txTail = 0;
+static volatile uint32_t txOverflow = 0;
+
+void Uart_InitTx(void)
+{
+    // FCR -> enable and clear the FIFOs.
+    WriteReg32(UART_BASE, 0x08, 0x07);
+
+    SetNvicPriority(4, UART_PRIORITY);
+    EnableNvicInterrupt(4);
+}
+
+void Uart_HandleIrq4(void)
+{
+    // LSR[5] is set when the transmit FIFO is empty, so it can take a full FIFO's worth.
+    if (!(ReadReg32(UART_BASE, 0x14) & (1U << 5))) {
+        return;
+    }
+
+    uint32_t tail = txTail;
+    for (int i = 0; i < UART_TX_FIFO_DEPTH && tail != txHead; ++i) {
+        WriteReg32(UART_BASE, 0x00, txBuffer[tail % UART_TX_BUFFER_SIZE]);
+        ++tail;
+    }
+    txTail = tail;
+
+    // Stop the interrupt until more data is enqueued. Interrupts are blocked, so that a GPT
+    // callback cannot enqueue data between the check and the register write.
+    uint32_t prevBasePri = BlockIrqs();
+    if (tail == txHead) {
+        // IER[1] = 0 -> disable transmit holding register empty interrupt.
+        ClearReg32(UART_BASE, 0x04, 1U << 1);
+    }
+    RestoreIrqs(prevBasePri);
+}
+
+void Uart_EnqueueString(const char *msg)
+{
+    Uart_EnqueueBytes(msg, __builtin_strlen(msg));
+}
+
+void Uart_EnqueueBytes(const void *data, size_t size)
+{
+    const uint8_t *data8 = (const uint8_t *)data;
+
+    uint32_t prevBasePri = BlockIrqs();
+    uint32_t head = txHead;
+    if (size > UART_TX_BUFFER_SIZE - (head - txTail)) {
+        txOverflow += size;
+        RestoreIrqs(prevBasePri);
+        return;
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+        txBuffer[head % UART_TX_BUFFER_SIZE] = data8[i];
+        ++head;
+    }
+    txHead = head;
+
+    // IER[1] = 1 -> the interrupt fires as soon as the transmit FIFO is empty, which
+    // may be immediately.
+    SetReg32(UART_BASE, 0x04, 1U << 1);
+    RestoreIrqs(prevBasePri);
+}
+
+void Uart_EnqueueInteger(int value)
+{
+    // Maximum decimal length is minus sign, ten digits, and null terminator.
+    char txt[1 + 10 + 1];
+    char *p = txt + sizeof(txt);
+    *--p = '\0';
+
+    // Work with the magnitude as unsigned, so that INT_MIN does not overflow.
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) {
+        *--p = '-';
+    }
+
+    Uart_EnqueueString(p);
+}
+
+void Uart_EnqueueHexByte(uint8_t value)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    char text[3];
+    text[0] = digits[value >> 4];
+    text[1] = digits[value & 0xF];
+    text[2] = '\0';
+
+    Uart_EnqueueString(text);
+}
+
+size_t Uart_GetTxFreeSpace(void)
+{
+    return UART_TX_BUFFER_SIZE - (txHead - txTail);
+}
+
+uint32_t Uart_GetTxOverflowCount(void)
+{
+    return txOverflow;
+}
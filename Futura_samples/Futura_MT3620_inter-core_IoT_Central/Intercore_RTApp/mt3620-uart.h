@@ -0,0 +1,76 @@
+/* Futura MT3620 interrupt-driven debug UART output.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>Size of the transmit buffer in bytes.</summary>
+#define UART_TX_BUFFER_SIZE 2048
+
+/// <summary>The UART interrupt runs at this priority level, below the GPTs and mailbox.</summary>
+static const uint32_t UART_PRIORITY = 3;
+
+/// <summary>
+///     Enables buffered output on the IOM4 debug UART. Call this once, after
+///     <see cref="Uart_Init" />. Install <see cref="Uart_HandleIrq4" /> as the INT4 handler
+///     in the exception table.
+/// </summary>
+void Uart_InitTx(void);
+
+/// <summary>
+///     To use buffered output, install this function as the INT4 handler in the exception
+///     table. Applications should not call this function directly.
+/// </summary>
+void Uart_HandleIrq4(void);
+
+/// <summary>
+///     <para>
+///         Copies a zero-terminated string to the transmit buffer and returns without
+///         waiting. The UART interrupt writes it out while the core does other work.
+///     </para>
+///     <para>
+///         If the string does not fit in the free space, none of it is written, so that
+///         output is never cut mid-line, and its length is added to the overflow count.
+///         This function may be called from interrupt context.
+///     </para>
+///     <para>
+///         Fault handlers, which cannot rely on interrupts, should use
+///         <see cref="Uart_WriteStringPoll" /> instead.
+///     </para>
+/// </summary>
+/// <param name="msg">Null-terminated string to write to the debug UART.</param>
+void Uart_EnqueueString(const char *msg);
+
+/// <summary>
+///     Enqueues binary data, as <see cref="Uart_EnqueueString" />: if it does not fit, none of
+///     it is written and its size is added to the overflow count.
+/// </summary>
+/// <param name="data">Data to write to the UART.</param>
+/// <param name="size">Size of the data in bytes.</param>
+void Uart_EnqueueBytes(const void *data, size_t size);
+
+/// <summary>
+///     Enqueues the decimal text representation of an integer, as
+///     <see cref="Uart_EnqueueString" />.
+/// </summary>
+/// <param name="value">Value to write to the UART.</param>
+void Uart_EnqueueInteger(int value);
+
+/// <summary>
+///     Enqueues a two-character hexadecimal string ("%02x"-format) which represents the
+///     supplied value, as <see cref="Uart_EnqueueString" />.
+/// </summary>
+/// <param name="value">The value whose string representation is written to the UART.</param>
+void Uart_EnqueueHexByte(uint8_t value);
+
+/// <summary>
+///     Returns the free space in the transmit buffer in bytes. Data of this size can be
+///     enqueued without loss until more is enqueued, including by interrupts.
+/// </summary>
+size_t Uart_GetTxFreeSpace(void);
+
+/// <summary>Returns the number of bytes dropped because the transmit buffer was full.</summary>
+uint32_t Uart_GetTxOverflowCount(void);
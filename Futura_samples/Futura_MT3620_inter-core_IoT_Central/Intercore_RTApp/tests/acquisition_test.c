@@ -0,0 +1,428 @@
+/* Futura MT3620 inter-core: acquisition engine test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Runs logical-acquisition.c, with mt3620-adc.c, over a simulated ADC: a scan converts the
+// channels of ADC_CTL0 into the FIFO a few polls apart, each value telling its scan and
+// channel apart, and now and then stops halfway and leaves a late sample in the FIFO. The
+// HLApp receives the batches and matches each sample with its scan. Checks that:
+// - the ADC and the outbound buffer are only used from the main loop, never in an interrupt;
+// - every sample has the value and timestamp of its scan, samples of a scan which timed out
+//   are not sent, and batches arrive in sequence;
+// - while the main loop keeps up, each channel is sampled once per period, without drift,
+//   and a partial batch is sent once its first sample has waited for the latency;
+// - when the main loop or the HLApp falls behind, every sample which is due is sent, counted
+//   as dropped, or lost with a scan which timed out;
+// - batches which did not fit in the outbound buffer at a stop are sent without another
+//   command.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "host-mt3620.h"
+#include "logical-acquisition.h"
+#include "logical-dht.h"
+#include "logical-dpc.h"
+#include "logical-timer.h"
+
+#define ADC_BASE 0x38000000
+#define FIFO_DEPTH 16
+#define MAX_SCANS 200000
+// Longest step of the main loop while it keeps up.
+#define STEP_US 200
+
+static const ComponentId hlAppId = {.data1 = 0x25025d2c,
+                                    .data2 = 0x66da,
+                                    .data3 = 0x4448,
+                                    .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc, 0xdd, 0x36, 0x27}};
+
+typedef struct {
+    uint32_t timeUs;
+    uint32_t mask;
+    bool complete;
+} Scan;
+
+// The simulated ADC
+static Scan scans[MAX_SCANS];
+static uint32_t scanCount = 0;
+static uint32_t toConvert = 0; // channels of the running scan not yet converted
+static bool stalled = false;
+static bool faults = false;
+static uint32_t fifo[FIFO_DEPTH];
+static uint32_t fifoCount = 0;
+
+// The HLApp
+static IntercoreComm icc;
+static uint32_t nextSequence = 0;
+static uint32_t lastDropped = 0;
+static uint32_t scanCursor = 0;
+static unsigned long received = 0;
+static uint32_t periodsMs[ACQUISITION_CHANNEL_COUNT];
+static uint32_t latencyMs;
+static bool keepingUp = false;
+static bool sampled[ACQUISITION_CHANNEL_COUNT];
+static uint32_t lastSampleUs[ACQUISITION_CHANNEL_COUNT];
+static unsigned long failures = 0;
+
+static uint32_t rngState = 0x85EBCA6B;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "at %llu us: %s: %lu\n", (unsigned long long)HostGpt_NowUs(), what, n);
+    }
+}
+
+// The logical-dht.c stand-in; the test does not read the DHT22.
+bool SetDhtPeriod(const ComponentId *newRecipient, uint32_t newPeriodMs)
+{
+    (void)newRecipient;
+    (void)newPeriodMs;
+    return false;
+}
+
+static uint16_t ValueOf(uint32_t scan, uint32_t channel)
+{
+    return (uint16_t)((scan * 37 + channel * 512) & MT3620_ADC_MAX_SAMPLE);
+}
+
+static void Push(uint32_t channel, uint16_t value)
+{
+    if (fifoCount == FIFO_DEPTH) {
+        Fail("ADC FIFO overflow", scanCount);
+        return;
+    }
+    fifo[fifoCount++] = ((uint32_t)value << 4) | channel;
+}
+
+static void CheckContext(void)
+{
+    if (HostIrq_IsRunning()) {
+        Fail("ADC used in an interrupt", scanCount);
+    }
+}
+
+static uint32_t AdcRead(size_t offset)
+{
+    CheckContext();
+    switch (offset) {
+    case 0x100: {
+        // ADC_FIFO_RBR
+        if (fifoCount == 0) {
+            Fail("ADC FIFO read while empty", scanCount);
+            return 0;
+        }
+        uint32_t entry = fifo[0];
+        memmove(fifo, fifo + 1, --fifoCount * sizeof(fifo[0]));
+        return entry;
+    }
+    case 0x114:
+        // ADC_FIFO_LSR: the next channel is converted now and then, unless the ADC stopped.
+        if (faults && Random(1000) == 0) {
+            stalled = true;
+        }
+        if (toConvert != 0 && !stalled && Random(3) == 0) {
+            uint32_t channel = (uint32_t)__builtin_ctz(toConvert);
+            Push(channel, ValueOf(scanCount - 1, channel));
+            toConvert &= toConvert - 1;
+            scans[scanCount - 1].complete = toConvert == 0;
+        }
+        return fifoCount != 0 ? 1 : 0;
+    default:
+        return 0;
+    }
+}
+
+static void AdcWrite(size_t offset, uint32_t value)
+{
+    CheckContext();
+    if (offset != 0x00) {
+        return;
+    }
+    // ADC_CTL0
+    if ((value & 1) == 0) {
+        // A scan which stopped halfway may still deliver a sample, for the next to discard.
+        if (toConvert != 0 && Random(2) == 0) {
+            uint32_t channel = (uint32_t)__builtin_ctz(toConvert);
+            Push(channel, (uint16_t)(ValueOf(scanCount - 1, channel) ^ 0x800));
+        }
+        toConvert = 0;
+        return;
+    }
+    if (toConvert != 0) {
+        Fail("scan started while one runs", scanCount);
+    }
+    if (scanCount == MAX_SCANS) {
+        Fail("too many scans", scanCount);
+        return;
+    }
+    Scan *scan = &scans[scanCount++];
+    scan->timeUs = (uint32_t)HostGpt_NowUs();
+    scan->mask = (value >> 16) & 0xFF;
+    scan->complete = false;
+    toConvert = scan->mask;
+    stalled = false;
+}
+
+static const HostPeripheral adc = {
+    .base = ADC_BASE, .size = 0x200, .read = AdcRead, .write = AdcWrite};
+
+static void OnMessageSent(void)
+{
+    if (HostIrq_IsRunning()) {
+        Fail("batch sent in an interrupt", nextSequence);
+    }
+}
+
+static void CheckSample(const AcquisitionSample *sample)
+{
+    // Samples arrive in the order of their scans.
+    uint32_t bit = UINT32_C(1) << sample->channel;
+    while (scanCursor < scanCount &&
+           (scans[scanCursor].timeUs != sample->timestampUs || (scans[scanCursor].mask & bit) == 0)) {
+        ++scanCursor;
+    }
+    if (scanCursor == scanCount) {
+        Fail("sample of no scan, channel", sample->channel);
+        scanCursor = 0;
+        return;
+    }
+    if (!scans[scanCursor].complete) {
+        Fail("sample of a scan which timed out", scanCursor);
+    }
+    if (sample->value != ValueOf(scanCursor, sample->channel)) {
+        Fail("sample value differs, scan", scanCursor);
+    }
+    ++received;
+
+    uint32_t channel = sample->channel;
+    if (keepingUp && sampled[channel]) {
+        // The tick is on time and the main loop converts it within a step.
+        uint32_t gapUs = sample->timestampUs - lastSampleUs[channel];
+        if (gapUs + STEP_US <= periodsMs[channel] * 1000 ||
+            gapUs >= periodsMs[channel] * 1000 + STEP_US) {
+            Fail("sampling period differs, us", gapUs);
+        }
+    }
+    sampled[channel] = true;
+    lastSampleUs[channel] = sample->timestampUs;
+}
+
+static void CheckBatch(const uint8_t *message, size_t size)
+{
+    AcquisitionBatchHeader header;
+    if (size < sizeof(header)) {
+        Fail("message too short", size);
+        return;
+    }
+    memcpy(&header, message, sizeof(header));
+    if (header.magic != ACQUISITION_BATCH_MAGIC || header.version != ACQUISITION_BATCH_VERSION ||
+        header.sampleCount == 0 || header.sampleCount > ACQUISITION_BATCH_SAMPLES ||
+        size != sizeof(header) + header.sampleCount * sizeof(AcquisitionSample)) {
+        Fail("malformed batch, size", size);
+        return;
+    }
+    if (header.sequence != nextSequence) {
+        Fail("batch out of sequence", header.sequence);
+    }
+    nextSequence = header.sequence + 1;
+    if (header.droppedSamples < lastDropped || (keepingUp && header.droppedSamples != lastDropped)) {
+        Fail("dropped samples", header.droppedSamples);
+    }
+    lastDropped = header.droppedSamples;
+
+    AcquisitionSample first;
+    memcpy(&first, message + sizeof(header), sizeof(first));
+    // A partial batch is completed at the first tick after its latency, which is at most
+    // the longest period later.
+    uint32_t longestMs = 0;
+    for (int channel = 0; channel < ACQUISITION_CHANNEL_COUNT; ++channel) {
+        longestMs = periodsMs[channel] > longestMs ? periodsMs[channel] : longestMs;
+    }
+    if (keepingUp && header.sampleCount < ACQUISITION_BATCH_SAMPLES &&
+        (uint32_t)HostGpt_NowUs() - first.timestampUs > (latencyMs + longestMs) * 1000 + STEP_US) {
+        Fail("partial batch sent late, samples", header.sampleCount);
+    }
+
+    for (uint32_t i = 0; i < header.sampleCount; ++i) {
+        AcquisitionSample sample;
+        memcpy(&sample, message + sizeof(header) + i * sizeof(sample), sizeof(sample));
+        CheckSample(&sample);
+    }
+}
+
+static void Receive(void)
+{
+    uint8_t buffer[INTERCORE_MAX_PAYLOAD_LEN];
+    ComponentId sender;
+    size_t size = sizeof(buffer);
+    while (HostHl_Recv(&sender, buffer, &size)) {
+        CheckBatch(buffer, size);
+        size = sizeof(buffer);
+    }
+}
+
+static void Command(AcquisitionCommandCode code, uint32_t channel, uint32_t valueMs)
+{
+    AcquisitionCommand command = {.magic = ACQUISITION_COMMAND_MAGIC,
+                                  .command = (uint8_t)code,
+                                  .channel = (uint8_t)channel,
+                                  .reserved = 0,
+                                  .valueMs = valueMs};
+    if (!HandleAcquisitionCommand(&hlAppId, &command, sizeof(command))) {
+        Fail("command not handled", code);
+    }
+}
+
+static void Configure(const uint32_t *periods, uint32_t latency)
+{
+    for (uint32_t channel = 0; channel < ACQUISITION_CHANNEL_COUNT; ++channel) {
+        periodsMs[channel] = periods[channel];
+        sampled[channel] = false;
+        Command(AcquisitionCommand_SetPeriod, channel, periods[channel]);
+    }
+    latencyMs = latency;
+    Command(AcquisitionCommand_SetLatency, 0, latency);
+}
+
+// Runs the main loop for a time, in steps of up to stepUs, and the HLApp every drainEvery steps.
+static void Run(uint32_t durationMs, uint32_t stepUs, uint32_t drainEvery)
+{
+    uint64_t endUs = HostGpt_NowUs() + (uint64_t)durationMs * 1000;
+    while (HostGpt_NowUs() < endUs) {
+        HostGpt_Advance(1 + Random(stepUs));
+        InvokeDeferredProcs();
+        if (drainEvery != 0 && Random(drainEvery) == 0) {
+            Receive();
+        }
+    }
+}
+
+static unsigned long CompleteScanSamples(uint32_t from)
+{
+    unsigned long samples = 0;
+    for (uint32_t i = from; i < scanCount; ++i) {
+        if (scans[i].complete) {
+            samples += (unsigned long)__builtin_popcount(scans[i].mask);
+        }
+    }
+    return samples;
+}
+
+// Channel periods which a main loop of STEP_US keeps up with, and every sample is checked.
+static void TestKeepingUp(void)
+{
+    static const uint32_t choices[] = {0, 0, 1, 2, 5, 10, 20, 50, 100};
+    for (int round = 0; round < 6; ++round) {
+        uint32_t periods[ACQUISITION_CHANNEL_COUNT];
+        for (int channel = 0; channel < ACQUISITION_CHANNEL_COUNT; ++channel) {
+            periods[channel] = choices[Random(sizeof(choices) / sizeof(choices[0]))];
+        }
+        keepingUp = true;
+        Configure(periods, 5 + Random(200));
+        Command(AcquisitionCommand_Start, 0, 0);
+        Run(5000, STEP_US, 1);
+        Command(AcquisitionCommand_Stop, 0, 0);
+        Receive();
+        keepingUp = false;
+    }
+}
+
+// Every channel is due at each 1 ms tick, while the main loop runs every few milliseconds,
+// the HLApp is slow, and the ADC stops now and then. The samples which are due are sent,
+// dropped, or lost with a scan which timed out.
+static void TestFallingBehind(void)
+{
+    static const uint32_t periods[ACQUISITION_CHANNEL_COUNT] = {1, 1, 1, 1, 1, 1, 1, 1};
+    Configure(periods, 20);
+    Receive();
+    uint32_t firstScan = scanCount;
+    unsigned long receivedBefore = received;
+    uint32_t droppedBefore = lastDropped;
+
+    faults = true;
+    uint64_t startUs = HostGpt_NowUs();
+    Command(AcquisitionCommand_Start, 0, 0);
+    Run(10000, 5000, 4);
+    uint64_t stopUs = HostGpt_NowUs();
+    Command(AcquisitionCommand_Stop, 0, 0);
+    faults = false;
+    Run(100, STEP_US, 1);
+
+    unsigned long due = 0;
+    for (uint32_t i = firstScan; i < scanCount; ++i) {
+        if (!scans[i].complete) {
+            due += (unsigned long)__builtin_popcount(scans[i].mask);
+        }
+    }
+    due += received - receivedBefore + (lastDropped - droppedBefore);
+    // The first tick is 1 to 2 ms after the start.
+    unsigned long ticks = (unsigned long)((stopUs - startUs) / 1000);
+    if (due < (ticks - 1) * ACQUISITION_CHANNEL_COUNT || due > ticks * ACQUISITION_CHANNEL_COUNT) {
+        Fail("samples sent, dropped or lost, not the samples due", due);
+    }
+    if (lastDropped == droppedBefore) {
+        Fail("nothing dropped while falling behind", 0);
+    }
+}
+
+// The HLApp does not read while the batches fill the outbound buffer, and some wait in the
+// engine, which is stopped before it drops samples. Then the HLApp drains, and no command
+// comes.
+static void TestStopWithFullBuffer(void)
+{
+    static const uint32_t periods[ACQUISITION_CHANNEL_COUNT] = {1, 0, 0, 0, 0, 0, 0, 2};
+    Configure(periods, 10);
+    Receive();
+    uint32_t firstScan = scanCount;
+    unsigned long receivedBefore = received;
+
+    Command(AcquisitionCommand_Start, 0, 0);
+    Run(300, STEP_US, 0);
+    Command(AcquisitionCommand_Stop, 0, 0);
+    Run(200, STEP_US, 0);
+    for (int i = 0; i < 20; ++i) {
+        Receive();
+        Run(20, STEP_US, 0);
+    }
+
+    if (received - receivedBefore != CompleteScanSamples(firstScan)) {
+        Fail("samples converted before the stop were not sent", received - receivedBefore);
+    }
+    if (HostGpt_IsRunning(TimerGpt0)) {
+        Fail("a timer runs with nothing to send", 0);
+    }
+}
+
+int main(void)
+{
+    HostIntercore_Init(4096, 4096);
+    SetupIntercoreComm(&icc, NULL);
+    hostOnMessageSent = OnMessageSent;
+    HostReg_Map(&adc);
+    SetupSoftTimers(TimerGpt0);
+    MT3620_Adc_Init();
+    SetupAcquisition(&icc);
+
+    TestKeepingUp();
+    TestFallingBehind();
+    TestStopWithFullBuffer();
+    HostIntercore_Cleanup();
+
+    uint32_t timedOut = 0;
+    for (uint32_t i = 0; i < scanCount; ++i) {
+        timedOut += scans[i].complete ? 0 : 1;
+    }
+    printf("%u scans, %u timed out, %lu samples received, %u dropped, %u batches, "
+           "%lu failure(s)\n",
+           scanCount, timedOut, received, lastDropped, nextSequence, failures);
+    return failures != 0;
+}
@@ -0,0 +1,468 @@
+/* Futura MT3620 inter-core: DHT22 test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Decodes edges of random readings, timed as the sampling of the line would, then runs
+// logical-dht.c, with mt3620-gpio.c, over a simulated DHT22 on a GPIO: the sensor answers a
+// start pulse of at least 1ms with its response and 40 bits, within the tolerance of its
+// datasheet, and each call of MT3620_Gpt_GetTimestampUs moves the time on by a few
+// microseconds. Some reads have no sensor, a wrong checksum, or an interrupt which delays the
+// sampling. Checks that:
+// - DecodeDhtEdges returns the bytes of every reading, including negative temperatures, and
+//   reports a bad checksum, a missing response, a truncated transfer and pulses out of range;
+// - every read is reported to the HLApp, with its status, temperature, humidity, attempts,
+//   status counts and start time;
+// - the line is only driven low, for at least 1ms while other timers run, and reads are a period apart after a
+//   valid one and DHT_MIN_INTERVAL_MS apart after a failed one, and stop when asked to.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host-mt3620.h"
+#include "logical-dht.h"
+#include "logical-dpc.h"
+#include "logical-timer.h"
+
+#define DHT_GPIO 5
+#define GPIO_BLOCK_BASE (0x38010000 + (DHT_GPIO / 4) * 0x10000)
+#define GPIO_PIN (1U << (DHT_GPIO % 4))
+#define DECODES 100000
+#define MAX_READS 2000
+// Longest time between two samples of the line when nothing interrupts the sampling.
+#define SAMPLE_GAP_US 10
+#define WAVEFORM_EDGES DHT_MAX_EDGES
+
+static const ComponentId hlAppId = {.data1 = 0x25025d2c,
+                                    .data2 = 0x66da,
+                                    .data3 = 0x4448,
+                                    .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc, 0xdd, 0x36, 0x27}};
+
+typedef enum { Read_Ok, Read_Absent, Read_Checksum, Read_Interrupted } ReadKind;
+
+typedef struct {
+    ReadKind kind;
+    int16_t temperatureTenths;
+    uint16_t humidityTenths;
+    uint32_t releaseUs;
+} Read;
+
+// The simulated sensor
+static bool driven = false;
+static bool driveHigh = false;
+static uint64_t drivenSinceUs = 0;
+static uint64_t waveformUs[WAVEFORM_EDGES];
+static bool waveformHigh[WAVEFORM_EDGES];
+static uint32_t waveformEdges = 0;
+static uint64_t interruptAtUs = 0;
+static bool interruptPending = false;
+
+// The reads, as the sensor saw them, and the HLApp
+static IntercoreComm icc;
+static Read reads[MAX_READS];
+static uint32_t readCount = 0;
+static uint32_t readsReceived = 0;
+static uint8_t expectedAttempts = 0;
+static uint32_t expectedCounts[DHT_STATUS_COUNT];
+static uint32_t periodMs = 0;
+static unsigned long failures = 0;
+
+static uint32_t rngState = 0xC2B2AE35;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "at %llu us: %s: %lu\n", (unsigned long long)HostGpt_NowUs(), what, n);
+    }
+}
+
+static uint32_t Between(uint32_t min, uint32_t max)
+{
+    return min + Random(max - min + 1);
+}
+
+static void Encode(int16_t temperatureTenths, uint16_t humidityTenths, uint8_t *data)
+{
+    uint16_t magnitude = (uint16_t)abs(temperatureTenths);
+    data[0] = (uint8_t)(humidityTenths >> 8);
+    data[1] = (uint8_t)humidityTenths;
+    data[2] = (uint8_t)((magnitude >> 8) | (temperatureTenths < 0 ? 0x80 : 0));
+    data[3] = (uint8_t)magnitude;
+    data[4] = (uint8_t)(data[0] + data[1] + data[2] + data[3]);
+}
+
+static void RandomReading(int16_t *temperatureTenths, uint16_t *humidityTenths)
+{
+    // -40.0 to 80.0 degrees and 0 to 100.0 percent, the range of the DHT22.
+    *temperatureTenths = (int16_t)((int32_t)Random(1201) - 400);
+    *humidityTenths = (uint16_t)Random(1001);
+}
+
+// The edges of a transfer after the line is released at startUs, as the datasheet gives them:
+// the response, 80us low and 80us high, each bit as 50us low and 26-28us or 70us high, and
+// 50us low before the sensor releases the line.
+static uint32_t Waveform(const uint8_t *data, uint64_t startUs, uint64_t *times, bool *highs)
+{
+    uint32_t count = 0;
+    uint64_t t = startUs + Between(20, 40);
+    times[count] = t;
+    highs[count++] = false;
+    t += Between(75, 85);
+    times[count] = t;
+    highs[count++] = true;
+    t += Between(75, 85);
+    times[count] = t;
+    highs[count++] = false;
+    for (uint32_t bit = 0; bit < 40; ++bit) {
+        bool one = (data[bit / 8] & (0x80 >> (bit % 8))) != 0;
+        t += Between(48, 55);
+        times[count] = t;
+        highs[count++] = true;
+        t += one ? Between(68, 75) : Between(22, 30);
+        times[count] = t;
+        highs[count++] = false;
+    }
+    t += Between(45, 55);
+    times[count] = t;
+    highs[count++] = true;
+    return count;
+}
+
+static void CheckDecode(const DhtEdge *edges, size_t count, DhtStatus expected,
+                        const uint8_t *expectedData, const char *what, unsigned long n)
+{
+    uint8_t data[5];
+    DhtStatus status = DecodeDhtEdges(edges, count, data);
+    if (status != expected) {
+        Fail(what, n);
+    } else if (expectedData != NULL && memcmp(data, expectedData, sizeof(data)) != 0) {
+        Fail("decoded bytes differ, reading", n);
+    }
+}
+
+// Random readings, whose edges are seen up to SAMPLE_GAP_US late, then spoiled in various ways.
+static void TestDecode(void)
+{
+    for (unsigned long n = 0; n < DECODES; ++n) {
+        int16_t temperatureTenths;
+        uint16_t humidityTenths;
+        uint8_t data[5];
+        RandomReading(&temperatureTenths, &humidityTenths);
+        Encode(temperatureTenths, humidityTenths, data);
+
+        uint64_t times[WAVEFORM_EDGES];
+        bool highs[WAVEFORM_EDGES];
+        uint32_t count = Waveform(data, 0, times, highs);
+        DhtEdge edges[WAVEFORM_EDGES];
+        for (uint32_t i = 0; i < count; ++i) {
+            edges[i] = (DhtEdge){.timeUs = (uint32_t)times[i] + Random(SAMPLE_GAP_US + 1),
+                                 .high = highs[i]};
+        }
+
+        // The release of the line at the end is not needed.
+        CheckDecode(edges, count - Random(2), DhtStatus_Ok, data, "reading not decoded", n);
+
+        DhtEdge spoiled[WAVEFORM_EDGES];
+        memcpy(spoiled, edges, sizeof(spoiled));
+        switch (Random(5)) {
+        case 0:
+            CheckDecode(edges, Random(3), DhtStatus_NoResponse, NULL,
+                        "no response not reported, edges", count);
+            break;
+        case 1: {
+            size_t truncated = 3 + Random(80);
+            CheckDecode(edges, truncated, DhtStatus_BadTiming, NULL,
+                        "truncated transfer not reported, edges", truncated);
+            break;
+        }
+        case 2: {
+            // A pulse too long: every edge from a random one on is late.
+            uint32_t from = 1 + Random(count - 2);
+            for (uint32_t i = from; i < count; ++i) {
+                spoiled[i].timeUs += 130;
+            }
+            CheckDecode(spoiled, count, DhtStatus_BadTiming, NULL, "long pulse accepted, edge",
+                        from);
+            break;
+        }
+        case 3: {
+            // A glitch: a pulse too short to be the sensor's.
+            uint32_t edge = 1 + Random(count - 2);
+            spoiled[edge].timeUs = spoiled[edge - 1].timeUs + Random(8);
+            CheckDecode(spoiled, count, DhtStatus_BadTiming, NULL, "short pulse accepted, edge",
+                        edge);
+            break;
+        }
+        default: {
+            // Each bit of the checksum, or of the data, changes the sum.
+            uint32_t bit = Random(40);
+            uint32_t edge = 3 + 2 * bit + 1;
+            bool one = (data[bit / 8] & (0x80 >> (bit % 8))) != 0;
+            int32_t shift = one ? -45 : 45;
+            for (uint32_t i = edge; i < count; ++i) {
+                spoiled[i].timeUs = (uint32_t)((int32_t)spoiled[i].timeUs + shift);
+            }
+            CheckDecode(spoiled, count, DhtStatus_Checksum, NULL, "bad checksum accepted, bit",
+                        bit);
+            break;
+        }
+        }
+    }
+}
+
+static bool LineHigh(void)
+{
+    if (driven) {
+        return driveHigh;
+    }
+    // The pull-up holds the line high, unless the sensor pulls it low.
+    uint64_t nowUs = HostGpt_NowUs();
+    bool high = true;
+    for (uint32_t i = 0; i < waveformEdges && waveformUs[i] <= nowUs; ++i) {
+        high = waveformHigh[i];
+    }
+    return high;
+}
+
+static void Release(void)
+{
+    uint64_t nowUs = HostGpt_NowUs();
+    driven = false;
+    waveformEdges = 0;
+    if (!driveHigh && nowUs - drivenSinceUs < 1000) {
+        Fail("start pulse shorter than 1ms, us", (unsigned long)(nowUs - drivenSinceUs));
+        return;
+    }
+    if (readCount == MAX_READS) {
+        Fail("too many reads", readCount);
+        return;
+    }
+
+    if (readCount > 0) {
+        // A read lasts about 5ms, and the timer ticks every millisecond.
+        uint32_t delayMs = reads[readCount - 1].kind == Read_Ok ? periodMs : DHT_MIN_INTERVAL_MS;
+        uint32_t sinceUs = (uint32_t)nowUs - reads[readCount - 1].releaseUs;
+        if (sinceUs < delayMs * 1000 || sinceUs > delayMs * 1000 + 10000) {
+            Fail("time between two reads, us", sinceUs);
+        }
+    }
+
+    Read *read = &reads[readCount++];
+    uint32_t kind = Random(10);
+    read->kind = kind < 7 ? Read_Ok : (ReadKind)(kind - 6);
+    read->releaseUs = (uint32_t)nowUs;
+    RandomReading(&read->temperatureTenths, &read->humidityTenths);
+    if (read->kind == Read_Absent) {
+        return;
+    }
+    uint8_t data[5];
+    Encode(read->temperatureTenths, read->humidityTenths, data);
+    if (read->kind == Read_Checksum) {
+        data[4] ^= (uint8_t)(1 + Random(255));
+    }
+    waveformEdges = Waveform(data, nowUs, waveformUs, waveformHigh);
+    if (read->kind == Read_Interrupted) {
+        // Sampling stops at the last edge.
+        interruptAtUs = nowUs + Random((uint32_t)(waveformUs[waveformEdges - 1] - nowUs));
+        interruptPending = true;
+    }
+}
+
+static uint32_t GpioRead(size_t offset)
+{
+    // GPIO_DIN
+    return offset == 0x04 && LineHigh() ? GPIO_PIN : 0;
+}
+
+static void GpioWrite(size_t offset, uint32_t value)
+{
+    if ((value & GPIO_PIN) == 0) {
+        return;
+    }
+    switch (offset) {
+    case 0x14:
+        // GPIO_DOUT_SET: an open-drain bus must never be driven high.
+        driveHigh = true;
+        break;
+    case 0x18:
+        // GPIO_DOUT_RESET
+        driveHigh = false;
+        break;
+    case 0x24:
+        // GPIO_OE_SET
+        if (driveHigh) {
+            Fail("line driven high, read", readCount);
+        }
+        if (!driven) {
+            driven = true;
+            drivenSinceUs = HostGpt_NowUs();
+        }
+        break;
+    case 0x28:
+        // GPIO_OE_RESET
+        if (driven) {
+            Release();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static const HostPeripheral gpio = {
+    .base = GPIO_BLOCK_BASE, .size = 0x100, .read = GpioRead, .write = GpioWrite};
+
+// Each timestamp of the main loop is a few microseconds after the previous one, as the sampling
+// loop runs, and an interrupt now and then takes longer. Timestamps in an interrupt, which
+// HostGpt_Advance may be running, leave the time alone.
+static void OnTimestamp(void)
+{
+    if (HostIrq_IsRunning()) {
+        return;
+    }
+    if (interruptPending && HostGpt_NowUs() >= interruptAtUs) {
+        interruptPending = false;
+        HostGpt_Advance(13 + Random(100));
+        return;
+    }
+    HostGpt_Advance(1 + Random(SAMPLE_GAP_US));
+}
+
+static void CheckReading(const DhtReadingMessage *message)
+{
+    if (readsReceived == readCount) {
+        Fail("reading of no read", message->timestampUs);
+        return;
+    }
+    const Read *read = &reads[readsReceived++];
+    static const DhtStatus statuses[] = {DhtStatus_Ok, DhtStatus_NoResponse, DhtStatus_Checksum,
+                                         DhtStatus_Interrupted};
+    DhtStatus status = statuses[read->kind];
+    if (message->status != status) {
+        Fail("status differs, read", readsReceived - 1);
+    }
+    if (expectedAttempts < UINT8_MAX) {
+        ++expectedAttempts;
+    }
+    ++expectedCounts[status];
+    if (message->attempts != expectedAttempts) {
+        Fail("attempts differ, read", readsReceived - 1);
+    }
+    if (memcmp(message->statusCounts, expectedCounts, sizeof(expectedCounts)) != 0) {
+        Fail("status counts differ, read", readsReceived - 1);
+    }
+    // The start time is the first sample, just after the release.
+    if (message->timestampUs - read->releaseUs > SAMPLE_GAP_US) {
+        Fail("start time differs, read", readsReceived - 1);
+    }
+    bool valid = status == DhtStatus_Ok;
+    if (message->temperatureTenths != (valid ? read->temperatureTenths : 0) ||
+        message->humidityTenths != (valid ? read->humidityTenths : 0)) {
+        Fail("reading differs, read", readsReceived - 1);
+    }
+    if (valid) {
+        expectedAttempts = 0;
+    }
+}
+
+static void Receive(void)
+{
+    uint8_t buffer[INTERCORE_MAX_PAYLOAD_LEN];
+    ComponentId sender;
+    size_t size = sizeof(buffer);
+    while (HostHl_Recv(&sender, buffer, &size)) {
+        DhtReadingMessage message;
+        if (size != sizeof(message) || buffer[0] != DHT_READING_MAGIC) {
+            Fail("malformed reading, size", size);
+        } else {
+            memcpy(&message, buffer, sizeof(message));
+            CheckReading(&message);
+        }
+        size = sizeof(buffer);
+    }
+}
+
+// Runs the main loop for a time, in steps of up to 200us.
+static void Run(uint32_t durationMs)
+{
+    uint64_t endUs = HostGpt_NowUs() + (uint64_t)durationMs * 1000;
+    while (HostGpt_NowUs() < endUs) {
+        HostGpt_Advance(1 + Random(200));
+        InvokeDeferredProcs();
+        Receive();
+    }
+}
+
+static void Tick(void) {}
+
+// Another timer shares the GPT, so a timer of the DHT22 starts between two of its ticks.
+static SoftTimer otherTimer = {.next = NULL, .running = false, .cb = Tick};
+
+static void TestReads(void)
+{
+    if (SetDhtPeriod(&hlAppId, DHT_MIN_INTERVAL_MS - 1)) {
+        Fail("period below the minimum accepted", DHT_MIN_INTERVAL_MS - 1);
+    }
+    Run(5000);
+    if (readCount != 0) {
+        Fail("read before a period was set", readCount);
+    }
+
+    static const uint32_t periods[] = {DHT_MIN_INTERVAL_MS, 2500, 5000, 10000};
+    for (int round = 0; round < 8; ++round) {
+        periodMs = periods[Random(sizeof(periods) / sizeof(periods[0]))];
+        StartSoftTimer(&otherTimer, 1 + Random(7), 1 + Random(7));
+        if (!SetDhtPeriod(&hlAppId, periodMs)) {
+            Fail("period not accepted", periodMs);
+        }
+        Run(200000);
+        if (!SetDhtPeriod(&hlAppId, 0)) {
+            Fail("stop not accepted", 0);
+        }
+        // A read which had started ends, and no other follows.
+        Run(100);
+        StopSoftTimer(&otherTimer);
+        uint32_t stoppedAt = readCount;
+        Run(30000);
+        if (readCount != stoppedAt) {
+            Fail("read after a stop", readCount - stoppedAt);
+        }
+        if (readsReceived != readCount) {
+            Fail("reads not reported", readCount - readsReceived);
+        }
+        // The next round starts a read DHT_MIN_INTERVAL_MS after the period is set.
+        readCount = 0;
+        readsReceived = 0;
+    }
+}
+
+int main(void)
+{
+    TestDecode();
+
+    HostIntercore_Init(4096, 4096);
+    SetupIntercoreComm(&icc, NULL);
+    HostReg_Map(&gpio);
+    SetupSoftTimers(TimerGpt0);
+    hostOnTimestamp = OnTimestamp;
+    SetupDht(&icc, DHT_GPIO);
+
+    TestReads();
+    HostIntercore_Cleanup();
+
+    printf("%d readings decoded, %u reads, %u ok, %u no response, %u checksum, %u interrupted, "
+           "%lu failure(s)\n",
+           DECODES, expectedCounts[0] + expectedCounts[1] + expectedCounts[2] + expectedCounts[3] +
+                        expectedCounts[4],
+           expectedCounts[DhtStatus_Ok], expectedCounts[DhtStatus_NoResponse],
+           expectedCounts[DhtStatus_Checksum], expectedCounts[DhtStatus_Interrupted], failures);
+    return failures != 0;
+}
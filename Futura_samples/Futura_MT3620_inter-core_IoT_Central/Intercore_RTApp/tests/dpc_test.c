@@ -0,0 +1,261 @@
+/* Futura MT3620 inter-core: deferred procedure call test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Runs logical-dpc.c over the interrupts of host-mt3620.c, whose BASEPRI keeps only the
+// priority bits of the MT3620, and checks that:
+// - BlockIrqs masks the priorities which the application uses, also when nested, and
+//   RestoreIrqs runs the interrupts which were raised meanwhile;
+// - interrupts raised in the middle of EnqueueDeferredProc and InvokeDeferredProcs, from
+//   MT3620_Gpt_GetTimestampUs, and DPCs which enqueue DPCs, themselves included, leave lists
+//   which run every DPC once per enqueue, the highest priority first and in enqueue order
+//   within a priority, as a model of the lists does;
+// - runCount and maxLatencyUs match the model.
+
+#include <stdio.h>
+
+#include "host-mt3620.h"
+#include "logical-dpc.h"
+
+#define NODES 12
+#define OPERATIONS 200000
+
+typedef struct {
+    CallbackNode node;
+    // Model
+    bool enqueued;
+    uint32_t enqueuedUs;
+    uint32_t runCount;
+    uint32_t maxLatencyUs;
+} TestNode;
+
+static TestNode nodes[NODES];
+// The model of the lists: nodes in enqueue order, for each priority.
+static int queues[DPC_PRIORITY_COUNT][NODES];
+static int queueLengths[DPC_PRIORITY_COUNT];
+// The node which InvokeDeferredProcs took off its list, if the model found out before it ran.
+static int inFlight = -1;
+static uint32_t inFlightEnqueuedUs;
+static uint32_t nowUs = 0;
+static unsigned long isrRuns = 0;
+static unsigned long dpcRuns = 0;
+static unsigned long failures = 0;
+
+static uint32_t rngState = 0x9E3779B9;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, int index)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "at %u us, node %d: %s\n", nowUs, index, what);
+    }
+}
+
+// The model of taking the node off the lists, which must be the next to run.
+static void Dequeue(int index)
+{
+    int priority = DPC_PRIORITY_COUNT - 1;
+    while (priority >= 0 && queueLengths[priority] == 0) {
+        --priority;
+    }
+    if (priority < 0 || queues[priority][0] != index) {
+        Fail("ran out of order", index);
+        return;
+    }
+    for (int i = 1; i < queueLengths[priority]; ++i) {
+        queues[priority][i - 1] = queues[priority][i];
+    }
+    --queueLengths[priority];
+}
+
+static void Enqueue(int index)
+{
+    // If InvokeDeferredProcs took a node off the lists and an interrupt came before it ran,
+    // the model takes it off first.
+    for (int i = 0; i < NODES; ++i) {
+        if (nodes[i].enqueued && !nodes[i].node.enqueued) {
+            Dequeue(i);
+            nodes[i].enqueued = false;
+            inFlight = i;
+            inFlightEnqueuedUs = nodes[i].enqueuedUs;
+        }
+    }
+
+    TestNode *test = &nodes[index];
+    if (!test->enqueued) {
+        DpcPriority priority = test->node.priority;
+        queues[priority][queueLengths[priority]++] = index;
+        test->enqueued = true;
+        test->enqueuedUs = nowUs;
+    }
+    EnqueueDeferredProc(&test->node);
+}
+
+static void Advance(uint32_t us)
+{
+    HostGpt_Advance(us);
+    nowUs += us;
+}
+
+// Each DPC checks that it is the first node of the highest priority list of the model.
+static void RunDpc(int index)
+{
+    TestNode *test = &nodes[index];
+    ++dpcRuns;
+    uint32_t enqueuedUs;
+    if (inFlight == index) {
+        inFlight = -1;
+        enqueuedUs = inFlightEnqueuedUs;
+    } else {
+        if (!test->enqueued) {
+            Fail("ran without being enqueued", index);
+        }
+        Dequeue(index);
+        test->enqueued = false;
+        enqueuedUs = test->enqueuedUs;
+    }
+    ++test->runCount;
+    if (nowUs - enqueuedUs > test->maxLatencyUs) {
+        test->maxLatencyUs = nowUs - enqueuedUs;
+    }
+
+    Advance(Random(20));
+    // Some DPCs enqueue DPCs, themselves included.
+    if (Random(4) == 0) {
+        Enqueue((int)Random(NODES));
+    }
+}
+
+#define DPC(n)                                                                                     \
+    static void Dpc##n(void)                                                                       \
+    {                                                                                              \
+        RunDpc(n);                                                                                 \
+    }
+DPC(0)
+DPC(1)
+DPC(2)
+DPC(3)
+DPC(4)
+DPC(5)
+DPC(6)
+DPC(7)
+DPC(8)
+DPC(9)
+DPC(10)
+DPC(11)
+static const Callback dpcs[NODES] = {Dpc0, Dpc1, Dpc2, Dpc3, Dpc4,  Dpc5,
+                                     Dpc6, Dpc7, Dpc8, Dpc9, Dpc10, Dpc11};
+
+// The interrupts of the application: GPT and mailbox at priority 2, UART at 3.
+static void Isr(void)
+{
+    ++isrRuns;
+    Enqueue((int)Random(NODES));
+    if (Random(2) == 0) {
+        Enqueue((int)Random(NODES));
+    }
+}
+
+static void UartIsr(void)
+{
+    Isr();
+}
+
+static void RaiseRandomIrq(void)
+{
+    if (Random(2) == 0) {
+        HostIrq_Raise(Isr, 2);
+    } else {
+        HostIrq_Raise(UartIsr, 3);
+    }
+}
+
+// Interrupts arrive in the middle of the DPC code, where it reads the timestamp.
+static void OnTimestamp(void)
+{
+    if (Random(3) == 0) {
+        RaiseRandomIrq();
+    }
+}
+
+static unsigned long blockedIsrRuns = 0;
+
+static void BlockedIsr(void)
+{
+    ++blockedIsrRuns;
+}
+
+static void TestBlockIrqs(void)
+{
+    uint32_t outer = BlockIrqs();
+    for (uint32_t priority = 1; priority < (1 << IRQ_PRIORITY_BITS); ++priority) {
+        if (!HostIrq_IsMasked(priority)) {
+            Fail("BlockIrqs does not mask a priority", (int)priority);
+        }
+    }
+    if (HostIrq_IsMasked(0)) {
+        Fail("BlockIrqs masks priority 0", 0);
+    }
+
+    HostIrq_Raise(BlockedIsr, 2);
+    uint32_t inner = BlockIrqs();
+    RestoreIrqs(inner);
+    if (blockedIsrRuns != 0) {
+        Fail("an interrupt ran while blocked", -1);
+    }
+    RestoreIrqs(outer);
+    if (blockedIsrRuns != 1) {
+        Fail("RestoreIrqs did not run the pending interrupt", -1);
+    }
+}
+
+int main(void)
+{
+    TestBlockIrqs();
+
+    for (int i = 0; i < NODES; ++i) {
+        nodes[i].node = (CallbackNode){.enqueued = false,
+                                       .next = NULL,
+                                       .cb = dpcs[i],
+                                       .priority = (DpcPriority)(i % DPC_PRIORITY_COUNT)};
+    }
+    hostOnTimestamp = OnTimestamp;
+
+    for (int op = 0; op < OPERATIONS; ++op) {
+        switch (Random(3)) {
+        case 0:
+            RaiseRandomIrq();
+            break;
+        case 1:
+            Advance(Random(100));
+            break;
+        default:
+            InvokeDeferredProcs();
+            for (int p = 0; p < DPC_PRIORITY_COUNT; ++p) {
+                if (queueLengths[p] != 0) {
+                    Fail("InvokeDeferredProcs returned with DPCs enqueued", queues[p][0]);
+                    queueLengths[p] = 0;
+                }
+            }
+            break;
+        }
+    }
+    hostOnTimestamp = NULL;
+    InvokeDeferredProcs();
+
+    for (int i = 0; i < NODES; ++i) {
+        if (nodes[i].node.runCount != nodes[i].runCount ||
+            nodes[i].node.maxLatencyUs != nodes[i].maxLatencyUs) {
+            Fail("runCount or maxLatencyUs differs", i);
+        }
+    }
+    printf("%lu interrupts, %lu DPCs run, %lu failure(s)\n", isrRuns, dpcRuns, failures);
+    return failures != 0;
+}
@@ -0,0 +1,13 @@
+/* Futura MT3620 inter-core: host build configuration, for the tests.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// CMakeLists.txt includes this before every source file.
+
+#pragma once
+
+// mt3620-baremetal.h then leaves BASEPRI and the registers to host-mt3620.c.
+#define BAREMETAL_HOST
+
+// A corrupt buffer stops the test, instead of spinning forever.
+#define INTERCORE_ASSERT(c) ((c) ? (void)0 : __builtin_trap())
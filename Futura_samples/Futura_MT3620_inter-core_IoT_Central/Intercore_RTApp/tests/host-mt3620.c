@@ -0,0 +1,366 @@
+/* Futura MT3620 inter-core: host stand-ins for the MT3620 drivers, for the tests.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "host-mt3620.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "mt3620-intercore.h"
+
+void (*hostOnMessageSent)(void) = NULL;
+void (*hostOnTimestamp)(void) = NULL;
+
+// Priorities are compared as the NVIC does, in the top IRQ_PRIORITY_BITS of a byte, where a
+// lower value is a higher priority. BASEPRI 0 masks nothing.
+#define PRIORITY_MASK ((0xFFu << (8 - IRQ_PRIORITY_BITS)) & 0xFFu)
+#define THREAD_LEVEL 0x100u
+#define MAX_PENDING_IRQS 8
+#define MAX_PERIPHERALS 8
+#define MAX_PLAIN_REGISTERS 64
+
+static uint32_t basePri = 0;
+static uint32_t activeLevel = THREAD_LEVEL;
+static struct {
+    Callback isr;
+    uint32_t level;
+} pendingIrqs[MAX_PENDING_IRQS];
+static int pendingIrqCount = 0;
+
+static const HostPeripheral *peripherals[MAX_PERIPHERALS];
+static int peripheralCount = 0;
+static struct {
+    uintptr_t address;
+    uint32_t value;
+} plainRegisters[MAX_PLAIN_REGISTERS];
+static int plainRegisterCount = 0;
+
+static uint8_t *inboundBuffer = NULL;
+static uint8_t *outboundBuffer = NULL;
+static uint32_t inboundSize;
+static uint32_t outboundSize;
+
+// The directions as the HLApp sees them: it sends on inbound and receives on outbound.
+static RingBuffer hlSend;
+static RingBuffer hlRecv;
+
+static unsigned long sentSignals = 0;
+static unsigned long receivedSignals = 0;
+
+// Virtual time, which only HostGpt_Advance moves; the GPTs count ticks of tickUs.
+static uint64_t nowUs = 0;
+static uint32_t tickUs = 1000;
+static struct {
+    bool running;
+    uint64_t expiryUs;
+    Callback callback;
+} gpts[TIMER_GPT_COUNT];
+
+uint32_t ReadBasePri(void)
+{
+    return basePri;
+}
+
+static bool IsLevelMasked(uint32_t level)
+{
+    return (basePri != 0 && level >= basePri) || level >= activeLevel;
+}
+
+static void RunIrq(Callback isr, uint32_t level)
+{
+    uint32_t interruptedLevel = activeLevel;
+    activeLevel = level;
+    isr();
+    activeLevel = interruptedLevel;
+}
+
+// Runs the pending interrupts which are no longer masked, the highest priority first.
+static void RunPendingIrqs(void)
+{
+    for (;;) {
+        int next = -1;
+        for (int i = 0; i < pendingIrqCount; ++i) {
+            if (!IsLevelMasked(pendingIrqs[i].level) &&
+                (next < 0 || pendingIrqs[i].level < pendingIrqs[next].level)) {
+                next = i;
+            }
+        }
+        if (next < 0) {
+            return;
+        }
+        Callback isr = pendingIrqs[next].isr;
+        uint32_t level = pendingIrqs[next].level;
+        pendingIrqs[next] = pendingIrqs[--pendingIrqCount];
+        RunIrq(isr, level);
+    }
+}
+
+void WriteBasePri(uint32_t value)
+{
+    basePri = value & PRIORITY_MASK;
+    RunPendingIrqs();
+}
+
+bool HostIrq_IsMasked(uint32_t priority)
+{
+    return IsLevelMasked((priority << (8 - IRQ_PRIORITY_BITS)) & PRIORITY_MASK);
+}
+
+bool HostIrq_IsRunning(void)
+{
+    return activeLevel != THREAD_LEVEL;
+}
+
+void HostIrq_Raise(Callback isr, uint32_t priority)
+{
+    uint32_t level = (priority << (8 - IRQ_PRIORITY_BITS)) & PRIORITY_MASK;
+    if (!IsLevelMasked(level)) {
+        RunIrq(isr, level);
+        RunPendingIrqs();
+        return;
+    }
+
+    // Like the pending bit of the NVIC, raising a pending interrupt again does nothing.
+    for (int i = 0; i < pendingIrqCount; ++i) {
+        if (pendingIrqs[i].isr == isr) {
+            return;
+        }
+    }
+    if (pendingIrqCount == MAX_PENDING_IRQS) {
+        fprintf(stderr, "more than %d interrupts pending\n", MAX_PENDING_IRQS);
+        exit(1);
+    }
+    pendingIrqs[pendingIrqCount].isr = isr;
+    pendingIrqs[pendingIrqCount].level = level;
+    ++pendingIrqCount;
+}
+
+void HostReg_Map(const HostPeripheral *peripheral)
+{
+    if (peripheralCount == MAX_PERIPHERALS) {
+        fprintf(stderr, "more than %d peripherals\n", MAX_PERIPHERALS);
+        exit(1);
+    }
+    peripherals[peripheralCount++] = peripheral;
+}
+
+void HostReg_Reset(void)
+{
+    peripheralCount = 0;
+    plainRegisterCount = 0;
+}
+
+static const HostPeripheral *FindPeripheral(uintptr_t address)
+{
+    for (int i = 0; i < peripheralCount; ++i) {
+        if (address >= peripherals[i]->base &&
+            address - peripherals[i]->base < peripherals[i]->size) {
+            return peripherals[i];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t *PlainRegister(uintptr_t address)
+{
+    for (int i = 0; i < plainRegisterCount; ++i) {
+        if (plainRegisters[i].address == address) {
+            return &plainRegisters[i].value;
+        }
+    }
+    if (plainRegisterCount == MAX_PLAIN_REGISTERS) {
+        fprintf(stderr, "more than %d registers\n", MAX_PLAIN_REGISTERS);
+        exit(1);
+    }
+    plainRegisters[plainRegisterCount].address = address;
+    plainRegisters[plainRegisterCount].value = 0;
+    return &plainRegisters[plainRegisterCount++].value;
+}
+
+void WriteReg32(uintptr_t baseAddr, size_t offset, uint32_t value)
+{
+    const HostPeripheral *peripheral = FindPeripheral(baseAddr + offset);
+    if (peripheral != NULL) {
+        peripheral->write(baseAddr + offset - peripheral->base, value);
+    } else {
+        *PlainRegister(baseAddr + offset) = value;
+    }
+}
+
+void WriteReg8(uintptr_t baseAddr, size_t offset, uint8_t value)
+{
+    WriteReg32(baseAddr, offset, value);
+}
+
+uint32_t ReadReg32(uintptr_t baseAddr, size_t offset)
+{
+    const HostPeripheral *peripheral = FindPeripheral(baseAddr + offset);
+    if (peripheral != NULL) {
+        return peripheral->read(baseAddr + offset - peripheral->base);
+    }
+    return *PlainRegister(baseAddr + offset);
+}
+
+// The size of a buffer is a power of two, encoded in the bottom five bits of its base.
+static uint8_t *AllocateShared(uint32_t size, uint32_t *base)
+{
+    uint8_t *buffer = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (buffer == MAP_FAILED || (uintptr_t)buffer > UINT32_MAX || (size & (size - 1)) != 0) {
+        fprintf(stderr, "cannot allocate a %u-byte shared buffer below 4 GB\n", size);
+        exit(1);
+    }
+    *base = (uint32_t)(uintptr_t)buffer | (uint32_t)__builtin_ctz(size);
+    return buffer;
+}
+
+void HostIntercore_Init(uint32_t inbound, uint32_t outbound)
+{
+    HostIntercore_Cleanup();
+    uint32_t inboundBase, outboundBase;
+    inboundSize = inbound;
+    outboundSize = outbound;
+    inboundBuffer = AllocateShared(inboundSize, &inboundBase);
+    outboundBuffer = AllocateShared(outboundSize, &outboundBase);
+
+    BufferHeader *inboundHeader = (BufferHeader *)inboundBuffer;
+    BufferHeader *outboundHeader = (BufferHeader *)outboundBuffer;
+    InitRingBuffer(&hlSend, inboundHeader, inboundSize, &inboundHeader->writePosition,
+                   &outboundHeader->readPosition);
+    InitRingBuffer(&hlRecv, outboundHeader, outboundSize, &outboundHeader->writePosition,
+                   &inboundHeader->readPosition);
+    sentSignals = 0;
+    receivedSignals = 0;
+}
+
+void HostIntercore_Cleanup(void)
+{
+    if (inboundBuffer != NULL) {
+        munmap(inboundBuffer, inboundSize);
+        munmap(outboundBuffer, outboundSize);
+        inboundBuffer = NULL;
+        outboundBuffer = NULL;
+    }
+}
+
+void MT3620_SetupIntercoreComm(uint32_t *inboundBase, uint32_t *outboundBase,
+                               Callback recvCallback)
+{
+    (void)recvCallback;
+    *inboundBase = (uint32_t)(uintptr_t)inboundBuffer | (uint32_t)__builtin_ctz(inboundSize);
+    *outboundBase = (uint32_t)(uintptr_t)outboundBuffer | (uint32_t)__builtin_ctz(outboundSize);
+}
+
+void MT3620_SignalHLCoreMessageSent(void)
+{
+    __atomic_add_fetch(&sentSignals, 1, __ATOMIC_RELAXED);
+    if (hostOnMessageSent != NULL) {
+        hostOnMessageSent();
+    }
+}
+
+void MT3620_SignalHLCoreMessageReceived(void)
+{
+    __atomic_add_fetch(&receivedSignals, 1, __ATOMIC_RELAXED);
+}
+
+unsigned long HostIntercore_SentSignals(void)
+{
+    return __atomic_load_n(&sentSignals, __ATOMIC_RELAXED);
+}
+
+unsigned long HostIntercore_ReceivedSignals(void)
+{
+    return __atomic_load_n(&receivedSignals, __ATOMIC_RELAXED);
+}
+
+uint32_t MT3620_Gpt_GetTimestampUs(void)
+{
+    static bool inHook = false;
+    if (hostOnTimestamp != NULL && !inHook) {
+        inHook = true;
+        hostOnTimestamp();
+        inHook = false;
+    }
+    return (uint32_t)nowUs;
+}
+
+void MT3620_Gpt_LaunchTimerMs(TimerGpt gpt, uint32_t periodMs, Callback callback)
+{
+    gpts[gpt].running = true;
+    gpts[gpt].expiryUs = nowUs + (uint64_t)periodMs * tickUs;
+    gpts[gpt].callback = callback;
+}
+
+void HostGpt_Advance(uint32_t us)
+{
+    uint64_t targetUs = nowUs + us;
+    for (;;) {
+        int next = -1;
+        for (int gpt = 0; gpt < TIMER_GPT_COUNT; ++gpt) {
+            if (gpts[gpt].running && gpts[gpt].expiryUs <= targetUs &&
+                (next < 0 || gpts[gpt].expiryUs < gpts[next].expiryUs)) {
+                next = gpt;
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+        nowUs = gpts[next].expiryUs;
+        gpts[next].running = false;
+        HostIrq_Raise(gpts[next].callback, GPT_PRIORITY);
+    }
+    nowUs = targetUs;
+}
+
+void MT3620_Gpt_CancelTimer(TimerGpt gpt)
+{
+    gpts[gpt].running = false;
+}
+
+bool HostGpt_IsRunning(TimerGpt gpt)
+{
+    return gpts[gpt].running;
+}
+
+uint64_t HostGpt_NowUs(void)
+{
+    return nowUs;
+}
+
+void HostGpt_SetTickUs(uint32_t us)
+{
+    tickUs = us;
+}
+
+bool HostHl_Send(const ComponentId *recipient, const void *data, size_t size)
+{
+    uint32_t writePosition = *hlSend.writePosition;
+    uint32_t position;
+    if (!WriteRingBlockHeader(&hlSend, writePosition, AcquireRingReadPosition(&hlSend),
+                              recipient, size, &position)) {
+        return false;
+    }
+    position = WriteRingCircular(&hlSend, position, data, size);
+    PublishRingWritePosition(&hlSend, WriteRingBlockSize(&hlSend, writePosition, size, position));
+    return true;
+}
+
+bool HostHl_Recv(ComponentId *sender, void *dest, size_t *size)
+{
+    uint32_t position, payloadSize;
+    if (!ReadRingBlockHeader(&hlRecv, *hlRecv.readPosition, AcquireRingWritePosition(&hlRecv),
+                             sender, &position, &payloadSize)) {
+        return false;
+    }
+    if (payloadSize > *size) {
+        fprintf(stderr, "a %u-byte message does not fit in %zu bytes\n", payloadSize, *size);
+        exit(1);
+    }
+    position = ReadRingCircular(&hlRecv, position, dest, payloadSize);
+    *size = payloadSize;
+    PublishRingReadPosition(&hlRecv, NextRingBlockPosition(&hlRecv, position));
+    return true;
+}
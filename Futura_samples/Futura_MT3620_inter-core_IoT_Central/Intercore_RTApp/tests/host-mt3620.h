@@ -0,0 +1,104 @@
+/* Futura MT3620 inter-core: host stand-ins for the MT3620 drivers, for the tests.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "logical-intercore.h"
+#include "mt3620-timer.h"
+
+// The tests build the logical layer of the RTApp natively, with BAREMETAL_HOST defined, and
+// replace the mt3620-*.c drivers with these functions. The shared buffers are allocated below
+// 4 GB, because the mailbox passes their addresses as 32-bit values, and the high-level side
+// of the protocol, which the Linux kernel implements on the device, is done here with the
+// same ring functions as the RTApp.
+
+/// <summary>
+///     Allocates the shared buffers, which MT3620_SetupIntercoreComm then returns.
+/// </summary>
+/// <param name="inboundSize">Size of the buffer from the HLApp, a power of two.</param>
+/// <param name="outboundSize">Size of the buffer to the HLApp, a power of two.</param>
+void HostIntercore_Init(uint32_t inboundSize, uint32_t outboundSize);
+
+/// <summary>Frees the shared buffers.</summary>
+void HostIntercore_Cleanup(void);
+
+/// <summary>Sends a message to the RTApp, as the HLApp does.</summary>
+/// <returns>false if the inbound buffer does not have enough space.</returns>
+bool HostHl_Send(const ComponentId *recipient, const void *data, size_t size);
+
+/// <summary>Receives a message from the RTApp, as the HLApp does.</summary>
+/// <param name="size">On entry, the size of dest; on exit, the payload size.</param>
+/// <returns>false if there is no message.</returns>
+bool HostHl_Recv(ComponentId *sender, void *dest, size_t *size);
+
+/// <summary>Number of calls to MT3620_SignalHLCoreMessageSent.</summary>
+unsigned long HostIntercore_SentSignals(void);
+
+/// <summary>Number of calls to MT3620_SignalHLCoreMessageReceived.</summary>
+unsigned long HostIntercore_ReceivedSignals(void);
+
+/// <summary>
+///     Advances the virtual time of the GPTs, and runs the callbacks of the timers which
+///     expire meanwhile, in order of expiry.
+/// </summary>
+void HostGpt_Advance(uint32_t us);
+
+/// <summary>Returns true if the GPT was launched and has not expired yet.</summary>
+bool HostGpt_IsRunning(TimerGpt gpt);
+
+/// <summary>Returns the virtual time, which GPT3 counts modulo 2^32.</summary>
+uint64_t HostGpt_NowUs(void);
+
+/// <summary>
+///     Sets the period of a tick of GPT0 and GPT1, 1000 us by default. Their clock on the
+///     MT3620 is only about 1 kHz, so a test can make them run fast or slow.
+/// </summary>
+void HostGpt_SetTickUs(uint32_t tickUs);
+
+/// <summary>
+///     A simulated peripheral, whose functions ReadReg32, WriteReg32 and WriteReg8 call for
+///     the registers from base to base + size. Other registers behave as plain memory.
+/// </summary>
+typedef struct {
+    uintptr_t base;
+    size_t size;
+    uint32_t (*read)(size_t offset);
+    void (*write)(size_t offset, uint32_t value);
+} HostPeripheral;
+
+/// <summary>Maps a peripheral, which must exist until <see cref="HostReg_Reset" />.</summary>
+void HostReg_Map(const HostPeripheral *peripheral);
+
+/// <summary>Unmaps every peripheral and clears the plain registers.</summary>
+void HostReg_Reset(void);
+
+/// <summary>
+///     Raises an interrupt of an NVIC priority, 0 to 7, as the hardware does: isr runs at once,
+///     unless BASEPRI or a running interrupt of the same or a higher priority masks it, in
+///     which case it runs as soon as the mask is lowered. BASEPRI keeps IRQ_PRIORITY_BITS bits,
+///     as on the MT3620, so a value which only sets lower bits masks nothing.
+/// </summary>
+void HostIrq_Raise(Callback isr, uint32_t priority);
+
+/// <summary>Returns true if BASEPRI or a running interrupt masks the priority.</summary>
+bool HostIrq_IsMasked(uint32_t priority);
+
+/// <summary>Returns true while an interrupt runs, false in the main loop and its DPCs.</summary>
+bool HostIrq_IsRunning(void);
+
+/// <summary>
+///     Function called by MT3620_Gpt_GetTimestampUs, where a test can raise interrupts in the
+///     middle of the code under test, or NULL. It is not called again while it runs.
+/// </summary>
+extern void (*hostOnTimestamp)(void);
+
+/// <summary>
+///     Function called by MT3620_SignalHLCoreMessageSent, for example to wake a thread which
+///     stands in for the HLApp, or NULL.
+/// </summary>
+extern void (*hostOnMessageSent)(void);
@@ -0,0 +1,243 @@
+/* Futura MT3620 inter-core: two-thread benchmark of the ring buffer API.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Runs the RTApp side of the intercore buffers, built for the host, against the high-level
+// side in another thread, and reports messages/s and bytes/s for each way to send and to
+// receive:
+// - IntercoreSend, which copies the payload into the outbound buffer, and IntercoreReserve
+//   with IntercoreCommit, where the producer writes it in place;
+// - IntercoreRecv, which copies the payload out of the inbound buffer, and IntercorePeek
+//   with IntercoreRelease, where the consumer reads it in place.
+// - IntercoreSendBatch, and IntercoreSend with IntercoreSetSendCoalescing, which signal the
+//   HLApp once for several messages.
+// Message sizes vary from 4 to INTERCORE_MAX_PAYLOAD_LEN bytes, so that blocks wrap around
+// the end of the buffers at every offset. The receiver checks every byte. The HLApp sleeps
+// until the RTApp signals it, as on the device, where each signal is a mailbox interrupt and
+// a socket wakeup; the mailbox interrupts per message are reported too.
+//
+// Usage: intercore_benchmark [buffer size in bytes, a power of two, default 4096]
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host-mt3620.h"
+#include "logical-intercore.h"
+
+#define MESSAGES 200000
+// Messages per IntercoreSendBatch call, and per interrupt with coalescing.
+#define BATCH 8
+
+static const ComponentId hlAppId = {.data1 = 0x25025d2c,
+                                    .data2 = 0x66da,
+                                    .data3 = 0x4448,
+                                    .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc, 0xdd, 0x36, 0x27}};
+
+static IntercoreComm icc;
+static unsigned long errors = 0;
+static sem_t signalled;
+
+typedef enum { Mode_Copy, Mode_InPlace, Mode_Batch, Mode_Coalesced } Mode;
+static Mode mode;
+
+// Message n: its number, then bytes which depend on it.
+static size_t MessageSize(uint32_t n)
+{
+    return sizeof(n) + (n * 7919u) % (INTERCORE_MAX_PAYLOAD_LEN - sizeof(n) + 1);
+}
+
+static void FillMessage(uint8_t *payload, uint32_t n, size_t size)
+{
+    memcpy(payload, &n, sizeof(n));
+    for (size_t i = sizeof(n); i < size; ++i) {
+        payload[i] = (uint8_t)(n + i);
+    }
+}
+
+static void CheckMessage(const ComponentId *id, const uint8_t *payload, size_t size, uint32_t n)
+{
+    uint32_t number;
+    memcpy(&number, payload, sizeof(number));
+    bool valid = memcmp(id, &hlAppId, sizeof(*id)) == 0 && size == MessageSize(n) && number == n;
+    for (size_t i = sizeof(n); valid && i < size; ++i) {
+        valid = payload[i] == (uint8_t)(n + i);
+    }
+    if (!valid && ++errors <= 10) {
+        fprintf(stderr, "message %u: wrong content\n", n);
+    }
+}
+
+static double Seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+// The mailbox interrupt, which wakes the HLApp.
+static void SignalHlApp(void)
+{
+    sem_post(&signalled);
+}
+
+// Sends count messages from n in one batch, waiting for space as needed.
+static void SendBatch(uint32_t n, size_t count)
+{
+    static uint8_t buffers[BATCH][INTERCORE_MAX_PAYLOAD_LEN];
+    IntercoreMessage messages[BATCH];
+    for (size_t i = 0; i < count; ++i) {
+        messages[i].data = buffers[i];
+        messages[i].size = MessageSize(n + (uint32_t)i);
+        FillMessage(buffers[i], n + (uint32_t)i, messages[i].size);
+    }
+
+    size_t done = 0;
+    while (done < count) {
+        size_t sent;
+        IntercoreSendBatch(&icc, &hlAppId, messages + done, count - done, &sent);
+        done += sent;
+        if (done < count) {
+            sched_yield();
+        }
+    }
+}
+
+// The RTApp sends.
+static void *RtSend(void *unused)
+{
+    static uint8_t buffer[INTERCORE_MAX_PAYLOAD_LEN];
+    for (uint32_t n = 0; n < MESSAGES;) {
+        size_t size = MessageSize(n);
+        if (mode == Mode_Batch) {
+            size_t count = MESSAGES - n < BATCH ? MESSAGES - n : BATCH;
+            SendBatch(n, count);
+            n += (uint32_t)count;
+            continue;
+        }
+
+        if (mode == Mode_InPlace) {
+            void *payload;
+            while (IntercoreReserve(&icc, &hlAppId, size, &payload) != Intercore_OK) {
+                sched_yield();
+            }
+            FillMessage(payload, n, size);
+            IntercoreCommit(&icc, size);
+        } else {
+            FillMessage(buffer, n, size);
+            while (IntercoreSend(&icc, &hlAppId, buffer, size) != Intercore_OK) {
+                sched_yield();
+            }
+        }
+        ++n;
+    }
+    // Signal the last messages, which may be waiting for the coalescing delay.
+    IntercoreFlush(&icc);
+    return unused;
+}
+
+// The HLApp receives everything which is waiting each time it is signalled.
+static void *HlRecv(void *unused)
+{
+    static uint8_t buffer[INTERCORE_MAX_PAYLOAD_LEN];
+    for (uint32_t n = 0; n < MESSAGES; ++n) {
+        ComponentId sender;
+        size_t size = sizeof(buffer);
+        while (!HostHl_Recv(&sender, buffer, &size)) {
+            sem_wait(&signalled);
+        }
+        CheckMessage(&sender, buffer, size, n);
+    }
+    return unused;
+}
+
+// The HLApp sends.
+static void *HlSend(void *unused)
+{
+    static uint8_t buffer[INTERCORE_MAX_PAYLOAD_LEN];
+    for (uint32_t n = 0; n < MESSAGES; ++n) {
+        size_t size = MessageSize(n);
+        FillMessage(buffer, n, size);
+        while (!HostHl_Send(&hlAppId, buffer, size)) {
+            sched_yield();
+        }
+    }
+    return unused;
+}
+
+// The RTApp receives.
+static void *RtRecv(void *unused)
+{
+    static uint8_t buffer[INTERCORE_MAX_PAYLOAD_LEN];
+    for (uint32_t n = 0; n < MESSAGES; ++n) {
+        ComponentId sender;
+        if (mode == Mode_Copy) {
+            size_t size = sizeof(buffer);
+            while (IntercoreRecv(&icc, &sender, buffer, &size) != Intercore_OK) {
+                sched_yield();
+            }
+            CheckMessage(&sender, buffer, size, n);
+        } else {
+            const void *payload;
+            size_t size;
+            while (IntercorePeek(&icc, &sender, &payload, &size) != Intercore_OK) {
+                sched_yield();
+            }
+            CheckMessage(&sender, payload, size, n);
+            IntercoreRelease(&icc);
+        }
+    }
+    return unused;
+}
+
+static void Run(const char *name, Mode runMode, void *(*rt)(void *), void *(*hl)(void *),
+                uint32_t bufferSize)
+{
+    HostIntercore_Init(bufferSize, bufferSize);
+    SetupIntercoreComm(&icc, NULL);
+    if (runMode == Mode_Coalesced) {
+        IntercoreSetSendCoalescing(&icc, BATCH, 10, TimerGpt1);
+    }
+    mode = runMode;
+    sem_init(&signalled, 0, 0);
+
+    double start = Seconds();
+    pthread_t rtThread, hlThread;
+    pthread_create(&rtThread, NULL, rt, NULL);
+    pthread_create(&hlThread, NULL, hl, NULL);
+    pthread_join(rtThread, NULL);
+    pthread_join(hlThread, NULL);
+    double elapsed = Seconds() - start;
+    sem_destroy(&signalled);
+
+    double bytes = 0;
+    for (uint32_t n = 0; n < MESSAGES; ++n) {
+        bytes += (double)MessageSize(n);
+    }
+    unsigned long interrupts = HostIntercore_SentSignals() + HostIntercore_ReceivedSignals();
+    printf("%-28s %10.0f messages/s %8.1f MB/s %7.3f interrupts/message\n", name,
+           MESSAGES / elapsed, bytes / elapsed / 1e6, (double)interrupts / MESSAGES);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t bufferSize = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 4096;
+    printf("%u-byte buffers, %d messages of 4 to %d bytes\n", bufferSize, MESSAGES,
+           INTERCORE_MAX_PAYLOAD_LEN);
+    hostOnMessageSent = SignalHlApp;
+
+    Run("IntercoreSend", Mode_Copy, RtSend, HlRecv, bufferSize);
+    Run("IntercoreReserve/Commit", Mode_InPlace, RtSend, HlRecv, bufferSize);
+    Run("IntercoreSendBatch of 8", Mode_Batch, RtSend, HlRecv, bufferSize);
+    Run("IntercoreSend, coalesced by 8", Mode_Coalesced, RtSend, HlRecv, bufferSize);
+    Run("IntercoreRecv", Mode_Copy, RtRecv, HlSend, bufferSize);
+    Run("IntercorePeek/Release", Mode_InPlace, RtRecv, HlSend, bufferSize);
+    HostIntercore_Cleanup();
+
+    printf("%lu error(s)\n", errors);
+    return errors != 0;
+}
@@ -0,0 +1,184 @@
+/* Futura MT3620 inter-core: batched sends and interrupt coalescing test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Counts the mailbox interrupts which IntercoreSendBatch and IntercoreSetSendCoalescing raise,
+// on a virtual GPT clock, and checks that:
+// - a batch is published with one interrupt, and a batch which does not fit sends what fits
+//   and signals it at once;
+// - with coalescing, the HLApp is signalled when the message count is reached, when the
+//   oldest message has waited for the delay, on IntercoreFlush, and when the buffer is full;
+// - the coalescing timer is cancelled whenever the waiting messages are signalled;
+// - the HLApp receives every message, in order.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "host-mt3620.h"
+#include "logical-intercore.h"
+
+static const ComponentId hlAppId = {.data1 = 0x25025d2c,
+                                    .data2 = 0x66da,
+                                    .data3 = 0x4448,
+                                    .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc, 0xdd, 0x36, 0x27}};
+
+static IntercoreComm icc;
+static int failures = 0;
+static uint32_t nextSent = 0;
+static uint32_t nextReceived = 0;
+
+static void Check(bool condition, const char *what)
+{
+    if (!condition) {
+        fprintf(stderr, "check failed: %s\n", what);
+        ++failures;
+    }
+}
+
+static void CheckSignals(unsigned long expected, const char *what)
+{
+    if (HostIntercore_SentSignals() != expected) {
+        fprintf(stderr, "%s: %lu interrupts, expected %lu\n", what, HostIntercore_SentSignals(),
+                expected);
+        ++failures;
+    }
+}
+
+// Sends the next message, of 100 bytes, which holds its number.
+static IntercoreResult SendNext(void)
+{
+    uint8_t payload[100] = {0};
+    memcpy(payload, &nextSent, sizeof(nextSent));
+    IntercoreResult icr = IntercoreSend(&icc, &hlAppId, payload, sizeof(payload));
+    if (icr == Intercore_OK) {
+        ++nextSent;
+    }
+    return icr;
+}
+
+// Sends the next count messages in one batch. Returns the number sent.
+static size_t SendNextBatch(size_t count)
+{
+    uint8_t payloads[16][100] = {{0}};
+    IntercoreMessage messages[16];
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t n = nextSent + (uint32_t)i;
+        memcpy(payloads[i], &n, sizeof(n));
+        messages[i] = (IntercoreMessage){.data = payloads[i], .size = sizeof(payloads[i])};
+    }
+    size_t sent;
+    IntercoreResult icr = IntercoreSendBatch(&icc, &hlAppId, messages, count, &sent);
+    Check((icr == Intercore_OK) == (sent == count), "batch result matches the count sent");
+    nextSent += (uint32_t)sent;
+    return sent;
+}
+
+// Receives every message which is waiting, as the HLApp does on an interrupt.
+static void Drain(void)
+{
+    uint8_t buffer[INTERCORE_MAX_PAYLOAD_LEN];
+    ComponentId sender;
+    size_t size = sizeof(buffer);
+    while (HostHl_Recv(&sender, buffer, &size)) {
+        uint32_t n;
+        memcpy(&n, buffer, sizeof(n));
+        if (n != nextReceived || size != 100) {
+            fprintf(stderr, "received message %u of %zu bytes, expected %u\n", n, size,
+                    nextReceived);
+            ++failures;
+        }
+        nextReceived = n + 1;
+        size = sizeof(buffer);
+    }
+}
+
+static void TestBatches(void)
+{
+    // By default every send signals the HLApp.
+    SendNext();
+    SendNext();
+    CheckSignals(2, "two sends");
+
+    Check(SendNextBatch(5) == 5, "batch of 5 sent");
+    CheckSignals(3, "batch of 5");
+    Drain();
+
+    // A 4032-byte data area holds 31 blocks of 100 bytes with their headers.
+    size_t sent = SendNextBatch(16) + SendNextBatch(16);
+    Check(sent < 32, "batches larger than the buffer are cut");
+    CheckSignals(5, "two batches larger than the buffer");
+    Check(SendNextBatch(1) == 0, "nothing is sent to a full buffer");
+    CheckSignals(5, "batch to a full buffer");
+    Drain();
+}
+
+static void TestCoalescing(void)
+{
+    IntercoreSetSendCoalescing(&icc, 4, 10, TimerGpt1);
+    unsigned long signals = HostIntercore_SentSignals();
+
+    // The count is reached: the timer which the first message started is cancelled.
+    SendNext();
+    Check(HostGpt_IsRunning(TimerGpt1), "the first message starts the timer");
+    SendNext();
+    SendNext();
+    CheckSignals(signals, "three messages wait");
+    SendNext();
+    CheckSignals(++signals, "the fourth message signals");
+    Check(!HostGpt_IsRunning(TimerGpt1), "the count cancels the timer");
+    HostGpt_Advance(20000);
+    CheckSignals(signals, "no interrupt after the count");
+    Drain();
+
+    // The delay is reached.
+    HostGpt_Advance(3000);
+    SendNext();
+    HostGpt_Advance(5000);
+    SendNext();
+    HostGpt_Advance(4999);
+    CheckSignals(signals, "two messages wait");
+    HostGpt_Advance(1);
+    CheckSignals(++signals, "the delay of the first message signals");
+    Drain();
+
+    // Batches count each of their messages.
+    SendNextBatch(3);
+    CheckSignals(signals, "a batch of 3 waits");
+    SendNextBatch(2);
+    CheckSignals(++signals, "a batch which reaches the count signals");
+    Check(!HostGpt_IsRunning(TimerGpt1), "a batch which reaches the count cancels the timer");
+    Drain();
+
+    // IntercoreFlush.
+    SendNext();
+    IntercoreFlush(&icc);
+    CheckSignals(++signals, "flush signals");
+    Check(!HostGpt_IsRunning(TimerGpt1), "flush cancels the timer");
+    IntercoreFlush(&icc);
+    CheckSignals(signals, "flush without waiting messages does not signal");
+    Drain();
+
+    // A full buffer is signalled, so the HLApp can make space.
+    IntercoreSetSendCoalescing(&icc, 100, 1000, TimerGpt1);
+    IntercoreResult icr;
+    while ((icr = SendNext()) == Intercore_OK) {
+    }
+    Check(icr == Intercore_Send_NotEnoughBufferSpace, "the buffer fills up");
+    CheckSignals(++signals, "a full buffer signals");
+    Check(!HostGpt_IsRunning(TimerGpt1), "a full buffer cancels the timer");
+    Drain();
+}
+
+int main(void)
+{
+    HostIntercore_Init(4096, 4096);
+    SetupIntercoreComm(&icc, NULL);
+    TestBatches();
+    TestCoalescing();
+    HostIntercore_Cleanup();
+
+    Check(nextReceived == nextSent, "every message is received");
+    printf("%u messages, %lu interrupts, %d check(s) failed\n", nextSent,
+           HostIntercore_SentSignals(), failures);
+    return failures != 0;
+}
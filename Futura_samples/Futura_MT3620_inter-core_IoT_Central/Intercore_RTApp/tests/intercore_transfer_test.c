@@ -0,0 +1,245 @@
+/* Futura MT3620 inter-core: transfer fragmentation and reassembly test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Sends random transfers with ContinueIntercoreTransfer through a small outbound buffer, with
+// plain messages in between, to the reassembly of the HLApp (intercore_reassembly.c), which
+// drains the buffer at random moments and loses a fragment now and then. Checks that:
+// - every transfer which lost no fragment and fits the reassembly buffer completes, with its
+//   data, and no other transfer does;
+// - the fragments lost are counted exactly, also across the wrap of the 16-bit sequence;
+// - the plain messages all arrive, in order, between the fragments.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "host-mt3620.h"
+#include "intercore_reassembly.h"
+#include "logical-transfer.h"
+
+#define TRANSFERS 20000
+#define MAX_TRANSFER_SIZE (12 * 1024)
+#define REASSEMBLY_CAPACITY (8 * 1024)
+// One fragment in LOSS_PERIOD is lost, on average.
+#define LOSS_PERIOD 200
+#define PLAIN_MAGIC 0x01
+
+static const ComponentId hlAppId = {.data1 = 0x25025d2c,
+                                    .data2 = 0x66da,
+                                    .data3 = 0x4448,
+                                    .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc, 0xdd, 0x36, 0x27}};
+
+typedef struct {
+    size_t size;
+    bool lost;
+    bool completed;
+} TransferRecord;
+
+static IntercoreComm icc;
+static IntercoreReassembly reassembly;
+static uint8_t reassemblyBuffer[REASSEMBLY_CAPACITY];
+static TransferRecord records[TRANSFERS];
+static uint32_t fragmentsSent = 0;
+static uint32_t fragmentsLost = 0;
+static uint32_t plainSent = 0;
+static uint32_t plainReceived = 0;
+static uint16_t lastTransferId = 0;
+static unsigned long failures = 0;
+
+static uint32_t rngState = 0x12345678;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, uint32_t n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %u\n", what, n);
+    }
+}
+
+static uint8_t DataByte(uint32_t transfer, size_t i)
+{
+    return (uint8_t)(i * 31 + (i >> 8) + transfer * 7);
+}
+
+// Sizes at the edges of the fragments and of the reassembly buffer, or random.
+static size_t RandomSize(void)
+{
+    static const size_t edges[] = {0,
+                                   1,
+                                   INTERCORE_FRAGMENT_DATA_LEN - 1,
+                                   INTERCORE_FRAGMENT_DATA_LEN,
+                                   INTERCORE_FRAGMENT_DATA_LEN + 1,
+                                   3 * INTERCORE_FRAGMENT_DATA_LEN,
+                                   REASSEMBLY_CAPACITY - 1,
+                                   REASSEMBLY_CAPACITY,
+                                   REASSEMBLY_CAPACITY + 1};
+    if (Random(4) == 0) {
+        return edges[Random(sizeof(edges) / sizeof(edges[0]))];
+    }
+    return Random(MAX_TRANSFER_SIZE + 1);
+}
+
+static void CheckCompleted(const uint8_t *data, size_t size)
+{
+    uint32_t n = lastTransferId;
+    TransferRecord *record = &records[n];
+    if (record->completed || record->lost || record->size > REASSEMBLY_CAPACITY) {
+        Fail("transfer completed which should not", n);
+    }
+    record->completed = true;
+    bool valid = size == record->size;
+    for (size_t i = 0; valid && i < size; ++i) {
+        valid = data[i] == DataByte(n, i);
+    }
+    if (!valid) {
+        Fail("transfer data differs", n);
+    }
+}
+
+// The HLApp receives up to count messages, and loses some of the fragments.
+static void Drain(uint32_t count)
+{
+    static uint8_t message[INTERCORE_MAX_PAYLOAD_LEN];
+    ComponentId sender;
+    size_t size = sizeof(message);
+    while (count-- > 0 && HostHl_Recv(&sender, message, &size)) {
+        if (message[0] == INTERCORE_TRANSFER_MAGIC) {
+            IntercoreFragmentHeader header;
+            memcpy(&header, message, sizeof(header));
+            if (Random(LOSS_PERIOD) == 0) {
+                records[header.transferId].lost = true;
+                ++fragmentsLost;
+                size = sizeof(message);
+                continue;
+            }
+            lastTransferId = header.transferId;
+        }
+
+        const uint8_t *data;
+        size_t dataSize;
+        switch (IntercoreReassembly_Add(&reassembly, message, size, &data, &dataSize)) {
+        case IntercoreReassembly_NotFragment: {
+            uint32_t n;
+            memcpy(&n, message + 1, sizeof(n));
+            if (message[0] != PLAIN_MAGIC || size != 1 + sizeof(n) || n != plainReceived) {
+                Fail("plain message out of order", plainReceived);
+            }
+            plainReceived = n + 1;
+            break;
+        }
+        case IntercoreReassembly_Complete:
+            CheckCompleted(data, dataSize);
+            break;
+        case IntercoreReassembly_Pending:
+        case IntercoreReassembly_Dropped:
+            break;
+        }
+        size = sizeof(message);
+    }
+}
+
+static void SendPlain(void)
+{
+    uint8_t message[1 + sizeof(plainSent)] = {PLAIN_MAGIC};
+    memcpy(message + 1, &plainSent, sizeof(plainSent));
+    if (IntercoreSend(&icc, &hlAppId, message, sizeof(message)) == Intercore_OK) {
+        ++plainSent;
+    }
+}
+
+static void SendTransfer(uint32_t n, size_t size)
+{
+    static uint8_t data[MAX_TRANSFER_SIZE];
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = DataByte(n, i);
+    }
+    records[n].size = size;
+
+    IntercoreTransfer transfer;
+    if (StartIntercoreTransfer(&transfer, data, size) != Intercore_OK) {
+        Fail("transfer not started", n);
+        return;
+    }
+    fragmentsSent += transfer.count;
+    while (ContinueIntercoreTransfer(&icc, &hlAppId, &transfer) != Intercore_OK) {
+        if (Random(3) == 0) {
+            SendPlain();
+        }
+        Drain(1 + Random(4));
+    }
+    if (Random(2) == 0) {
+        SendPlain();
+    }
+    Drain(Random(4));
+}
+
+int main(void)
+{
+    HostIntercore_Init(4096, 4096);
+    SetupIntercoreComm(&icc, NULL);
+    IntercoreReassembly_Init(&reassembly, reassemblyBuffer, sizeof(reassemblyBuffer));
+
+    for (uint32_t n = 0; n < TRANSFERS - 1; ++n) {
+        SendTransfer(n, RandomSize());
+    }
+    Drain(UINT32_MAX);
+
+    // A last transfer, without loss, shows the loss of the last fragments before it.
+    uint32_t last = TRANSFERS - 1;
+    records[last].size = INTERCORE_FRAGMENT_DATA_LEN + 1;
+    IntercoreTransfer transfer;
+    static uint8_t data[INTERCORE_FRAGMENT_DATA_LEN + 1];
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = DataByte(last, i);
+    }
+    StartIntercoreTransfer(&transfer, data, sizeof(data));
+    ContinueIntercoreTransfer(&icc, &hlAppId, &transfer);
+    fragmentsSent += transfer.count;
+    for (size_t remaining = transfer.count; remaining > 0; --remaining) {
+        ComponentId sender;
+        static uint8_t message[INTERCORE_MAX_PAYLOAD_LEN];
+        size_t size = sizeof(message);
+        const uint8_t *transferData;
+        size_t transferSize;
+        HostHl_Recv(&sender, message, &size);
+        lastTransferId = (uint16_t)last;
+        if (IntercoreReassembly_Add(&reassembly, message, size, &transferData, &transferSize) ==
+            IntercoreReassembly_Complete) {
+            CheckCompleted(transferData, transferSize);
+        }
+    }
+    HostIntercore_Cleanup();
+
+    uint32_t expected = 0;
+    uint32_t completed = 0;
+    for (uint32_t n = 0; n < TRANSFERS; ++n) {
+        bool shouldComplete = !records[n].lost && records[n].size <= REASSEMBLY_CAPACITY;
+        if (shouldComplete && !records[n].completed) {
+            Fail("transfer did not complete", n);
+        }
+        expected += shouldComplete;
+        completed += records[n].completed;
+    }
+    if (IntercoreReassembly_GetLostFragments(&reassembly) != fragmentsLost) {
+        Fail("lost fragments counted", IntercoreReassembly_GetLostFragments(&reassembly));
+    }
+    if (plainReceived != plainSent) {
+        Fail("plain messages received", plainReceived);
+    }
+    if (fragmentsSent <= UINT16_MAX) {
+        Fail("the sequence did not wrap, fragments", fragmentsSent);
+    }
+
+    printf("%u transfers of %u fragments, %u completed of %u expected, %u fragments lost, "
+           "%u dropped, %u plain messages, %lu failure(s)\n",
+           TRANSFERS, fragmentsSent, completed, expected, fragmentsLost,
+           IntercoreReassembly_GetDroppedTransfers(&reassembly), plainSent, failures);
+    return failures != 0;
+}
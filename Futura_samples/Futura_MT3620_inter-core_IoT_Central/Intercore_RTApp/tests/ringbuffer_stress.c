@@ -0,0 +1,221 @@
+/* Futura MT3620 inter-core: two-thread stress test of the ring buffer protocol.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Drives one direction of the shared memory with the functions of logical-ringbuffer.c alone,
+// a sender thread against a receiver thread, as the two cores do. Build with
+// -DINTERCORE_TSAN=ON to run it under ThreadSanitizer. For each buffer size it sends:
+// - random sizes, from empty to the largest block which fits the buffer;
+// - sizes whose blocks end one byte before, at and one byte after an alignment boundary;
+// - near-full blocks, which only fit an almost empty buffer, so that the sender keeps
+//   finding one byte too few.
+// The receiver checks every byte, the component ID and that both positions stay aligned and
+// inside the buffer. Reports messages/s and bytes/s, and how often the positions wrapped, a
+// block straddled the end of the buffer and the sender found the buffer full.
+//
+// Usage: ringbuffer_stress [messages per run, default 100000; fewer for buffers over 1 KB,
+//                           whose messages are larger]
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "logical-ringbuffer.h"
+
+// Block size field, component ID and reserved word.
+#define BLOCK_OVERHEAD (sizeof(uint32_t) + sizeof(ComponentId) + sizeof(uint32_t))
+
+static const ComponentId senderId = {.data1 = 0x25025d2c,
+                                     .data2 = 0x66da,
+                                     .data3 = 0x4448,
+                                     .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc, 0xdd, 0x36, 0x27}};
+
+typedef enum { Sizes_Random, Sizes_AlignmentEdges, Sizes_NearFull } Sizes;
+static const char *const sizesNames[] = {"random", "alignment edges", "near full"};
+
+typedef struct {
+    RingBuffer ring;
+    Sizes sizes;
+    uint32_t messages;
+    uint32_t maxPayload;
+    // Sender's statistics
+    unsigned long fullStalls;
+    // Receiver's statistics
+    unsigned long wraps;
+    unsigned long straddles;
+    double bytes;
+    unsigned long errors;
+} Run;
+
+static uint32_t NextRandom(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// The payload size of message n. Sender and receiver draw the same sequence.
+static uint32_t PayloadSize(const Run *run, uint32_t *state)
+{
+    uint32_t r = NextRandom(state);
+    switch (run->sizes) {
+    case Sizes_Random:
+        return r % (run->maxPayload + 1);
+    case Sizes_AlignmentEdges: {
+        // The block ends 1 byte before, at, or 1 byte after a multiple of the alignment.
+        uint32_t units = 2 + (r >> 2) % (run->maxPayload / RINGBUFFER_ALIGNMENT - 1);
+        uint32_t size = units * RINGBUFFER_ALIGNMENT - BLOCK_OVERHEAD + r % 3 - 1;
+        return size > run->maxPayload ? run->maxPayload : size;
+    }
+    case Sizes_NearFull:
+    default:
+        return run->maxPayload - r % (2 * RINGBUFFER_ALIGNMENT);
+    }
+}
+
+static uint8_t PayloadByte(uint32_t n, uint32_t i)
+{
+    return (uint8_t)(n * 13 + i + (i >> 8));
+}
+
+static void Fail(Run *run, uint32_t n, const char *what)
+{
+    if (++run->errors <= 10) {
+        fprintf(stderr, "%s, message %u: %s\n", sizesNames[run->sizes], n, what);
+    }
+}
+
+static void *Send(void *context)
+{
+    Run *run = context;
+    static uint8_t payload[1 << 16];
+    uint32_t state = 0x2545F491;
+    for (uint32_t n = 0; n < run->messages; ++n) {
+        uint32_t size = PayloadSize(run, &state);
+        for (uint32_t i = 0; i < size; ++i) {
+            payload[i] = PayloadByte(n, i);
+        }
+
+        // The sender owns the write position, so it reads it without synchronization.
+        uint32_t writePosition = *run->ring.writePosition;
+        uint32_t position;
+        while (!WriteRingBlockHeader(&run->ring, writePosition, AcquireRingReadPosition(&run->ring),
+                                     &senderId, size, &position)) {
+            ++run->fullStalls;
+            sched_yield();
+        }
+        position = WriteRingCircular(&run->ring, position, payload, size);
+        PublishRingWritePosition(&run->ring,
+                                 WriteRingBlockSize(&run->ring, writePosition, size, position));
+    }
+    return NULL;
+}
+
+static void *Receive(void *context)
+{
+    Run *run = context;
+    static uint8_t payload[1 << 16];
+    uint32_t state = 0x2545F491;
+    for (uint32_t n = 0; n < run->messages; ++n) {
+        uint32_t expectedSize = PayloadSize(run, &state);
+        uint32_t readPosition = *run->ring.readPosition;
+        ComponentId id;
+        uint32_t position, size;
+        while (!ReadRingBlockHeader(&run->ring, readPosition, AcquireRingWritePosition(&run->ring),
+                                    &id, &position, &size)) {
+            sched_yield();
+        }
+
+        if (size != expectedSize) {
+            Fail(run, n, "wrong size");
+            size = size < expectedSize ? size : expectedSize;
+        }
+        if (memcmp(&id, &senderId, sizeof(id)) != 0) {
+            Fail(run, n, "wrong component ID");
+        }
+        uint32_t end = ReadRingCircular(&run->ring, position, payload, size);
+        for (uint32_t i = 0; i < size; ++i) {
+            if (payload[i] != PayloadByte(n, i)) {
+                Fail(run, n, "wrong payload");
+                break;
+            }
+        }
+
+        uint32_t next = NextRingBlockPosition(&run->ring, end);
+        if (next >= run->ring.size || next % RINGBUFFER_ALIGNMENT != 0) {
+            Fail(run, n, "next block misaligned");
+        }
+        if (readPosition + BLOCK_OVERHEAD + size > run->ring.size) {
+            ++run->straddles;
+        }
+        if (next <= readPosition) {
+            ++run->wraps;
+        }
+        run->bytes += size;
+        PublishRingReadPosition(&run->ring, next);
+    }
+    return NULL;
+}
+
+static double Seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static unsigned long RunOne(uint32_t totalSize, Sizes sizes, uint32_t messages)
+{
+    // Like the shared buffers, each header has a line of its own. The read position lives in
+    // the header of the buffer of the other direction, which only its receiver writes.
+    BufferHeader *header = aligned_alloc(64, totalSize);
+    BufferHeader *otherHeader = aligned_alloc(64, sizeof(BufferHeader));
+    memset(header, 0, totalSize);
+    memset(otherHeader, 0, sizeof(*otherHeader));
+
+    Run run = {.sizes = sizes, .messages = messages};
+    InitRingBuffer(&run.ring, header, totalSize, &header->writePosition,
+                   &otherHeader->readPosition);
+    // The largest block which fits: one alignment unit always stays free.
+    run.maxPayload = run.ring.size - RINGBUFFER_ALIGNMENT - BLOCK_OVERHEAD;
+
+    double start = Seconds();
+    pthread_t sender, receiver;
+    pthread_create(&sender, NULL, Send, &run);
+    pthread_create(&receiver, NULL, Receive, &run);
+    pthread_join(sender, NULL);
+    pthread_join(receiver, NULL);
+    double elapsed = Seconds() - start;
+
+    printf("%6u %-16s %6u %9.0f messages/s %6.1f MB/s %6lu wraps %6lu straddles %6lu full\n",
+           totalSize, sizesNames[sizes], messages, messages / elapsed, run.bytes / elapsed / 1e6,
+           run.wraps, run.straddles, run.fullStalls);
+    if (run.wraps == 0 || run.straddles == 0) {
+        Fail(&run, messages, "the run did not wrap around the buffer");
+    }
+    free(header);
+    free(otherHeader);
+    return run.errors;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t totalSizes[] = {256, 1024, 4096, 65536};
+    uint32_t messages = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 100000;
+    printf("%d-byte alignment; buffer sizes in bytes with the header\n", RINGBUFFER_ALIGNMENT);
+
+    unsigned long errors = 0;
+    for (size_t s = 0; s < sizeof(totalSizes) / sizeof(totalSizes[0]); ++s) {
+        for (int sizes = Sizes_Random; sizes <= Sizes_NearFull; ++sizes) {
+            uint32_t runMessages =
+                totalSizes[s] > 1024 ? messages / (totalSizes[s] / 1024) : messages;
+            errors += RunOne(totalSizes[s], (Sizes)sizes, runMessages);
+        }
+    }
+    printf("%lu error(s)\n", errors);
+    return errors != 0;
+}
@@ -0,0 +1,229 @@
+/* Futura MT3620 inter-core: software timer test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Drives the delta list of logical-timer.c on the virtual GPT of host-mt3620.c through random
+// starts, stops and clock steps, with GPT0 ticks of exactly 1 ms, 2.3% shorter, as with a
+// 1024 Hz clock, and 1.2% longer, and across the 32-bit wrap of the GPT3 timestamp. A model
+// keeps the nominal expiry of each running timer, the start time plus its delay, and then
+// every period after it. Checks that:
+// - every timer fires, never more than the 250 us slack before its nominal expiry, and at
+//   most 1 ms of rounding plus MAX_LATE_US after it, so periodic timers do not drift;
+// - stopped timers do not fire, and IsSoftTimerRunning agrees with the model;
+// - callbacks may start and stop timers, themselves included.
+
+#include <stdio.h>
+
+#include "host-mt3620.h"
+#include "logical-timer.h"
+
+#define TIMERS 16
+#define OPERATIONS 100000
+#define SLACK_US 250
+// Beyond the millisecond to which a start is rounded up.
+#define MAX_LATE_US 2000
+
+typedef struct {
+    SoftTimer timer;
+    // Model
+    bool running;
+    uint64_t nominalUs;
+    uint64_t periodUs;
+} TestTimer;
+
+static TestTimer timers[TIMERS];
+static unsigned long fires = 0;
+static unsigned long failures = 0;
+static int64_t earliestUs = 0; // fire time relative to the nominal expiry
+static int64_t latestUs = 0;
+
+static uint32_t rngState = 0x2545F491;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, int index)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "at %llu us, timer %d: %s\n", (unsigned long long)HostGpt_NowUs(), index,
+                what);
+    }
+}
+
+static uint32_t RandomDelayMs(void)
+{
+    switch (Random(4)) {
+    case 0:
+        return Random(5);
+    case 1:
+        return Random(100);
+    case 2:
+        return Random(5000);
+    default:
+        // Beyond the longest count of the GPT
+        return Random(200000);
+    }
+}
+
+static void Start(int index)
+{
+    TestTimer *test = &timers[index];
+    uint32_t delayMs = RandomDelayMs();
+    uint32_t periodMs = Random(3) == 0 ? 1 + Random(Random(2) ? 50 : 20000) : 0;
+    StartSoftTimer(&test->timer, delayMs, periodMs);
+    test->running = true;
+    test->nominalUs = HostGpt_NowUs() + (uint64_t)delayMs * 1000;
+    test->periodUs = (uint64_t)periodMs * 1000;
+}
+
+static void Stop(int index)
+{
+    StopSoftTimer(&timers[index].timer);
+    timers[index].running = false;
+}
+
+static void Fired(int index)
+{
+    TestTimer *test = &timers[index];
+    ++fires;
+    if (!test->running) {
+        Fail("fired while stopped", index);
+    } else {
+        int64_t offsetUs = (int64_t)(HostGpt_NowUs() - test->nominalUs);
+        earliestUs = offsetUs < earliestUs ? offsetUs : earliestUs;
+        latestUs = offsetUs > latestUs ? offsetUs : latestUs;
+        if (offsetUs < -SLACK_US) {
+            Fail("fired early", index);
+        } else if (offsetUs > 1000 + MAX_LATE_US) {
+            Fail("fired late", index);
+        }
+    }
+
+    if (test->periodUs != 0) {
+        test->nominalUs += test->periodUs;
+    } else {
+        test->running = false;
+    }
+    if (IsSoftTimerRunning(&test->timer) != test->running) {
+        Fail("running state differs", index);
+    }
+
+    // Some callbacks start or stop timers, themselves included.
+    switch (Random(8)) {
+    case 0:
+        Start(index);
+        break;
+    case 1:
+        Stop(index);
+        break;
+    case 2:
+        Start((int)Random(TIMERS));
+        break;
+    case 3:
+        Stop((int)Random(TIMERS));
+        break;
+    default:
+        break;
+    }
+}
+
+#define TIMER(n)                                                                                   \
+    static void Timer##n(void)                                                                     \
+    {                                                                                              \
+        Fired(n);                                                                                  \
+    }
+TIMER(0)
+TIMER(1)
+TIMER(2)
+TIMER(3)
+TIMER(4)
+TIMER(5)
+TIMER(6)
+TIMER(7)
+TIMER(8)
+TIMER(9)
+TIMER(10)
+TIMER(11)
+TIMER(12)
+TIMER(13)
+TIMER(14)
+TIMER(15)
+static const Callback callbacks[TIMERS] = {Timer0, Timer1, Timer2,  Timer3,  Timer4,  Timer5,
+                                           Timer6, Timer7, Timer8,  Timer9,  Timer10, Timer11,
+                                           Timer12, Timer13, Timer14, Timer15};
+
+// Checks that no running timer is past its latest expiry.
+static void CheckMissed(void)
+{
+    for (int i = 0; i < TIMERS; ++i) {
+        if (timers[i].running &&
+            HostGpt_NowUs() > timers[i].nominalUs + 1000 + MAX_LATE_US) {
+            Fail("missed", i);
+            Stop(i);
+        }
+    }
+}
+
+static void Run(uint32_t tickUs)
+{
+    HostGpt_SetTickUs(tickUs);
+    for (int op = 0; op < OPERATIONS; ++op) {
+        switch (Random(8)) {
+        case 0:
+        case 1:
+            Start((int)Random(TIMERS));
+            break;
+        case 2:
+            Stop((int)Random(TIMERS));
+            break;
+        default:
+            // Steps short enough to catch late timers, now and then a long one.
+            HostGpt_Advance(Random(50) == 0 ? Random(500000) : Random(1000));
+            break;
+        }
+        CheckMissed();
+    }
+
+    // Let the last one-shot timers fire.
+    for (int i = 0; i < TIMERS; ++i) {
+        if (timers[i].periodUs != 0) {
+            Stop(i);
+        }
+    }
+    for (int step = 0; step < 400; ++step) {
+        HostGpt_Advance(500);
+        CheckMissed();
+    }
+    for (int i = 0; i < TIMERS; ++i) {
+        HostGpt_Advance(200000);
+        CheckMissed();
+    }
+}
+
+int main(void)
+{
+    for (int i = 0; i < TIMERS; ++i) {
+        timers[i].timer = (SoftTimer){.next = NULL, .running = false, .cb = callbacks[i]};
+    }
+    SetupSoftTimers(TimerGpt0);
+
+    static const uint32_t tickUs[] = {1000, 977, 1012};
+    for (size_t i = 0; i < sizeof(tickUs) / sizeof(tickUs[0]); ++i) {
+        Run(tickUs[i]);
+    }
+    // The GPT3 timestamp wraps after about 71 minutes.
+    uint64_t wrapUs = (UINT64_C(1) << 32) - HostGpt_NowUs() % (UINT64_C(1) << 32);
+    HostGpt_Advance((uint32_t)(wrapUs > 60000000 ? wrapUs - 60000000 : 0));
+    Run(1000);
+
+    printf("%lu expiries checked from %lld us to %lld us after the nominal expiry, "
+           "%llu s of virtual time, %lu failure(s)\n",
+           fires, (long long)earliestUs, (long long)latestUs,
+           (unsigned long long)(HostGpt_NowUs() / 1000000), failures);
+    return failures != 0;
+}
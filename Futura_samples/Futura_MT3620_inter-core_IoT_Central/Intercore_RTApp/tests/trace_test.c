@@ -0,0 +1,258 @@
+/* Futura MT3620 inter-core: trace frame test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Records random events with logical-trace.c, some of unknown identifiers, flushes them at
+// random with FlushTraceToIntercore into an outbound buffer which the HLApp drains now and
+// then, and decodes the frames with TraceFrame_Decode of the HLApp. Checks that:
+// - every frame is a valid message, and every line is the event rendered with its format
+//   from trace-events.h and its timestamp;
+// - events arrive in order, and those which a full buffer dropped are counted by the
+//   TraceOverflow events, each drop once;
+// - FlushTraceToIntercore returns Intercore_OK only when nothing is left to send;
+// - TraceFrame_Decode leaves other messages and rejects malformed frames.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "host-mt3620.h"
+#include "logical-trace.h"
+#include "trace_frame.h"
+
+#define OPERATIONS 200000
+#define MAX_EVENTS OPERATIONS
+#define MAX_LINE 160
+#define FRAME_HEADER 4
+
+static const ComponentId hlAppId = {.data1 = 0x25025d2c,
+                                    .data2 = 0x66da,
+                                    .data3 = 0x4448,
+                                    .data4 = {0xba, 0xe1, 0xac, 0x26, 0xfc, 0xdd, 0x36, 0x27}};
+
+static const char *const formats[] = {
+#define TRACE_EVENT(identifier, format) format,
+#include "trace-events.h"
+#undef TRACE_EVENT
+};
+
+typedef struct {
+    uint32_t id;
+    uint32_t argCount;
+    uint32_t timestampUs;
+    uint32_t args[TRACE_MAX_ARGS];
+} Event;
+
+static IntercoreComm icc;
+static Event events[MAX_EVENTS];
+static uint32_t eventCount = 0;
+static uint32_t nextExpected = 0;
+static unsigned long skipped = 0;
+static unsigned long reportedDropped = 0;
+static unsigned long frames = 0;
+static unsigned long lines = 0;
+static unsigned long failures = 0;
+
+static uint32_t rngState = 0x1B873593;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %lu\n", what, n);
+    }
+}
+
+static void FormatEvent(char *line, const Event *event)
+{
+    int length = snprintf(line, MAX_LINE, "[%5u.%06u] ", event->timestampUs / 1000000,
+                          event->timestampUs % 1000000);
+    if (event->id < TraceEventCount) {
+        snprintf(line + length, MAX_LINE - (size_t)length, formats[event->id], event->args[0],
+                 event->args[1], event->args[2], event->args[3]);
+        return;
+    }
+    length += snprintf(line + length, MAX_LINE - (size_t)length, "unknown event %u:", event->id);
+    for (uint32_t i = 0; i < event->argCount; ++i) {
+        length += snprintf(line + length, MAX_LINE - (size_t)length, " %08x", event->args[i]);
+    }
+}
+
+static void Trace(void)
+{
+    // Each event has its own timestamp, by which a decoded line finds its event.
+    HostGpt_Advance(1 + Random(50));
+
+    Event *event = &events[eventCount++];
+    event->id = Random(50) == 0 ? TraceEventCount + Random(100) : 1 + Random(TraceEventCount - 1);
+    event->argCount = Random(TRACE_MAX_ARGS + 1);
+    memset(event->args, 0, sizeof(event->args));
+    for (uint32_t i = 0; i < event->argCount; ++i) {
+        event->args[i] = Random(4) == 0 ? Random(10) : Random(UINT32_MAX);
+    }
+    event->timestampUs = MT3620_Gpt_GetTimestampUs();
+    TraceEvent((TraceEventId)event->id, event->argCount, event->args[0], event->args[1],
+               event->args[2], event->args[3]);
+}
+
+static void CheckLine(const char *line, void *context)
+{
+    (void)context;
+    ++lines;
+    unsigned seconds, micros, count;
+    if (sscanf(line, "[%u.%u] trace: %u events dropped", &seconds, &micros, &count) == 3) {
+        reportedDropped += count;
+        if (reportedDropped > skipped + (eventCount - nextExpected)) {
+            Fail("more drops reported than events traced", reportedDropped);
+        }
+        return;
+    }
+    if (sscanf(line, "[%u.%u]", &seconds, &micros) != 2) {
+        Fail("line without a timestamp", lines);
+        return;
+    }
+
+    // The events before the one of this timestamp were dropped.
+    uint32_t timestampUs = seconds * 1000000 + micros;
+    uint32_t index = nextExpected;
+    while (index < eventCount && events[index].timestampUs != timestampUs) {
+        ++index;
+    }
+    if (index == eventCount) {
+        Fail("line of no event, or out of order", lines);
+        return;
+    }
+    skipped += index - nextExpected;
+    nextExpected = index + 1;
+
+    char expected[MAX_LINE];
+    FormatEvent(expected, &events[index]);
+    if (strcmp(line, expected) != 0) {
+        Fail("line differs, event", index);
+    }
+}
+
+static void Receive(bool all)
+{
+    uint8_t buffer[INTERCORE_MAX_PAYLOAD_LEN];
+    ComponentId sender;
+    size_t size = sizeof(buffer);
+    while (HostHl_Recv(&sender, buffer, &size)) {
+        ++frames;
+        if (TraceFrame_Decode(buffer, size, CheckLine, NULL) != TraceFrame_Decoded) {
+            Fail("frame not decoded", frames);
+        }
+        if (!all) {
+            return;
+        }
+        size = sizeof(buffer);
+    }
+}
+
+static void Flush(void)
+{
+    IntercoreResult icr = FlushTraceToIntercore(&icc, &hlAppId);
+    if (icr == Intercore_OK) {
+        // Nothing is left, so a second flush sends nothing.
+        unsigned long signals = HostIntercore_SentSignals();
+        FlushTraceToIntercore(&icc, &hlAppId);
+        if (HostIntercore_SentSignals() != signals) {
+            Fail("a flush which returned Intercore_OK left events", eventCount);
+        }
+    } else if (icr != Intercore_Send_NotEnoughBufferSpace) {
+        Fail("unexpected flush result", icr);
+    }
+}
+
+static void CheckDecode(const uint8_t *message, size_t size, TraceFrame_Result expected,
+                        const char *what)
+{
+    if (TraceFrame_Decode(message, size, CheckLine, NULL) != expected) {
+        Fail(what, size);
+    }
+}
+
+static void TestMalformed(void)
+{
+    unsigned long linesBefore = lines;
+    // An event of identifier 1 with one argument.
+    uint8_t frame[] = {TRACE_FRAME_MAGIC, TRACE_FRAME_VERSION, 12, 0, 1, 0, 1, 0,
+                       0,                 0,                   0,  0, 7, 0, 0, 0};
+    uint8_t bad[sizeof(frame)];
+    // An event with five arguments, of the right length for them.
+    uint8_t tooMany[FRAME_HEADER + 8 + 5 * 4] = {TRACE_FRAME_MAGIC, TRACE_FRAME_VERSION, 28, 0,
+                                                 1,                 0,                   5};
+    static const uint8_t text[] = "RTApp text";
+
+    CheckDecode(text, sizeof(text), TraceFrame_NotFrame, "text is a frame");
+    CheckDecode(frame, 0, TraceFrame_NotFrame, "an empty message is a frame");
+    CheckDecode(frame, 3, TraceFrame_Invalid, "a short header is accepted");
+    CheckDecode(frame, sizeof(frame) - 1, TraceFrame_Invalid, "a truncated frame is accepted");
+    memcpy(bad, frame, sizeof(bad));
+    bad[1] = TRACE_FRAME_VERSION + 1;
+    CheckDecode(bad, sizeof(bad), TraceFrame_Invalid, "another version is accepted");
+    memcpy(bad, frame, sizeof(bad));
+    bad[2] = 8;
+    CheckDecode(bad, sizeof(bad), TraceFrame_Invalid, "a wrong length is accepted");
+    CheckDecode(tooMany, sizeof(tooMany), TraceFrame_Invalid, "too many arguments are accepted");
+    memcpy(bad, frame, sizeof(bad));
+    // Without the argument, the frame holds an event and half of the header of another.
+    bad[6] = 0;
+    CheckDecode(bad, sizeof(bad), TraceFrame_Invalid, "a partial event is accepted");
+    if (lines != linesBefore) {
+        Fail("malformed frames were decoded", lines - linesBefore);
+    }
+}
+
+int main(void)
+{
+    TestMalformed();
+
+    HostIntercore_Init(4096, 4096);
+    SetupIntercoreComm(&icc, NULL);
+
+    for (int op = 0; op < OPERATIONS; ++op) {
+        // Phases in which the HLApp keeps up, and others in which the buffers fill.
+        bool keepingUp = (op / 10000) % 2 == 0;
+        switch (Random(16)) {
+        case 12:
+        case 13:
+            Flush();
+            break;
+        case 14:
+        case 15:
+            if (keepingUp || Random(64) == 0) {
+                Receive(keepingUp);
+            }
+            break;
+        default:
+            Trace();
+            break;
+        }
+    }
+    // Empty the buffers, then a last event must arrive.
+    for (int i = 0; i < 100; ++i) {
+        Flush();
+        Receive(true);
+    }
+    Trace();
+    Flush();
+    Receive(true);
+    HostIntercore_Cleanup();
+
+    if (nextExpected != eventCount) {
+        Fail("the last events were not received", eventCount - nextExpected);
+    }
+    if (reportedDropped != skipped) {
+        Fail("dropped events reported", reportedDropped);
+    }
+    printf("%u events, %lu dropped, %lu frames, %lu lines, %lu failure(s)\n", eventCount, skipped,
+           frames, lines, failures);
+    return failures != 0;
+}
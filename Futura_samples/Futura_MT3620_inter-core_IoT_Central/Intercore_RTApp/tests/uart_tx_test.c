@@ -0,0 +1,260 @@
+/* Futura MT3620 inter-core: buffered UART output test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Runs mt3620-uart.c against a simulated UART: a 16-byte transmit FIFO which the line drains
+// a few characters at a time, LSR[5] while the FIFO is empty, and the THRE interrupt, which
+// IER[1] enables and which stays raised while the FIFO is empty. The main loop and a
+// priority 2 interrupt, which arrives at random register accesses, as a GPT callback
+// would, enqueue numbered lines of random length, some larger than the buffer. Checks that:
+// - the line carries every accepted line once, whole, and in order for each writer;
+// - a line is rejected exactly when it is larger than the free space, and the overflow
+//   count is the sum of the rejected sizes;
+// - Uart_GetTxFreeSpace matches the bytes not yet written to the FIFO;
+// - the FIFO is never written while it is not empty, and the output never stalls.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host-mt3620.h"
+#include "mt3620-uart.h"
+
+#define UART_BASE 0x21040000
+#define FIFO_DEPTH 16
+#define LINES 50000
+#define MAX_LINE (UART_TX_BUFFER_SIZE + 64)
+// The header of a line, "w nnnnnnnn llll ", and its newline.
+#define MIN_LINE 17
+
+// The simulated UART
+static uint8_t fifo[FIFO_DEPTH];
+static int fifoCount = 0;
+static uint32_t ier = 0;
+static unsigned long thrWrites = 0;
+
+// What the line carried, parsed into lines as it arrives.
+static char received[MAX_LINE];
+static size_t receivedLength = 0;
+
+// The writers: 0 is the main loop, 1 the interrupt.
+static uint32_t nextLine[2] = {0, 0};
+static uint32_t expectedLine[2] = {0, 0};
+static uint32_t rejectedLine[2][LINES]; // numbers of rejected lines, in order
+static uint32_t rejectedCount[2] = {0, 0};
+static uint32_t rejectedRead[2] = {0, 0};
+static unsigned long acceptedBytes = 0;
+static unsigned long rejectedBytes = 0;
+static unsigned long isrRejectedBytes = 0;
+static bool gptRunning = true;
+static unsigned long failures = 0;
+
+static uint32_t rngState = 0x6C078965;
+
+static uint32_t Random(uint32_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, unsigned long n)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "%s: %lu\n", what, n);
+    }
+}
+
+// A line: the writer, its number and its length in hex, then letters and a newline.
+static size_t FormatLine(char *line, int writer, uint32_t number, size_t length)
+{
+    int header = snprintf(line, MAX_LINE, "%d %08x %04zx ", writer, number, length);
+    for (size_t i = (size_t)header; i < length - 1; ++i) {
+        line[i] = (char)('a' + (number + i) % 26);
+    }
+    line[length - 1] = '\n';
+    return length;
+}
+
+static void ParseLine(void)
+{
+    int writer;
+    unsigned number;
+    size_t length;
+    static char expected[MAX_LINE];
+    received[receivedLength] = '\0';
+    if (sscanf(received, "%d %08x %04zx ", &writer, &number, &length) != 3 || writer < 0 ||
+        writer > 1 || length != receivedLength) {
+        Fail("garbled line, length", receivedLength);
+        return;
+    }
+    // Skip the lines which were rejected.
+    while (rejectedRead[writer] < rejectedCount[writer] &&
+           rejectedLine[writer][rejectedRead[writer]] == expectedLine[writer]) {
+        ++rejectedRead[writer];
+        ++expectedLine[writer];
+    }
+    if (number != expectedLine[writer]) {
+        Fail("line out of order", number);
+    }
+    expectedLine[writer] = number + 1;
+    FormatLine(expected, writer, number, length);
+    if (memcmp(expected, received, length) != 0) {
+        Fail("line content differs", number);
+    }
+}
+
+static void Shift(uint8_t c)
+{
+    if (receivedLength < MAX_LINE - 1) {
+        received[receivedLength++] = (char)c;
+    }
+    if (c == '\n') {
+        ParseLine();
+        receivedLength = 0;
+    }
+}
+
+static void UpdateIrq(void)
+{
+    // The THRE interrupt is level triggered: raised while enabled and the FIFO is empty.
+    if ((ier & (1U << 1)) != 0 && fifoCount == 0) {
+        HostIrq_Raise(Uart_HandleIrq4, UART_PRIORITY);
+    }
+}
+
+static void Write(int writer, size_t length);
+
+// A GPT callback which writes a line now and then, at a register access.
+static void GptIsr(void)
+{
+    unsigned long before = Uart_GetTxOverflowCount();
+    Write(1, MIN_LINE + Random(16));
+    isrRejectedBytes += Uart_GetTxOverflowCount() - before;
+}
+
+static void MaybeInterrupt(void)
+{
+    if (gptRunning && Random(128) == 0) {
+        HostIrq_Raise(GptIsr, 2);
+    }
+}
+
+static uint32_t UartRead(size_t offset)
+{
+    MaybeInterrupt();
+    switch (offset) {
+    case 0x04:
+        return ier;
+    case 0x14:
+        // LSR[5]: THR empty; LSR[6]: transmitter empty.
+        return fifoCount == 0 ? (1U << 5) | (1U << 6) : 0;
+    default:
+        return 0;
+    }
+}
+
+static void UartWrite(size_t offset, uint32_t value)
+{
+    MaybeInterrupt();
+    switch (offset) {
+    case 0x00:
+        if (fifoCount == FIFO_DEPTH) {
+            Fail("transmit FIFO overrun", thrWrites);
+        } else {
+            fifo[fifoCount++] = (uint8_t)value;
+        }
+        ++thrWrites;
+        break;
+    case 0x04:
+        ier = value;
+        UpdateIrq();
+        break;
+    default:
+        break;
+    }
+}
+
+static const HostPeripheral uart = {
+    .base = UART_BASE, .size = 0x100, .read = UartRead, .write = UartWrite};
+
+// The line sends up to count characters.
+static void Transmit(int count)
+{
+    UpdateIrq();
+    while (count-- > 0 && fifoCount > 0) {
+        Shift(fifo[0]);
+        memmove(fifo, fifo + 1, (size_t)--fifoCount);
+        UpdateIrq();
+    }
+}
+
+static void Write(int writer, size_t length)
+{
+    static char lines[2][MAX_LINE];
+    char *line = lines[writer];
+    uint32_t number = nextLine[writer]++;
+    FormatLine(line, writer, number, length);
+
+    size_t freeSpace = Uart_GetTxFreeSpace();
+    unsigned long before = Uart_GetTxOverflowCount();
+    unsigned long isrBefore = isrRejectedBytes;
+    Uart_EnqueueBytes(line, length);
+    // Lines which the interrupt wrote meanwhile were enqueued after this one.
+    unsigned long rejected = Uart_GetTxOverflowCount() - before - (isrRejectedBytes - isrBefore);
+    if (rejected != 0 && rejected != length) {
+        Fail("overflow count is not the line size", number);
+    }
+    if ((rejected != 0) != (length > freeSpace)) {
+        Fail(rejected ? "a line which fits was rejected" : "a line larger than the space fit",
+             number);
+    }
+    if (rejected != 0) {
+        rejectedLine[writer][rejectedCount[writer]++] = number;
+        rejectedBytes += length;
+    } else {
+        acceptedBytes += length;
+    }
+}
+
+int main(void)
+{
+    HostReg_Map(&uart);
+    Uart_InitTx();
+
+    for (int n = 0; n < LINES; ++n) {
+        // Mostly short lines, which the line keeps up with, and bursts which fill the buffer.
+        size_t length = Random(20) == 0 ? MIN_LINE + Random(MAX_LINE - MIN_LINE)
+                                         : MIN_LINE + Random(100);
+        Write(0, length);
+        Transmit((int)Random(Random(4) == 0 ? 800 : 150));
+        if (Uart_GetTxFreeSpace() != UART_TX_BUFFER_SIZE - (acceptedBytes - thrWrites)) {
+            Fail("free space differs, line", (unsigned long)n);
+        }
+        // Data waits in the buffer, but nothing will move it to the FIFO.
+        if (Uart_GetTxFreeSpace() < UART_TX_BUFFER_SIZE && fifoCount == 0 &&
+            (ier & (1U << 1)) == 0) {
+            Fail("output stalled, line", (unsigned long)n);
+        }
+    }
+    gptRunning = false;
+    for (int i = 0; i < 1000 && (fifoCount > 0 || Uart_GetTxFreeSpace() < UART_TX_BUFFER_SIZE);
+         ++i) {
+        Transmit(FIFO_DEPTH);
+    }
+
+    if (thrWrites != acceptedBytes) {
+        Fail("bytes accepted but not sent", acceptedBytes - thrWrites);
+    }
+    if (Uart_GetTxOverflowCount() != rejectedBytes) {
+        Fail("overflow count differs", Uart_GetTxOverflowCount());
+    }
+    if (receivedLength != 0) {
+        Fail("the output ends inside a line", receivedLength);
+    }
+    printf("%u + %u lines, %u + %u rejected, %lu bytes sent, %lu overflowed, %lu failure(s)\n",
+           nextLine[0], nextLine[1], rejectedCount[0], rejectedCount[1], thrWrites,
+           (unsigned long)Uart_GetTxOverflowCount(), failures);
+    return failures != 0;
+}
@@ -0,0 +1,23 @@
+/* Futura MT3620 trace events of the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// No include guard: this table is included with different definitions of TRACE_EVENT.
+// logical-trace.h turns it into the TraceEventId enum, and the host decoder
+// (TraceDecoder/trace_decoder.c) and the HLApp (trace_frame.c) into their format tables, so
+// the format strings never take space on the real-time core. Append new events at the end, so that the identifiers in
+// existing captures stay valid. Formats take up to four unsigned 32-bit arguments.
+
+// TRACE_EVENT(identifier, format)
+TRACE_EVENT(TraceOverflow, "trace: %u events dropped, buffer full")
+TRACE_EVENT(TraceAppStarted, "RTApp started")
+TRACE_EVENT(TraceIntercoreSetupFailed, "SetupIntercoreComm: %u")
+TRACE_EVENT(TraceIntercoreSendFailed, "IntercoreSend: %u")
+TRACE_EVENT(TraceIntercoreRecvFailed, "IntercoreRecv: %u")
+TRACE_EVENT(TraceMessageReceived,
+            "Message from %08x: %u bytes, first bytes %08x %08x (little-endian words)")
+TRACE_EVENT(TraceAcquisitionCommand, "acquisition: command %u, channel %u, %u ms")
+TRACE_EVENT(TraceAcquisitionCommandRejected, "acquisition: command %u rejected, %u bytes")
+TRACE_EVENT(TraceAcquisitionAdcTimeout, "acquisition: ADC scan of channels %02x timed out")
+TRACE_EVENT(TraceAcquisitionSendFailed, "acquisition: batch %u waiting, IntercoreSend: %u")
+TRACE_EVENT(TraceDhtReadFailed, "dht: read failed with status %u after %u edges")
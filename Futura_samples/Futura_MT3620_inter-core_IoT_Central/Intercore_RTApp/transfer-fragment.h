@@ -0,0 +1,32 @@
+/* Futura MT3620 intercore transfers larger than one message: fragment format.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdint.h>
+
+// The RTApp sends a transfer as a sequence of messages (fragments), each starting with this
+// header (logical-transfer.c), and the HLApp reassembles it (intercore_reassembly.c). Both
+// include this file.
+
+/// <summary>First byte of every fragment. Plain messages must not start with it.</summary>
+#define INTERCORE_TRANSFER_MAGIC 0xF5
+
+/// <summary>Start of each fragment of a transfer, which the fragment data follows.</summary>
+typedef struct __attribute__((packed)) {
+    /// <summary>Always <see cref="INTERCORE_TRANSFER_MAGIC" />.</summary>
+    uint8_t magic;
+    /// <summary>Position of the fragment in the transfer, from 0.</summary>
+    uint8_t index;
+    /// <summary>Number of fragments in the transfer.</summary>
+    uint8_t count;
+    /// <summary>Always 0.</summary>
+    uint8_t reserved;
+    /// <summary>Identifies the transfer; incremented for each transfer.</summary>
+    uint16_t transferId;
+    /// <summary>Incremented for each fragment sent, so that the receiver can detect losses.</summary>
+    uint16_t sequence;
+} IntercoreFragmentHeader;
+
+_Static_assert(sizeof(IntercoreFragmentHeader) == 8, "IntercoreFragmentHeader is sent as it is");
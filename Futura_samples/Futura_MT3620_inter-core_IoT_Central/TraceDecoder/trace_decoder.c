@@ -0,0 +1,191 @@
+/* Futura MT3620 decoder of binary traces from the real-time core.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Reads what the RTApp writes to its debug UART, from a capture file or from standard input,
+// for example "trace_decoder < /dev/ttyUSB0". Text is copied as it is, and trace frames are
+// rendered with the format strings of Intercore_RTApp/trace-events.h, one line per event:
+//
+//     [   12.345678] Message from 25025d2c: 19 bytes, first bytes ...
+//
+// The timestamp is the GPT3 time of the event in seconds; it wraps after about 71 minutes.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// These must match logical-trace.h in the RTApp.
+#define TRACE_MAX_ARGS 4
+#define TRACE_FRAME_MAGIC 0xF7
+#define TRACE_FRAME_VERSION 1
+
+#define FRAME_HEADER_SIZE 4
+#define RECORD_HEADER_SIZE 8
+// Frames sent over the intercore channel are the largest, one message each.
+#define MAX_FRAME_BODY_SIZE 1024
+
+typedef struct {
+    const char *name;
+    const char *format;
+} TraceEventInfo;
+
+static const TraceEventInfo events[] = {
+#define TRACE_EVENT(identifier, format) {#identifier, format},
+#include "trace-events.h"
+#undef TRACE_EVENT
+};
+
+#define EVENT_COUNT (sizeof(events) / sizeof(events[0]))
+
+static uint8_t pending[FRAME_HEADER_SIZE + MAX_FRAME_BODY_SIZE];
+static size_t pendingSize = 0;
+static unsigned long framesDecoded = 0;
+static unsigned long framesRejected = 0;
+
+static uint32_t Get16(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t Get32(const uint8_t *p)
+{
+    return Get16(p) | (Get16(p + 2) << 16);
+}
+
+// Checks that the frame body is a whole number of well-formed events. A false magic byte
+// in the text is unlikely to be followed by a body which passes this check.
+static bool ValidateFrame(const uint8_t *body, size_t size)
+{
+    size_t offset = 0;
+    while (offset < size) {
+        if (size - offset < RECORD_HEADER_SIZE) {
+            return false;
+        }
+        uint32_t argCount = body[offset + 2];
+        if (argCount > TRACE_MAX_ARGS || body[offset + 3] != 0) {
+            return false;
+        }
+        offset += RECORD_HEADER_SIZE + argCount * sizeof(uint32_t);
+    }
+    return offset == size && size != 0;
+}
+
+static void PrintFrame(FILE *out, const uint8_t *body, size_t size)
+{
+    size_t offset = 0;
+    while (offset < size) {
+        const uint8_t *record = body + offset;
+        uint32_t id = Get16(record);
+        uint32_t argCount = record[2];
+        uint32_t timestampUs = Get32(record + 4);
+        uint32_t args[TRACE_MAX_ARGS] = {0};
+        for (uint32_t i = 0; i < argCount; ++i) {
+            args[i] = Get32(record + RECORD_HEADER_SIZE + i * sizeof(uint32_t));
+        }
+
+        fprintf(out, "[%5u.%06u] ", timestampUs / 1000000, timestampUs % 1000000);
+        if (id < EVENT_COUNT) {
+            fprintf(out, events[id].format, args[0], args[1], args[2], args[3]);
+        } else {
+            // The RTApp was built with a newer event table than this decoder.
+            fprintf(out, "unknown event %u:", id);
+            for (uint32_t i = 0; i < argCount; ++i) {
+                fprintf(out, " %08x", args[i]);
+            }
+        }
+        fputc('\n', out);
+
+        offset += RECORD_HEADER_SIZE + argCount * sizeof(uint32_t);
+    }
+}
+
+static void Feed(FILE *out, uint8_t byte);
+
+// The bytes collected since a magic byte are not a frame. Emit nothing for the magic byte,
+// which is not printable, and look for a frame again in the bytes which follow it.
+static void Reject(FILE *out)
+{
+    uint8_t rest[sizeof(pending)];
+    size_t restSize = pendingSize - 1;
+    memcpy(rest, pending + 1, restSize);
+    pendingSize = 0;
+    ++framesRejected;
+
+    for (size_t i = 0; i < restSize; ++i) {
+        Feed(out, rest[i]);
+    }
+}
+
+static void Feed(FILE *out, uint8_t byte)
+{
+    if (pendingSize == 0) {
+        if (byte != TRACE_FRAME_MAGIC) {
+            fputc(byte, out);
+            if (byte == '\n') {
+                fflush(out);
+            }
+            return;
+        }
+    }
+
+    pending[pendingSize++] = byte;
+    if (pendingSize == 2 && pending[1] != TRACE_FRAME_VERSION) {
+        Reject(out);
+        return;
+    }
+    if (pendingSize < FRAME_HEADER_SIZE) {
+        return;
+    }
+
+    size_t bodySize = Get16(pending + 2);
+    if (bodySize > MAX_FRAME_BODY_SIZE) {
+        Reject(out);
+        return;
+    }
+    if (pendingSize < FRAME_HEADER_SIZE + bodySize) {
+        return;
+    }
+
+    if (!ValidateFrame(pending + FRAME_HEADER_SIZE, bodySize)) {
+        Reject(out);
+        return;
+    }
+    PrintFrame(out, pending + FRAME_HEADER_SIZE, bodySize);
+    fflush(out);
+    pendingSize = 0;
+    ++framesDecoded;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [capture file]\n", argv[0]);
+        return 2;
+    }
+
+    FILE *in = stdin;
+    if (argc == 2) {
+        in = fopen(argv[1], "rb");
+        if (in == NULL) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        Feed(stdout, (uint8_t)c);
+    }
+
+    if (pendingSize != 0) {
+        fprintf(stderr, "trace_decoder: capture ends inside a frame\n");
+    }
+    fprintf(stderr, "trace_decoder: %lu frames decoded, %lu false frame starts skipped\n",
+            framesDecoded, framesRejected);
+
+    if (in != stdin) {
+        fclose(in);
+    }
+    return 0;
+}
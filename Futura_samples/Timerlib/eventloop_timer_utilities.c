@@ -0,0 +1,244 @@
+/* Futura MT3620 event loop timers on a shared timer wheel.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include <applibs/log.h>
+#include <applibs/eventloop.h>
+
+#include "eventloop_timer_utilities.h"
+#include "timer_wheel.h"
+
+// Default slack is delay / defaultSlackDivisor, capped at maxDefaultSlackMs.
+static const uint64_t defaultSlackDivisor = 16;
+static const uint64_t maxDefaultSlackMs = 64;
+
+struct EventLoopTimer {
+    TimerWheelEntry entry;
+    EventLoopTimerHandler handler;
+    // Tolerated delay in ms, or -1 to derive it from the delay.
+    int32_t slackMs;
+};
+
+// The wheel and the timerfd that wakes the event loop for its earliest expiry.
+static struct {
+    EventLoop *eventLoop;
+    int fd;
+    EventRegistration *registration;
+    TimerWheel wheel;
+    unsigned int timerCount;
+    // Absolute CLOCK_MONOTONIC expiry the timerfd is armed for, 0 if disarmed.
+    uint64_t armedMs;
+    // Set while expired timers are dispatched; the timerfd is re-armed once afterwards.
+    bool dispatching;
+} service = {.fd = -1};
+
+static uint64_t NowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+// Converts to milliseconds, rounding up so that a timer never fires early.
+static uint64_t ToMs(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000 + ((uint64_t)ts->tv_nsec + 999999) / 1000000;
+}
+
+// Arms the timerfd for the earliest expiry in the wheel, skipping the system call when
+// it is already armed for it.
+static int RearmService(void)
+{
+    if (service.dispatching || service.fd == -1) {
+        return 0;
+    }
+
+    uint64_t expiryMs = 0;
+    if (!TimerWheel_NextExpiry(&service.wheel, &expiryMs)) {
+        expiryMs = 0;
+    }
+    if (expiryMs == service.armedMs) {
+        return 0;
+    }
+
+    struct itimerspec newValue = {.it_value = {.tv_sec = (time_t)(expiryMs / 1000),
+                                               .tv_nsec = (long)(expiryMs % 1000) * 1000000}};
+    if (timerfd_settime(service.fd, TFD_TIMER_ABSTIME, &newValue, /* old_value */ NULL) < 0) {
+        Log_Debug("ERROR: Could not set timer period: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+    service.armedMs = expiryMs;
+    return 0;
+}
+
+// This satisfies the EventLoopIoCallback signature.
+static void ServiceCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
+{
+    uint64_t timerData = 0;
+    if (read(fd, &timerData, sizeof(timerData)) == -1 && errno != EAGAIN) {
+        Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
+    }
+    service.armedMs = 0;
+
+    service.dispatching = true;
+    TimerWheel_Advance(&service.wheel, NowMs());
+    service.dispatching = false;
+
+    RearmService();
+}
+
+static void EntryCallback(TimerWheelEntry *entry)
+{
+    EventLoopTimer *timer = (EventLoopTimer *)entry->context;
+    timer->handler(timer);
+}
+
+// Creates the shared timerfd with the first timer.
+static int AcquireService(EventLoop *eventLoop)
+{
+    if (service.timerCount > 0) {
+        if (eventLoop != service.eventLoop) {
+            errno = EINVAL;
+            return -1;
+        }
+        ++service.timerCount;
+        return 0;
+    }
+
+    service.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (service.fd == -1) {
+        Log_Debug("ERROR: Unable to create timer: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    service.registration =
+        EventLoop_RegisterIo(eventLoop, service.fd, EventLoop_Input, ServiceCallback, NULL);
+    if (service.registration == NULL) {
+        Log_Debug("ERROR: Unable to register timer event: %s (%d).\n", strerror(errno), errno);
+        close(service.fd);
+        service.fd = -1;
+        return -1;
+    }
+
+    service.eventLoop = eventLoop;
+    service.armedMs = 0;
+    TimerWheel_Init(&service.wheel, NowMs());
+    service.timerCount = 1;
+    return 0;
+}
+
+// Closes the shared timerfd with the last timer.
+static void ReleaseService(void)
+{
+    if (--service.timerCount > 0) {
+        return;
+    }
+
+    EventLoop_UnregisterIo(service.eventLoop, service.registration);
+    service.registration = NULL;
+    close(service.fd);
+    service.fd = -1;
+    service.eventLoop = NULL;
+}
+
+// Arms the timer in the wheel; a zero delay disarms it, as with timerfd_settime.
+static int ArmTimer(EventLoopTimer *timer, const struct timespec *delay, bool periodic)
+{
+    if (delay == NULL || (delay->tv_sec == 0 && delay->tv_nsec == 0)) {
+        TimerWheel_Cancel(&service.wheel, &timer->entry);
+        return RearmService();
+    }
+
+    uint64_t delayMs = ToMs(delay);
+    uint64_t slackMs = (uint64_t)timer->slackMs;
+    if (timer->slackMs < 0) {
+        slackMs = delayMs / defaultSlackDivisor;
+        if (slackMs > maxDefaultSlackMs) {
+            slackMs = maxDefaultSlackMs;
+        }
+    }
+
+    TimerWheel_Schedule(&service.wheel, &timer->entry, NowMs(), delayMs, periodic ? delayMs : 0,
+                        (uint32_t)slackMs);
+    return RearmService();
+}
+
+EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTimerHandler handler,
+                                             const struct timespec *period)
+{
+    if (handler == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    EventLoopTimer *timer = malloc(sizeof(EventLoopTimer));
+    if (timer == NULL) {
+        return NULL;
+    }
+
+    if (AcquireService(eventLoop) != 0) {
+        free(timer);
+        return NULL;
+    }
+
+    TimerWheel_InitEntry(&timer->entry, EntryCallback, timer);
+    timer->handler = handler;
+    timer->slackMs = -1;
+
+    if (ArmTimer(timer, period, /* periodic */ true) == -1) {
+        DisposeEventLoopTimer(timer);
+        return NULL;
+    }
+
+    return timer;
+}
+
+EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
+{
+    return CreateEventLoopPeriodicTimer(eventLoop, handler, NULL);
+}
+
+void DisposeEventLoopTimer(EventLoopTimer *timer)
+{
+    if (timer == NULL) {
+        return;
+    }
+
+    TimerWheel_Cancel(&service.wheel, &timer->entry);
+    ReleaseService();
+    RearmService();
+    free(timer);
+}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
+{
+    return 0;
+}
+
+int SetEventLoopTimerPeriod(EventLoopTimer *timer, const struct timespec *period)
+{
+    return ArmTimer(timer, period, /* periodic */ true);
+}
+
+int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay)
+{
+    return ArmTimer(timer, delay, /* periodic */ false);
+}
+
+int DisarmEventLoopTimer(EventLoopTimer *timer)
+{
+    return ArmTimer(timer, NULL, /* periodic */ false);
+}
+
+void SetEventLoopTimerSlack(EventLoopTimer *timer, const struct timespec *slack)
+{
+    timer->slackMs = slack == NULL ? -1 : (int32_t)ToMs(slack);
+}
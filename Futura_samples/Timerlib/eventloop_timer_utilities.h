@@ -8,6 +8,11 @@
 
 #include <applibs/eventloop.h>
 
+// All timers share one timerfd and one event loop registration, created with the first
+// timer and closed with the last one. Logical timers are kept in a hierarchical timer
+// wheel (timer_wheel.h) with 1 ms resolution, so arming and disarming take constant time.
+// All timers must use the same event loop.
+
 /// <summary>
 /// Opaque handle. Obtain via <see cref="CreateEventLoopPeriodicTimer" />
 /// or <see cref="CreateEventLoopDisarmedTimer" /> and dispose of via
@@ -58,7 +63,8 @@ EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTime
 void DisposeEventLoopTimer(EventLoopTimer *timer);
 
 /// <summary>
-/// The timer callback should call this function to consume the timer event.
+/// The timer callback should call this function to consume the timer event. The shared
+/// timerfd is consumed before callbacks run, so this only exists for compatibility.
 /// </summary>
 /// <param name="timer">Successfully allocated timer.</param>
 /// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
@@ -100,3 +106,13 @@ int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay
 /// <seealso cref="SetEventLoopTimerOneShot" />
 /// <seealso cref="SetEventLoopTimerPeriod" />
 int DisarmEventLoopTimer(EventLoopTimer *timer);
+
+/// <summary>
+/// Set how late the timer may expire so that its expiry coincides with other timers and
+/// they are handled in a single wakeup. By default the slack is 1/16 of the delay or period,
+/// at most 64 ms. Takes effect the next time the timer is armed.
+/// </summary>
+/// <param name="timer">Timer previously allocated with <see cref="CreateEventLoopPeriodicTimer" />
+/// or <see cref="CreateEventLoopDisarmedTimer" />.</param>
+/// <param name="slack">Tolerated delay, or NULL to restore the default.</param>
+void SetEventLoopTimerSlack(EventLoopTimer *timer, const struct timespec *slack);
@@ -0,0 +1,237 @@
+/* Futura MT3620 hierarchical timer wheel: virtual clock test.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+// Drives the wheel with a virtual clock through random schedules, cancellations and clock
+// steps, some beyond the span of the wheel, and checks it against a model that keeps the
+// tick each armed entry must fire at:
+// - every entry fires at exactly its tick, never early or late, and in tick order;
+// - TimerWheel_NextExpiry is never later than the earliest tick, so the event loop, which
+//   sleeps until then, never oversleeps;
+// - a periodic entry keeps its phase, and after a long stall fires once and resumes;
+// - callbacks may schedule and cancel entries, themselves included.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "timer_wheel.h"
+
+#define ENTRIES 64
+#define OPERATIONS 50000
+
+typedef struct {
+    TimerWheelEntry entry;
+    bool armed;        // model
+    uint64_t expiryMs; // model: nominal expiry
+    uint64_t tick;     // model: when it must fire
+    uint64_t periodMs;
+    uint32_t slackMs;
+} TestTimer;
+
+static TimerWheel wheel;
+static TestTimer timers[ENTRIES];
+static uint64_t advanceTo; // target of the TimerWheel_Advance call in progress
+static uint64_t lastFiredTick;
+static unsigned long fires;
+static unsigned long failures;
+
+static uint64_t rngState = 0x9E3779B97F4A7C15ull;
+
+static uint64_t Random(uint64_t range)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return range ? rngState % range : 0;
+}
+
+static void Fail(const char *what, int index)
+{
+    if (++failures <= 10) {
+        fprintf(stderr, "at %llu ms, timer %d: %s\n", (unsigned long long)wheel.currentMs,
+                index, what);
+    }
+}
+
+// The model of Arm: the expiry rounded up to the slack granule, and after the clock.
+static void ModelArm(TestTimer *timer)
+{
+    uint64_t granule = 1;
+    while ((granule << 1) <= timer->slackMs) {
+        granule <<= 1;
+    }
+    timer->tick = (timer->expiryMs + granule - 1) & ~(granule - 1);
+    if (timer->tick <= wheel.currentMs) {
+        timer->tick = wheel.currentMs + 1;
+    }
+    timer->armed = true;
+}
+
+static uint64_t RandomDelay(void)
+{
+    switch (Random(4)) {
+    case 0:
+        return Random(64);
+    case 1:
+        return Random(5000);
+    case 2:
+        return Random(1ull << 20);
+    default:
+        // Beyond the 2^24 ms span of the wheel
+        return Random(1ull << 26);
+    }
+}
+
+static void ScheduleRandom(int index, uint64_t nowMs)
+{
+    static const uint32_t slacks[] = {0, 1, 3, 16, 100, 1000};
+    TestTimer *timer = &timers[index];
+    uint64_t delay = RandomDelay();
+    uint64_t period = Random(3) == 0 ? 1 + Random(Random(2) ? 100 : 100000) : 0;
+    uint32_t slack = slacks[Random(sizeof(slacks) / sizeof(slacks[0]))];
+    TimerWheel_Schedule(&wheel, &timer->entry, nowMs, delay, period, slack);
+    timer->expiryMs = nowMs + delay;
+    timer->periodMs = period;
+    timer->slackMs = slack;
+    ModelArm(timer);
+}
+
+static void Cancel(int index)
+{
+    TimerWheel_Cancel(&wheel, &timers[index].entry);
+    timers[index].armed = false;
+}
+
+static void Callback(TimerWheelEntry *entry)
+{
+    TestTimer *timer = entry->context;
+    int index = (int)(timer - timers);
+    ++fires;
+
+    if (!timer->armed) {
+        Fail("fired while disarmed", index);
+    } else if (wheel.currentMs != timer->tick) {
+        Fail(wheel.currentMs < timer->tick ? "fired early" : "fired late", index);
+    }
+    if (wheel.currentMs < lastFiredTick) {
+        Fail("fired out of order", index);
+    }
+    lastFiredTick = wheel.currentMs;
+
+    // The model of the re-arm of a periodic entry, done before the callback.
+    timer->armed = false;
+    if (timer->periodMs != 0) {
+        timer->expiryMs += timer->periodMs;
+        if (timer->expiryMs <= advanceTo) {
+            timer->expiryMs += ((advanceTo - timer->expiryMs) / timer->periodMs + 1) *
+                               timer->periodMs;
+        }
+        ModelArm(timer);
+    }
+    if (TimerWheel_IsArmed(entry) != timer->armed) {
+        Fail("armed state differs", index);
+    }
+
+    // Some callbacks reschedule or cancel entries, themselves included.
+    switch (Random(8)) {
+    case 0:
+        ScheduleRandom(index, wheel.currentMs);
+        break;
+    case 1:
+        Cancel((index + 1) % ENTRIES);
+        break;
+    case 2:
+        ScheduleRandom((index + 2) % ENTRIES, wheel.currentMs);
+        break;
+    default:
+        break;
+    }
+}
+
+static void Advance(uint64_t nowMs)
+{
+    advanceTo = nowMs;
+    lastFiredTick = wheel.currentMs;
+    TimerWheel_Advance(&wheel, nowMs);
+    if (wheel.currentMs != nowMs) {
+        Fail("clock not advanced", -1);
+    }
+    for (int i = 0; i < ENTRIES; ++i) {
+        if (timers[i].armed && timers[i].tick <= nowMs) {
+            Fail("missed", i);
+            timers[i].armed = false;
+            TimerWheel_Cancel(&wheel, &timers[i].entry);
+        }
+    }
+}
+
+// Checks the count and the next expiry against the model.
+static void CheckNextExpiry(void)
+{
+    uint64_t earliest = UINT64_MAX;
+    size_t armed = 0;
+    for (int i = 0; i < ENTRIES; ++i) {
+        if (timers[i].armed) {
+            ++armed;
+            if (timers[i].tick < earliest) {
+                earliest = timers[i].tick;
+            }
+        }
+    }
+    if (wheel.count != armed) {
+        Fail("count differs", -1);
+    }
+
+    uint64_t next;
+    bool found = TimerWheel_NextExpiry(&wheel, &next);
+    if (found != (armed != 0)) {
+        Fail("next expiry presence differs", -1);
+    } else if (found && (next > earliest || next <= wheel.currentMs)) {
+        Fail("next expiry out of range", -1);
+    }
+}
+
+static void Run(uint64_t startMs)
+{
+    TimerWheel_Init(&wheel, startMs);
+    for (int i = 0; i < ENTRIES; ++i) {
+        TimerWheel_InitEntry(&timers[i].entry, Callback, &timers[i]);
+        timers[i].armed = false;
+    }
+
+    for (int op = 0; op < OPERATIONS; ++op) {
+        uint64_t next;
+        switch (Random(10)) {
+        case 0:
+        case 1:
+        case 2:
+            ScheduleRandom((int)Random(ENTRIES), wheel.currentMs);
+            break;
+        case 3:
+            Cancel((int)Random(ENTRIES));
+            break;
+        case 4:
+            // A step of the clock that may run past several expiries, now and then past the
+            // span of the wheel, whose every 64 ms boundary Advance visits.
+            Advance(wheel.currentMs + (Random(50) == 0 ? RandomDelay() : Random(5000)));
+            break;
+        default:
+            // What the event loop does: sleep until the next expiry, or a bit later.
+            if (TimerWheel_NextExpiry(&wheel, &next)) {
+                Advance(next + (Random(4) == 0 ? Random(10) : 0));
+            }
+            break;
+        }
+        CheckNextExpiry();
+    }
+}
+
+int main(void)
+{
+    Run(0);
+    Run((1ull << 40) + 12345);
+    Run(UINT32_MAX - 1000);
+    printf("%lu callbacks checked, %lu failure(s)\n", fires, failures);
+    return failures != 0;
+}
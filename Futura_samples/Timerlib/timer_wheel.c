@@ -0,0 +1,237 @@
+/* Futura MT3620 hierarchical timer wheel.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#include "timer_wheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level)*TIMER_WHEEL_SLOT_BITS)
+
+// Ticks covered by the whole wheel; later expiries are clamped to its end.
+static const uint64_t wheelSpan = (uint64_t)1 << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS);
+
+static void Unlink(TimerWheel *wheel, TimerWheelEntry *entry)
+{
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        wheel->slots[entry->level][entry->slot] = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    }
+    if (wheel->slots[entry->level][entry->slot] == NULL) {
+        wheel->occupied[entry->level] &= ~((uint64_t)1 << entry->slot);
+    }
+}
+
+// Files an entry relative to base, the tick being processed or the wheel clock: level 0
+// holds the next 64 ticks, level n the ticks up to 64^(n+1) ahead, each slot of level n
+// spanning 64^n ticks. A slot of level n > 0 is moved down a level (cascaded) when the
+// clock reaches its first tick.
+static void Place(TimerWheel *wheel, TimerWheelEntry *entry, uint64_t base)
+{
+    uint64_t tick = entry->tick < base ? base : entry->tick;
+    uint64_t delta = tick - base;
+    if (delta >= wheelSpan) {
+        delta = wheelSpan - 1;
+        tick = base + delta;
+    }
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (uint64_t)1 << LEVEL_SHIFT(level + 1)) {
+        ++level;
+    }
+    int slot = (int)((tick >> LEVEL_SHIFT(level)) & SLOT_MASK);
+
+    entry->level = (uint8_t)level;
+    entry->slot = (uint8_t)slot;
+    entry->prev = NULL;
+    entry->next = wheel->slots[level][slot];
+    if (entry->next != NULL) {
+        entry->next->prev = entry;
+    }
+    wheel->slots[level][slot] = entry;
+    wheel->occupied[level] |= (uint64_t)1 << slot;
+}
+
+// Rounds the nominal expiry up to the slack granule and files the entry.
+static void Arm(TimerWheel *wheel, TimerWheelEntry *entry)
+{
+    uint64_t granule = 1;
+    while ((granule << 1) <= entry->slackMs) {
+        granule <<= 1;
+    }
+    entry->tick = (entry->expiryMs + granule - 1) & ~(granule - 1);
+    if (entry->tick <= wheel->currentMs) {
+        entry->tick = wheel->currentMs + 1;
+    }
+
+    Place(wheel, entry, wheel->currentMs);
+    entry->armed = true;
+    ++wheel->count;
+}
+
+void TimerWheel_Init(TimerWheel *wheel, uint64_t nowMs)
+{
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot) {
+            wheel->slots[level][slot] = NULL;
+        }
+        wheel->occupied[level] = 0;
+    }
+    wheel->currentMs = nowMs;
+    wheel->count = 0;
+}
+
+void TimerWheel_InitEntry(TimerWheelEntry *entry, TimerWheelCallback callback, void *context)
+{
+    entry->next = NULL;
+    entry->prev = NULL;
+    entry->callback = callback;
+    entry->context = context;
+    entry->expiryMs = 0;
+    entry->tick = 0;
+    entry->periodMs = 0;
+    entry->slackMs = 0;
+    entry->level = 0;
+    entry->slot = 0;
+    entry->armed = false;
+}
+
+void TimerWheel_Schedule(TimerWheel *wheel, TimerWheelEntry *entry, uint64_t nowMs,
+                         uint64_t delayMs, uint64_t periodMs, uint32_t slackMs)
+{
+    TimerWheel_Cancel(wheel, entry);
+    entry->expiryMs = nowMs + delayMs;
+    entry->periodMs = periodMs;
+    entry->slackMs = slackMs;
+    Arm(wheel, entry);
+}
+
+void TimerWheel_Cancel(TimerWheel *wheel, TimerWheelEntry *entry)
+{
+    if (!entry->armed) {
+        return;
+    }
+    Unlink(wheel, entry);
+    entry->armed = false;
+    --wheel->count;
+}
+
+bool TimerWheel_NextExpiry(const TimerWheel *wheel, uint64_t *expiryMs)
+{
+    bool found = false;
+    uint64_t earliest = UINT64_MAX;
+
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        uint64_t occupied = wheel->occupied[level];
+        if (occupied == 0) {
+            continue;
+        }
+
+        // Slots are reached in rotation order starting after the current one, so the first
+        // occupied slot in that order holds the earliest entries of the level.
+        int shift = LEVEL_SHIFT(level);
+        int current = (int)((wheel->currentMs >> shift) & SLOT_MASK);
+        int start = (current + 1) & SLOT_MASK;
+        uint64_t rotated = start == 0 ? occupied : (occupied >> start) | (occupied << (64 - start));
+        int slot = (start + __builtin_ctzll(rotated)) & SLOT_MASK;
+
+        // Entries clamped to the end of the wheel have not reached their slot yet; the wheel
+        // must wake when the slot is cascaded to re-file them.
+        int distance = ((slot - current) & SLOT_MASK) == 0 ? TIMER_WHEEL_SLOTS
+                                                           : ((slot - current) & SLOT_MASK);
+        uint64_t slotStart = ((wheel->currentMs >> shift) + (uint64_t)distance) << shift;
+        uint64_t slotEnd = slotStart + ((uint64_t)1 << shift);
+
+        for (const TimerWheelEntry *entry = wheel->slots[level][slot]; entry != NULL;
+             entry = entry->next) {
+            uint64_t tick = entry->tick < slotEnd ? entry->tick : slotStart;
+            if (tick < earliest) {
+                earliest = tick;
+            }
+        }
+        found = true;
+    }
+
+    if (found) {
+        *expiryMs = earliest;
+    }
+    return found;
+}
+
+// Re-files the entries of the level slot that starts at tick.
+static void Cascade(TimerWheel *wheel, int level, uint64_t tick)
+{
+    int slot = (int)((tick >> LEVEL_SHIFT(level)) & SLOT_MASK);
+    TimerWheelEntry *entry = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~((uint64_t)1 << slot);
+
+    while (entry != NULL) {
+        TimerWheelEntry *next = entry->next;
+        Place(wheel, entry, tick);
+        entry = next;
+    }
+}
+
+// Runs the entries due at tick. Entries armed by the callbacks land in later slots.
+static unsigned int FireSlot(TimerWheel *wheel, uint64_t tick, uint64_t nowMs)
+{
+    unsigned int fired = 0;
+    int slot = (int)(tick & SLOT_MASK);
+    TimerWheelEntry *entry;
+
+    while ((entry = wheel->slots[0][slot]) != NULL) {
+        Unlink(wheel, entry);
+        entry->armed = false;
+        --wheel->count;
+
+        if (entry->periodMs != 0) {
+            entry->expiryMs += entry->periodMs;
+            if (entry->expiryMs <= nowMs) {
+                entry->expiryMs +=
+                    ((nowMs - entry->expiryMs) / entry->periodMs + 1) * entry->periodMs;
+            }
+            Arm(wheel, entry);
+        }
+
+        entry->callback(entry);
+        ++fired;
+    }
+    return fired;
+}
+
+unsigned int TimerWheel_Advance(TimerWheel *wheel, uint64_t nowMs)
+{
+    unsigned int fired = 0;
+
+    while (wheel->currentMs < nowMs) {
+        uint64_t tick = wheel->currentMs + 1;
+
+        // Skip empty level 0 slots up to the next cascade boundary.
+        if ((tick & SLOT_MASK) != 0) {
+            uint64_t pending = wheel->occupied[0] >> (tick & SLOT_MASK);
+            uint64_t next =
+                pending != 0 ? tick + (uint64_t)__builtin_ctzll(pending) : (tick | SLOT_MASK) + 1;
+            if (next > nowMs) {
+                wheel->currentMs = nowMs;
+                break;
+            }
+            tick = next;
+        }
+
+        if ((tick & SLOT_MASK) == 0) {
+            for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; --level) {
+                if ((tick & (((uint64_t)1 << LEVEL_SHIFT(level)) - 1)) == 0) {
+                    Cascade(wheel, level, tick);
+                }
+            }
+        }
+
+        wheel->currentMs = tick;
+        fired += FireSlot(wheel, tick, nowMs);
+    }
+    return fired;
+}
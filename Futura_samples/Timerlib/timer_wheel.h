@@ -0,0 +1,99 @@
+/* Futura MT3620 hierarchical timer wheel.
+   Copyright 2020 Pier Calderan.
+   Licensed under the MIT License. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Wheel geometry: TIMER_WHEEL_LEVELS levels of 64 slots with a 1 ms tick cover
+// 2^(6 * TIMER_WHEEL_LEVELS) ms (about 4.6 hours). Later expiries are parked in the
+// last slot of the top level and re-filed when it is reached.
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+typedef struct TimerWheelEntry TimerWheelEntry;
+
+/// <summary>
+/// Called from TimerWheel_Advance when an entry expires. The entry may be rescheduled or
+/// cancelled, and other entries scheduled or cancelled, from the callback.
+/// </summary>
+typedef void (*TimerWheelCallback)(TimerWheelEntry *entry);
+
+/// <summary>
+/// A logical timer. The wheel links entries in place, so scheduling and cancelling
+/// never allocate. Initialize with TimerWheel_InitEntry; the other fields are private.
+/// </summary>
+struct TimerWheelEntry {
+    TimerWheelEntry *next;
+    TimerWheelEntry *prev;
+    TimerWheelCallback callback;
+    void *context;
+    uint64_t expiryMs; // nominal expiry, the base of the next period
+    uint64_t tick;     // expiry rounded up to the slack granule, when the entry fires
+    uint64_t periodMs; // 0 for one-shot entries
+    uint32_t slackMs;
+    uint8_t level;
+    uint8_t slot;
+    bool armed;
+};
+
+/// <summary>
+/// Timer wheel. Time is a caller-supplied millisecond count, so the wheel can be driven
+/// by CLOCK_MONOTONIC on the device or by a virtual clock in a host test.
+/// </summary>
+typedef struct {
+    TimerWheelEntry *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS]; // bit i set when slots[level][i] is not empty
+    uint64_t currentMs;                     // every entry with tick <= currentMs has fired
+    size_t count;                           // armed entries
+} TimerWheel;
+
+/// <summary>
+/// Initializes an empty wheel whose clock starts at nowMs.
+/// </summary>
+void TimerWheel_Init(TimerWheel *wheel, uint64_t nowMs);
+
+/// <summary>
+/// Initializes a disarmed entry.
+/// </summary>
+void TimerWheel_InitEntry(TimerWheelEntry *entry, TimerWheelCallback callback, void *context);
+
+/// <summary>
+/// Arms an entry to expire delayMs after nowMs and then every periodMs, or once if periodMs
+/// is 0. An armed entry is rescheduled. The expiry may be delayed by up to slackMs so that
+/// it coincides with other expiries: it is rounded up to a multiple of the largest power of
+/// two not above slackMs. Periodic entries keep their phase; the slack does not accumulate.
+/// </summary>
+void TimerWheel_Schedule(TimerWheel *wheel, TimerWheelEntry *entry, uint64_t nowMs,
+                         uint64_t delayMs, uint64_t periodMs, uint32_t slackMs);
+
+/// <summary>
+/// Disarms an entry. Cancelling a disarmed entry has no effect.
+/// </summary>
+void TimerWheel_Cancel(TimerWheel *wheel, TimerWheelEntry *entry);
+
+/// <summary>
+/// Returns true if the entry is armed.
+/// </summary>
+static inline bool TimerWheel_IsArmed(const TimerWheelEntry *entry)
+{
+    return entry->armed;
+}
+
+/// <summary>
+/// Gets the time at which the earliest armed entry fires.
+/// </summary>
+/// <returns>false if no entry is armed.</returns>
+bool TimerWheel_NextExpiry(const TimerWheel *wheel, uint64_t *expiryMs);
+
+/// <summary>
+/// Moves the wheel clock forward to nowMs, calling the callback of every entry that expires
+/// on the way, in expiry order. A periodic entry that fell behind by several periods fires
+/// once and resumes on its next period after nowMs.
+/// </summary>
+/// <returns>Number of callbacks run.</returns>
+unsigned int TimerWheel_Advance(TimerWheel *wheel, uint64_t nowMs);